@@ -24,6 +24,8 @@ import argparse
 import operator
 import sys
 import textwrap
+import threading
+import time
 import timeit
 from collections import OrderedDict
 from itertools import count
@@ -644,9 +646,148 @@ def benchmark(  # pylint: disable=too-many-locals
         .replace('N/A    |', '   N/A |'),
     )
     print(flush=True)
+
+    # Per-node cost of the critical sections elided by `assume_unshared=True`. The difference is
+    # only expected to be non-zero on free-threaded Python builds.
+    shared_us, unshared_us = (
+        10e6 * case.timeit(number, repeat=repeat, globals={'x': x})
+        for case in (
+            BenchmarkCase(name='OpTree(shared)', stmt='optree.tree_leaves(x)'),
+            BenchmarkCase(
+                name='OpTree(unshared)',
+                stmt='optree.tree_leaves(x, assume_unshared=True)',
+            ),
+        )
+    )
+    cprint(
+        f'Tree Flatten with `assume_unshared=True`: {unshared_us:8.2f}μs vs. {shared_us:8.2f}μs '
+        f'-- saved {1000.0 * (shared_us - unshared_us) / treespec.num_nodes:.2f}ns per node',
+    )
+    print(flush=True)
     return df
 
 
+def benchmark_threads(
+    name: str,
+    module: nn.Module,
+    max_threads: int,
+    number: int = 1000,
+    unordered: bool = False,
+) -> None:
+    x = extract(module, unordered=unordered)
+
+    # A single predicate and a single treespec shared by all threads, as in data-parallel loops.
+    def is_leaf(obj: Any) -> bool:
+        return isinstance(obj, torch.Tensor)
+
+    leaves, treespec = optree.tree_flatten(x)
+    workloads = OrderedDict(
+        [
+            ('flattens', lambda: optree.tree_leaves(x, is_leaf=is_leaf)),
+            ('unflattens', lambda: optree.tree_unflatten(treespec, leaves)),
+        ],
+    )
+
+    print(
+        f'{colored(name, color="blue", attrs=("bold",))}'
+        f'({number} calls per thread, Python {sys.version.split()[0]}, '
+        f'GIL enabled: {getattr(sys, "_is_gil_enabled", lambda: True)()})',
+        flush=True,
+    )
+    for unit, func in workloads.items():
+
+        def worker(func: Any = func) -> None:
+            for _ in range(number):
+                func()
+
+        baseline = None
+        num_threads = 1
+        while num_threads <= max_threads:
+            threads = [threading.Thread(target=worker) for _ in range(num_threads)]
+            start = time.perf_counter()
+            for thread in threads:
+                thread.start()
+            for thread in threads:
+                thread.join()
+            elapsed = time.perf_counter() - start
+            throughput = num_threads * number / elapsed
+            baseline = baseline or throughput
+            cprint(
+                f'  threads={num_threads:<4d}: {throughput:12.2f} {unit}/s  '
+                f'(scaling: {throughput / baseline:5.2f}x)',
+            )
+            num_threads *= 2
+    print(flush=True)
+
+
+def benchmark_metadata(num_specs: int, number: int = 10, repeat: int = 5) -> None:
+    # A custom node type with unhashable metadata, registered with and without a metadata key.
+    class Box:
+        def __init__(self, metadata: dict[str, Any], value: Any) -> None:
+            self.metadata = metadata
+            self.value = value
+
+    def flatten(box: Box) -> tuple[tuple[Any], dict[str, Any]]:
+        return (box.value,), box.metadata
+
+    def unflatten(metadata: dict[str, Any], children: tuple[Any]) -> Box:
+        return Box(metadata, *children)
+
+    namespaces = OrderedDict(
+        [
+            ('benchmark-unhashed', None),
+            ('benchmark-keyed', lambda metadata: tuple(sorted(metadata.items()))),
+        ],
+    )
+    for namespace, metadata_key in namespaces.items():
+        optree.register_pytree_node(
+            Box,
+            flatten,
+            unflatten,
+            metadata_key=metadata_key,
+            namespace=namespace,
+        )
+
+    print(
+        f'{colored("Custom Metadata", color="blue", attrs=("bold",))}'
+        f'({num_specs} treespecs differing only in the custom metadata)',
+        flush=True,
+    )
+    try:
+        for namespace, metadata_key in namespaces.items():
+            # Build the treespecs once, then time hashing them into a fresh set and looking them up.
+            treespecs = [
+                optree.tree_structure(
+                    [Box({'index': i, 'shape': (i, i)}, 0)],
+                    namespace=namespace,
+                )
+                for i in range(num_specs)
+            ]
+            lookup = set(treespecs)
+
+            def build_set(treespecs: list[optree.PyTreeSpec] = treespecs) -> None:
+                set(treespecs)
+
+            def lookup_all(
+                treespecs: list[optree.PyTreeSpec] = treespecs,
+                lookup: set[optree.PyTreeSpec] = lookup,
+            ) -> None:
+                for treespec in treespecs:
+                    assert treespec in lookup
+
+            build_us = min(timeit.repeat(build_set, number=number, repeat=repeat)) / number * 1e6
+            lookup_us = min(timeit.repeat(lookup_all, number=number, repeat=repeat)) / number * 1e6
+            label = 'without metadata key' if metadata_key is None else 'with metadata key'
+            cprint(
+                f'  {label:<20s}: {len({hash(t) for t in treespecs}):6d} distinct hashes, '
+                f'set build {build_us:12.2f}μs, lookups {lookup_us:12.2f}μs',
+            )
+    finally:
+        for namespace in namespaces:
+            optree.unregister_pytree_node(Box, namespace=namespace)
+    print(flush=True)
+
+
 def main() -> None:
     parser = argparse.ArgumentParser()
     parser.add_argument(
@@ -671,11 +812,55 @@ def main() -> None:
         help='how many times to repeat the timer and report the best (default: %(default)d)',
     )
 
+    parser.add_argument(
+        '--threads',
+        '-t',
+        metavar='N',
+        type=int,
+        default=0,
+        help=(
+            'benchmark concurrent flattening with a shared `is_leaf` and unflattening with a '
+            'shared treespec on up to N threads instead of the single-threaded comparison '
+            '(default: disabled)'
+        ),
+    )
+
+    parser.add_argument(
+        '--metadata',
+        '-m',
+        metavar='N',
+        type=int,
+        default=0,
+        help=(
+            'benchmark hashing and looking up N treespecs that differ only in the custom metadata '
+            'with and without a registered metadata key (default: disabled)'
+        ),
+    )
+
     args = parser.parse_args()
     unordered = args.unordered
     number = args.number
     repeat = args.repeat
 
+    if args.metadata > 0:
+        benchmark_metadata(args.metadata, number=max(number // 1000, 1), repeat=repeat)
+        return
+
+    if args.threads > 0:
+        for name, module_factory in (
+            ('TinyMLP', tiny_mlp),
+            ('ResNet50', models.resnet50),
+            ('ViT-H/14', models.vit_h_14),
+        ):
+            benchmark_threads(
+                name,
+                module_factory(),
+                max_threads=args.threads,
+                number=max(number // 10, 1),
+                unordered=unordered,
+            )
+        return
+
     df = pd.DataFrame(
         columns=[
             'Subject',
@@ -69,17 +69,22 @@ inline constexpr Py_ALWAYS_INLINE bool Py_IsConstant(PyObject* x) noexcept {
 #define Py_Get_ID(name) (::Py_ID_##name())
 
 Py_Declare_ID(optree);
-Py_Declare_ID(__main__);           // __main__
-Py_Declare_ID(__module__);         // type.__module__
-Py_Declare_ID(__qualname__);       // type.__qualname__
-Py_Declare_ID(__name__);           // type.__name__
-Py_Declare_ID(sort);               // list.sort
-Py_Declare_ID(copy);               // dict.copy
-Py_Declare_ID(default_factory);    // defaultdict.default_factory
-Py_Declare_ID(maxlen);             // deque.maxlen
-Py_Declare_ID(_fields);            // namedtuple._fields
-Py_Declare_ID(_make);              // namedtuple._make
-Py_Declare_ID(_asdict);            // namedtuple._asdict
-Py_Declare_ID(n_fields);           // structseq.n_fields
-Py_Declare_ID(n_sequence_fields);  // structseq.n_sequence_fields
-Py_Declare_ID(n_unnamed_fields);   // structseq.n_unnamed_fields
+Py_Declare_ID(__main__);             // __main__
+Py_Declare_ID(__module__);           // type.__module__
+Py_Declare_ID(__qualname__);         // type.__qualname__
+Py_Declare_ID(__name__);             // type.__name__
+Py_Declare_ID(sort);                 // list.sort
+Py_Declare_ID(copy);                 // dict.copy
+Py_Declare_ID(default_factory);      // defaultdict.default_factory
+Py_Declare_ID(maxlen);               // deque.maxlen
+Py_Declare_ID(_fields);              // namedtuple._fields
+Py_Declare_ID(_make);                // namedtuple._make
+Py_Declare_ID(_asdict);              // namedtuple._asdict
+Py_Declare_ID(n_fields);             // structseq.n_fields
+Py_Declare_ID(n_sequence_fields);    // structseq.n_sequence_fields
+Py_Declare_ID(n_unnamed_fields);     // structseq.n_unnamed_fields
+Py_Declare_ID(__array_interface__);  // array.__array_interface__
+Py_Declare_ID(shape);                // array.__array_interface__['shape']
+Py_Declare_ID(typestr);              // array.__array_interface__['typestr']
+Py_Declare_ID(str);                  // numpy.dtype.str
+Py_Declare_ID(cast);                 // memoryview.cast
@@ -17,11 +17,14 @@ limitations under the License.
 
 #pragma once
 
+#include <algorithm>      // std::sort, std::stable_sort
+#include <cstddef>        // std::size_t
 #include <exception>      // std::rethrow_exception, std::current_exception
 #include <string>         // std::string
 #include <type_traits>    // std::enable_if_t, std::is_base_of_v
 #include <unordered_map>  // std::unordered_map
 #include <utility>        // std::move, std::pair, std::make_pair
+#include <vector>         // std::vector
 
 #include <Python.h>
 
@@ -34,6 +37,7 @@ limitations under the License.
 
 #include "include/hashing.h"
 #include "include/pymacros.h"
+#include "include/stdutils.h"
 #include "include/synchronization.h"
 
 namespace py = pybind11;
@@ -147,6 +151,19 @@ inline Py_ALWAYS_INLINE py::object DictGetItem(const py::handle& dict, const py:
     return DictGetItemAs<py::object>(dict, key);
 }
 
+// Borrowed access to the items of a container that is never mutated after construction, such as
+// the metadata owned by a PyTreeSpec. The returned handle is valid for the lifetime of the
+// container. No reference is taken, which avoids refcount contention on free-threaded builds when
+// many threads read the same container.
+inline Py_ALWAYS_INLINE py::handle TupleGetItemBorrowed(const py::handle& tuple,
+                                                        const py::ssize_t& index) {
+    return PyTuple_GET_ITEM(tuple.ptr(), index);
+}
+inline Py_ALWAYS_INLINE py::handle FrozenListGetItemBorrowed(const py::handle& list,
+                                                             const py::ssize_t& index) {
+    return PyList_GET_ITEM(list.ptr(), index);
+}
+
 inline Py_ALWAYS_INLINE void TupleSetItem(const py::handle& tuple,
                                           const py::ssize_t& index,
                                           const py::handle& value) {
@@ -470,39 +487,164 @@ inline py::tuple StructSequenceGetFields(const py::handle& object) {
     return fields;
 }
 
+// Returns `f'{cls.__module__}.{cls.__qualname__}'` of the given type.
+inline std::string TypeQualifiedName(const py::handle& cls) {
+    return EVALUATE_WITH_LOCK_HELD(PyStr(py::getattr(cls, Py_Get_ID(__module__))) + "." +
+                                       PyStr(py::getattr(cls, Py_Get_ID(__qualname__))),
+                                   cls);
+}
+
+// The outcome of sorting a list with the default `<` comparison, predicted from element types.
+enum class SortPrediction : unsigned char {
+    Success,  // all elements are exact builtin scalars from a single comparable family
+    Failure,  // all elements are exact builtin scalars from mutually incomparable families
+    Unknown,  // some element may define arbitrary rich comparisons
+};
+
+// Predict the outcome of sorting the list by scanning the element types once.
+// Elements from two incomparable families must be compared directly at least once by any
+// comparison sort, so the `Failure` prediction is exact.
+inline SortPrediction PredictSort(const py::list& list) {
+    enum ScalarFamily : unsigned char {
+        Number = 1U << 0U,  // `int`, `bool`, `float`
+        String = 1U << 1U,  // `str`
+        Bytes = 1U << 2U,   // `bytes`
+    };
+
+    unsigned char families = 0;
+    const py::ssize_t size = ListGetSize(list);
+    for (py::ssize_t i = 0; i < size; ++i) {
+        PyObject* const item = PyList_GET_ITEM(list.ptr(), i);
+        if (PyLong_CheckExact(item) || PyBool_Check(item) || PyFloat_CheckExact(item)) [[likely]] {
+            families |= ScalarFamily::Number;
+        } else if (PyUnicode_CheckExact(item)) [[likely]] {
+            families |= ScalarFamily::String;
+        } else if (PyBytes_CheckExact(item)) {
+            families |= ScalarFamily::Bytes;
+        } else [[unlikely]] {
+            return SortPrediction::Unknown;
+        }
+    }
+    // More than one bit set.
+    return (families & (families - 1)) != 0 ? SortPrediction::Failure : SortPrediction::Success;
+}
+
+// Sort the list in place with the total order key
+// `(f'{type(obj).__module__}.{type(obj).__qualname__}', obj)`.
+// The qualified name of each distinct type is computed only once and converted to an integer rank.
+// Elements are then compared by rank and only objects within the same rank are compared with `<`.
+// If any comparison raises `TypeError`, the list is left unchanged.
+inline void TypeRankSort(py::list& list) {  // NOLINT[runtime/references]
+    const py::ssize_t size = ListGetSize(list);
+
+    // Collect the distinct types and their qualified names.
+    auto types = std::vector<std::pair<PyTypeObject*, std::string>>{};
+    auto entries =
+        reserved_vector<std::pair<py::ssize_t, py::object>>(static_cast<std::size_t>(size));
+    for (py::ssize_t i = 0; i < size; ++i) {
+        py::object item = ListGetItem(list, i);
+        PyTypeObject* const type = Py_TYPE(item.ptr());
+        py::ssize_t index = 0;
+        const auto num_types = static_cast<py::ssize_t>(types.size());
+        while (index < num_types && types[index].first != type) {
+            ++index;
+        }
+        if (index == num_types) [[unlikely]] {
+            types.emplace_back(type, TypeQualifiedName(reinterpret_cast<PyObject*>(type)));
+        }
+        entries.emplace_back(index, std::move(item));
+    }
+
+    // Convert the type indices into ranks ordered by qualified names.
+    // Distinct types with the same qualified name share the same rank.
+    auto order = reserved_vector<py::ssize_t>(types.size());
+    for (py::ssize_t index = 0; index < static_cast<py::ssize_t>(types.size()); ++index) {
+        order.emplace_back(index);
+    }
+    std::sort(order.begin(), order.end(), [&types](const py::ssize_t& a, const py::ssize_t& b) {
+        return types[a].second < types[b].second;
+    });
+    auto ranks = std::vector<py::ssize_t>(types.size(), 0);
+    for (py::ssize_t i = 1; i < static_cast<py::ssize_t>(order.size()); ++i) {
+        ranks[order[i]] = ranks[order[i - 1]] +
+                          (types[order[i]].second == types[order[i - 1]].second ? 0 : 1);
+    }
+    for (auto& entry : entries) {
+        entry.first = ranks[entry.first];
+    }
+
+    try {
+        std::stable_sort(entries.begin(),
+                         entries.end(),
+                         [](const std::pair<py::ssize_t, py::object>& a,
+                            const std::pair<py::ssize_t, py::object>& b) -> bool {
+                             if (a.first != b.first) [[likely]] {
+                                 return a.first < b.first;
+                             }
+                             const int result =
+                                 PyObject_RichCompareBool(a.second.ptr(), b.second.ptr(), Py_LT);
+                             if (result == -1) [[unlikely]] {
+                                 throw py::error_already_set();
+                             }
+                             return result == 1;
+                         });
+    } catch (py::error_already_set& ex) {
+        if (ex.matches(PyExc_TypeError)) [[likely]] {
+            // Found incomparable user-defined key types.
+            // The keys remain in the insertion order.
+            PyErr_Clear();
+            return;
+        }
+        std::rethrow_exception(std::current_exception());
+    }
+
+    const scoped_critical_section cs{list};
+    if (ListGetSize(list) != size) [[unlikely]] {
+        throw py::value_error("list changed size during sort.");
+    }
+    for (py::ssize_t i = 0; i < size; ++i) {
+        // `PyList_SetItem` steals the new reference and releases the old one.
+        PyList_SetItem(list.ptr(), i, entries[i].second.release().ptr());
+    }
+}
+
 inline void TotalOrderSort(py::list& list) {  // NOLINT[runtime/references]
+    if (ListGetSize(list) <= 1) [[unlikely]] {
+        return;
+    }
+
+    const SortPrediction prediction = EVALUATE_WITH_LOCK_HELD(PredictSort(list), list);
+    if (prediction == SortPrediction::Failure) [[unlikely]] {
+        // Found incomparable keys (e.g. `int` vs. `str`).
+        // Skip the direct sort which is certain to fail.
+        TypeRankSort(list);
+        return;
+    }
+
+    // A failed `list.sort()` may leave the list partially modified. Keep a copy of the original
+    // order if the sort may fail.
+    const py::list original = (prediction == SortPrediction::Unknown
+                                   ? py::reinterpret_steal<py::list>(EVALUATE_WITH_LOCK_HELD(
+                                         PyList_GetSlice(list.ptr(), 0, PY_SSIZE_T_MAX), list))
+                                   : py::list{});
     try {
         // Sort directly if possible.
         if (static_cast<bool>(EVALUATE_WITH_LOCK_HELD(PyList_Sort(list.ptr()), list)))
             [[unlikely]] {
             throw py::error_already_set();
         }
-    } catch (py::error_already_set& ex1) {
-        if (ex1.matches(PyExc_TypeError)) [[likely]] {
-            // Found incomparable keys (e.g. `int` vs. `str`, or user-defined types).
-            try {
-                // Sort with `(f'{obj.__class__.__module__}.{obj.__class__.__qualname__}', obj)`
-                const auto sort_key_fn = py::cpp_function([](const py::object& obj) -> py::tuple {
-                    const py::handle cls = py::type::handle_of(obj);
-                    const py::str qualname{EVALUATE_WITH_LOCK_HELD(
-                        PyStr(py::getattr(cls, Py_Get_ID(__module__))) + "." +
-                            PyStr(py::getattr(cls, Py_Get_ID(__qualname__))),
-                        cls)};
-                    return py::make_tuple(qualname, obj);
-                });
-                {
-                    const scoped_critical_section cs{list};
-                    py::getattr(list, Py_Get_ID(sort))(py::arg("key") = sort_key_fn);
-                }
-            } catch (py::error_already_set& ex2) {
-                if (ex2.matches(PyExc_TypeError)) [[likely]] {
-                    // Found incomparable user-defined key types.
-                    // The keys remain in the insertion order.
-                    PyErr_Clear();
-                } else [[unlikely]] {
-                    std::rethrow_exception(std::current_exception());
+    } catch (py::error_already_set& ex) {
+        if (ex.matches(PyExc_TypeError) && prediction == SortPrediction::Unknown) [[likely]] {
+            // Found incomparable keys (e.g. user-defined types).
+            PyErr_Clear();
+            {
+                const scoped_critical_section2 cs{list, original};
+                if (PyList_SetSlice(list.ptr(), 0, PY_SSIZE_T_MAX, original.ptr()) != 0)
+                    [[unlikely]] {
+                    throw py::error_already_set();
                 }
             }
+            TypeRankSort(list);
         } else [[unlikely]] {
             std::rethrow_exception(std::current_exception());
         }
@@ -550,3 +692,44 @@ inline std::pair<py::list, py::list> DictKeysDifference(const py::list& /*unique
     TotalOrderSort(extra_keys);
     return std::make_pair(std::move(missing_keys), std::move(extra_keys));
 }
+
+// Return the object itself if it is a list or a tuple, otherwise a new list of its items.
+inline py::object SequenceFast(const py::handle& sequence) {
+    PyObject* const fast = PySequence_Fast(sequence.ptr(), "Expected a sequence.");
+    if (fast == nullptr) [[unlikely]] {
+        throw py::error_already_set();
+    }
+    return py::reinterpret_steal<py::object>(fast);
+}
+inline Py_ALWAYS_INLINE py::ssize_t SequenceFastGetSize(const py::handle& fast) {
+    return PySequence_Fast_GET_SIZE(fast.ptr());
+}
+inline Py_ALWAYS_INLINE py::object SequenceFastGetItem(const py::handle& fast,
+                                                       const py::ssize_t& index) {
+    return py::reinterpret_borrow<py::object>(PySequence_Fast_GET_ITEM(fast.ptr(), index));
+}
+
+// Return a new dictionary with the items of a mapping in iteration order.
+inline py::dict MappingToDict(const py::handle& mapping) {
+    const auto items = py::reinterpret_steal<py::object>(PyMapping_Items(mapping.ptr()));
+    if (!items) [[unlikely]] {
+        throw py::error_already_set();
+    }
+    py::dict dict{};
+    if (PyDict_MergeFromSeq2(dict.ptr(), items.ptr(), /*override=*/1) < 0) [[unlikely]] {
+        throw py::error_already_set();
+    }
+    return dict;
+}
+
+inline py::object CallOneArg(const py::handle& callable, const py::handle& arg) {
+#if PY_VERSION_HEX >= 0x03090000  // Python 3.9
+    PyObject* const result = PyObject_CallOneArg(callable.ptr(), arg.ptr());
+#else
+    PyObject* const result = PyObject_CallFunctionObjArgs(callable.ptr(), arg.ptr(), nullptr);
+#endif
+    if (result == nullptr) [[unlikely]] {
+        throw py::error_already_set();
+    }
+    return py::reinterpret_steal<py::object>(result);
+}
@@ -52,6 +52,13 @@ enum class PyTreeKind : std::uint8_t {
     StructSequence,  // A PyStructSequence
 };
 
+// The protocol used to flatten and unflatten a custom node type.
+enum class PyTreeNodeProtocol : std::uint8_t {
+    Function = 0,  // User-defined flatten/unflatten functions
+    Sequence,      // The sequence protocol, rebuilt via `cls(children)`
+    Mapping,       // The mapping protocol, rebuilt via `cls(dict(zip(keys, children)))`
+};
+
 constexpr PyTreeKind kCustom = PyTreeKind::Custom;
 constexpr PyTreeKind kLeaf = PyTreeKind::Leaf;
 constexpr PyTreeKind kNone = PyTreeKind::None;
@@ -77,6 +84,7 @@ public:
 
     struct Registration {
         PyTreeKind kind = PyTreeKind::Custom;
+        PyTreeNodeProtocol protocol = PyTreeNodeProtocol::Function;
 
         // NOTE: the registration should use `py::object` instead of `py::handle`
         // to hold extra references to the Python objects. Otherwise, the Python
@@ -87,11 +95,16 @@ public:
         // The Python type object, used to identify the type.
         py::object type{};
         // A function with signature: object -> (iterable, metadata, entries)
+        // For the declarative protocols, the function is only used by the Python side.
         py::function flatten_func{};
         // A function with signature: (metadata, iterable) -> object
         py::function unflatten_func{};
         // The Python type object for the path entry class.
         py::object path_entry_type{};
+        // A function with signature: metadata -> hashable key, used to hash the metadata of the
+        // custom nodes. `True` hashes the metadata itself. The metadata is not hashed if empty or
+        // `None`, since it may be unhashable.
+        py::object metadata_key{};
     };
 
     using RegistrationPtr = std::shared_ptr<const Registration>;
@@ -102,7 +115,9 @@ public:
                          const py::function &flatten_func,
                          const py::function &unflatten_func,
                          const py::object &path_entry_type,
-                         const std::string &registry_namespace = "");
+                         const std::string &registry_namespace = "",
+                         const std::string &kind = "",
+                         const py::object &metadata_key = py::none());
 
     static void Unregister(const py::object &cls, const std::string &registry_namespace = "");
 
@@ -110,6 +125,18 @@ public:
     template <bool NoneIsLeaf>
     static RegistrationPtr Lookup(const py::object &cls, const std::string &registry_namespace);
 
+    // Flatten an instance of a custom type into a tuple (children, metadata, entries) as the
+    // flatten function does. The declarative protocols read the children without calling back
+    // into Python.
+    static py::tuple FlattenCustom(const RegistrationPtr &registration,
+                                   const py::handle &handle,
+                                   const bool &sort_keys);
+
+    // Build an instance of a custom type from the metadata and the children.
+    static py::object UnflattenCustom(const RegistrationPtr &registration,
+                                      const py::object &metadata,
+                                      const py::tuple &children);
+
     // Compute the node kind of a given Python object.
     template <bool NoneIsLeaf>
     static PyTreeKind GetKind(const py::handle &handle,
@@ -127,7 +154,9 @@ private:
                              const py::function &flatten_func,
                              const py::function &unflatten_func,
                              const py::object &path_entry_type,
-                             const std::string &registry_namespace);
+                             const std::string &registry_namespace,
+                             const PyTreeNodeProtocol &protocol,
+                             const py::object &metadata_key);
 
     template <bool NoneIsLeaf>
     static RegistrationPtr UnregisterImpl(const py::object &cls,
@@ -17,7 +17,10 @@ limitations under the License.
 
 #pragma once
 
-#include <mutex>  // std::mutex, std::recursive_mutex, std::lock_guard, std::unique_lock
+#include <atomic>   // std::atomic, std::memory_order_*
+#include <memory>   // std::unique_ptr, std::make_unique
+#include <mutex>    // std::mutex, std::recursive_mutex, std::lock_guard, std::unique_lock
+#include <utility>  // std::forward
 
 #include <Python.h>
 
@@ -162,6 +165,9 @@ private:
 #endif
 };
 
+// Evaluate the expression in a critical section on the handle(s). Callables shared by many threads
+// (e.g., the leaf predicate and the registered node functions) are not locked, only the objects
+// they are called on.
 #ifdef Py_GIL_DISABLED
 
 #define EVALUATE_WITH_LOCK_HELD(expression, handle)                                                \
@@ -181,3 +187,98 @@ template <typename T>
 inline Py_ALWAYS_INLINE T thread_safe_cast(const py::handle& handle) {
     return EVALUATE_WITH_LOCK_HELD(py::cast<T>(handle), handle);
 }
+
+// A critical section that is elided at compile time when `Enabled` is false. Traversals select the
+// elided instantiation only when the caller promises the containers are not shared across threads.
+template <bool Enabled>
+class maybe_critical_section : public scoped_critical_section {
+public:
+    using scoped_critical_section::scoped_critical_section;
+};
+
+template <>
+class maybe_critical_section<false> {
+public:
+    maybe_critical_section() = delete;
+    explicit maybe_critical_section(const py::handle& /*unused*/) noexcept {}
+    ~maybe_critical_section() noexcept = default;
+
+    maybe_critical_section(const maybe_critical_section&) = delete;
+    maybe_critical_section& operator=(const maybe_critical_section&) = delete;
+    maybe_critical_section(maybe_critical_section&&) = delete;
+    maybe_critical_section& operator=(maybe_critical_section&&) = delete;
+};
+
+template <bool Enabled>
+class maybe_critical_section2 : public scoped_critical_section2 {
+public:
+    using scoped_critical_section2::scoped_critical_section2;
+};
+
+template <>
+class maybe_critical_section2<false> {
+public:
+    maybe_critical_section2() = delete;
+    explicit maybe_critical_section2(const py::handle& /*unused*/,
+                                     const py::handle& /*unused*/) noexcept {}
+    ~maybe_critical_section2() noexcept = default;
+
+    maybe_critical_section2(const maybe_critical_section2&) = delete;
+    maybe_critical_section2& operator=(const maybe_critical_section2&) = delete;
+    maybe_critical_section2(maybe_critical_section2&&) = delete;
+    maybe_critical_section2& operator=(maybe_critical_section2&&) = delete;
+};
+
+template <typename T, bool Enabled>
+inline Py_ALWAYS_INLINE T maybe_thread_safe_cast(const py::handle& handle) {
+    if constexpr (Enabled) {
+        return thread_safe_cast<T>(handle);
+    } else {
+        return py::cast<T>(handle);
+    }
+}
+
+// A value that is built on first access and published atomically. Concurrent first accesses may
+// build the value more than once, but only one result is published and all readers observe it.
+// Copies and moves start unbuilt, so the owner can remain copyable and movable.
+template <typename T>
+class thread_safe_lazy {
+public:
+    thread_safe_lazy() noexcept = default;
+    ~thread_safe_lazy() { delete m_value.load(std::memory_order_acquire); }
+
+    thread_safe_lazy(const thread_safe_lazy& /*unused*/) noexcept {}
+    thread_safe_lazy& operator=(const thread_safe_lazy& other) noexcept {
+        if (this != &other) [[likely]] {
+            delete m_value.exchange(nullptr, std::memory_order_acq_rel);
+        }
+        return *this;
+    }
+    thread_safe_lazy(thread_safe_lazy&& other) noexcept
+        : m_value{other.m_value.exchange(nullptr, std::memory_order_acq_rel)} {}
+    thread_safe_lazy& operator=(thread_safe_lazy&& other) noexcept {
+        if (this != &other) [[likely]] {
+            delete m_value.exchange(other.m_value.exchange(nullptr, std::memory_order_acq_rel),
+                                    std::memory_order_acq_rel);
+        }
+        return *this;
+    }
+
+    template <typename Factory>
+    const T& get(Factory&& factory) const {
+        const T* value = m_value.load(std::memory_order_acquire);
+        if (value == nullptr) [[unlikely]] {
+            auto built = std::make_unique<const T>(std::forward<Factory>(factory)());
+            if (m_value.compare_exchange_strong(value,
+                                                built.get(),
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_acquire)) [[likely]] {
+                value = built.release();
+            }
+        }
+        return *value;
+    }
+
+private:
+    mutable std::atomic<const T*> m_value{nullptr};
+};
@@ -17,15 +17,18 @@ limitations under the License.
 
 #pragma once
 
-#include <algorithm>      // std::min
-#include <memory>         // std::unique_ptr
-#include <optional>       // std::optional, std::nullopt
-#include <string>         // std::string
-#include <thread>         // std::thread::id
-#include <tuple>          // std::tuple
-#include <unordered_set>  // std::unordered_set
-#include <utility>        // std::pair
-#include <vector>         // std::vector
+#include <algorithm>    // std::min
+#include <atomic>       // std::atomic, std::memory_order_acquire
+#include <cstdint>      // std::uint32_t
+#include <map>          // std::map
+#include <memory>       // std::unique_ptr
+#include <optional>     // std::optional, std::nullopt
+#include <string>       // std::string
+#include <thread>       // std::thread::id
+#include <tuple>        // std::tuple
+#include <type_traits>  // std::underlying_type_t
+#include <utility>      // std::pair
+#include <vector>       // std::vector
 
 #include <pybind11/pybind11.h>
 
@@ -62,6 +65,51 @@ bool AllLeaves(const py::iterable &iterable,
                const bool &none_is_leaf = false,
                const std::string &registry_namespace = "");
 
+// Partition the leaves of a PyTree into two PyTrees with the same structure. The leaves selected
+// by the predicate or the mask tree go to the first PyTree and the others go to the second PyTree.
+// The vacated positions are filled with the placeholder.
+py::tuple TreePartition(const py::object &tree,
+                        const py::object &predicate_or_mask_tree,
+                        const py::object &placeholder,
+                        const std::optional<py::function> &leaf_predicate,
+                        const bool &none_is_leaf = false,
+                        const std::string &registry_namespace = "");
+
+// Combine PyTrees with the same structure by taking the first leaf that is not the placeholder at
+// each position.
+py::object TreeCombine(const py::tuple &trees,
+                       const py::object &placeholder,
+                       const std::optional<py::function> &leaf_predicate,
+                       const bool &none_is_leaf = false,
+                       const std::string &registry_namespace = "");
+
+// Broadcast two pytrees to their common suffix structure. Return a pair of trees, each keeping its
+// own node types and key order.
+py::tuple TreeBroadcastCommon(const py::object &tree,
+                              const py::object &other_tree,
+                              const std::optional<py::function> &leaf_predicate,
+                              const bool &none_is_leaf = false,
+                              const std::string &registry_namespace = "");
+
+// Broadcast two pytrees to their common suffix structure. Return a pair of leaf lists aligned to
+// the leaves of the common suffix of the first tree.
+py::tuple BroadcastCommon(const py::object &tree,
+                          const py::object &other_tree,
+                          const std::optional<py::function> &leaf_predicate,
+                          const bool &none_is_leaf = false,
+                          const std::string &registry_namespace = "");
+
+// Strip the native byte order and alignment prefix of a buffer format string.
+std::string NativeFormat(const std::string &format);
+
+// Test whether the object is a one-dimensional buffer with a native integer format.
+bool IsIntegerArray(const py::object &array);
+
+// Read a one-dimensional array of integers. Objects supporting the buffer protocol with a native
+// integer format are read directly without creating intermediate Python integers. Other objects
+// are iterated as sequences of integers.
+std::vector<ssize_t> ReadIntegerArray(const py::object &array, const char *name);
+
 template <bool NoneIsLeaf>
 bool IsLeafImpl(const py::handle &handle,
                 const std::optional<py::function> &leaf_predicate,
@@ -74,6 +122,103 @@ bool AllLeavesImpl(const py::iterable &iterable,
 
 py::module_ GetCxxModule(const std::optional<py::module_> &module = std::nullopt);
 
+class PyTreeSpec;
+class PyTreeProxy;
+class PyTreeTraversalArray;
+
+// Ravel the leaves of a PyTree that are exact `float`, `int`, or `bool` objects into a contiguous
+// buffer of `double` (if any leaf is a `float`) or `int64` values. Return the buffer, its format,
+// the per-leaf type codes ('f', 'i', or 'b'), and the PyTreeSpec.
+std::tuple<py::bytearray, py::str, py::bytes, std::unique_ptr<PyTreeSpec>> TreeRavelScalars(
+    const py::object &tree,
+    const std::optional<py::function> &leaf_predicate,
+    const bool &none_is_leaf = false,
+    const std::string &registry_namespace = "");
+
+// Rebuild a PyTree of Python scalars from a one-dimensional `double` or integer buffer and the
+// per-leaf type codes returned by `TreeRavelScalars`.
+py::object TreeUnravelScalars(const PyTreeSpec &treespec,
+                              const py::object &flat,
+                              const py::bytes &kinds);
+
+// Per-namespace configuration flags for the pytree operations.
+enum class PyTreeConfigFlag : std::uint32_t {
+    DictInsertionOrdered = 1U << 0U,  // Preserve the insertion order of the dictionary keys
+};
+
+// An immutable snapshot of the per-namespace configuration flags. Snapshots are interned by their
+// contents and published atomically, so the readers take neither a lock nor a reference.
+class PyTreeConfigSnapshot {
+public:
+    // A bitmask of `PyTreeConfigFlag` values.
+    using Flags = std::underlying_type_t<PyTreeConfigFlag>;
+    using FlagsMap = std::map<std::string, Flags>;
+
+    explicit PyTreeConfigSnapshot(FlagsMap flags)
+        : m_flags{std::move(flags)}, m_global{GetOrZero(m_flags, "")} {}
+
+    // Return the flags of the namespace, optionally combined with the global namespace flags.
+    [[nodiscard]] inline Py_ALWAYS_INLINE Flags Get(const std::string &registry_namespace,
+                                                    const bool &inherit_global_namespace) const {
+        if (registry_namespace.empty()) [[likely]] {
+            return m_global;
+        }
+        const Flags flags = (inherit_global_namespace ? m_global : 0U);
+        if (m_flags.empty()) [[likely]] {
+            return flags;
+        }
+        return flags | GetOrZero(m_flags, registry_namespace);
+    }
+
+    [[nodiscard]] inline const FlagsMap &GetFlagsMap() const noexcept { return m_flags; }
+
+    // Return the bit of the flag in a bitmask of flags.
+    [[nodiscard]] static constexpr Flags Bit(const PyTreeConfigFlag &flag) noexcept {
+        return static_cast<Flags>(flag);
+    }
+
+    // Return whether the flag is set in a bitmask of flags.
+    [[nodiscard]] static constexpr bool HasFlag(const Flags &flags,
+                                                const PyTreeConfigFlag &flag) noexcept {
+        return (flags & Bit(flag)) != 0U;
+    }
+
+    // Return the currently published snapshot. Return nullptr if no flag has ever been set.
+    [[nodiscard]] static inline Py_ALWAYS_INLINE const PyTreeConfigSnapshot *Current() noexcept {
+        return sm_current.load(std::memory_order_acquire);
+    }
+
+    // Return the flags of the namespace in the currently published snapshot.
+    [[nodiscard]] static inline Py_ALWAYS_INLINE Flags CurrentFlags(
+        const std::string &registry_namespace,
+        const bool &inherit_global_namespace = true) {
+        const PyTreeConfigSnapshot *const snapshot = Current();
+        return (snapshot != nullptr ? snapshot->Get(registry_namespace, inherit_global_namespace)
+                                    : 0U);
+    }
+
+    // Set or clear a flag of the namespace and publish the new snapshot.
+    static void SetFlag(const PyTreeConfigFlag &flag,
+                        const bool &mode,
+                        const std::string &registry_namespace);
+
+private:
+    static inline Flags GetOrZero(const FlagsMap &flags, const std::string &registry_namespace) {
+        const auto it = flags.find(registry_namespace);
+        return (it != flags.end() ? it->second : 0U);
+    }
+
+    const FlagsMap m_flags;
+    const Flags m_global;
+
+    // The published snapshot. The snapshots are never freed while the module is alive, so the
+    // pointer stays valid after being replaced. Interning bounds the number of snapshots by the
+    // number of distinct configurations.
+    static inline std::atomic<const PyTreeConfigSnapshot *> sm_current{nullptr};
+    static inline std::map<FlagsMap, std::unique_ptr<const PyTreeConfigSnapshot>> sm_snapshots{};
+    static inline mutex sm_mutex{};
+};
+
 // A PyTreeSpec describes the tree structure of a PyTree. A PyTree is a tree of Python values, where
 // the interior nodes are tuples, lists, dictionaries, or user-defined containers, and the leaves
 // are other objects.
@@ -92,12 +237,14 @@ public:
 
     // Flatten a PyTree into a list of leaves and a PyTreeSpec.
     // Return references to the flattened objects, which might be temporary objects in the case of
-    // custom PyType handlers.
+    // custom PyType handlers. If 'assume_unshared' is true, the caller guarantees that no other
+    // thread mutates the containers, and the critical sections on them are elided.
     static std::pair<std::vector<py::object>, std::unique_ptr<PyTreeSpec>> Flatten(
         const py::object &tree,
         const std::optional<py::function> &leaf_predicate = std::nullopt,
         const bool &none_is_leaf = false,
-        const std::string &registry_namespace = "");
+        const std::string &registry_namespace = "",
+        const bool &assume_unshared = false);
 
     // Flatten a PyTree into a list of leaves with a list of paths and a PyTreeSpec.
     // Return references to the flattened objects, which might be temporary objects in the case of
@@ -111,15 +258,40 @@ public:
     // Return an unflattened PyTree given an iterable of leaves and a PyTreeSpec.
     [[nodiscard]] py::object Unflatten(const py::iterable &leaves) const;
 
+    // Return a lazy view of the unflattened PyTree given an iterable of leaves and a PyTreeSpec.
+    // The containers are built only for the subtrees that are accessed.
+    [[nodiscard]] static py::object UnflattenLazy(const py::object &treespec,
+                                                  const py::iterable &leaves);
+
     // Flatten a PyTree up to this PyTreeSpec. 'this' must be a tree prefix of the tree-structure
     // of 'x'. For example, if we flatten a value [(1, (2, 3)), {"foo": 4}] with a PyTreeSpec [(*,
     // *), *], the result is the list of leaves [1, (2, 3), {"foo": 4}].
-    [[nodiscard]] py::list FlattenUpTo(const py::object &full_tree) const;
+    [[nodiscard]] py::list FlattenUpTo(const py::object &full_tree,
+                                       const bool &assume_unshared = false) const;
+
+    // Return read-only buffers of the kinds, arities, numbers of leaves, and numbers of nodes of
+    // the nodes in post-order. The buffers alias the traversal of the PyTreeSpec without copying.
+    [[nodiscard]] static py::tuple TraversalArrays(const py::object &treespec);
+
+    // Broadcast the leaves of a prefix PyTreeSpec to the leaves of this PyTreeSpec. 'prefix' must
+    // be a tree prefix of this PyTreeSpec. Return the covering prefix leaf for each of our leaves.
+    [[nodiscard]] std::vector<py::object> BroadcastPrefixLeaves(
+        const PyTreeSpec &prefix,
+        const std::vector<py::object> &prefix_leaves) const;
 
     // Broadcast to a common suffix of this PyTreeSpec and other PyTreeSpec.
     [[nodiscard]] std::unique_ptr<PyTreeSpec> BroadcastToCommonSuffix(
         const PyTreeSpec &other) const;
 
+    // Broadcast to a common suffix of this PyTreeSpec and other PyTreeSpec, together with the
+    // leaves of both trees. Return the common suffix and both leaf lists aligned to its leaves.
+    [[nodiscard]] std::tuple<std::unique_ptr<PyTreeSpec>,
+                             std::vector<py::object>,
+                             std::vector<py::object>>
+    BroadcastToCommonSuffixLeaves(const PyTreeSpec &other,
+                                  const std::vector<py::object> &leaves,
+                                  const std::vector<py::object> &other_leaves) const;
+
     // Compose two PyTreeSpecs, replacing the leaves of this tree with copies of `inner`.
     [[nodiscard]] std::unique_ptr<PyTreeSpec> Compose(const PyTreeSpec &inner_treespec) const;
 
@@ -135,6 +307,25 @@ public:
     // Return a list of accessors to all leaves in the PyTreeSpec.
     [[nodiscard]] std::vector<py::object> Accessors() const;
 
+    // Return the paths to all leaves in the PyTreeSpec rendered as strings, with the path entries
+    // formatted by `str()` (style "plain") or `repr()` (style "repr") and joined by the separator.
+    // The result of the first call is cached on the PyTreeSpec.
+    [[nodiscard]] py::tuple PathStrings(const std::string &separator = ".",
+                                        const std::string &style = "plain") const;
+
+    // Return the leaves whose paths match the glob pattern. Path entries are rendered as in
+    // `PathStrings()`, and pattern segments are separated by `.` or `/`. A `*` segment matches
+    // exactly one entry, a `**` segment matches any number of entries, and other segments may use
+    // `*` and `?` wildcards within the entry. Returns a tuple of the sorted leaf indices and a
+    // boolean mask tree. The leaf indices are cached per pattern on the PyTreeSpec.
+    [[nodiscard]] py::tuple Select(const std::string &pattern) const;
+
+    // Split the leaves into `n` contiguous shards aligned to subtree boundaries. The `balance`
+    // argument is "leaves", "nodes", or a sequence of per-leaf weights. Each shard is a tuple
+    // `(start, stop, roots)` of the leaf range and the roots of the subtrees covering the range,
+    // given as `(indices, treespec)` pairs where `indices` are the child positions from the root.
+    [[nodiscard]] py::list Partition(const ssize_t &n, const py::object &balance) const;
+
     // Return one-level entries of the PyTreeSpec to its children.
     [[nodiscard]] py::list Entries() const;
 
@@ -147,6 +338,22 @@ public:
     // Return the child at the given index of the PyTreeSpec.
     [[nodiscard]] std::unique_ptr<PyTreeSpec> Child(ssize_t index) const;
 
+    // Return the index of the leaf at the given path.
+    [[nodiscard]] ssize_t LeafIndex(const py::tuple &path) const;
+
+    // Return a new PyTreeSpec with the given per-leaf annotation columns added or replaced. A
+    // column has one entry per leaf. One-dimensional buffers of native integers are stored
+    // compactly as 64-bit integers, and other sequences are stored as tuples of Python objects.
+    // A `None` column removes the annotation.
+    [[nodiscard]] std::unique_ptr<PyTreeSpec> WithAnnotations(const py::dict &columns) const;
+
+    // Return the per-leaf annotation columns. Integer columns are returned as read-only
+    // `memoryview`s and object columns as tuples.
+    [[nodiscard]] py::dict GetAnnotations() const;
+
+    // Return the annotation of the leaf given by its index or its path.
+    [[nodiscard]] py::object GetAnnotation(const std::string &name, const py::object &leaf) const;
+
     [[nodiscard]] inline Py_ALWAYS_INLINE ssize_t GetNumLeaves() const {
         EXPECT_FALSE(m_traversal.empty(), "The tree node traversal is empty.");
         return m_traversal.back().num_leaves;
@@ -238,33 +445,40 @@ public:
         const bool &none_is_leaf = false,
         const std::string &registry_namespace = "");
 
+    // Make a PyTreeSpec from the node kinds and arities of a post-order traversal and a table that
+    // maps node indices to their metadata. The traversal is validated and the subtree sizes are
+    // computed in a single pass.
+    static std::unique_ptr<PyTreeSpec> FromArrays(const py::object &kinds,
+                                                  const py::object &arities,
+                                                  const std::optional<py::dict> &node_data,
+                                                  const bool &none_is_leaf = false,
+                                                  const std::string &registry_namespace = "");
+
     // Check if should preserve the insertion order of the dictionary keys during flattening.
     static inline Py_ALWAYS_INLINE bool IsDictInsertionOrdered(
         const std::string &registry_namespace,
         const bool &inherit_global_namespace = true) {
-        const scoped_read_lock_guard lock{sm_is_dict_insertion_ordered_mutex};
-
-        return (sm_is_dict_insertion_ordered.find(registry_namespace) !=
-                sm_is_dict_insertion_ordered.end()) ||
-               (inherit_global_namespace &&
-                sm_is_dict_insertion_ordered.find("") != sm_is_dict_insertion_ordered.end());
+        return PyTreeConfigSnapshot::HasFlag(
+            PyTreeConfigSnapshot::CurrentFlags(registry_namespace, inherit_global_namespace),
+            PyTreeConfigFlag::DictInsertionOrdered);
     }
 
     // Set the namespace to preserve the insertion order of the dictionary keys during flattening.
     static inline Py_ALWAYS_INLINE void SetDictInsertionOrdered(
         const bool &mode,
         const std::string &registry_namespace) {
-        const scoped_write_lock_guard lock{sm_is_dict_insertion_ordered_mutex};
-
-        if (mode) [[likely]] {
-            sm_is_dict_insertion_ordered.insert(registry_namespace);
-        } else [[unlikely]] {
-            sm_is_dict_insertion_ordered.erase(registry_namespace);
-        }
+        PyTreeConfigSnapshot::SetFlag(
+            PyTreeConfigFlag::DictInsertionOrdered, mode, registry_namespace);
     }
 
     friend void BuildModule(py::module_ &mod);  // NOLINT[runtime/references]
 
+    friend class PyTreeProxy;
+
+    friend class PyTreeTraversalArray;
+
+    friend class PyTreeIter;
+
 private:
     using RegistrationPtr = PyTreeTypeRegistry::RegistrationPtr;
     using ThreadedIdentity = std::pair<const optree::PyTreeSpec *, std::thread::id>;
@@ -282,6 +496,13 @@ private:
         // For a DefaultDict, contains a tuple of (default_factory, sorted list of keys).
         // For a Deque, contains the `maxlen` attribute.
         // For a Custom type, contains the metadata returned by the `flatten_func` function.
+        //
+        // The metadata is read without critical sections (e.g., when unflattening and comparing),
+        // so threads sharing a PyTreeSpec do not contend on it. The containers built for the
+        // builtin kinds (e.g., the key lists) are private to the PyTreeSpec and never mutated after
+        // construction. The metadata of a Custom type is the user's object and may be mutable; the
+        // PyTreeSpec does not mutate it, and mutating it from another thread concurrently with a
+        // traversal of the PyTreeSpec is not synchronized.
         py::object node_data{};
 
         // The tuple of path entries.
@@ -312,6 +533,49 @@ private:
     // The registry namespace used to resolve the custom pytree node types.
     std::string m_namespace{};
 
+    // A per-leaf annotation column. Integer columns hold native 64-bit integers in a bytes object
+    // and object columns hold one Python object per leaf in a tuple.
+    struct AnnotationColumn {
+        py::object values{};
+        bool is_integer = false;
+    };
+
+    // The per-leaf annotation columns by name. They are carried through Children(), Child(), and
+    // Compose(), and do not participate in the comparison and hashing.
+    std::map<std::string, AnnotationColumn> m_annotations{};
+
+    // The canonical signature of the tree structure. It is built once per treespec on first use.
+    struct Signature {
+        // Packed node kinds, arities, and counts, followed by the hash values of the node metadata
+        // for each node. Equal treespecs always have equal words.
+        std::vector<ssize_t> words{};
+
+        // Process-wide intern IDs of the node metadata and the custom type registrations. Two
+        // treespecs with interned metadata are equal if and only if their words and IDs are equal.
+        std::vector<ssize_t> ids{};
+
+        // Whether all node metadata are interned. Only builtin immutable values, classes, and
+        // functions can be interned.
+        bool interned = false;
+
+        // The generation of the intern table in which the IDs were assigned. IDs are comparable
+        // only within the same generation.
+        ssize_t generation = 0;
+    };
+    mutable thread_safe_lazy<Signature> m_signature{};
+
+    // The rendered path strings of the leaves keyed by the `(separator, use_repr)` pair.
+    mutable thread_safe_lazy<py::dict> m_path_strings{};
+
+    // The maximum number of argument pairs in the path strings cache before it is cleared.
+    static constexpr ssize_t MAX_PATH_STRINGS_CACHE_SIZE = 16;
+
+    // The selected leaf indices (a read-only `memoryview` of int64) keyed by the glob pattern.
+    mutable thread_safe_lazy<py::dict> m_selections{};
+
+    // The maximum number of patterns in the selection cache before it is cleared.
+    static constexpr ssize_t MAX_SELECTION_CACHE_SIZE = 64;
+
     // Helper that returns the string representation of a node kind.
     static std::string NodeKindToString(const Node &node);
 
@@ -323,20 +587,45 @@ private:
     // Helper that identifies the path entry class for a node.
     static py::object GetPathEntryType(const Node &node);
 
+    // Helper that returns the position of the path entry among the children of a node. Return -1
+    // if the node has no such entry.
+    static ssize_t FindEntry(const Node &node, const py::handle &entry);
+
+    // Helper that copies the annotations of the leaves in [start, stop) into `treespec`.
+    void SliceAnnotationsInto(PyTreeSpec &treespec,  // NOLINT[runtime/references]
+                              const ssize_t &start,
+                              const ssize_t &stop) const;
+
+    // Helper that computes the annotations of `Compose(inner)` into `treespec`. The annotations of
+    // this PyTreeSpec are repeated for the leaves of each copy of `inner`, and the annotations of
+    // `inner` are tiled over the copies.
+    void ComposeAnnotationsInto(PyTreeSpec &treespec,  // NOLINT[runtime/references]
+                                const PyTreeSpec &inner) const;
+
     // Recursive helper used to implement Flatten().
+    template <bool AssumeUnshared>
     bool FlattenInto(const py::handle &handle,
                      std::vector<py::object> &leaves,  // NOLINT[runtime/references]
                      const std::optional<py::function> &leaf_predicate,
                      const bool &none_is_leaf,
                      const std::string &registry_namespace);
 
-    template <bool NoneIsLeaf, bool DictShouldBeSorted, typename Span>
+    template <bool NoneIsLeaf, bool DictShouldBeSorted, bool AssumeUnshared, typename Span>
     bool FlattenIntoImpl(const py::handle &handle,
                          Span &leaves,  // NOLINT[runtime/references]
                          const ssize_t &depth,
                          const std::optional<py::function> &leaf_predicate,
                          const std::string &registry_namespace);
 
+    // Helper used to implement FlattenInto() for lazy views. The nodes and the leaves of the view
+    // are copied directly if the view is compatible with the current flattening.
+    template <bool NoneIsLeaf, bool DictShouldBeSorted, bool AssumeUnshared, typename Span>
+    bool FlattenProxyInto(const PyTreeProxy &proxy,
+                          Span &leaves,  // NOLINT[runtime/references]
+                          const ssize_t &depth,
+                          const std::optional<py::function> &leaf_predicate,
+                          const std::string &registry_namespace);
+
     // Recursive helper used to implement FlattenWithPath().
     bool FlattenIntoWithPath(const py::handle &handle,
                              std::vector<py::object> &leaves,  // NOLINT[runtime/references]
@@ -358,15 +647,30 @@ private:
                                  const std::optional<py::function> &leaf_predicate,
                                  const std::string &registry_namespace);
 
+    // Helper used to implement FlattenUpTo().
+    template <bool AssumeUnshared>
+    [[nodiscard]] py::list FlattenUpToImpl(const py::object &full_tree) const;
+
+    // Reconstruct the subtree spanned by the nodes in `m_traversal[first:last]`.
     template <typename Span>
-    py::object UnflattenImpl(const Span &leaves) const;
+    py::object UnflattenImpl(const Span &leaves, const ssize_t &first, const ssize_t &last) const;
 
-    static std::tuple<ssize_t, ssize_t, ssize_t, ssize_t> BroadcastToCommonSuffixImpl(
+    // Walk both traversals iteratively and emit the common suffix nodes in post-order. With
+    // `WithLeaves`, also broadcast both leaf lists to the leaves of the common suffix.
+    template <bool WithLeaves>
+    static ssize_t BroadcastToCommonSuffixImpl(
         std::vector<Node> &nodes,  // NOLINT[runtime/references]
         const std::vector<Node> &traversal,
-        const ssize_t &pos,
         const std::vector<Node> &other_traversal,
-        const ssize_t &other_pos);
+        const std::vector<py::object> &leaves,
+        const std::vector<py::object> &other_leaves,
+        std::vector<py::object> &common_leaves,         // NOLINT[runtime/references]
+        std::vector<py::object> &other_common_leaves);  // NOLINT[runtime/references]
+
+    // Create an empty PyTreeSpec for the common suffix after checking that the PyTreeSpecs agree
+    // on `none_is_leaf` and the registry namespace.
+    [[nodiscard]] std::unique_ptr<PyTreeSpec> MakeCommonSuffixTreeSpec(
+        const PyTreeSpec &other) const;
 
     template <typename Span, typename Stack>
     [[nodiscard]] ssize_t PathsImpl(Span &paths,   // NOLINT[runtime/references]
@@ -374,6 +678,14 @@ private:
                                     const ssize_t &pos,
                                     const ssize_t &depth) const;
 
+    template <typename Span>
+    [[nodiscard]] ssize_t PathStringsImpl(Span &strings,        // NOLINT[runtime/references]
+                                          std::string &buffer,  // NOLINT[runtime/references]
+                                          const std::string &separator,
+                                          const bool &use_repr,
+                                          const ssize_t &pos,
+                                          const ssize_t &depth) const;
+
     template <typename Span, typename Stack>
     [[nodiscard]] ssize_t AccessorsImpl(Span &accessors,  // NOLINT[runtime/references]
                                         Stack &stack,     // NOLINT[runtime/references]
@@ -384,17 +696,28 @@ private:
 
     [[nodiscard]] ssize_t HashValueImpl() const;
 
+    // Get the canonical signature of the tree structure, building it if necessary.
+    [[nodiscard]] const Signature &GetSignature() const;
+
+    [[nodiscard]] Signature MakeSignature() const;
+
+    // Get the intern ID of the object in the given generation of the intern table. Equal objects
+    // share the same ID within a generation. Returns -1 if the object cannot be interned, or if the
+    // intern table is full (it is then cleared) or has moved on to a newer generation.
+    static ssize_t InternMetadata(const py::handle &object, const ssize_t &generation);
+
     template <bool NoneIsLeaf>
     static std::unique_ptr<PyTreeSpec> MakeFromCollectionImpl(const py::handle &handle,
                                                               std::string registry_namespace);
 
+    template <bool NoneIsLeaf>
+    static std::unique_ptr<PyTreeSpec> FromArraysImpl(const py::object &kinds,
+                                                      const py::object &arities,
+                                                      const std::optional<py::dict> &node_data,
+                                                      const std::string &registry_namespace);
+
     // Used in tp_traverse for GC support.
     static int PyTpTraverse(PyObject *self_base, visitproc visit, void *arg);
-
-    // A set of namespaces that preserve the insertion order of the dictionary keys during
-    // flattening.
-    static inline std::unordered_set<std::string> sm_is_dict_insertion_ordered{};
-    static inline read_write_mutex sm_is_dict_insertion_ordered_mutex{};
 };
 
 class PyTreeIter {
@@ -402,13 +725,8 @@ public:
     explicit PyTreeIter(const py::object &tree,
                         const std::optional<py::function> &leaf_predicate,
                         const bool &none_is_leaf,
-                        const std::string &registry_namespace)
-        : m_root{tree},
-          m_agenda{{{tree, 0}}},
-          m_leaf_predicate{leaf_predicate},
-          m_none_is_leaf{none_is_leaf},
-          m_namespace{registry_namespace},
-          m_is_dict_insertion_ordered{PyTreeSpec::IsDictInsertionOrdered(registry_namespace)} {}
+                        const std::string &registry_namespace,
+                        const bool &build_treespec = false);
 
     PyTreeIter() = delete;
     ~PyTreeIter() = default;
@@ -422,24 +740,307 @@ public:
 
     [[nodiscard]] py::object Next();
 
+    // Return the PyTreeSpec built while iterating. Only available after the iterator is exhausted
+    // when it is created with `build_treespec=true`.
+    [[nodiscard]] std::unique_ptr<PyTreeSpec> GetTreeSpec() const;
+
     friend void BuildModule(py::module_ &mod);  // NOLINT[runtime/references]
 
 private:
     const py::object m_root;
+    // A null object in the agenda marks the end of the children of the innermost pending node.
     std::vector<std::pair<py::object, ssize_t>> m_agenda;
     const std::optional<py::function> m_leaf_predicate;
     const bool m_none_is_leaf;
     const std::string m_namespace;
     const bool m_is_dict_insertion_ordered;
+
+    // The PyTreeSpec being built in the post-order of `PyTreeSpec::FlattenIntoImpl`, or null if
+    // the structure is not recorded. The pending nodes are the ancestors of the current object,
+    // whose `num_nodes` and `num_leaves` fields hold the counts before their children until the
+    // nodes are completed.
+    std::unique_ptr<PyTreeSpec> m_treespec;
+    std::vector<PyTreeSpec::Node> m_pending{};
+    ssize_t m_num_leaves = 0;
+    bool m_exhausted = false;
 #ifdef Py_GIL_DISABLED
     mutable mutex m_mutex{};
 #endif
 
-    template <bool NoneIsLeaf>
+    template <bool NoneIsLeaf, bool BuildTreeSpec>
     [[nodiscard]] py::object NextImpl();
 
     // Used in tp_traverse for GC support.
     static int PyTpTraverse(PyObject *self_base, visitproc visit, void *arg);
 };
 
+// An iterator over the leaves of several PyTrees in lockstep. The first PyTree determines the
+// structure. The nodes of the other PyTrees are checked against it on the fly as in
+// `PyTreeSpec::FlattenUpTo`, and their subtrees at the leaf positions of the first PyTree are
+// yielded as-is. No intermediate leaf lists are built.
+class PyTreeZipIter {
+public:
+    explicit PyTreeZipIter(const py::object &tree,
+                           const py::tuple &rests,
+                           const std::optional<py::function> &leaf_predicate,
+                           const bool &none_is_leaf,
+                           const std::string &registry_namespace);
+
+    PyTreeZipIter() = delete;
+    ~PyTreeZipIter() = default;
+
+    PyTreeZipIter(const PyTreeZipIter &) = delete;
+    PyTreeZipIter &operator=(const PyTreeZipIter &) = delete;
+    PyTreeZipIter(PyTreeZipIter &&) = delete;
+    PyTreeZipIter &operator=(PyTreeZipIter &&) = delete;
+
+    [[nodiscard]] PyTreeZipIter &Iter() noexcept { return *this; }
+
+    [[nodiscard]] py::tuple Next();
+
+    friend void BuildModule(py::module_ &mod);  // NOLINT[runtime/references]
+
+private:
+    using RegistrationPtr = PyTreeTypeRegistry::RegistrationPtr;
+
+    const py::object m_root;
+    const py::tuple m_rests;
+    const ssize_t m_num_trees;
+    // The pending nodes, `m_num_trees` consecutive objects (one per PyTree) per entry.
+    std::vector<py::object> m_agenda;
+    std::vector<ssize_t> m_depths;
+    const std::optional<py::function> m_leaf_predicate;
+    const bool m_none_is_leaf;
+    const std::string m_namespace;
+    const bool m_is_dict_insertion_ordered;
+#ifdef Py_GIL_DISABLED
+    mutable mutex m_mutex{};
+#endif
+
+    template <bool NoneIsLeaf>
+    [[nodiscard]] py::tuple NextImpl();
+
+    // Check the nodes of the other PyTrees against the node of the first PyTree and push the
+    // children of all of them onto the agenda.
+    template <bool NoneIsLeaf>
+    void PushChildren(const std::vector<py::object> &nodes,
+                      const PyTreeKind &kind,
+                      const RegistrationPtr &custom,
+                      const ssize_t &depth);
+
+    // Used in tp_traverse for GC support.
+    static int PyTpTraverse(PyObject *self_base, visitproc visit, void *arg);
+};
+
+// A lazy view of a subtree of the PyTree reconstructed from a PyTreeSpec and leaves. It supports
+// the sequence and mapping protocols of the underlying container and builds the real containers
+// only for the subtrees that are accessed.
+class PyTreeProxy {
+public:
+    explicit PyTreeProxy(const py::object &treespec,
+                         const py::tuple &leaves,
+                         const ssize_t &pos,
+                         const ssize_t &leaf_start);
+
+    PyTreeProxy() = delete;
+    ~PyTreeProxy() = default;
+
+    PyTreeProxy(const PyTreeProxy &) = delete;
+    PyTreeProxy &operator=(const PyTreeProxy &) = delete;
+    PyTreeProxy(PyTreeProxy &&) = delete;
+    PyTreeProxy &operator=(PyTreeProxy &&) = delete;
+
+    // Return the leaf, the lazy view, or the materialized object for the subtree at the given
+    // node position.
+    static py::object MakeView(const py::object &treespec,
+                               const py::tuple &leaves,
+                               const ssize_t &pos,
+                               const ssize_t &leaf_start);
+
+    // Return the number of children.
+    [[nodiscard]] ssize_t GetLength() const;
+
+    // Return the child at the given index (for sequences) or key (for mappings).
+    [[nodiscard]] py::object GetItem(const py::object &key);
+
+    // Return the child with the given field name (for namedtuples and PyStructSequences).
+    [[nodiscard]] py::object GetAttr(const std::string &name);
+
+    // Test whether the given key (for mappings) or value (for sequences) is in the container.
+    [[nodiscard]] bool Contains(const py::object &value);
+
+    // Return an iterator over the keys (for mappings) or the children (for sequences).
+    [[nodiscard]] py::iterator Iter();
+
+    // Return the keys of a mapping in insertion order.
+    [[nodiscard]] py::list Keys() const;
+
+    // Return the children of a mapping in insertion order.
+    [[nodiscard]] py::list Values();
+
+    // Return the key-child pairs of a mapping in insertion order.
+    [[nodiscard]] py::list Items();
+
+    // Return the child for the given key of a mapping, or the default value if the key is missing.
+    [[nodiscard]] py::object Get(const py::object &key, const py::object &default_value);
+
+    // Build the real containers for the whole subtree.
+    [[nodiscard]] py::object Materialize() const;
+
+    // Return the treespec of the subtree.
+    [[nodiscard]] std::unique_ptr<PyTreeSpec> GetTreeSpec() const;
+
+    [[nodiscard]] std::string ToString() const;
+
+    // Test whether the given object is a lazy view.
+    static inline Py_ALWAYS_INLINE bool Check(const py::handle &object) {
+        return Py_TYPE(object.ptr()) == sm_type;
+    }
+
+    friend void BuildModule(py::module_ &mod);  // NOLINT[runtime/references]
+
+    friend class PyTreeSpec;
+
+private:
+    // The Python treespec object. It keeps the traversal alive.
+    const py::object m_treespec;
+    const PyTreeSpec *const m_spec;
+    // The leaves of the whole tree, shared by all views of the same tree.
+    const py::tuple m_leaves;
+    // The position of the subtree root in the traversal and the index of its first leaf.
+    const ssize_t m_pos;
+    const ssize_t m_leaf_start;
+    // The node positions and the first leaf indices of the children.
+    std::vector<std::pair<ssize_t, ssize_t>> m_child_positions;
+    // The children that have been accessed.
+    std::vector<py::object> m_children;
+    // A mapping from the keys to the child indices, built on first key access.
+    py::object m_key_index{};
+#ifdef Py_GIL_DISABLED
+    mutable mutex m_mutex{};
+#endif
+
+    // The Python type object of the lazy view.
+    static inline PyTypeObject *sm_type = nullptr;
+
+    [[nodiscard]] const PyTreeSpec::Node &GetNode() const;
+
+    [[nodiscard]] bool IsMapping() const;
+
+    // Return the child at the given index, building the view of it if necessary.
+    [[nodiscard]] py::object GetChild(const ssize_t &index);
+
+    // Return the index of the child with the given key, or -1 if the key is missing.
+    [[nodiscard]] ssize_t FindKey(const py::object &key);
+
+    // Return the keys of a mapping in the same order as the children.
+    [[nodiscard]] py::list GetSortedKeys() const;
+
+    // Used in tp_traverse for GC support.
+    static int PyTpTraverse(PyObject *self_base, visitproc visit, void *arg);
+};
+
+// A schema of a PyTree, built from a PyTreeSpec with per-leaf constraints on the leaf types and the
+// array shapes and dtypes. The constraints are compiled once and each validation runs in a single
+// native pass over the leaves.
+class PyTreeSchema {
+public:
+    explicit PyTreeSchema(const py::object &treespec, const py::iterable &constraints);
+
+    PyTreeSchema() = delete;
+    ~PyTreeSchema() = default;
+
+    PyTreeSchema(const PyTreeSchema &) = delete;
+    PyTreeSchema &operator=(const PyTreeSchema &) = delete;
+    PyTreeSchema(PyTreeSchema &&) = delete;
+    PyTreeSchema &operator=(PyTreeSchema &&) = delete;
+
+    // Return a list of all violations as `(path, message)` pairs. The list is empty if the tree is
+    // valid.
+    [[nodiscard]] py::list Validate(const py::object &tree) const;
+
+    // Test whether the tree is valid. Stop at the first violation.
+    [[nodiscard]] bool IsValid(const py::object &tree) const;
+
+    [[nodiscard]] py::object GetTreeSpec() const { return m_treespec; }
+
+    // Return the original leaf constraints.
+    [[nodiscard]] py::list GetConstraints() const;
+
+    [[nodiscard]] std::string ToString() const;
+
+    friend void BuildModule(py::module_ &mod);  // NOLINT[runtime/references]
+
+private:
+    struct LeafConstraint {
+        // The allowed exact leaf types. Empty if any type is allowed.
+        std::vector<py::object> types{};
+
+        // The expected array shape. A negative dimension matches any size.
+        std::optional<std::vector<ssize_t>> shape{};
+
+        // The expected array type string as in `__array_interface__['typestr']`.
+        std::optional<std::string> typestr{};
+
+        // The original constraint object.
+        py::object original{};
+    };
+
+    // The Python treespec object and its traversal.
+    const py::object m_treespec;
+    const PyTreeSpec *const m_spec;
+    std::vector<LeafConstraint> m_constraints{};
+    // The paths to the leaves, computed once.
+    std::vector<py::tuple> m_paths{};
+
+    static LeafConstraint ParseConstraint(const py::object &constraint);
+
+    static std::vector<py::object> ParseTypes(const py::object &types);
+
+    // Return an empty string if the leaf satisfies the constraint, or the violation message.
+    [[nodiscard]] static std::string CheckLeaf(const LeafConstraint &constraint,
+                                               const py::handle &leaf);
+
+    template <bool StopOnFirstViolation>
+    [[nodiscard]] py::list ValidateImpl(const py::object &tree) const;
+
+    // Used in tp_traverse for GC support.
+    static int PyTpTraverse(PyObject *self_base, visitproc visit, void *arg);
+};
+
+// A read-only one-dimensional buffer over a field of the nodes of a PyTreeSpec. The buffer is a
+// strided view into the traversal of the PyTreeSpec, which is kept alive by this object.
+class PyTreeTraversalArray {
+public:
+    enum class Field : std::uint8_t {
+        Kind = 0,
+        Arity,
+        NumLeaves,
+        NumNodes,
+    };
+
+    explicit PyTreeTraversalArray(const py::object &treespec, const Field &field);
+
+    PyTreeTraversalArray() = delete;
+    ~PyTreeTraversalArray() = default;
+
+    PyTreeTraversalArray(const PyTreeTraversalArray &) = delete;
+    PyTreeTraversalArray &operator=(const PyTreeTraversalArray &) = delete;
+    PyTreeTraversalArray(PyTreeTraversalArray &&) = delete;
+    PyTreeTraversalArray &operator=(PyTreeTraversalArray &&) = delete;
+
+    [[nodiscard]] py::buffer_info GetBuffer() const;
+
+    friend void BuildModule(py::module_ &mod);  // NOLINT[runtime/references]
+
+private:
+    // The Python treespec object. It keeps the traversal alive.
+    const py::object m_treespec;
+    const PyTreeSpec *const m_spec;
+    const Field m_field;
+
+    // Used in tp_traverse for GC support.
+    static int PyTpTraverse(PyObject *self_base, visitproc visit, void *arg);
+};
+
 }  // namespace optree
@@ -18,7 +18,7 @@
 import builtins
 import enum
 from collections.abc import Callable, Collection, Iterable, Iterator
-from typing import Any
+from typing import Any, Generic, Literal
 from typing_extensions import Self
 
 from optree.typing import (
@@ -46,6 +46,7 @@ def flatten(
     leaf_predicate: Callable[[T], bool] | None = None,
     node_is_leaf: bool = False,
     namespace: str = '',
+    assume_unshared: bool = False,
 ) -> tuple[list[T], PyTreeSpec]: ...
 def flatten_with_path(
     tree: PyTree[T],
@@ -66,6 +67,13 @@ def make_from_collection(
     node_is_leaf: bool = False,
     namespace: str = '',
 ) -> PyTreeSpec: ...
+def make_from_arrays(
+    kinds: Iterable[int],
+    arities: Iterable[int],
+    node_data: dict[int, Any] | None = None,
+    node_is_leaf: bool = False,
+    namespace: str = '',
+) -> PyTreeSpec: ...
 def is_leaf(
     obj: T,
     leaf_predicate: Callable[[T], bool] | None = None,
@@ -78,6 +86,46 @@ def all_leaves(
     node_is_leaf: bool = False,
     namespace: str = '',
 ) -> bool: ...
+def partition(
+    tree: PyTree[T],
+    predicate_or_mask_tree: Callable[[T], bool] | PyTree[bool | Callable[[T], bool]],
+    placeholder: Any = None,
+    leaf_predicate: Callable[[T], bool] | None = None,
+    node_is_leaf: bool = False,
+    namespace: str = '',
+) -> tuple[PyTree[T], PyTree[T]]: ...
+def combine(
+    trees: tuple[PyTree[T], ...],
+    placeholder: Any = None,
+    leaf_predicate: Callable[[T], bool] | None = None,
+    node_is_leaf: bool = False,
+    namespace: str = '',
+) -> PyTree[T]: ...
+def broadcast_common_trees(
+    tree: PyTree[T],
+    other_tree: PyTree[T],
+    leaf_predicate: Callable[[T], bool] | None = None,
+    node_is_leaf: bool = False,
+    namespace: str = '',
+) -> tuple[PyTree[T], PyTree[T]]: ...
+def broadcast_common(
+    tree: PyTree[T],
+    other_tree: PyTree[T],
+    leaf_predicate: Callable[[T], bool] | None = None,
+    node_is_leaf: bool = False,
+    namespace: str = '',
+) -> tuple[list[T], list[T]]: ...
+def ravel_scalars(
+    tree: PyTree[float | int | bool],
+    leaf_predicate: Callable[[Any], bool] | None = None,
+    node_is_leaf: bool = False,
+    namespace: str = '',
+) -> tuple[bytearray, str, bytes, PyTreeSpec]: ...
+def unravel_scalars(
+    treespec: PyTreeSpec,
+    flat: Any,
+    kinds: bytes,
+) -> PyTree[float | int | bool]: ...
 def is_namedtuple(obj: object | type) -> bool: ...
 def is_namedtuple_instance(obj: object) -> bool: ...
 def is_namedtuple_class(cls: type) -> bool: ...
@@ -109,7 +157,13 @@ class PyTreeSpec:
     type: builtins.type | None
     kind: PyTreeKind
     def unflatten(self, leaves: Iterable[T]) -> PyTree[T]: ...
-    def flatten_up_to(self, full_tree: PyTree[T]) -> list[PyTree[T]]: ...
+    def unflatten_lazy(self, leaves: Iterable[T]) -> PyTreeProxy[T] | PyTree[T]: ...
+    def flatten_up_to(
+        self,
+        full_tree: PyTree[T],
+        assume_unshared: bool = False,
+    ) -> list[PyTree[T]]: ...
+    def traversal_arrays(self) -> tuple[memoryview, memoryview, memoryview, memoryview]: ...
     def broadcast_to_common_suffix(self, other: PyTreeSpec) -> PyTreeSpec: ...
     def compose(self, inner_treespec: PyTreeSpec) -> PyTreeSpec: ...
     def walk(
@@ -119,11 +173,26 @@ class PyTreeSpec:
         leaves: Iterable[T],
     ) -> U: ...
     def paths(self) -> list[tuple[Any, ...]]: ...
+    def path_strings(
+        self,
+        separator: str = '.',
+        style: Literal['plain', 'repr'] = 'plain',
+    ) -> tuple[str, ...]: ...
+    def select(self, pattern: str) -> tuple[memoryview, PyTree[bool]]: ...
+    def partition(
+        self,
+        n: int,
+        balance: Literal['leaves', 'nodes'] | Iterable[float] = 'leaves',
+    ) -> list[tuple[int, int, tuple[tuple[tuple[int, ...], PyTreeSpec], ...]]]: ...
     def accessors(self) -> list[PyTreeAccessor]: ...
     def entries(self) -> list[Any]: ...
     def entry(self, index: int) -> Any: ...
     def children(self) -> list[PyTreeSpec]: ...
     def child(self, index: int) -> PyTreeSpec: ...
+    def leaf_index(self, path: tuple[Any, ...]) -> int: ...
+    def with_annotations(self, annotations: dict[str, Iterable[Any] | None]) -> PyTreeSpec: ...
+    def annotations(self) -> dict[str, tuple[Any, ...] | memoryview]: ...
+    def annotation(self, name: str, leaf: int | tuple[Any, ...]) -> Any: ...
     def is_leaf(self, strict: bool = True) -> bool: ...
     def is_prefix(self, other: PyTreeSpec, strict: bool = False) -> bool: ...
     def is_suffix(self, other: PyTreeSpec, strict: bool = False) -> bool: ...
@@ -143,9 +212,50 @@ class PyTreeIter(Iterator[T]):
         leaf_predicate: Callable[[T], bool] | None = None,
         node_is_leaf: bool = False,
         namespace: str = '',
+        build_treespec: bool = False,
     ) -> None: ...
     def __iter__(self) -> Self: ...
     def __next__(self) -> T: ...
+    @property
+    def treespec(self) -> PyTreeSpec: ...
+
+class PyTreeZipIter(Iterator[tuple[Any, ...]]):
+    def __init__(
+        self,
+        tree: PyTree[T],
+        rests: tuple[PyTree[Any], ...] = (),
+        leaf_predicate: Callable[[T], bool] | None = None,
+        node_is_leaf: bool = False,
+        namespace: str = '',
+    ) -> None: ...
+    def __iter__(self) -> Self: ...
+    def __next__(self) -> tuple[Any, ...]: ...
+
+class PyTreeProxy(Generic[T]):
+    treespec: PyTreeSpec
+    def materialize(self) -> PyTree[T]: ...
+    def keys(self) -> list[Any]: ...
+    def values(self) -> list[PyTreeProxy[T] | PyTree[T]]: ...
+    def items(self) -> list[tuple[Any, PyTreeProxy[T] | PyTree[T]]]: ...
+    def get(
+        self,
+        key: Any,
+        default: PyTreeProxy[T] | PyTree[T] | None = None,
+    ) -> PyTreeProxy[T] | PyTree[T] | None: ...
+    def __getitem__(self, key: Any) -> PyTreeProxy[T] | PyTree[T]: ...
+    def __getattr__(self, name: str) -> PyTreeProxy[T] | PyTree[T]: ...
+    def __contains__(self, value: object) -> bool: ...
+    def __iter__(self) -> Iterator[Any]: ...
+    def __len__(self) -> int: ...
+
+class PyTreeTraversalArray: ...
+
+class PyTreeSchema:
+    treespec: PyTreeSpec
+    constraints: list[Any]
+    def __init__(self, treespec: PyTreeSpec, constraints: Iterable[Any]) -> None: ...
+    def validate(self, tree: PyTree[Any]) -> list[tuple[tuple[Any, ...], str]]: ...
+    def is_valid(self, tree: PyTree[Any]) -> bool: ...
 
 def register_node(
     cls: type[Collection[T]],
@@ -153,6 +263,8 @@ def register_node(
     unflatten_func: UnflattenFunc[T],
     path_entry_type: type[PyTreeEntry],
     namespace: str = '',
+    kind: str = '',
+    metadata_key: Callable[[MetaData], Any] | bool | None = None,
 ) -> None: ...
 def unregister_node(
     cls: type,
@@ -14,7 +14,7 @@
 # ==============================================================================
 """OpTree: Optimized PyTree Utilities."""
 
-from optree import accessor, dataclasses, functools, integration, typing
+from optree import accessor, checkpoint, dataclasses, functools, integration, typing
 from optree.accessor import (
     AutoEntry,
     DataclassEntry,
@@ -45,12 +45,15 @@ from optree.ops import (
     tree_broadcast_map_with_accessor,
     tree_broadcast_map_with_path,
     tree_broadcast_prefix,
+    tree_combine,
     tree_flatten,
     tree_flatten_one_level,
     tree_flatten_with_accessor,
     tree_flatten_with_path,
     tree_is_leaf,
     tree_iter,
+    tree_iter_shard,
+    tree_iter_zip,
     tree_leaves,
     tree_map,
     tree_map_,
@@ -60,6 +63,7 @@ from optree.ops import (
     tree_map_with_path_,
     tree_max,
     tree_min,
+    tree_partition,
     tree_paths,
     tree_reduce,
     tree_replace_nones,
@@ -78,6 +82,7 @@ from optree.ops import (
     treespec_dict,
     treespec_entries,
     treespec_entry,
+    treespec_from_arrays,
     treespec_from_collection,
     treespec_is_leaf,
     treespec_is_prefix,
@@ -107,6 +112,7 @@ from optree.typing import (
     PyTree,
     PyTreeDef,
     PyTreeKind,
+    PyTreeSchema,
     PyTreeSpec,
     PyTreeTypeVar,
     UnflattenFunc,
@@ -132,6 +138,8 @@ __all__ = [
     'tree_flatten_with_accessor',
     'tree_unflatten',
     'tree_iter',
+    'tree_iter_zip',
+    'tree_iter_shard',
     'tree_leaves',
     'tree_structure',
     'tree_paths',
@@ -145,6 +153,8 @@ __all__ = [
     'tree_map_with_accessor',
     'tree_map_with_accessor_',
     'tree_replace_nones',
+    'tree_partition',
+    'tree_combine',
     'tree_transpose',
     'tree_transpose_map',
     'tree_transpose_map_with_path',
@@ -185,6 +195,7 @@ __all__ = [
     'treespec_deque',
     'treespec_structseq',
     'treespec_from_collection',
+    'treespec_from_arrays',
     # Accessor
     'PyTreeEntry',
     'GetAttrEntry',
@@ -204,6 +215,7 @@ __all__ = [
     'dict_insertion_ordered',
     # Typing
     'PyTreeSpec',
+    'PyTreeSchema',
     'PyTreeDef',
     'PyTreeKind',
     'PyTree',
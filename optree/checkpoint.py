@@ -0,0 +1,566 @@
+# Copyright 2022-2024 MetaOPT Team. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Parallel chunked checkpoint I/O for pytrees.
+
+A checkpoint is a directory with two files:
+
+- ``data.bin``: the raw bytes of the leaves, each leaf starting at an aligned offset.
+- ``manifest.pkl``: the pickled :class:`PyTreeSpec` of the tree and one record per leaf holding
+  its path, content hash, byte range, and how to rebuild it.
+
+Leaves exposing a C-contiguous buffer (e.g., NumPy arrays and writable buffers such as
+:class:`bytearray` and :class:`array.array`) are stored as raw bytes. Large buffers are split
+into chunks that are written and read concurrently by a thread pool with :func:`os.pwrite` and
+:func:`os.preadv`, directly from and into the leaf memory. Other leaves are pickled into the data
+file.
+
+An incremental checkpoint only writes the leaves that changed since a base checkpoint, and its
+records point at the data files of its ancestors for the others. :func:`compact` copies those bytes
+into the checkpoint's own data file.
+
+.. warning::
+    Loading a checkpoint unpickles its manifest. Only load checkpoints from trusted sources.
+"""
+
+from __future__ import annotations
+
+import concurrent.futures
+import contextlib
+import hashlib
+import os
+import pickle
+import sys
+import threading
+from typing import Any, Callable
+
+from optree.ops import tree_flatten
+from optree.typing import PyTree, PyTreeSpec, T
+
+
+__all__ = [
+    'save',
+    'load',
+    'load_manifest',
+    'compact',
+]
+
+
+MANIFEST_FILENAME: str = 'manifest.pkl'
+DATA_FILENAME: str = 'data.bin'
+DEFAULT_CHUNK_SIZE: int = 64 * 1024 * 1024
+ALIGNMENT: int = 4096
+MANIFEST_VERSION: int = 1
+
+_IO_LOCK = threading.Lock()
+
+
+def _align(offset: int) -> int:
+    return -(-offset // ALIGNMENT) * ALIGNMENT
+
+
+def _as_byte_view(leaf: Any, *, writable: bool = False) -> memoryview | None:
+    """Return a flat byte view of the leaf's memory, or :data:`None` if it has no usable buffer."""
+    numpy = sys.modules.get('numpy')
+    if numpy is not None and isinstance(leaf, numpy.ndarray):
+        # Some dtypes (e.g., `datetime64`) have no buffer format, so view the bytes through NumPy.
+        if leaf.dtype.hasobject or not leaf.flags.c_contiguous:
+            return None
+        if writable and not leaf.flags.writeable:
+            return None
+        return memoryview(leaf.reshape(-1).view(numpy.uint8))
+    try:
+        view = memoryview(leaf)
+    except (TypeError, ValueError):
+        return None
+    if not view.c_contiguous or (writable and view.readonly):
+        return None
+    try:
+        return view.cast('B')
+    except (TypeError, ValueError, NotImplementedError):
+        return None
+
+
+def _is_buffer_leaf(leaf: Any) -> bool:
+    numpy = sys.modules.get('numpy')
+    if numpy is not None and isinstance(leaf, numpy.ndarray):
+        return not leaf.dtype.hasobject
+    # Read-only buffers (e.g., `bytes`) are pickled so that they are restored with their type.
+    return _as_byte_view(leaf, writable=True) is not None
+
+
+def _pwrite(fd: int, view: memoryview, offset: int) -> None:
+    if hasattr(os, 'pwrite'):
+        while view:
+            written = os.pwrite(fd, view, offset)
+            view, offset = view[written:], offset + written
+        return
+    with _IO_LOCK:  # no positional I/O on this platform
+        os.lseek(fd, offset, os.SEEK_SET)
+        while view:
+            written = os.write(fd, view)
+            view = view[written:]
+
+
+def _pread(fd: int, view: memoryview, offset: int) -> None:
+    while view:
+        if hasattr(os, 'preadv'):
+            read = os.preadv(fd, [view], offset)
+        elif hasattr(os, 'pread'):
+            data = os.pread(fd, len(view), offset)
+            read = len(data)
+            view[:read] = data
+        else:
+            with _IO_LOCK:  # no positional I/O on this platform
+                os.lseek(fd, offset, os.SEEK_SET)
+                data = os.read(fd, len(view))
+            read = len(data)
+            view[:read] = data
+        if read == 0:
+            raise EOFError(f'Unexpected end of checkpoint data at offset {offset}.')
+        view, offset = view[read:], offset + read
+
+
+def _copy(src_fd: int, src_offset: int, dst_fd: int, dst_offset: int, nbytes: int) -> None:
+    if hasattr(os, 'copy_file_range'):
+        try:
+            while nbytes > 0:
+                copied = os.copy_file_range(src_fd, dst_fd, nbytes, src_offset, dst_offset)
+                if copied == 0:
+                    raise EOFError(f'Unexpected end of checkpoint data at offset {src_offset}.')
+                src_offset, dst_offset, nbytes = (
+                    src_offset + copied,
+                    dst_offset + copied,
+                    nbytes - copied,
+                )
+            return
+        except OSError:
+            pass  # e.g., across file systems on older kernels, fall back to a buffered copy
+    buffer = memoryview(bytearray(nbytes))
+    _pread(src_fd, buffer, src_offset)
+    _pwrite(dst_fd, buffer, dst_offset)
+
+
+def _hash(payload: memoryview) -> str:
+    return hashlib.blake2b(payload, digest_size=32).hexdigest()
+
+
+def _chunks(
+    fd: int,
+    view: memoryview,
+    offset: int,
+    chunk_size: int,
+) -> list[tuple[int, memoryview, int]]:
+    return [
+        (fd, view[start : start + chunk_size], offset + start)
+        for start in range(0, len(view), chunk_size)
+    ]
+
+
+def _run_parallel(
+    func: Callable[..., T],
+    tasks: list[tuple[Any, ...]],
+    max_workers: int | None,
+) -> list[T]:
+    if len(tasks) <= 1 or max_workers == 1:
+        return [func(*task) for task in tasks]
+    with concurrent.futures.ThreadPoolExecutor(max_workers=max_workers) as executor:
+        return list(executor.map(func, *zip(*tasks)))
+
+
+def _check_chunk_size(chunk_size: int) -> None:
+    if not isinstance(chunk_size, int) or chunk_size <= 0:
+        raise ValueError(f'Expected `chunk_size` to be a positive integer, got {chunk_size!r}.')
+
+
+def _serialize(leaf: Any) -> tuple[dict[str, Any], memoryview]:
+    if _is_buffer_leaf(leaf):
+        numpy = sys.modules.get('numpy')
+        if numpy is not None and isinstance(leaf, numpy.ndarray):
+            leaf = numpy.ascontiguousarray(leaf)
+            record = {'kind': 'buffer', 'dtype': leaf.dtype, 'shape': leaf.shape}
+            return record, memoryview(leaf.reshape(-1).view(numpy.uint8))
+        view = memoryview(leaf)
+        return {'kind': 'buffer', 'format': view.format, 'shape': view.shape}, view.cast('B')
+    payload = memoryview(pickle.dumps(leaf, protocol=pickle.HIGHEST_PROTOCOL))
+    return {'kind': 'pickle'}, payload
+
+
+def _same_layout(record: dict[str, Any], leaf: Any) -> bool:
+    """Return whether the leaf has the saved dtype (or format) and shape of the record."""
+    numpy = sys.modules.get('numpy')
+    if numpy is not None and isinstance(leaf, numpy.ndarray):
+        return (
+            'dtype' in record
+            and leaf.dtype == record['dtype']
+            and leaf.shape == tuple(record['shape'])
+        )
+    if 'format' not in record:
+        return False
+    view = memoryview(leaf)
+    return view.format == record['format'] and view.shape == tuple(record['shape'])
+
+
+def _same_content(record: dict[str, Any], other: dict[str, Any]) -> bool:
+    return all(
+        record.get(key) == other.get(key)
+        for key in ('hash', 'kind', 'nbytes', 'dtype', 'format', 'shape')
+    )
+
+
+def _open(path: str, flags: int, fds: dict[str, int]) -> int:
+    path = os.path.normpath(path)
+    if path not in fds:
+        fds[path] = os.open(path, flags | getattr(os, 'O_BINARY', 0))
+    return fds[path]
+
+
+def _close(fds: dict[str, int]) -> None:
+    for fd in fds.values():
+        os.close(fd)
+
+
+def _write_manifest(path: str | os.PathLike[str], manifest: dict[str, Any]) -> None:
+    manifest_path = os.path.join(path, MANIFEST_FILENAME)
+    with open(f'{manifest_path}.tmp', mode='wb') as file:
+        pickle.dump(manifest, file, protocol=pickle.HIGHEST_PROTOCOL)
+        file.flush()
+        os.fsync(file.fileno())
+    os.replace(f'{manifest_path}.tmp', manifest_path)
+
+
+def save(
+    path: str | os.PathLike[str],
+    tree: PyTree[Any],
+    /,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    base: str | os.PathLike[str] | None = None,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+    chunk_size: int = DEFAULT_CHUNK_SIZE,
+    max_workers: int | None = None,
+) -> PyTreeSpec:
+    """Save a pytree to a checkpoint directory.
+
+    The leaf bytes are written to a temporary file first with a thread pool, which then replaces
+    the data file before the manifest is written, so an interrupted save never leaves a manifest
+    that points at partially written data. Every leaf record stores the path of the leaf and a
+    content hash.
+
+    If ``base`` is given, the checkpoint is incremental: leaves whose path exists in the base
+    checkpoint with the same content hash, size, and type are not written, and their records point
+    at the bytes already stored by the base checkpoint (or by the ancestor that wrote them). Leaves
+    are matched by path rather than by position, so leaves may be added, removed, or moved between
+    checkpoints. The manifest records the base checkpoint as its ``'parent'``, forming a chain that
+    can be made self-contained with :func:`compact`. An ancestor of a checkpoint must not be
+    overwritten or deleted before the checkpoint is compacted. Leaves whose base bytes live in the
+    data file of ``path`` itself (e.g., when alternating between two checkpoint directories) are
+    written again, since that file is replaced by the save.
+
+    >>> import array, os, tempfile
+    >>> tree = {'w': array.array('d', [1.0, 2.0, 3.0]), 'step': 7, 'name': 'run'}
+    >>> with tempfile.TemporaryDirectory() as root:
+    ...     treespec = save(os.path.join(root, '1'), tree, chunk_size=8)
+    ...     tree['step'] = 8
+    ...     _ = save(os.path.join(root, '2'), tree, base=os.path.join(root, '1'))
+    ...     files = [record['file'] for record in load_manifest(os.path.join(root, '2'))['records']]
+    ...     restored = load(os.path.join(root, '2'))
+    >>> treespec
+    PyTreeSpec({'name': *, 'step': *, 'w': *})
+    >>> [os.path.basename(os.path.dirname(file)) or '.' for file in files]
+    ['1', '.', '1']
+    >>> restored['w'].tolist(), restored['step'], restored['name']
+    ([1.0, 2.0, 3.0], 8, 'run')
+
+    Args:
+        path (str or os.PathLike): The checkpoint directory. It is created if it does not exist.
+        tree (pytree): A pytree to be saved.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        base (str or os.PathLike, optional): A previous checkpoint directory to save incrementally
+            against. (default: :data:`None`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+        chunk_size (int, optional): The maximum number of bytes written by a single I/O call.
+            Buffer leaves larger than this are split into multiple chunks.
+            (default: :const:`64 MiB`)
+        max_workers (int or None, optional): The number of I/O threads. :data:`None` uses the
+            default of :class:`concurrent.futures.ThreadPoolExecutor`. (default: :data:`None`)
+
+    Returns:
+        The treespec of the saved tree.
+    """
+    _check_chunk_size(chunk_size)
+    leaves, treespec = tree_flatten(tree, is_leaf, none_is_leaf=none_is_leaf, namespace=namespace)
+
+    base_records: dict[tuple[Any, ...], dict[str, Any]] = {}
+    parent: str | None = None
+    if base is not None:
+        if os.path.realpath(base) == os.path.realpath(path):
+            raise ValueError('Expected `base` to be a different checkpoint directory than `path`.')
+        base_manifest = load_manifest(base)
+        data_file = os.path.realpath(os.path.join(path, DATA_FILENAME))
+        for record in base_manifest['records']:
+            file = os.path.join(os.path.abspath(base), record['file'])
+            # The data file of `path` is replaced below, so its bytes cannot be reused.
+            if os.path.realpath(file) == data_file:
+                continue
+            record['file'] = os.path.relpath(file, os.path.abspath(path))
+            base_records[record['path']] = record
+        parent = os.path.relpath(os.path.abspath(base), os.path.abspath(path))
+
+    serialized = [_serialize(leaf) for leaf in leaves]
+    hashes = _run_parallel(_hash, [(payload,) for _, payload in serialized], max_workers)
+
+    records: list[dict[str, Any]] = []
+    writes: list[tuple[memoryview, int]] = []
+    offset = 0
+    for leaf_path, (record, payload), digest in zip(treespec.paths(), serialized, hashes):
+        record.update(path=leaf_path, hash=digest, nbytes=payload.nbytes)
+        base_record = base_records.get(leaf_path)
+        if base_record is not None and _same_content(record, base_record):
+            records.append(base_record)
+            continue
+        offset = _align(offset)
+        record.update(file=DATA_FILENAME, offset=offset)
+        offset += payload.nbytes
+        records.append(record)
+        writes.append((payload, record['offset']))
+
+    os.makedirs(path, exist_ok=True)
+    data_path = os.path.join(path, DATA_FILENAME)
+    fds: dict[str, int] = {}
+    try:
+        fd = _open(f'{data_path}.tmp', os.O_WRONLY | os.O_CREAT | os.O_TRUNC, fds)
+        os.ftruncate(fd, offset)  # preallocate so that the chunks can be written in any order
+        chunks = [
+            chunk
+            for payload, payload_offset in writes
+            for chunk in _chunks(fd, payload, payload_offset, chunk_size)
+        ]
+        _run_parallel(_pwrite, chunks, max_workers)
+        os.fsync(fd)
+    finally:
+        _close(fds)
+
+    # The data file of an existing checkpoint is replaced only after its manifest is removed, so an
+    # interrupted save leaves either the old checkpoint or no manifest at all.
+    with contextlib.suppress(FileNotFoundError):
+        os.unlink(os.path.join(path, MANIFEST_FILENAME))
+    os.replace(f'{data_path}.tmp', data_path)
+    _write_manifest(
+        path,
+        {
+            'version': MANIFEST_VERSION,
+            'treespec': treespec,
+            'records': records,
+            'parent': parent,
+        },
+    )
+    return treespec
+
+
+def load_manifest(path: str | os.PathLike[str], /) -> dict[str, Any]:
+    """Load the manifest of a checkpoint directory.
+
+    The manifest is a :class:`dict` with keys ``'treespec'`` (the :class:`PyTreeSpec` of the
+    saved tree), ``'records'`` (one :class:`dict` per leaf with its ``'path'``, content
+    ``'hash'``, and the ``'file'`` relative to the checkpoint directory, ``'offset'``, and
+    ``'nbytes'`` of its bytes), and ``'parent'`` (the base checkpoint directory relative to the
+    checkpoint directory, or :data:`None` if the checkpoint is self-contained).
+    """
+    with open(os.path.join(path, MANIFEST_FILENAME), mode='rb') as file:
+        manifest = pickle.load(file)  # noqa: S301
+    if not isinstance(manifest, dict) or manifest.get('version') != MANIFEST_VERSION:
+        raise ValueError(f'Unsupported checkpoint manifest in {os.fspath(path)!r}.')
+    return manifest
+
+
+def compact(
+    path: str | os.PathLike[str],
+    /,
+    *,
+    chunk_size: int = DEFAULT_CHUNK_SIZE,
+    max_workers: int | None = None,
+) -> dict[str, Any]:
+    """Make an incremental checkpoint self-contained.
+
+    The bytes the checkpoint borrows from its ancestors are appended to its own data file, using
+    :func:`os.copy_file_range` where available, and the manifest is atomically replaced without a
+    parent. The offsets of the bytes already in the data file are unchanged, so checkpoints that
+    use this one as their base stay valid. Afterwards, the ancestors may be deleted if no other
+    checkpoint refers to them.
+
+    Args:
+        path (str or os.PathLike): The checkpoint directory.
+        chunk_size (int, optional): The maximum number of bytes copied by a single I/O call.
+            (default: :const:`64 MiB`)
+        max_workers (int or None, optional): The number of I/O threads. :data:`None` uses the
+            default of :class:`concurrent.futures.ThreadPoolExecutor`. (default: :data:`None`)
+
+    Returns:
+        The new manifest.
+    """
+    _check_chunk_size(chunk_size)
+    manifest = load_manifest(path)
+    if manifest['parent'] is None:
+        return manifest
+
+    data_path = os.path.join(path, DATA_FILENAME)
+    offset = os.path.getsize(data_path)
+    records: list[dict[str, Any]] = []
+    fds: dict[str, int] = {}
+    try:
+        fd = _open(data_path, os.O_WRONLY, fds)
+        tasks: list[tuple[int, int, int, int, int]] = []
+        for record in manifest['records']:
+            if record['file'] == DATA_FILENAME:
+                records.append(record)
+                continue
+            src_fd = _open(os.path.join(path, record['file']), os.O_RDONLY, fds)
+            offset = _align(offset)
+            tasks.extend(
+                (
+                    src_fd,
+                    record['offset'] + start,
+                    fd,
+                    offset + start,
+                    min(chunk_size, record['nbytes'] - start),
+                )
+                for start in range(0, record['nbytes'], chunk_size)
+            )
+            records.append(dict(record, file=DATA_FILENAME, offset=offset))
+            offset += record['nbytes']
+        os.ftruncate(fd, offset)
+        _run_parallel(_copy, tasks, max_workers)
+        os.fsync(fd)
+    finally:
+        _close(fds)
+
+    manifest.update(records=records, parent=None)
+    _write_manifest(path, manifest)
+    return manifest
+
+
+def _allocate(record: dict[str, Any]) -> tuple[Any, memoryview]:
+    if 'dtype' in record:
+        import numpy  # pylint: disable=import-outside-toplevel
+
+        array = numpy.empty(record['shape'], dtype=record['dtype'])
+        return array, memoryview(array.reshape(-1).view(numpy.uint8))
+    storage = bytearray(record['nbytes'])
+    view = memoryview(storage)
+    # Empty views cannot be cast, so they are restored as flat byte views.
+    if record['nbytes'] > 0 and (record['format'] != 'B' or len(record['shape']) != 1):
+        view = view.cast(record['format'], record['shape'])
+    return view, memoryview(storage)
+
+
+def load(
+    path: str | os.PathLike[str],
+    /,
+    target: PyTree[Any] | None = None,
+    *,
+    chunk_size: int = DEFAULT_CHUNK_SIZE,
+    max_workers: int | None = None,
+) -> PyTree[Any]:
+    """Load a pytree from a checkpoint directory.
+
+    If ``target`` is given, it must have the same structure as the saved tree. Buffer leaves are
+    then restored in place into the writable, C-contiguous leaves of ``target`` with the saved
+    dtype (or format) and shape, and the result tree shares those leaves. Otherwise, new leaves are
+    allocated: NumPy arrays are restored as NumPy arrays and other buffer leaves as
+    :class:`memoryview` objects with the saved format and shape.
+
+    >>> import array, tempfile
+    >>> tree = {'w': array.array('d', [1.0, 2.0, 3.0]), 'step': 7}
+    >>> target = {'w': array.array('d', [0.0, 0.0, 0.0]), 'step': 0}
+    >>> with tempfile.TemporaryDirectory() as path:
+    ...     _ = save(path, tree)
+    ...     restored = load(path, target)
+    >>> restored['w'] is target['w'], target['w']
+    (True, array('d', [1.0, 2.0, 3.0]))
+    >>> restored['step']
+    7
+
+    Args:
+        path (str or os.PathLike): The checkpoint directory.
+        target (pytree, optional): A pytree with the saved structure whose buffer leaves receive
+            the data in place. (default: :data:`None`)
+        chunk_size (int, optional): The maximum number of bytes read by a single I/O call.
+            (default: :const:`64 MiB`)
+        max_workers (int or None, optional): The number of I/O threads. :data:`None` uses the
+            default of :class:`concurrent.futures.ThreadPoolExecutor`. (default: :data:`None`)
+
+    Returns:
+        The restored pytree.
+    """
+    _check_chunk_size(chunk_size)
+    manifest = load_manifest(path)
+    treespec: PyTreeSpec = manifest['treespec']
+    records: list[dict[str, Any]] = manifest['records']
+
+    destinations: list[Any] = [None] * len(records)
+    if target is not None:
+        destinations, target_treespec = tree_flatten(
+            target,
+            none_is_leaf=treespec.none_is_leaf,
+            namespace=treespec.namespace,
+        )
+        if target_treespec != treespec:
+            raise ValueError(
+                f'Expected the target to have the saved structure {treespec}, '
+                f'got {target_treespec}.',
+            )
+
+    leaves: list[Any] = [None] * len(records)
+    pickled: list[tuple[int, bytearray]] = []
+    fds: dict[str, int] = {}
+    try:
+        chunks: list[tuple[int, memoryview, int]] = []
+        for i, (record, destination) in enumerate(zip(records, destinations)):
+            view: memoryview | None = None
+            if record['kind'] == 'buffer' and destination is not None:
+                view = _as_byte_view(destination, writable=True)
+                if (
+                    view is not None
+                    and view.nbytes == record['nbytes']
+                    and _same_layout(record, destination)
+                ):
+                    leaves[i] = destination
+                else:
+                    view = None
+            if view is None:
+                if record['kind'] == 'buffer':
+                    leaves[i], view = _allocate(record)
+                else:
+                    storage = bytearray(record['nbytes'])
+                    pickled.append((i, storage))
+                    view = memoryview(storage)
+            fd = _open(os.path.join(path, record['file']), os.O_RDONLY, fds)
+            chunks.extend(_chunks(fd, view, record['offset'], chunk_size))
+        _run_parallel(_pread, chunks, max_workers)
+    finally:
+        _close(fds)
+
+    for i, storage in pickled:
+        leaves[i] = pickle.loads(storage)  # noqa: S301
+    return treespec.unflatten(leaves)
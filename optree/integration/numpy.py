@@ -25,12 +25,24 @@ from typing_extensions import TypeAlias  # Python 3.10+
 import numpy as np  # pylint: disable=import-error
 from numpy.typing import ArrayLike  # pylint: disable=import-error
 
+from optree import _C
 from optree.ops import tree_flatten, tree_unflatten
-from optree.typing import PyTreeSpec, PyTreeTypeVar
+from optree.typing import PyTree, PyTreeSpec, PyTreeTypeVar
 from optree.utils import safe_zip
 
 
-__all__ = ['ArrayLikeTree', 'ArrayTree', 'tree_ravel']
+__all__ = [
+    'ArrayLikeTree',
+    'ArrayTree',
+    'tree_ravel',
+    'tree_ravel_views',
+    'tree_ravel_scalars',
+    'tree_foreach_add',
+    'tree_foreach_axpy',
+    'tree_foreach_scale',
+    'tree_foreach_lerp',
+    'tree_foreach_norm',
+]
 
 
 ArrayLikeTree: TypeAlias = PyTreeTypeVar('ArrayLikeTree', ArrayLike)  # type: ignore[valid-type]
@@ -118,6 +130,457 @@ def tree_ravel(
 ravel_pytree = tree_ravel
 
 
+def tree_ravel_views(
+    tree: ArrayLikeTree,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> tuple[dict[np.dtype, np.ndarray], ArrayTree]:
+    """Copy the leaves of a pytree into one contiguous 1D storage per dtype and return views.
+
+    Unlike :func:`tree_ravel`, the returned pytree shares memory with the flat storages. Each leaf
+    of the returned pytree is a view into the storage of its dtype, so in-place updates on a flat
+    storage (e.g., a fused optimizer step) are seen by the structured pytree and vice versa. The
+    leaves are copied only once, and raveling the returned pytree again is not needed.
+
+    >>> tree = {
+    ...     'weight': np.arange(0, 6, dtype=np.float32).reshape((2, 3)),
+    ...     'bias': np.arange(6, 8, dtype=np.float32),
+    ...     'step': np.array(0),
+    ... }
+    >>> storages, views = tree_ravel_views(tree)
+    >>> storages[np.dtype(np.float32)]
+    array([6., 7., 0., 1., 2., 3., 4., 5.], dtype=float32)
+    >>> storages[np.dtype(np.float32)] *= 2.0
+    >>> views['weight']
+    array([[ 0.,  2.,  4.],
+           [ 6.,  8., 10.]], dtype=float32)
+
+    Args:
+        tree (pytree): a pytree of arrays and scalars to ravel.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pair ``(storages, views)`` where the first element is a dictionary that maps each leaf
+        ``dtype`` to a 1D array holding the leaves of that ``dtype`` in the flattening order, and
+        the second element is a pytree of the same structure as the input ``tree`` whose leaves
+        are views into the storages.
+    """
+    leaves, treespec = tree_flatten(
+        tree,
+        is_leaf=is_leaf,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    arrays = [np.asarray(leaf) for leaf in leaves]
+
+    sizes: dict[np.dtype, int] = {}
+    for array in arrays:
+        sizes[array.dtype] = sizes.get(array.dtype, 0) + array.size
+    storages = {dtype: np.empty((size,), dtype=dtype) for dtype, size in sizes.items()}
+
+    offsets = dict.fromkeys(storages, 0)
+    views = []
+    for array in arrays:
+        offset = offsets[array.dtype]
+        offsets[array.dtype] = offset + array.size
+        view = storages[array.dtype][offset : offset + array.size].reshape(array.shape)
+        np.copyto(view, array)
+        views.append(view)
+    return storages, tree_unflatten(treespec, views)
+
+
+def tree_ravel_scalars(
+    tree: PyTree[float | int | bool],
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> tuple[np.ndarray, Callable[[np.ndarray], PyTree[float | int | bool]]]:
+    """Ravel a pytree of Python scalars into a 1D array without creating per-leaf arrays.
+
+    The leaves must be exact :class:`float`, :class:`int`, or :class:`bool` objects. They are
+    written directly into a contiguous ``float64`` buffer (if any leaf is a :class:`float`) or
+    ``int64`` buffer by the C++ extension, and the unravel function builds Python scalars of the
+    original types directly from a 1D array. Compared to :func:`tree_ravel`, this avoids creating
+    a 0-d array per leaf, which dominates the cost for trees of many scalars (e.g., hyperparameters
+    and metrics).
+
+    >>> tree = {'lr': 0.5, 'momentum': 0.9, 'nesterov': True, 'steps': 100}
+    >>> flat, unravel_func = tree_ravel_scalars(tree)
+    >>> flat.dtype, flat.tolist()
+    (dtype('float64'), [0.5, 0.9, 1.0, 100.0])
+    >>> unravel_func(flat * 2)
+    {'lr': 1.0, 'momentum': 1.8, 'nesterov': True, 'steps': 200}
+
+    Args:
+        tree (pytree): a pytree of Python scalars to ravel.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pair ``(array, unravel_func)`` where the first element is a 1D ``float64`` or ``int64``
+        array of the leaf values, and the second element is a callable for unflattening a 1D array
+        of the same length back to a pytree of Python scalars with the same structure and leaf types
+        as the input ``tree``.
+
+    Raises:
+        TypeError: If any leaf is not an exact :class:`float`, :class:`int`, or :class:`bool`.
+        OverflowError: If an integer leaf does not fit in the buffer dtype.
+    """
+    data, fmt, kinds, treespec = _C.ravel_scalars(tree, is_leaf, none_is_leaf, namespace)
+    dtype = np.dtype(np.float64 if fmt == 'd' else np.int64)
+    flat = np.frombuffer(data, dtype=dtype)
+    return flat, functools.partial(_tree_unravel_scalars, treespec, kinds, dtype)
+
+
+def tree_foreach_add(
+    tree: ArrayLikeTree,
+    other: ArrayLikeTree,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    alpha: Any = 1,
+    inplace: bool = False,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> ArrayTree:
+    """Compute ``tree + alpha * other`` leaf-wise with the ufuncs batched per ``dtype``.
+
+    The pytrees are flattened once, and the leaves of the same result ``dtype`` are concatenated
+    into flat buffers, so each ufunc runs once per ``dtype`` rather than once per leaf.
+
+    >>> tree = {'x': np.ones(2), 'y': np.zeros(3)}
+    >>> tree_foreach_add(tree, {'x': np.ones(2), 'y': np.ones(3)}, alpha=2.0)
+    {'x': array([3., 3.]), 'y': array([2., 2., 2.])}
+
+    Args:
+        tree (pytree): A pytree of arrays.
+        other (pytree): A pytree of arrays with the same structure as ``tree``, or with ``tree`` as
+            a prefix.
+        alpha (scalar, optional): The multiplier of ``other``. (default: :const:`1`)
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        inplace (bool, optional): Whether to write the results into the leaves of ``tree``, which
+            must be writable arrays. (default: :data:`False`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pytree of arrays with the same structure as ``tree``. If ``inplace=True``, ``tree`` is
+        returned with its leaves updated.
+    """
+
+    def kernel(out: np.ndarray, x: np.ndarray, y: np.ndarray, scratch: np.ndarray) -> None:
+        if isinstance(alpha, (int, float)) and alpha == 1:
+            np.add(x, y, out=out)
+        else:
+            np.multiply(y, alpha, out=scratch)
+            np.add(x, scratch, out=out)
+
+    return _tree_foreach(
+        kernel,
+        tree,
+        (other,),
+        (alpha,),
+        is_leaf=is_leaf,
+        inplace=inplace,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+
+
+def tree_foreach_axpy(
+    alpha: Any,
+    x: ArrayLikeTree,
+    y: ArrayLikeTree,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    inplace: bool = False,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> ArrayTree:
+    """Compute ``alpha * x + y`` leaf-wise with the ufuncs batched per ``dtype``.
+
+    This is :func:`tree_foreach_add` with the operands in BLAS order. If ``inplace=True``, the
+    result is written into the leaves of ``y``.
+
+    >>> tree_foreach_axpy(0.5, {'w': np.full(2, 4.0)}, {'w': np.ones(2)})
+    {'w': array([3., 3.])}
+
+    Args:
+        alpha (scalar): The multiplier of ``x``.
+        x (pytree): A pytree of arrays with the same structure as ``y``, or with ``y`` as a prefix.
+        y (pytree): A pytree of arrays.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        inplace (bool, optional): Whether to write the results into the leaves of ``y``, which
+            must be writable arrays. (default: :data:`False`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pytree of arrays with the same structure as ``y``.
+    """
+    return tree_foreach_add(
+        y,
+        x,
+        is_leaf=is_leaf,
+        alpha=alpha,
+        inplace=inplace,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+
+
+def tree_foreach_scale(
+    tree: ArrayLikeTree,
+    scalar: Any,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    inplace: bool = False,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> ArrayTree:
+    """Compute ``scalar * tree`` leaf-wise with the ufuncs batched per ``dtype``.
+
+    >>> tree_foreach_scale({'x': np.ones(2), 'y': np.arange(3.0)}, 2.0)
+    {'x': array([2., 2.]), 'y': array([0., 2., 4.])}
+
+    Args:
+        tree (pytree): A pytree of arrays.
+        scalar (scalar): The multiplier.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        inplace (bool, optional): Whether to write the results into the leaves of ``tree``, which
+            must be writable arrays. (default: :data:`False`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pytree of arrays with the same structure as ``tree``.
+    """
+
+    def kernel(out: np.ndarray, x: np.ndarray, scratch: np.ndarray) -> None:  # noqa: ARG001
+        np.multiply(x, scalar, out=out)
+
+    return _tree_foreach(
+        kernel,
+        tree,
+        (),
+        (scalar,),
+        is_leaf=is_leaf,
+        inplace=inplace,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+
+
+def tree_foreach_lerp(
+    tree: ArrayLikeTree,
+    end: ArrayLikeTree,
+    weight: Any,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    inplace: bool = False,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> ArrayTree:
+    """Compute ``tree + weight * (end - tree)`` leaf-wise with the ufuncs batched per ``dtype``.
+
+    This is the update of an exponential moving average, e.g., the moments of Adam.
+
+    >>> tree_foreach_lerp({'m': np.zeros(2)}, {'m': np.full(2, 10.0)}, 0.1)
+    {'m': array([1., 1.])}
+
+    Args:
+        tree (pytree): A pytree of arrays of the start values.
+        end (pytree): A pytree of arrays of the end values with the same structure as ``tree``, or
+            with ``tree`` as a prefix.
+        weight (scalar): The interpolation weight.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        inplace (bool, optional): Whether to write the results into the leaves of ``tree``, which
+            must be writable arrays. (default: :data:`False`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pytree of arrays with the same structure as ``tree``.
+    """
+
+    def kernel(out: np.ndarray, x: np.ndarray, y: np.ndarray, scratch: np.ndarray) -> None:
+        np.subtract(y, x, out=scratch)
+        np.multiply(scratch, weight, out=scratch)
+        np.add(x, scratch, out=out)
+
+    return _tree_foreach(
+        kernel,
+        tree,
+        (end,),
+        (weight,),
+        is_leaf=is_leaf,
+        inplace=inplace,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+
+
+def tree_foreach_norm(
+    tree: ArrayLikeTree,
+    ord: float = 2.0,  # pylint: disable=redefined-builtin
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> np.floating:
+    """Compute the vector norm of all leaves of a pytree as if they were concatenated.
+
+    >>> float(tree_foreach_norm({'x': np.full(2, 2.0), 'y': np.full(4, 1.0)}))
+    3.4641016151377544
+    >>> float(tree_foreach_norm({'x': np.full(2, 2.0), 'y': np.full(4, 1.0)}, ord=np.inf))
+    2.0
+
+    Args:
+        tree (pytree): A pytree of arrays.
+        ord (float, optional): The order of the vector norm. (default: :const:`2.0`)
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        The norm of the concatenated leaves as a scalar.
+    """
+    leaves = tree_flatten(tree, is_leaf=is_leaf, none_is_leaf=none_is_leaf, namespace=namespace)[0]
+    groups: dict[np.dtype, list[np.ndarray]] = {}
+    for leaf in leaves:
+        array = np.asarray(leaf)
+        # Zero-size leaves add nothing to the norm (and have no maximum for `ord=inf`).
+        if array.size > 0:
+            groups.setdefault(array.dtype, []).append(array.reshape(-1))
+    if not groups:
+        return np.float64(0.0)
+
+    # The leaves of each dtype are concatenated and reduced by a single call.
+    norms = [np.linalg.norm(np.concatenate(arrays), ord=ord) for arrays in groups.values()]
+    if ord == 0:
+        # The "0-norm" counts the nonzero elements, which add up over the groups.
+        return np.float64(sum(norms))
+    # For a nonzero order, the p-norm of the concatenation is the p-norm of the per-group p-norms.
+    return np.linalg.norm(np.asarray(norms), ord=ord)
+
+
+def _tree_foreach(
+    kernel: Callable[..., None],
+    tree: ArrayLikeTree,
+    others: tuple[ArrayLikeTree, ...],
+    scalars: tuple[Any, ...],
+    *,
+    is_leaf: Callable[[Any], bool] | None,
+    inplace: bool,
+    none_is_leaf: bool,
+    namespace: str,
+) -> ArrayTree:
+    leaves, treespec = tree_flatten(
+        tree,
+        is_leaf=is_leaf,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    if inplace and not all(isinstance(leaf, np.ndarray) for leaf in leaves):
+        raise ValueError('All leaves must be arrays for in-place operations.')
+    arrays = [np.asarray(leaf) for leaf in leaves]
+    other_arrays = [list(map(np.asarray, treespec.flatten_up_to(other))) for other in others]
+
+    groups: dict[np.dtype, list[int]] = {}
+    for i, array in enumerate(arrays):
+        if inplace:
+            dtype = array.dtype
+        else:
+            dtype = np.result_type(array, *(a[i] for a in other_arrays), *scalars)
+        groups.setdefault(dtype, []).append(i)
+
+    # The operands of the leaves with the same result dtype are concatenated into flat buffers, so
+    # the kernel runs its ufuncs once per dtype rather than once per leaf.
+    outputs: list[np.ndarray] = [None] * len(arrays)  # type: ignore[list-item]
+    for dtype, indices in groups.items():
+        shapes = [arrays[i].shape for i in indices]
+        out = _concatenate([arrays[i] for i in indices], shapes, dtype)
+        operands = [_concatenate([a[i] for i in indices], shapes, dtype) for a in other_arrays]
+        kernel(out, out, *operands, np.empty_like(out))
+
+        offset = 0
+        for i, shape in safe_zip(indices, shapes):
+            size = arrays[i].size
+            result = out[offset : offset + size].reshape(shape)
+            offset += size
+            if inplace:
+                np.copyto(arrays[i], result)
+            else:
+                outputs[i] = result
+
+    if inplace:
+        return tree
+    return tree_unflatten(treespec, outputs)
+
+
+def _concatenate(
+    arrays: list[np.ndarray],
+    shapes: list[tuple[int, ...]],
+    dtype: np.dtype,
+) -> np.ndarray:
+    flat = [np.broadcast_to(array, shape).reshape(-1) for array, shape in safe_zip(arrays, shapes)]
+    return np.concatenate(flat).astype(dtype, copy=False)
+
+
 def _tree_unravel(
     treespec: PyTreeSpec,
     unravel_flat: Callable[[np.ndarray], list[np.ndarray]],
@@ -126,6 +589,15 @@ def _tree_unravel(
     return tree_unflatten(treespec, unravel_flat(flat))
 
 
+def _tree_unravel_scalars(
+    treespec: PyTreeSpec,
+    kinds: bytes,
+    dtype: np.dtype,
+    flat: np.ndarray,
+) -> PyTree[float | int | bool]:
+    return _C.unravel_scalars(treespec, np.ascontiguousarray(flat, dtype=dtype), kinds)
+
+
 def _ravel_leaves(
     leaves: list[np.ndarray],
 ) -> tuple[np.ndarray, Callable[[np.ndarray], list[np.ndarray]]]:
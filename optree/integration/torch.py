@@ -28,7 +28,16 @@ from optree.typing import PyTreeSpec, PyTreeTypeVar
 from optree.utils import safe_zip
 
 
-__all__ = ['TensorTree', 'tree_ravel']
+__all__ = [
+    'TensorTree',
+    'tree_ravel',
+    'tree_ravel_views',
+    'tree_foreach_add',
+    'tree_foreach_axpy',
+    'tree_foreach_scale',
+    'tree_foreach_lerp',
+    'tree_foreach_norm',
+]
 
 
 TensorTree: TypeAlias = PyTreeTypeVar('TensorTree', torch.Tensor)  # type: ignore[valid-type]
@@ -115,6 +124,400 @@ def tree_ravel(
 ravel_pytree = tree_ravel
 
 
+def tree_ravel_views(
+    tree: TensorTree,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> tuple[dict[torch.dtype, torch.Tensor], TensorTree]:
+    """Copy the leaves of a pytree into one contiguous 1D storage per dtype and return views.
+
+    Unlike :func:`tree_ravel`, the returned pytree shares memory with the flat storages, in the
+    style of the flat parameters of fully sharded data parallel training. Each leaf of the returned
+    pytree is a view into the storage of its dtype, so in-place updates on a flat storage (e.g., a
+    fused optimizer step) are seen by the structured pytree and vice versa. The leaves are copied
+    only once, and raveling the returned pytree again is not needed. If any leaf of a dtype requires
+    gradient, the storage of that dtype requires gradient and the gradients of the views accumulate
+    into it.
+
+    >>> tree = {
+    ...     'weight': torch.arange(0, 6, dtype=torch.float32).reshape((2, 3)),
+    ...     'bias': torch.arange(6, 8, dtype=torch.float32),
+    ...     'step': torch.tensor(0),
+    ... }
+    >>> storages, views = tree_ravel_views(tree)
+    >>> storages[torch.float32]
+    tensor([6., 7., 0., 1., 2., 3., 4., 5.])
+    >>> storages[torch.float32].mul_(2.0)
+    tensor([12., 14.,  0.,  2.,  4.,  6.,  8., 10.])
+    >>> views['weight']
+    tensor([[ 0.,  2.,  4.],
+            [ 6.,  8., 10.]])
+
+    Args:
+        tree (pytree): a pytree of tensors to ravel.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pair ``(storages, views)`` where the first element is a dictionary that maps each leaf
+        ``dtype`` to a 1D tensor holding the leaves of that ``dtype`` in the flattening order, and
+        the second element is a pytree of the same structure as the input ``tree`` whose leaves
+        are views into the storages.
+    """
+    leaves, treespec = tree_flatten(
+        tree,
+        is_leaf=is_leaf,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    if not all(torch.is_tensor(leaf) for leaf in leaves):
+        raise ValueError('All leaves must be tensors.')
+
+    sizes: dict[torch.dtype, int] = {}
+    devices: dict[torch.dtype, torch.device] = {}
+    requires_grad: dict[torch.dtype, bool] = {}
+    for leaf in leaves:
+        dtype = leaf.dtype
+        if devices.setdefault(dtype, leaf.device) != leaf.device:
+            raise ValueError(
+                f'All leaves of dtype {dtype} must be on the same device, '
+                f'got {devices[dtype]} and {leaf.device}.',
+            )
+        sizes[dtype] = sizes.get(dtype, 0) + leaf.numel()
+        requires_grad[dtype] = requires_grad.get(dtype, False) or leaf.requires_grad
+
+    storages = {
+        dtype: torch.empty((size,), dtype=dtype, device=devices[dtype])
+        for dtype, size in sizes.items()
+    }
+    offsets = []
+    with torch.no_grad():
+        next_offsets = dict.fromkeys(storages, 0)
+        for leaf in leaves:
+            offset = next_offsets[leaf.dtype]
+            next_offsets[leaf.dtype] = offset + leaf.numel()
+            storages[leaf.dtype][offset : offset + leaf.numel()].copy_(leaf.reshape(-1))
+            offsets.append(offset)
+    for dtype, storage in storages.items():
+        storage.requires_grad_(requires_grad[dtype])
+
+    # Make the views after enabling gradient on the storages so that they are differentiable.
+    views = [
+        storages[leaf.dtype][offset : offset + leaf.numel()].view(leaf.shape)
+        for leaf, offset in safe_zip(leaves, offsets)
+    ]
+    return storages, tree_unflatten(treespec, views)
+
+
+def tree_foreach_add(
+    tree: TensorTree,
+    other: TensorTree,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    alpha: Any = 1,
+    inplace: bool = False,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> TensorTree:
+    """Compute ``tree + alpha * other`` leaf-wise with the ``torch._foreach_add`` kernels.
+
+    The pytrees are flattened once, and the leaves are grouped by device and ``dtype`` so that each
+    group is processed by a single multi-tensor kernel launch.
+
+    >>> tree = {'x': torch.ones(2), 'y': torch.zeros(3)}
+    >>> tree_foreach_add(tree, {'x': torch.ones(2), 'y': torch.ones(3)}, alpha=2.0)
+    {'x': tensor([3., 3.]), 'y': tensor([2., 2., 2.])}
+
+    Args:
+        tree (pytree): A pytree of tensors.
+        other (pytree): A pytree of tensors with the same structure as ``tree``, or with ``tree``
+            as a prefix.
+        alpha (scalar, optional): The multiplier of ``other``. (default: :const:`1`)
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        inplace (bool, optional): Whether to write the results into the leaves of ``tree``.
+            (default: :data:`False`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pytree of tensors with the same structure as ``tree``. If ``inplace=True``, ``tree`` is
+        returned with its leaves updated.
+    """
+    return _tree_foreach(
+        'add',
+        tree,
+        (other,),
+        {'alpha': alpha},
+        is_leaf=is_leaf,
+        inplace=inplace,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+
+
+def tree_foreach_axpy(
+    alpha: Any,
+    x: TensorTree,
+    y: TensorTree,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    inplace: bool = False,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> TensorTree:
+    """Compute ``alpha * x + y`` leaf-wise with the ``torch._foreach_add`` kernels.
+
+    This is :func:`tree_foreach_add` with the operands in BLAS order. If ``inplace=True``, the
+    result is written into the leaves of ``y``.
+
+    >>> tree_foreach_axpy(0.5, {'w': torch.full((2,), 4.0)}, {'w': torch.ones(2)})
+    {'w': tensor([3., 3.])}
+
+    Args:
+        alpha (scalar): The multiplier of ``x``.
+        x (pytree): A pytree of tensors with the same structure as ``y``, or with ``y`` as a
+            prefix.
+        y (pytree): A pytree of tensors.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        inplace (bool, optional): Whether to write the results into the leaves of ``y``.
+            (default: :data:`False`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pytree of tensors with the same structure as ``y``.
+    """
+    return tree_foreach_add(
+        y,
+        x,
+        is_leaf=is_leaf,
+        alpha=alpha,
+        inplace=inplace,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+
+
+def tree_foreach_scale(
+    tree: TensorTree,
+    scalar: Any,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    inplace: bool = False,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> TensorTree:
+    """Compute ``scalar * tree`` leaf-wise with the ``torch._foreach_mul`` kernels.
+
+    >>> tree_foreach_scale({'x': torch.ones(2), 'y': torch.arange(3.0)}, 2.0)
+    {'x': tensor([2., 2.]), 'y': tensor([0., 2., 4.])}
+
+    Args:
+        tree (pytree): A pytree of tensors.
+        scalar (scalar): The multiplier.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        inplace (bool, optional): Whether to write the results into the leaves of ``tree``.
+            (default: :data:`False`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pytree of tensors with the same structure as ``tree``.
+    """
+    return _tree_foreach(
+        'mul',
+        tree,
+        (),
+        {'scalar': scalar},
+        is_leaf=is_leaf,
+        inplace=inplace,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+
+
+def tree_foreach_lerp(
+    tree: TensorTree,
+    end: TensorTree,
+    weight: Any,
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    inplace: bool = False,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> TensorTree:
+    """Compute ``tree + weight * (end - tree)`` leaf-wise with the ``torch._foreach_lerp`` kernels.
+
+    This is the update of an exponential moving average, e.g., the moments of Adam.
+
+    >>> tree_foreach_lerp({'m': torch.zeros(2)}, {'m': torch.full((2,), 10.0)}, 0.1)
+    {'m': tensor([1., 1.])}
+
+    Args:
+        tree (pytree): A pytree of tensors of the start values.
+        end (pytree): A pytree of tensors of the end values with the same structure as ``tree``,
+            or with ``tree`` as a prefix.
+        weight (scalar): The interpolation weight.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        inplace (bool, optional): Whether to write the results into the leaves of ``tree``.
+            (default: :data:`False`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pytree of tensors with the same structure as ``tree``.
+    """
+    return _tree_foreach(
+        'lerp',
+        tree,
+        (end,),
+        {'weight': weight},
+        is_leaf=is_leaf,
+        inplace=inplace,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+
+
+def tree_foreach_norm(
+    tree: TensorTree,
+    ord: float = 2.0,  # pylint: disable=redefined-builtin
+    is_leaf: Callable[[Any], bool] | None = None,
+    *,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> torch.Tensor:
+    """Compute the vector norm of all leaves of a pytree as if they were concatenated.
+
+    The per-leaf norms are computed with the ``torch._foreach_norm`` kernels.
+
+    >>> tree_foreach_norm({'x': torch.full((2,), 2.0), 'y': torch.full((4,), 1.0)})
+    tensor(3.4641)
+    >>> tree_foreach_norm({'x': torch.full((2,), 2.0), 'y': torch.full((4,), 1.0)}, ord=torch.inf)
+    tensor(2.)
+
+    Args:
+        tree (pytree): A pytree of tensors.
+        ord (float, optional): The order of the vector norm. (default: :const:`2.0`)
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        The norm of the concatenated leaves as a scalar tensor on the device of the first leaf.
+    """
+    leaves = tree_flatten(tree, is_leaf=is_leaf, none_is_leaf=none_is_leaf, namespace=namespace)[0]
+    if not all(torch.is_tensor(leaf) for leaf in leaves):
+        raise ValueError('All leaves must be tensors.')
+    if not leaves:
+        return torch.zeros(())
+
+    device = leaves[0].device
+    if ord == 0:
+        # The "0-norm" counts the nonzero elements, which add up over the leaves.
+        return torch.stack([torch.linalg.vector_norm(leaf, 0).to(device) for leaf in leaves]).sum()
+
+    # For a nonzero order, the p-norm of the concatenation is the p-norm of the per-leaf p-norms.
+    norms = []
+    for group in _foreach_groups(leaves).values():
+        norms.extend(
+            norm.to(device) for norm in torch._foreach_norm([leaves[i] for i in group], ord)
+        )
+    return torch.linalg.vector_norm(torch.stack(norms), ord)
+
+
+def _foreach_groups(
+    leaves: list[torch.Tensor],
+) -> dict[tuple[torch.device, torch.dtype], list[int]]:
+    groups: dict[tuple[torch.device, torch.dtype], list[int]] = {}
+    for i, leaf in enumerate(leaves):
+        groups.setdefault((leaf.device, leaf.dtype), []).append(i)
+    return groups
+
+
+def _tree_foreach(
+    op: str,
+    tree: TensorTree,
+    others: tuple[TensorTree, ...],
+    kwargs: dict[str, Any],
+    *,
+    is_leaf: Callable[[Any], bool] | None,
+    inplace: bool,
+    none_is_leaf: bool,
+    namespace: str,
+) -> TensorTree:
+    leaves, treespec = tree_flatten(
+        tree,
+        is_leaf=is_leaf,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    if not all(torch.is_tensor(leaf) for leaf in leaves):
+        raise ValueError('All leaves must be tensors.')
+    other_leaves = [treespec.flatten_up_to(other) for other in others]
+
+    foreach = getattr(torch, f'_foreach_{op}_' if inplace else f'_foreach_{op}')
+    outputs: list[torch.Tensor] = list(leaves)
+    for group in _foreach_groups(leaves).values():
+        results = foreach(
+            [leaves[i] for i in group],
+            *([o[i] for i in group] for o in other_leaves),
+            **kwargs,
+        )
+        if not inplace:
+            for i, result in safe_zip(group, results):
+                outputs[i] = result
+
+    if inplace:
+        return tree
+    return tree_unflatten(treespec, outputs)
+
+
 def _tree_unravel(
     treespec: PyTreeSpec,
     unravel_flat: Callable[[torch.Tensor], list[torch.Tensor]],
@@ -51,6 +51,8 @@ __all__ = [
     'tree_flatten_with_accessor',
     'tree_unflatten',
     'tree_iter',
+    'tree_iter_zip',
+    'tree_iter_shard',
     'tree_leaves',
     'tree_structure',
     'tree_paths',
@@ -64,6 +66,8 @@ __all__ = [
     'tree_map_with_accessor',
     'tree_map_with_accessor_',
     'tree_replace_nones',
+    'tree_partition',
+    'tree_combine',
     'tree_transpose',
     'tree_transpose_map',
     'tree_transpose_map_with_path',
@@ -103,6 +107,7 @@ __all__ = [
     'treespec_deque',
     'treespec_structseq',
     'treespec_from_collection',
+    'treespec_from_arrays',
     'prefix_errors',
 ]
 
@@ -124,6 +129,7 @@ def tree_flatten(
     *,
     none_is_leaf: bool = False,
     namespace: str = '',
+    assume_unshared: bool = False,
 ) -> tuple[list[T], PyTreeSpec]:
     """Flatten a pytree.
 
@@ -178,12 +184,17 @@ def tree_flatten(
             treespec rather than in the leaves list. (default: :data:`False`)
         namespace (str, optional): The registry namespace used for custom pytree node types.
             (default: :const:`''`, i.e., the global namespace)
+        assume_unshared (bool, optional): Whether the caller guarantees that no other thread
+            accesses the containers in the pytree during the call. If :data:`True`, the per-node
+            critical sections are skipped on free-threaded Python builds. Debug builds raise a
+            :exc:`RuntimeError` if a container is mutated during flattening. This has no effect on
+            builds with the GIL. (default: :data:`False`)
 
     Returns:
         A pair ``(leaves, treespec)`` where the first element is a list of leaf values and the
         second element is a treespec representing the structure of the pytree.
     """
-    return _C.flatten(tree, is_leaf, none_is_leaf, namespace)
+    return _C.flatten(tree, is_leaf, none_is_leaf, namespace, assume_unshared)
 
 
 def tree_flatten_with_path(
@@ -387,6 +398,7 @@ def tree_iter(
     *,
     none_is_leaf: bool = False,
     namespace: str = '',
+    build_treespec: bool = False,
 ) -> Iterable[T]:
     """Get an iterator over the leaves of a pytree.
 
@@ -404,6 +416,16 @@ def tree_iter(
     >>> list(tree_iter(None, none_is_leaf=True))
     [None]
 
+    With ``build_treespec=True``, the iterator records the structure while yielding the leaves, and
+    its ``treespec`` attribute holds the same treespec as :func:`tree_structure` once the iterator
+    is exhausted. This avoids a second traversal when both the leaves and the structure are needed.
+
+    >>> it = tree_iter(tree, build_treespec=True)
+    >>> list(it)
+    [1, 2, 3, 4, 5]
+    >>> it.treespec
+    PyTreeSpec({'a': *, 'b': (*, [*, *]), 'c': None, 'd': *})
+
     Args:
         tree (pytree): A pytree to iterate over.
         is_leaf (callable, optional): An optionally specified function that will be called at each
@@ -415,11 +437,115 @@ def tree_iter(
             treespec rather than in the leaves list. (default: :data:`False`)
         namespace (str, optional): The registry namespace used for custom pytree node types.
             (default: :const:`''`, i.e., the global namespace)
+        build_treespec (bool, optional): Whether to build the treespec while iterating. If
+            :data:`True`, the treespec is available as the ``treespec`` attribute of the iterator
+            after it is exhausted. (default: :data:`False`)
 
     Returns:
         An iterator over the leaf values.
     """
-    return _C.PyTreeIter(tree, is_leaf, none_is_leaf, namespace)
+    return _C.PyTreeIter(tree, is_leaf, none_is_leaf, namespace, build_treespec)
+
+
+def tree_iter_zip(
+    tree: PyTree[T],
+    /,
+    *rests: PyTree[S],
+    is_leaf: Callable[[T], bool] | None = None,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> Iterable[tuple[T, ...]]:
+    """Get an iterator over the corresponding leaves of several pytrees in lockstep.
+
+    The first pytree determines the structure, and each of ``rests`` must have the same structure
+    as ``tree`` or have ``tree`` as its prefix, as in :func:`tree_map`. The nodes are checked on the
+    fly while iterating, and no intermediate leaf lists are built, so the memory usage does not
+    grow with the number of leaves. The iteration is equivalent to
+    ``zip(tree_leaves(tree), *(treespec.flatten_up_to(r) for r in rests))``.
+
+    See also :func:`tree_iter`, :func:`tree_map`, and :meth:`PyTreeSpec.flatten_up_to`.
+
+    >>> params = {'w': 1.0, 'b': (2.0, None)}
+    >>> ema = {'w': 0.5, 'b': (1.5, None)}
+    >>> list(tree_iter_zip(params, ema))
+    [(2.0, 1.5), (1.0, 0.5)]
+    >>> list(tree_iter_zip({'x': 1, 'y': 2}, {'x': [3, 4], 'y': 5}))
+    [(1, [3, 4]), (2, 5)]
+    >>> list(tree_iter_zip([1, 2], [3]))
+    Traceback (most recent call last):
+        ...
+    ValueError: list arity mismatch; expected: 2, got: 1; list: [3].
+
+    Args:
+        tree (pytree): A pytree that determines the structure.
+        *rests (pytree): A tuple of pytrees, each of which has the same structure as ``tree`` or
+            has ``tree`` as a prefix.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step of ``tree``. It should return a boolean, with :data:`True` stopping the
+            traversal and the whole subtree being treated as a leaf, and :data:`False` indicating
+            the flattening should traverse the current object.
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        An iterator over tuples of corresponding leaf values, one per pytree.
+    """
+    return _C.PyTreeZipIter(tree, rests, is_leaf, none_is_leaf, namespace)
+
+
+def tree_iter_shard(
+    tree: PyTree[T],
+    treespec: PyTreeSpec,
+    shard: tuple[int, int, tuple[tuple[tuple[int, ...], PyTreeSpec], ...]],
+) -> Iterable[T]:
+    """Get an iterator over the leaves in a shard of a pytree made by :meth:`PyTreeSpec.partition`.
+
+    Only the subtrees covered by the shard and their ancestors are visited, so the shards of one
+    pytree can be consumed by separate threads without flattening the whole pytree first. The
+    leaves are yielded in the order of ``tree_leaves(tree)[start:stop]``, where ``(start, stop)``
+    is the leaf range of the shard.
+
+    See also :func:`tree_iter` and :meth:`PyTreeSpec.partition`.
+
+    >>> tree = {'a': [1, 2, 3], 'b': (4, 5), 'c': 6}
+    >>> treespec = tree_structure(tree)
+    >>> shards = treespec.partition(2)
+    >>> [shard[:2] for shard in shards]
+    [(0, 3), (3, 6)]
+    >>> [list(tree_iter_shard(tree, treespec, shard)) for shard in shards]
+    [[1, 2, 3], [4, 5, 6]]
+
+    Args:
+        tree (pytree): A pytree with the structure of ``treespec``.
+        treespec (PyTreeSpec): The treespec that made the shard.
+        shard (tuple): A shard returned by :meth:`PyTreeSpec.partition`.
+
+    Returns:
+        An iterator over the leaves in the shard.
+    """
+    _, _, roots = shard
+    # The children of the ancestors of the current subtree root, shared by the consecutive roots.
+    levels: list[list[Any]] = []
+    path: tuple[int, ...] = ()
+    for indices, subtreespec in roots:
+        common = 0
+        while common < min(len(path), len(indices)) and path[common] == indices[common]:
+            common += 1
+        del levels[min(common + 1, len(indices)) :]
+        for depth in range(len(levels), len(indices)):
+            node = levels[depth - 1][indices[depth - 1]] if depth > 0 else tree
+            children, *_ = tree_flatten_one_level(
+                node,
+                none_is_leaf=treespec.none_is_leaf,
+                namespace=treespec.namespace,
+            )
+            levels.append(children)
+        subtree = levels[-1][indices[-1]] if indices else tree
+        path = indices
+        yield from subtreespec.flatten_up_to(subtree)
 
 
 def tree_leaves(
@@ -428,6 +554,7 @@ def tree_leaves(
     *,
     none_is_leaf: bool = False,
     namespace: str = '',
+    assume_unshared: bool = False,
 ) -> list[T]:
     """Get the leaves of a pytree.
 
@@ -456,11 +583,16 @@ def tree_leaves(
             treespec rather than in the leaves list. (default: :data:`False`)
         namespace (str, optional): The registry namespace used for custom pytree node types.
             (default: :const:`''`, i.e., the global namespace)
+        assume_unshared (bool, optional): Whether the caller guarantees that no other thread
+            accesses the containers in the pytree during the call. If :data:`True`, the per-node
+            critical sections are skipped on free-threaded Python builds. Debug builds raise a
+            :exc:`RuntimeError` if a container is mutated during flattening. This has no effect on
+            builds with the GIL. (default: :data:`False`)
 
     Returns:
         A list of leaf values.
     """
-    return _C.flatten(tree, is_leaf, none_is_leaf, namespace)[0]
+    return _C.flatten(tree, is_leaf, none_is_leaf, namespace, assume_unshared)[0]
 
 
 def tree_structure(
@@ -469,6 +601,7 @@ def tree_structure(
     *,
     none_is_leaf: bool = False,
     namespace: str = '',
+    assume_unshared: bool = False,
 ) -> PyTreeSpec:
     """Get the treespec for a pytree.
 
@@ -497,11 +630,16 @@ def tree_structure(
             treespec rather than in the leaves list. (default: :data:`False`)
         namespace (str, optional): The registry namespace used for custom pytree node types.
             (default: :const:`''`, i.e., the global namespace)
+        assume_unshared (bool, optional): Whether the caller guarantees that no other thread
+            accesses the containers in the pytree during the call. If :data:`True`, the per-node
+            critical sections are skipped on free-threaded Python builds. Debug builds raise a
+            :exc:`RuntimeError` if a container is mutated during flattening. This has no effect on
+            builds with the GIL. (default: :data:`False`)
 
     Returns:
         A treespec object representing the structure of the pytree.
     """
-    return _C.flatten(tree, is_leaf, none_is_leaf, namespace)[1]
+    return _C.flatten(tree, is_leaf, none_is_leaf, namespace, assume_unshared)[1]
 
 
 def tree_paths(
@@ -1025,6 +1163,125 @@ def tree_replace_nones(sentinel: Any, tree: PyTree[T] | None, namespace: str = '
     )
 
 
+def tree_partition(
+    tree: PyTree[T],
+    predicate_or_mask_tree: Callable[[T], Any] | PyTree[Any],
+    is_leaf: Callable[[T], bool] | None = None,
+    *,
+    placeholder: Any = None,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> tuple[PyTree[T], PyTree[T]]:
+    """Partition the leaves of a pytree into two pytrees with the same structure.
+
+    See also :func:`tree_combine`, :func:`tree_map`, and :func:`tree_broadcast_prefix`.
+
+    The leaves selected by ``predicate_or_mask_tree`` go to the first pytree and the other leaves
+    go to the second pytree. The vacated positions are filled with ``placeholder``. Both pytrees are
+    built in a single traversal of ``tree``.
+
+    >>> tree = {'a': 1, 'b': 2.0, 'c': (3, 4.0)}
+    >>> tree_partition(tree, lambda x: isinstance(x, int))
+    ({'a': 1, 'b': None, 'c': (3, None)}, {'a': None, 'b': 2.0, 'c': (None, 4.0)})
+    >>> tree_partition(tree, {'a': True, 'b': False, 'c': True})
+    ({'a': 1, 'b': None, 'c': (3, 4.0)}, {'a': None, 'b': 2.0, 'c': (None, None)})
+    >>> hole = object()
+    >>> mask = {'a': True, 'b': False, 'c': lambda x: x > 3}
+    >>> first, second = tree_partition(tree, mask, placeholder=hole)
+    >>> first['b'] is hole, first['c'][0] is hole, second['a'] is hole, second['c'][1] is hole
+    (True, True, True, True)
+    >>> tree_combine(first, second, placeholder=hole)
+    {'a': 1, 'b': 2.0, 'c': (3, 4.0)}
+
+    Args:
+        tree (pytree): A pytree to be partitioned.
+        predicate_or_mask_tree (callable or pytree): A function that takes a leaf and returns a
+            boolean, or a mask tree with the prefix structure of ``tree``. Each leaf of the mask
+            tree is either a boolean value or a function, which is broadcast to all leaves in the
+            corresponding subtree of ``tree``.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        placeholder (object, optional): The object to fill in the vacated positions. Since
+            :func:`tree_combine` matches the placeholder by identity, use a unique sentinel (e.g.,
+            ``object()``) rather than a value that may also be a leaf. (default: :data:`None`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pair of pytrees with the same structure as ``tree``. The first contains the selected
+        leaves and the second contains the remaining leaves.
+    """
+    return _C.partition(
+        tree,
+        predicate_or_mask_tree,
+        placeholder,
+        is_leaf,
+        none_is_leaf,
+        namespace,
+    )
+
+
+def tree_combine(
+    tree: PyTree[T],
+    *rests: PyTree[T],
+    is_leaf: Callable[[T], bool] | None = None,
+    placeholder: Any = None,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> PyTree[T]:
+    """Combine pytrees with the same structure into one by filling in the placeholders.
+
+    See also :func:`tree_partition` and :func:`tree_replace_nones`.
+
+    Each leaf of the result is the first leaf among the input pytrees at the same position that is
+    not ``placeholder``. If all leaves at a position are ``placeholder``, the result is
+    ``placeholder``. When ``placeholder`` is :data:`None`, :data:`None` values are treated as leaves
+    regardless of ``none_is_leaf``.
+
+    >>> tree_combine({'a': 1, 'b': None, 'c': (3, None)}, {'a': None, 'b': 2.0, 'c': (None, 4.0)})
+    {'a': 1, 'b': 2.0, 'c': (3, 4.0)}
+    >>> tree_combine(*tree_partition({'a': 1, 'b': (2, None)}, lambda x: x > 1))
+    {'a': 1, 'b': (2, None)}
+    >>> hole = object()
+    >>> tree_combine([1, hole, hole], [hole, 2, hole], [hole, 5, 3], placeholder=hole)
+    [1, 2, 3]
+
+    Args:
+        tree (pytree): A pytree to be combined.
+        *rests (pytree): Additional pytrees with the same structure as ``tree``.
+        is_leaf (callable, optional): An optionally specified function that will be called at each
+            flattening step. It should return a boolean, with :data:`True` stopping the traversal
+            and the whole subtree being treated as a leaf, and :data:`False` indicating the
+            flattening should traverse the current object.
+        placeholder (object, optional): The object that marks the vacated positions. It is
+            matched by identity (``leaf is placeholder``), not by equality, so equal but distinct
+            objects (e.g., ``0.0`` or a large :class:`int`) are not treated as placeholders.
+            (default: :data:`None`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A pytree with the same structure as ``tree`` with the placeholders filled in.
+    """
+    return _C.combine(
+        (tree, *rests),
+        placeholder,
+        is_leaf,
+        none_is_leaf,
+        namespace,
+    )
+
+
 def tree_transpose(
     outer_treespec: PyTreeSpec,
     inner_treespec: PyTreeSpec,
@@ -1613,39 +1870,7 @@ def tree_broadcast_common(
     Returns:
         Two pytrees of common suffix structure of ``tree`` and ``other_tree`` with broadcasted subtrees.
     """
-    leaves, treespec = _C.flatten(tree, is_leaf, none_is_leaf, namespace)
-    other_leaves, other_treespec = _C.flatten(other_tree, is_leaf, none_is_leaf, namespace)
-    common_suffix_treespec = treespec.broadcast_to_common_suffix(other_treespec)
-
-    sentinel: T = object()  # type: ignore[assignment]
-    common_suffix_tree: PyTree[T] = common_suffix_treespec.unflatten(
-        itertools.repeat(sentinel, common_suffix_treespec.num_leaves),
-    )
-
-    def broadcast_leaves(x: T, subtree: PyTree[T]) -> PyTree[T]:
-        subtreespec = tree_structure(
-            subtree,
-            is_leaf=is_leaf,
-            none_is_leaf=none_is_leaf,
-            namespace=namespace,
-        )
-        return subtreespec.unflatten(itertools.repeat(x, subtreespec.num_leaves))
-
-    broadcasted_tree: PyTree[T] = treespec.unflatten(
-        map(
-            broadcast_leaves,  # type: ignore[arg-type]
-            leaves,
-            treespec.flatten_up_to(common_suffix_tree),
-        ),
-    )
-    other_broadcasted_tree: PyTree[T] = other_treespec.unflatten(
-        map(
-            broadcast_leaves,  # type: ignore[arg-type]
-            other_leaves,
-            other_treespec.flatten_up_to(common_suffix_tree),
-        ),
-    )
-    return broadcasted_tree, other_broadcasted_tree
+    return _C.broadcast_common_trees(tree, other_tree, is_leaf, none_is_leaf, namespace)
 
 
 def broadcast_common(
@@ -1705,30 +1930,7 @@ def broadcast_common(
         Two lists of leaves in ``tree`` and ``other_tree`` broadcasted to match the number of leaves
         in the common suffix structure.
     """  # pylint: disable=line-too-long
-    broadcasted_tree, other_broadcasted_tree = tree_broadcast_common(
-        tree,
-        other_tree,
-        is_leaf=is_leaf,
-        none_is_leaf=none_is_leaf,
-        namespace=namespace,
-    )
-
-    broadcasted_leaves: list[T] = []
-    other_broadcasted_leaves: list[T] = []
-
-    def add_leaves(x: T, y: T) -> None:
-        broadcasted_leaves.append(x)
-        other_broadcasted_leaves.append(y)
-
-    tree_map_(
-        add_leaves,
-        broadcasted_tree,
-        other_broadcasted_tree,
-        is_leaf=is_leaf,
-        none_is_leaf=none_is_leaf,
-        namespace=namespace,
-    )
-    return broadcasted_leaves, other_broadcasted_leaves
+    return _C.broadcast_common(tree, other_tree, is_leaf, none_is_leaf, namespace)
 
 
 def _tree_broadcast_common(
@@ -3174,6 +3376,63 @@ def treespec_from_collection(
     return _C.make_from_collection(collection, none_is_leaf, namespace)
 
 
+def treespec_from_arrays(
+    kinds: Iterable[int],
+    arities: Iterable[int],
+    node_data: dict[int, Any] | None = None,
+    *,
+    none_is_leaf: bool = False,
+    namespace: str = '',
+) -> PyTreeSpec:
+    """Make a treespec from the node kinds and arities of a post-order traversal.
+
+    This is the inverse of :meth:`PyTreeSpec.traversal_arrays`. The arrays can be any objects
+    supporting the buffer protocol with a native integer format (e.g., :class:`numpy.ndarray` and
+    :class:`memoryview`) or iterables of integers. The post-order invariants are validated and the
+    numbers of leaves and nodes of all subtrees are computed in a single pass.
+
+    See also :func:`treespec_from_collection` and :meth:`PyTreeSpec.traversal_arrays`.
+
+    >>> treespec_from_arrays([1, 1, 2, 3], [0, 0, 0, 3])
+    PyTreeSpec((*, *, None))
+    >>> treespec_from_arrays([1, 1, 5], [0, 0, 2], {2: ['a', 'b']})
+    PyTreeSpec({'a': *, 'b': *})
+    >>> kinds, arities, num_leaves, num_nodes = tree_structure(([1, 2], None)).traversal_arrays()
+    >>> treespec_from_arrays(kinds, arities)
+    PyTreeSpec(([*, *], None))
+    >>> treespec_from_arrays([1, 1], [0, 0])
+    Traceback (most recent call last):
+        ...
+    ValueError: Expected the post-order traversal to form a single tree, got 2 disconnected subtrees.
+
+    Args:
+        kinds (iterable of int): The :class:`PyTreeKind` values of the nodes in post-order.
+        arities (iterable of int): The numbers of children of the nodes in post-order.
+        node_data (dict of int to object, optional): A table that maps node indices to the node
+            metadata. Nodes of tuples, lists, leaves, and :data:`None` take no metadata. The
+            metadata of the other node kinds are:
+
+            - ``dict`` and ``OrderedDict``: the keys in the order of the children. Keys of a
+              ``dict`` must be sorted unless the namespace preserves the insertion order.
+            - ``defaultdict``: a pair ``(default_factory, keys)``.
+            - ``namedtuple`` and ``PyStructSequence``: the type.
+            - ``deque``: the ``maxlen`` (default to :data:`None`).
+            - custom nodes: a tuple ``(type, metadata)`` or ``(type, metadata, entries)``.
+
+            (default: :data:`None`)
+        none_is_leaf (bool, optional): Whether to treat :data:`None` as a leaf. If :data:`False`,
+            :data:`None` is a non-leaf node with arity 0. Thus :data:`None` is contained in the
+            treespec rather than in the leaves list and :data:`None` will be remain in the result
+            pytree. (default: :data:`False`)
+        namespace (str, optional): The registry namespace used for custom pytree node types.
+            (default: :const:`''`, i.e., the global namespace)
+
+    Returns:
+        A treespec with the given post-order traversal.
+    """
+    return _C.make_from_arrays(kinds, arities, node_data, none_is_leaf, namespace)
+
+
 def prefix_errors(
     prefix_tree: PyTree[T],
     full_tree: PyTree[S],
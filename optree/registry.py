@@ -34,6 +34,8 @@ from typing import (
     Generator,
     Generic,
     Iterable,
+    Literal,
+    Mapping,
     NamedTuple,
     Sequence,
     Type,
@@ -57,6 +59,7 @@ from optree.typing import (
     VT,
     CustomTreeNode,
     FlattenFunc,
+    MetaData,
     T,
     UnflattenFunc,
     is_namedtuple_class,
@@ -94,6 +97,8 @@ class PyTreeNodeRegistryEntry(Generic[T]):
 
     path_entry_type: builtins.type[PyTreeEntry] = AutoEntry
     namespace: str = ''
+    kind: Literal['sequence', 'mapping'] | None = None
+    metadata_key: Callable[[MetaData], Any] | bool | None = None
 
 
 del SLOTS
@@ -148,7 +153,7 @@ def _pytree_node_registry_get(
     if namespace is not __GLOBAL_NAMESPACE and namespace != '':
         handler = _NODETYPE_REGISTRY.get((namespace, cls))
         if handler is not None:
-            return handler
+            return _mapping_insertion_ordered_entry(handler, namespace)
 
     if _C.is_dict_insertion_ordered(namespace):
         if cls is dict:
@@ -168,7 +173,7 @@ def _pytree_node_registry_get(
 
     handler = _NODETYPE_REGISTRY.get(cls)
     if handler is not None:
-        return handler
+        return _mapping_insertion_ordered_entry(handler, namespace)
     if is_structseq_class(cls):
         return _NODETYPE_REGISTRY.get(structseq)
     if is_namedtuple_class(cls):
@@ -176,13 +181,43 @@ def _pytree_node_registry_get(
     return None
 
 
+# Derived entries of the mapping nodes for the insertion-ordered namespaces, keyed by the
+# registration. The source entry is stored alongside to detect a re-registration.
+_MAPPING_INSERTION_ORDERED_ENTRIES: dict[
+    tuple[type, str],
+    tuple[PyTreeNodeRegistryEntry, PyTreeNodeRegistryEntry],
+] = {}
+
+
+def _mapping_insertion_ordered_entry(
+    handler: PyTreeNodeRegistryEntry,
+    namespace: str,
+) -> PyTreeNodeRegistryEntry:
+    # Mapping nodes follow the key order of the namespace like the C++ side does.
+    if handler.kind != 'mapping' or not _C.is_dict_insertion_ordered(namespace):
+        return handler
+
+    key = (handler.type, handler.namespace)
+    cached = _MAPPING_INSERTION_ORDERED_ENTRIES.get(key)
+    if cached is not None and cached[0] is handler:
+        return cached[1]
+    entry = dataclasses.replace(
+        handler,
+        flatten_func=_mapping_insertion_ordered_flatten,  # type: ignore[arg-type]
+    )
+    _MAPPING_INSERTION_ORDERED_ENTRIES[key] = (handler, entry)
+    return entry
+
+
 @_add_get(_pytree_node_registry_get)
-def register_pytree_node(
+def register_pytree_node(  # noqa: C901
     cls: type[Collection[T]],
-    flatten_func: FlattenFunc[T],
-    unflatten_func: UnflattenFunc[T],
+    flatten_func: FlattenFunc[T] | None = None,
+    unflatten_func: UnflattenFunc[T] | None = None,
     *,
+    kind: Literal['sequence', 'mapping'] | None = None,
     path_entry_type: type[PyTreeEntry] = AutoEntry,
+    metadata_key: Callable[[MetaData], Any] | bool | None = None,
     namespace: str,
 ) -> type[Collection[T]]:
     """Extend the set of types that are considered internal nodes in pytrees.
@@ -199,19 +234,36 @@ def register_pytree_node(
         used to isolate the behavior of flattening and unflattening a pytree node type. This is to
         prevent accidental collisions between different libraries that may register the same type.
 
+    Instead of the flatten/unflatten functions, a sequence-like or mapping-like type can be
+    registered declaratively with ``kind='sequence'`` or ``kind='mapping'``. The children are then
+    read through the sequence or mapping protocol in C++ (with the keys sorted as for :class:`dict`)
+    and the node is rebuilt by ``cls(children)`` or ``cls(dict(zip(keys, children)))``. No Python
+    function is called per node during flattening and unflattening.
+
+    The metadata of custom nodes is not hashed by default since it may be unhashable, so treespecs
+    that differ only in the metadata share the same hash value. Pass ``metadata_key=True`` if the
+    metadata is hashable, or a function mapping the metadata to a hashable key, to include it in the
+    hash value of the treespecs. Equal metadata must have equal keys.
+
     Args:
         cls (type): A Python type to treat as an internal pytree node.
-        flatten_func (callable): A function to be used during flattening, taking an instance of ``cls``
+        flatten_func (callable, optional): A function to be used during flattening, taking an instance of ``cls``
             and returning a triple or optionally a pair, with (1) an iterable for the children to be
             flattened recursively, and (2) some hashable metadata to be stored in the treespec and
             to be passed to the ``unflatten_func``, and (3) (optional) an iterable for the tree path
             entries to the corresponding children. If the entries are not provided or given by
             :data:`None`, then `range(len(children))` will be used.
-        unflatten_func (callable): A function taking two arguments: the metadata that was returned
-            by ``flatten_func`` and stored in the treespec, and the unflattened children. The
-            function should return an instance of ``cls``.
+        unflatten_func (callable, optional): A function taking two arguments: the metadata that was
+            returned by ``flatten_func`` and stored in the treespec, and the unflattened children.
+            The function should return an instance of ``cls``.
+        kind (str, optional): Register the type declaratively with the ``'sequence'`` or
+            ``'mapping'`` protocol. If specified, ``flatten_func`` and ``unflatten_func`` must be
+            omitted. (default: :data:`None`)
         path_entry_type (type, optional): The type of the path entry to be used in the treespec.
             (default: :class:`AutoEntry`)
+        metadata_key (callable or bool, optional): A function mapping the metadata to a hashable
+            key, or :data:`True` if the metadata is hashable itself. The key is included in the hash
+            value of the treespecs. (default: :data:`None`, i.e., the metadata is not hashed)
         namespace (str): A non-empty string that uniquely identifies the namespace of the type registry.
             This is used to isolate the registry from other modules that might register a different
             custom behavior for the same type.
@@ -221,7 +273,10 @@ def register_pytree_node(
 
     Raises:
         TypeError: If the input type is not a class.
+        TypeError: If the flatten/unflatten functions are missing and ``kind`` is not specified.
+        ValueError: If ``kind`` is invalid or specified together with the flatten/unflatten functions.
         TypeError: If the path entry class is not a subclass of :class:`PyTreeEntry`.
+        TypeError: If the metadata key is not :data:`None`, a boolean, or a callable.
         TypeError: If the namespace is not a string.
         ValueError: If the namespace is an empty string.
         ValueError: If the type is already registered in the registry.
@@ -236,6 +291,15 @@ def register_pytree_node(
         ... )
         <class 'set'>
 
+        >>> # Register a sequence-like type declaratively
+        >>> from collections import UserList
+        >>> class MyList(UserList):
+        ...     pass
+        >>> register_pytree_node(MyList, kind='sequence', namespace='mylist')
+        <class '...MyList'>
+        >>> tree_flatten(MyList([1, (2, 3)]), namespace='mylist')
+        ([1, 2, 3], PyTreeSpec(CustomTreeNode(MyList[None], [*, (*, *)]), namespace='mylist'))
+
         >>> # Register a Python type into a namespace
         >>> import torch
         >>> register_pytree_node(
@@ -306,10 +370,36 @@ def register_pytree_node(
         raise TypeError(f'Expected a class, got {cls!r}.')
     if not (inspect.isclass(path_entry_type) and issubclass(path_entry_type, PyTreeEntry)):
         raise TypeError(f'Expected a subclass of PyTreeEntry, got {path_entry_type!r}.')
+    if metadata_key is False:
+        metadata_key = None
+    if not (metadata_key is None or metadata_key is True or callable(metadata_key)):
+        raise TypeError(
+            f'Expected the metadata key to be None, a boolean, or a callable, got {metadata_key!r}.',
+        )
     if namespace is not __GLOBAL_NAMESPACE and not isinstance(namespace, str):
         raise TypeError(f'The namespace must be a string, got {namespace!r}.')
     if namespace == '':
         raise ValueError('The namespace cannot be an empty string.')
+    if kind is None:
+        if flatten_func is None or unflatten_func is None:
+            raise TypeError(
+                'Must specify `flatten_func` and `unflatten_func` when `kind` is not specified.',
+            )
+    elif kind in {'sequence', 'mapping'}:
+        if flatten_func is not None or unflatten_func is not None:
+            raise ValueError(
+                f'Cannot specify `flatten_func` or `unflatten_func` with `kind={kind!r}`.',
+            )
+        # The Python functions are only used by the Python side (e.g., `tree_flatten_one_level`).
+        # The C++ side reads the children through the sequence or mapping protocol directly.
+        if kind == 'sequence':
+            flatten_func = _sequence_flatten  # type: ignore[assignment]
+            unflatten_func = functools.partial(_sequence_unflatten, cls)  # type: ignore[assignment]
+        else:
+            flatten_func = _mapping_flatten  # type: ignore[assignment]
+            unflatten_func = functools.partial(_mapping_unflatten, cls)  # type: ignore[assignment]
+    else:
+        raise ValueError(f"Expected `kind` to be one of 'sequence' and 'mapping', got {kind!r}.")
 
     registration_key: type | tuple[str, type]
     if namespace is __GLOBAL_NAMESPACE:
@@ -325,13 +415,18 @@ def register_pytree_node(
             unflatten_func,
             path_entry_type,
             namespace,
+            kind or '',
+            metadata_key,
         )
+        _MAPPING_INSERTION_ORDERED_ENTRIES.pop((cls, namespace), None)
         _NODETYPE_REGISTRY[registration_key] = PyTreeNodeRegistryEntry(
             cls,
-            flatten_func,
-            unflatten_func,
+            flatten_func,  # type: ignore[arg-type]
+            unflatten_func,  # type: ignore[arg-type]
             path_entry_type=path_entry_type,
             namespace=namespace,
+            kind=kind,
+            metadata_key=metadata_key,
         )
     return cls
 
@@ -346,7 +441,9 @@ CustomTreeNodeType: TypeAlias = Type[CustomTreeNode[T]]
 def register_pytree_node_class(
     cls: str | None = None,
     *,
+    kind: Literal['sequence', 'mapping'] | None = None,
     path_entry_type: type[PyTreeEntry] | None = None,
+    metadata_key: Callable[[MetaData], Any] | bool | None = None,
     namespace: str | None = None,
 ) -> Callable[[CustomTreeNodeType], CustomTreeNodeType]: ...
 
@@ -355,7 +452,9 @@ def register_pytree_node_class(
 def register_pytree_node_class(
     cls: CustomTreeNodeType,
     *,
+    kind: Literal['sequence', 'mapping'] | None = None,
     path_entry_type: type[PyTreeEntry] | None,
+    metadata_key: Callable[[MetaData], Any] | bool | None = None,
     namespace: str,
 ) -> CustomTreeNodeType: ...
 
@@ -363,7 +462,9 @@ def register_pytree_node_class(
 def register_pytree_node_class(  # noqa: C901
     cls: CustomTreeNodeType | str | None = None,
     *,
+    kind: Literal['sequence', 'mapping'] | None = None,
     path_entry_type: type[PyTreeEntry] | None = None,
+    metadata_key: Callable[[MetaData], Any] | bool | None = None,
     namespace: str | None = None,
 ) -> CustomTreeNodeType | Callable[[CustomTreeNodeType], CustomTreeNodeType]:
     """Extend the set of types that are considered internal nodes in pytrees.
@@ -382,8 +483,14 @@ def register_pytree_node_class(  # noqa: C901
 
     Args:
         cls (type, optional): A Python type to treat as an internal pytree node.
+        kind (str, optional): Register the class declaratively with the ``'sequence'`` or
+            ``'mapping'`` protocol instead of its ``tree_flatten`` and ``tree_unflatten`` methods.
+            See :func:`register_pytree_node` for more details. (default: :data:`None`)
         path_entry_type (type, optional): The type of the path entry to be used in the treespec.
             (default: :class:`AutoEntry`)
+        metadata_key (callable or bool, optional): A function mapping the metadata to a hashable
+            key, or :data:`True` if the metadata is hashable itself. See
+            :func:`register_pytree_node` for more details. (default: :data:`None`)
         namespace (str, optional): A non-empty string that uniquely identifies the namespace of the
             type registry. This is used to isolate the registry from other modules that might
             register a different custom behavior for the same type.
@@ -426,6 +533,10 @@ def register_pytree_node_class(  # noqa: C901
             @classmethod
             def tree_unflatten(cls, metadata, children):
                 return cls(*children)
+
+        @register_pytree_node_class('mydict', kind='mapping')
+        class MyDict(UserDict):
+            pass
     """
     if cls is __GLOBAL_NAMESPACE or isinstance(cls, str):
         if namespace is not None:
@@ -434,7 +545,9 @@ def register_pytree_node_class(  # noqa: C901
             raise ValueError('The namespace cannot be an empty string.')
         return functools.partial(
             register_pytree_node_class,
+            kind=kind,
             path_entry_type=path_entry_type,
+            metadata_key=metadata_key,
             namespace=cls,
         )  # type: ignore[return-value]
 
@@ -448,7 +561,9 @@ def register_pytree_node_class(  # noqa: C901
     if cls is None:
         return functools.partial(
             register_pytree_node_class,
+            kind=kind,
             path_entry_type=path_entry_type,
+            metadata_key=metadata_key,
             namespace=namespace,
         )  # type: ignore[return-value]
     if not inspect.isclass(cls):
@@ -457,13 +572,23 @@ def register_pytree_node_class(  # noqa: C901
         path_entry_type = getattr(cls, 'TREE_PATH_ENTRY_TYPE', AutoEntry)
     if not (inspect.isclass(path_entry_type) and issubclass(path_entry_type, PyTreeEntry)):
         raise TypeError(f'Expected a subclass of PyTreeEntry, got {path_entry_type!r}.')
-    register_pytree_node(
-        cls,
-        methodcaller('tree_flatten'),
-        cls.tree_unflatten,
-        path_entry_type=path_entry_type,
-        namespace=namespace,
-    )
+    if kind is not None:
+        register_pytree_node(
+            cls,
+            kind=kind,
+            path_entry_type=path_entry_type,
+            metadata_key=metadata_key,
+            namespace=namespace,
+        )
+    else:
+        register_pytree_node(
+            cls,
+            methodcaller('tree_flatten'),
+            cls.tree_unflatten,
+            path_entry_type=path_entry_type,
+            metadata_key=metadata_key,
+            namespace=namespace,
+        )
     return cls
 
 
@@ -517,6 +642,7 @@ def unregister_pytree_node(cls: type, *, namespace: str) -> PyTreeNodeRegistryEn
 
     with __REGISTRY_LOCK:
         _C.unregister_node(cls, namespace)
+        _MAPPING_INSERTION_ORDERED_ENTRIES.pop((cls, namespace), None)
         return _NODETYPE_REGISTRY.pop(registration_key)
 
 
@@ -659,6 +785,40 @@ def _defaultdict_insertion_ordered_unflatten(
     return defaultdict(default_factory, _dict_insertion_ordered_unflatten(keys, values))
 
 
+def _sequence_flatten(seq: Sequence[T]) -> tuple[tuple[T, ...], None]:
+    return tuple(seq), None
+
+
+def _sequence_unflatten(
+    cls: type[Sequence[T]],
+    _: None,
+    children: Iterable[T],
+) -> Sequence[T]:
+    return cls(tuple(children))  # type: ignore[call-arg]
+
+
+def _mapping_flatten(
+    mapping: Mapping[KT, VT],
+) -> tuple[tuple[VT, ...], tuple[KT, ...], tuple[KT, ...]]:
+    keys, values = unzip2(_sorted_items(mapping.items()))
+    return values, keys, keys
+
+
+def _mapping_insertion_ordered_flatten(
+    mapping: Mapping[KT, VT],
+) -> tuple[tuple[VT, ...], tuple[KT, ...], tuple[KT, ...]]:
+    keys, values = unzip2(mapping.items())
+    return values, keys, keys
+
+
+def _mapping_unflatten(
+    cls: type[Mapping[KT, VT]],
+    keys: tuple[KT, ...],
+    values: Iterable[VT],
+) -> Mapping[KT, VT]:
+    return cls(dict(safe_zip(keys, values)))  # type: ignore[call-arg]
+
+
 def _deque_flatten(deq: deque[T]) -> tuple[deque[T], int | None]:
     return deq, deq.maxlen
 
@@ -52,7 +52,7 @@ from typing_extensions import TypeAlias  # Python 3.10+
 from typing_extensions import runtime_checkable  # Python 3.8+
 
 from optree import _C
-from optree._C import PyTreeKind, PyTreeSpec
+from optree._C import PyTreeKind, PyTreeSchema, PyTreeSpec
 from optree.accessor import (
     AutoEntry,
     DataclassEntry,
@@ -70,6 +70,7 @@ from optree.accessor import (
 
 __all__ = [
     'PyTreeSpec',
+    'PyTreeSchema',
     'PyTreeDef',
     'PyTreeKind',
     'PyTree',
@@ -63,7 +63,9 @@ void BuildModule(py::module_& mod) {  // NOLINT[runtime/references]
             py::arg("flatten_func"),
             py::arg("unflatten_func"),
             py::arg("path_entry_type"),
-            py::arg("namespace") = "")
+            py::arg("namespace") = "",
+            py::arg("kind") = "",
+            py::arg("metadata_key") = py::none())
         .def("unregister_node",
              &PyTreeTypeRegistry::Unregister,
              "Unregister a Python type.",
@@ -85,7 +87,8 @@ void BuildModule(py::module_& mod) {  // NOLINT[runtime/references]
              py::arg("tree"),
              py::arg("leaf_predicate") = std::nullopt,
              py::arg("none_is_leaf") = false,
-             py::arg("namespace") = "")
+             py::arg("namespace") = "",
+             py::arg("assume_unshared") = false)
         .def("flatten_with_path",
              &PyTreeSpec::FlattenWithPath,
              "Flatten a pytree and additionally record the paths.",
@@ -107,6 +110,52 @@ void BuildModule(py::module_& mod) {  // NOLINT[runtime/references]
              py::arg("leaf_predicate") = std::nullopt,
              py::arg("none_is_leaf") = false,
              py::arg("namespace") = "")
+        .def("partition",
+             &TreePartition,
+             "Partition the leaves of a pytree into two pytrees with placeholders.",
+             py::arg("tree"),
+             py::arg("predicate_or_mask_tree"),
+             py::arg("placeholder") = py::none(),
+             py::arg("leaf_predicate") = std::nullopt,
+             py::arg("none_is_leaf") = false,
+             py::arg("namespace") = "")
+        .def("combine",
+             &TreeCombine,
+             "Combine pytrees by taking the first leaf that is not the placeholder.",
+             py::arg("trees"),
+             py::arg("placeholder") = py::none(),
+             py::arg("leaf_predicate") = std::nullopt,
+             py::arg("none_is_leaf") = false,
+             py::arg("namespace") = "")
+        .def("broadcast_common_trees",
+             &TreeBroadcastCommon,
+             "Broadcast two pytrees to their common suffix structure.",
+             py::arg("tree"),
+             py::arg("other_tree"),
+             py::arg("leaf_predicate") = std::nullopt,
+             py::arg("none_is_leaf") = false,
+             py::arg("namespace") = "")
+        .def("broadcast_common",
+             &BroadcastCommon,
+             "Broadcast the leaves of two pytrees to their common suffix structure.",
+             py::arg("tree"),
+             py::arg("other_tree"),
+             py::arg("leaf_predicate") = std::nullopt,
+             py::arg("none_is_leaf") = false,
+             py::arg("namespace") = "")
+        .def("ravel_scalars",
+             &TreeRavelScalars,
+             "Ravel the exact scalar leaves of a pytree into a contiguous buffer.",
+             py::arg("tree"),
+             py::arg("leaf_predicate") = std::nullopt,
+             py::arg("none_is_leaf") = false,
+             py::arg("namespace") = "")
+        .def("unravel_scalars",
+             &TreeUnravelScalars,
+             "Rebuild a pytree of Python scalars from a contiguous buffer.",
+             py::arg("treespec"),
+             py::arg("flat"),
+             py::arg("kinds"))
         .def("make_leaf",
              &PyTreeSpec::MakeLeaf,
              "Make a treespec representing a leaf node.",
@@ -123,6 +172,14 @@ void BuildModule(py::module_& mod) {  // NOLINT[runtime/references]
              py::arg("tuple"),
              py::arg("none_is_leaf") = false,
              py::arg("namespace") = "")
+        .def("make_from_arrays",
+             &PyTreeSpec::FromArrays,
+             "Make a treespec from the node kinds and arities of a post-order traversal.",
+             py::arg("kinds"),
+             py::arg("arities"),
+             py::arg("node_data") = std::nullopt,
+             py::arg("none_is_leaf") = false,
+             py::arg("namespace") = "")
         .def("is_namedtuple",
              &IsNamedTuple,
              "Return whether the object is an instance of namedtuple or a subclass of namedtuple.",
@@ -195,11 +252,21 @@ void BuildModule(py::module_& mod) {  // NOLINT[runtime/references]
              &PyTreeSpec::Unflatten,
              "Reconstruct a pytree from the leaves.",
              py::arg("leaves"))
+        .def("unflatten_lazy",
+             &PyTreeSpec::UnflattenLazy,
+             "Reconstruct a lazy view of the pytree from the leaves. "
+             "The containers are built only for the subtrees that are accessed.",
+             py::arg("leaves"))
         .def("flatten_up_to",
              &PyTreeSpec::FlattenUpTo,
              "Flatten the subtrees in ``full_tree`` up to the structure of this treespec "
              "and return a list of subtrees.",
-             py::arg("full_tree"))
+             py::arg("full_tree"),
+             py::arg("assume_unshared") = false)
+        .def("traversal_arrays",
+             &PyTreeSpec::TraversalArrays,
+             "Return read-only buffers of the kinds, arities, numbers of leaves, and numbers of "
+             "nodes of the nodes in post-order.")
         .def("broadcast_to_common_suffix",
              &PyTreeSpec::BroadcastToCommonSuffix,
              "Broadcast to the common suffix of this treespec and other treespec.",
@@ -216,6 +283,21 @@ void BuildModule(py::module_& mod) {  // NOLINT[runtime/references]
              py::arg("f_leaf"),
              py::arg("leaves"))
         .def("paths", &PyTreeSpec::Paths, "Return a list of paths to the leaves of the treespec.")
+        .def("path_strings",
+             &PyTreeSpec::PathStrings,
+             "Return the paths to the leaves of the treespec rendered as strings.",
+             py::arg("separator") = ".",
+             py::arg("style") = "plain")
+        .def("select",
+             &PyTreeSpec::Select,
+             "Return the sorted indices and a boolean mask tree of the leaves matching the glob "
+             "pattern.",
+             py::arg("pattern"))
+        .def("partition",
+             &PyTreeSpec::Partition,
+             "Split the leaves into ``n`` balanced shards aligned to subtree boundaries.",
+             py::arg("n"),
+             py::arg("balance") = "leaves")
         .def("accessors",
              &PyTreeSpec::Accessors,
              "Return a list of accessors to the leaves in the treespec.")
@@ -226,6 +308,22 @@ void BuildModule(py::module_& mod) {  // NOLINT[runtime/references]
              &PyTreeSpec::Child,
              "Return the treespec for the child at the given index.",
              py::arg("index"))
+        .def("leaf_index",
+             &PyTreeSpec::LeafIndex,
+             "Return the index of the leaf at the given path.",
+             py::arg("path"))
+        .def("with_annotations",
+             &PyTreeSpec::WithAnnotations,
+             "Return a new treespec with the given per-leaf annotation columns added or replaced.",
+             py::arg("annotations"))
+        .def("annotations",
+             &PyTreeSpec::GetAnnotations,
+             "Return a dictionary of the per-leaf annotation columns.")
+        .def("annotation",
+             &PyTreeSpec::GetAnnotation,
+             "Return the annotation of the leaf given by its index or its path.",
+             py::arg("name"),
+             py::arg("leaf"))
         .def_property_readonly("num_leaves",
                                &PyTreeSpec::GetNumLeaves,
                                "Number of leaves in the tree.")
@@ -323,22 +421,175 @@ void BuildModule(py::module_& mod) {  // NOLINT[runtime/references]
     py::setattr(PyTreeIterTypeObject.ptr(), Py_Get_ID(__module__), Py_Get_ID(optree));
 
     PyTreeIterTypeObject
-        .def(py::init<py::object, std::optional<py::function>, bool, std::string>(),
+        .def(py::init<py::object, std::optional<py::function>, bool, std::string, bool>(),
              "Create a new iterator over the leaves of a pytree.",
              py::arg("tree"),
              py::arg("leaf_predicate") = std::nullopt,
              py::arg("none_is_leaf") = false,
-             py::arg("namespace") = "")
+             py::arg("namespace") = "",
+             py::arg("build_treespec") = false)
         .def("__iter__", &PyTreeIter::Iter, "Return the iterator object itself.")
-        .def("__next__", &PyTreeIter::Next, "Return the next leaf in the pytree.");
+        .def("__next__", &PyTreeIter::Next, "Return the next leaf in the pytree.")
+        .def_property_readonly("treespec",
+                               &PyTreeIter::GetTreeSpec,
+                               "The treespec built while iterating. Only available after the "
+                               "iterator is exhausted.");
+
+    auto PyTreeZipIterTypeObject = py::class_<PyTreeZipIter>(
+        mod,
+        "PyTreeZipIter",
+        "Iterator over the leaves of several pytrees in lockstep.",
+        // NOLINTBEGIN[readability-function-cognitive-complexity,cppcoreguidelines-avoid-do-while]
+        py::custom_type_setup([](PyHeapTypeObject* heap_type) -> void {
+            auto* const type = &heap_type->ht_type;
+            type->tp_flags |= Py_TPFLAGS_HAVE_GC;
+            type->tp_traverse = &PyTreeZipIter::PyTpTraverse;
+        }),
+        // NOLINTEND[readability-function-cognitive-complexity,cppcoreguidelines-avoid-do-while]
+        py::module_local());
+    auto* const PyTreeZipIter_Type =
+        reinterpret_cast<PyTypeObject*>(PyTreeZipIterTypeObject.ptr());
+    PyTreeZipIter_Type->tp_name = "optree.PyTreeZipIter";
+    py::setattr(PyTreeZipIterTypeObject.ptr(), Py_Get_ID(__module__), Py_Get_ID(optree));
+
+    PyTreeZipIterTypeObject
+        .def(py::init<py::object, py::tuple, std::optional<py::function>, bool, std::string>(),
+             "Create a new iterator over the leaves of several pytrees in lockstep.",
+             py::arg("tree"),
+             py::arg("rests") = py::tuple{},
+             py::arg("leaf_predicate") = std::nullopt,
+             py::arg("none_is_leaf") = false,
+             py::arg("namespace") = "")
+        .def("__iter__", &PyTreeZipIter::Iter, "Return the iterator object itself.")
+        .def("__next__",
+             &PyTreeZipIter::Next,
+             "Return the next tuple of corresponding leaves in the pytrees.");
+
+    auto PyTreeProxyTypeObject = py::class_<PyTreeProxy>(
+        mod,
+        "PyTreeProxy",
+        "A lazy view of the pytree that builds the containers only for the accessed subtrees.",
+        // NOLINTBEGIN[readability-function-cognitive-complexity,cppcoreguidelines-avoid-do-while]
+        py::custom_type_setup([](PyHeapTypeObject* heap_type) -> void {
+            auto* const type = &heap_type->ht_type;
+            type->tp_flags |= Py_TPFLAGS_HAVE_GC;
+            type->tp_traverse = &PyTreeProxy::PyTpTraverse;
+        }),
+        // NOLINTEND[readability-function-cognitive-complexity,cppcoreguidelines-avoid-do-while]
+        py::module_local());
+    auto* const PyTreeProxy_Type = reinterpret_cast<PyTypeObject*>(PyTreeProxyTypeObject.ptr());
+    PyTreeProxy_Type->tp_name = "optree.PyTreeProxy";
+    py::setattr(PyTreeProxyTypeObject.ptr(), Py_Get_ID(__module__), Py_Get_ID(optree));
+    PyTreeProxy::sm_type = PyTreeProxy_Type;
+
+    PyTreeProxyTypeObject
+        .def("materialize",
+             &PyTreeProxy::Materialize,
+             "Build the real containers for the whole subtree.")
+        .def_property_readonly("treespec",
+                               &PyTreeProxy::GetTreeSpec,
+                               "The treespec of the subtree.")
+        .def("keys", &PyTreeProxy::Keys, "Return the keys of the mapping in insertion order.")
+        .def("values",
+             &PyTreeProxy::Values,
+             "Return the children of the mapping in insertion order.")
+        .def("items",
+             &PyTreeProxy::Items,
+             "Return the key-child pairs of the mapping in insertion order.")
+        .def("get",
+             &PyTreeProxy::Get,
+             "Return the child for the key if the key is in the mapping, else default.",
+             py::arg("key"),
+             py::arg("default") = py::none())
+        .def("__getitem__",
+             &PyTreeProxy::GetItem,
+             "Return the child at the given index or key.",
+             py::arg("key"))
+        .def("__getattr__",
+             &PyTreeProxy::GetAttr,
+             "Return the child with the given field name.",
+             py::arg("name"))
+        .def("__contains__",
+             &PyTreeProxy::Contains,
+             "Test whether the key or value is in the container.",
+             py::arg("value"))
+        .def("__iter__",
+             &PyTreeProxy::Iter,
+             "Return an iterator over the keys of a mapping or the children of a sequence.")
+        .def("__len__", &PyTreeProxy::GetLength, "Number of children in the container.")
+        .def("__repr__", &PyTreeProxy::ToString, "Return a string representation of the view.");
+
+    auto PyTreeTraversalArrayTypeObject = py::class_<PyTreeTraversalArray>(
+        mod,
+        "PyTreeTraversalArray",
+        "A read-only buffer over a field of the nodes of a treespec.",
+        py::buffer_protocol(),
+        // NOLINTBEGIN[readability-function-cognitive-complexity,cppcoreguidelines-avoid-do-while]
+        py::custom_type_setup([](PyHeapTypeObject* heap_type) -> void {
+            auto* const type = &heap_type->ht_type;
+            type->tp_flags |= Py_TPFLAGS_HAVE_GC;
+            type->tp_traverse = &PyTreeTraversalArray::PyTpTraverse;
+        }),
+        // NOLINTEND[readability-function-cognitive-complexity,cppcoreguidelines-avoid-do-while]
+        py::module_local());
+    auto* const PyTreeTraversalArray_Type =
+        reinterpret_cast<PyTypeObject*>(PyTreeTraversalArrayTypeObject.ptr());
+    PyTreeTraversalArray_Type->tp_name = "optree.PyTreeTraversalArray";
+    py::setattr(PyTreeTraversalArrayTypeObject.ptr(), Py_Get_ID(__module__), Py_Get_ID(optree));
+
+    PyTreeTraversalArrayTypeObject.def_buffer(&PyTreeTraversalArray::GetBuffer);
+
+    auto PyTreeSchemaTypeObject = py::class_<PyTreeSchema>(
+        mod,
+        "PyTreeSchema",
+        "A treespec with per-leaf constraints on the leaf types and the array shapes and dtypes.",
+        // NOLINTBEGIN[readability-function-cognitive-complexity,cppcoreguidelines-avoid-do-while]
+        py::custom_type_setup([](PyHeapTypeObject* heap_type) -> void {
+            auto* const type = &heap_type->ht_type;
+            type->tp_flags |= Py_TPFLAGS_HAVE_GC;
+            type->tp_traverse = &PyTreeSchema::PyTpTraverse;
+        }),
+        // NOLINTEND[readability-function-cognitive-complexity,cppcoreguidelines-avoid-do-while]
+        py::module_local());
+    auto* const PyTreeSchema_Type = reinterpret_cast<PyTypeObject*>(PyTreeSchemaTypeObject.ptr());
+    PyTreeSchema_Type->tp_name = "optree.PyTreeSchema";
+    py::setattr(PyTreeSchemaTypeObject.ptr(), Py_Get_ID(__module__), Py_Get_ID(optree));
+
+    PyTreeSchemaTypeObject
+        .def(py::init<py::object, py::iterable>(),
+             "Create a new schema from a treespec and the per-leaf constraints.",
+             py::arg("treespec"),
+             py::arg("constraints"))
+        .def("validate",
+             &PyTreeSchema::Validate,
+             "Validate the pytree and return a list of ``(path, message)`` pairs for all "
+             "violations.",
+             py::arg("tree"))
+        .def("is_valid",
+             &PyTreeSchema::IsValid,
+             "Test whether the pytree satisfies the schema.",
+             py::arg("tree"))
+        .def_property_readonly("treespec", &PyTreeSchema::GetTreeSpec, "The treespec.")
+        .def_property_readonly("constraints",
+                               &PyTreeSchema::GetConstraints,
+                               "The per-leaf constraints.")
+        .def("__repr__", &PyTreeSchema::ToString, "Return a string representation of the schema.");
 
 #ifdef Py_TPFLAGS_IMMUTABLETYPE
     PyTreeKind_Type->tp_flags |= Py_TPFLAGS_IMMUTABLETYPE;
     PyTreeSpec_Type->tp_flags |= Py_TPFLAGS_IMMUTABLETYPE;
     PyTreeIter_Type->tp_flags |= Py_TPFLAGS_IMMUTABLETYPE;
+    PyTreeZipIter_Type->tp_flags |= Py_TPFLAGS_IMMUTABLETYPE;
+    PyTreeProxy_Type->tp_flags |= Py_TPFLAGS_IMMUTABLETYPE;
+    PyTreeSchema_Type->tp_flags |= Py_TPFLAGS_IMMUTABLETYPE;
+    PyTreeTraversalArray_Type->tp_flags |= Py_TPFLAGS_IMMUTABLETYPE;
     PyTreeKind_Type->tp_flags &= ~Py_TPFLAGS_READY;
     PyTreeSpec_Type->tp_flags &= ~Py_TPFLAGS_READY;
     PyTreeIter_Type->tp_flags &= ~Py_TPFLAGS_READY;
+    PyTreeZipIter_Type->tp_flags &= ~Py_TPFLAGS_READY;
+    PyTreeProxy_Type->tp_flags &= ~Py_TPFLAGS_READY;
+    PyTreeSchema_Type->tp_flags &= ~Py_TPFLAGS_READY;
+    PyTreeTraversalArray_Type->tp_flags &= ~Py_TPFLAGS_READY;
 #endif
 
     if (PyType_Ready(PyTreeKind_Type) < 0) [[unlikely]] {
@@ -350,6 +601,18 @@ void BuildModule(py::module_& mod) {  // NOLINT[runtime/references]
     if (PyType_Ready(PyTreeIter_Type) < 0) [[unlikely]] {
         INTERNAL_ERROR("`PyType_Ready(&PyTreeIter_Type)` failed.");
     }
+    if (PyType_Ready(PyTreeZipIter_Type) < 0) [[unlikely]] {
+        INTERNAL_ERROR("`PyType_Ready(&PyTreeZipIter_Type)` failed.");
+    }
+    if (PyType_Ready(PyTreeProxy_Type) < 0) [[unlikely]] {
+        INTERNAL_ERROR("`PyType_Ready(&PyTreeProxy_Type)` failed.");
+    }
+    if (PyType_Ready(PyTreeSchema_Type) < 0) [[unlikely]] {
+        INTERNAL_ERROR("`PyType_Ready(&PyTreeSchema_Type)` failed.");
+    }
+    if (PyType_Ready(PyTreeTraversalArray_Type) < 0) [[unlikely]] {
+        INTERNAL_ERROR("`PyType_Ready(&PyTreeTraversalArray_Type)` failed.");
+    }
 
     py::getattr(py::module_::import("atexit"),
                 "register")(py::cpp_function(&PyTreeTypeRegistry::Clear));
@@ -74,7 +74,9 @@ template <bool NoneIsLeaf>
                                                  const py::function& flatten_func,
                                                  const py::function& unflatten_func,
                                                  const py::object& path_entry_type,
-                                                 const std::string& registry_namespace) {
+                                                 const std::string& registry_namespace,
+                                                 const PyTreeNodeProtocol& protocol,
+                                                 const py::object& metadata_key) {
     if (sm_builtins_types.find(cls) != sm_builtins_types.end()) [[unlikely]] {
         throw py::value_error("PyTree type " + PyRepr(cls) +
                               " is a built-in type and cannot be re-registered.");
@@ -83,10 +85,12 @@ template <bool NoneIsLeaf>
     PyTreeTypeRegistry* const registry = Singleton<NoneIsLeaf>();
     auto registration = std::make_shared<std::remove_const_t<RegistrationPtr::element_type>>();
     registration->kind = PyTreeKind::Custom;
+    registration->protocol = protocol;
     registration->type = py::reinterpret_borrow<py::object>(cls);
     registration->flatten_func = py::reinterpret_borrow<py::function>(flatten_func);
     registration->unflatten_func = py::reinterpret_borrow<py::function>(unflatten_func);
     registration->path_entry_type = py::reinterpret_borrow<py::object>(path_entry_type);
+    registration->metadata_key = py::reinterpret_borrow<py::object>(metadata_key);
     if (registry_namespace.empty()) [[unlikely]] {
         if (!registry->m_registrations.emplace(cls, std::move(registration)).second) [[unlikely]] {
             throw py::value_error("PyTree type " + PyRepr(cls) +
@@ -146,23 +150,49 @@ template <bool NoneIsLeaf>
                                              const py::function& flatten_func,
                                              const py::function& unflatten_func,
                                              const py::object& path_entry_type,
-                                             const std::string& registry_namespace) {
+                                             const std::string& registry_namespace,
+                                             const std::string& kind,
+                                             const py::object& metadata_key) {
+    PyTreeNodeProtocol node_protocol = PyTreeNodeProtocol::Function;
+    if (kind == "sequence") [[unlikely]] {
+        node_protocol = PyTreeNodeProtocol::Sequence;
+    } else if (kind == "mapping") [[unlikely]] {
+        node_protocol = PyTreeNodeProtocol::Mapping;
+    } else if (!kind.empty()) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "Expected the node kind to be one of 'sequence' and 'mapping', got "
+            << PyRepr(kind) << ".";
+        throw py::value_error(oss.str());
+    }
+    if (!metadata_key.is_none() && !metadata_key.is(py::bool_(true)) &&
+        PyCallable_Check(metadata_key.ptr()) == 0) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "Expected the metadata key to be None, True, or a callable, got "
+            << PyRepr(metadata_key) << ".";
+        throw py::type_error(oss.str());
+    }
+
     const scoped_write_lock_guard lock{sm_mutex};
 
     RegisterImpl<NONE_IS_NODE>(cls,
                                flatten_func,
                                unflatten_func,
                                path_entry_type,
-                               registry_namespace);
+                               registry_namespace,
+                               node_protocol,
+                               metadata_key);
     RegisterImpl<NONE_IS_LEAF>(cls,
                                flatten_func,
                                unflatten_func,
                                path_entry_type,
-                               registry_namespace);
+                               registry_namespace,
+                               node_protocol,
+                               metadata_key);
     cls.inc_ref();
     flatten_func.inc_ref();
     unflatten_func.inc_ref();
     path_entry_type.inc_ref();
+    metadata_key.inc_ref();
 }
 
 template <bool NoneIsLeaf>
@@ -225,13 +255,16 @@ template <bool NoneIsLeaf>
     const auto registration1 = UnregisterImpl<NONE_IS_NODE>(cls, registry_namespace);
     const auto registration2 = UnregisterImpl<NONE_IS_LEAF>(cls, registry_namespace);
     EXPECT_TRUE(registration1->type.is(registration2->type));
+    EXPECT_EQ(registration1->protocol, registration2->protocol);
     EXPECT_TRUE(registration1->flatten_func.is(registration2->flatten_func));
     EXPECT_TRUE(registration1->unflatten_func.is(registration2->unflatten_func));
     EXPECT_TRUE(registration1->path_entry_type.is(registration2->path_entry_type));
+    EXPECT_TRUE(registration1->metadata_key.is(registration2->metadata_key));
     registration1->type.dec_ref();
     registration1->flatten_func.dec_ref();
     registration1->unflatten_func.dec_ref();
     registration1->path_entry_type.dec_ref();
+    registration1->metadata_key.dec_ref();
 }
 
 template <bool NoneIsLeaf>
@@ -259,6 +292,73 @@ template PyTreeTypeRegistry::RegistrationPtr PyTreeTypeRegistry::Lookup<NONE_IS_
     const py::object&,
     const std::string&);
 
+/*static*/ py::tuple PyTreeTypeRegistry::FlattenCustom(const RegistrationPtr& registration,
+                                                      const py::handle& handle,
+                                                      const bool& sort_keys) {
+    switch (registration->protocol) {
+        case PyTreeNodeProtocol::Sequence: {
+            const py::object sequence = SequenceFast(handle);
+            const scoped_critical_section cs{sequence};
+            const ssize_t arity = SequenceFastGetSize(sequence);
+            const py::tuple children{arity};
+            for (ssize_t i = 0; i < arity; ++i) {
+                TupleSetItem(children, i, SequenceFastGetItem(sequence, i));
+            }
+            return py::make_tuple(children, py::none(), py::none());
+        }
+
+        case PyTreeNodeProtocol::Mapping: {
+            const py::dict items = MappingToDict(handle);
+            py::list keys = DictKeys(items);
+            if (sort_keys) [[likely]] {
+                TotalOrderSort(keys);
+            }
+            const ssize_t arity = ListGetSize(keys);
+            const py::tuple children{arity};
+            const py::tuple entries{arity};
+            for (ssize_t i = 0; i < arity; ++i) {
+                const py::object key = ListGetItem(keys, i);
+                TupleSetItem(children, i, DictGetItem(items, key));
+                TupleSetItem(entries, i, key);
+            }
+            return py::make_tuple(children, entries, entries);
+        }
+
+        case PyTreeNodeProtocol::Function:
+        default: {
+            return EVALUATE_WITH_LOCK_HELD(
+                thread_safe_cast<py::tuple>(registration->flatten_func(handle)), handle);
+        }
+    }
+}
+
+/*static*/ py::object PyTreeTypeRegistry::UnflattenCustom(const RegistrationPtr& registration,
+                                                         const py::object& metadata,
+                                                         const py::tuple& children) {
+    switch (registration->protocol) {
+        case PyTreeNodeProtocol::Sequence: {
+            return CallOneArg(registration->type, children);
+        }
+
+        case PyTreeNodeProtocol::Mapping: {
+            const ssize_t arity = TupleGetSize(children);
+            EXPECT_EQ(TupleGetSize(metadata), arity, "Number of keys and children mismatch.");
+            const py::dict dict{};
+            for (ssize_t i = 0; i < arity; ++i) {
+                DictSetItem(dict,
+                            TupleGetItemBorrowed(metadata, i),
+                            TupleGetItemBorrowed(children, i));
+            }
+            return CallOneArg(registration->type, dict);
+        }
+
+        case PyTreeNodeProtocol::Function:
+        default: {
+            return registration->unflatten_func(metadata, children);
+        }
+    }
+}
+
 template <bool NoneIsLeaf>
 /*static*/ PyTreeKind PyTreeTypeRegistry::GetKind(
     const py::handle& handle,
@@ -318,6 +418,7 @@ template PyTreeKind PyTreeTypeRegistry::GetKind<NONE_IS_LEAF>(
         EXPECT_TRUE(registration1->flatten_func.is(registration2->flatten_func));
         EXPECT_TRUE(registration1->unflatten_func.is(registration2->unflatten_func));
         EXPECT_TRUE(registration1->path_entry_type.is(registration2->path_entry_type));
+        EXPECT_TRUE(registration1->metadata_key.is(registration2->metadata_key));
     }
     for (const auto& entry : registry2->m_named_registrations) {
         const auto it = registry1->m_named_registrations.find(entry.first);
@@ -329,6 +430,7 @@ template PyTreeKind PyTreeTypeRegistry::GetKind<NONE_IS_LEAF>(
         EXPECT_TRUE(registration1->flatten_func.is(registration2->flatten_func));
         EXPECT_TRUE(registration1->unflatten_func.is(registration2->unflatten_func));
         EXPECT_TRUE(registration1->path_entry_type.is(registration2->path_entry_type));
+        EXPECT_TRUE(registration1->metadata_key.is(registration2->metadata_key));
     }
 #endif
 
@@ -337,12 +439,14 @@ template PyTreeKind PyTreeTypeRegistry::GetKind<NONE_IS_LEAF>(
         entry.second->flatten_func.dec_ref();
         entry.second->unflatten_func.dec_ref();
         entry.second->path_entry_type.dec_ref();
+        entry.second->metadata_key.dec_ref();
     }
     for (const auto& entry : registry1->m_named_registrations) {
         entry.second->type.dec_ref();
         entry.second->flatten_func.dec_ref();
         entry.second->unflatten_func.dec_ref();
         entry.second->path_entry_type.dec_ref();
+        entry.second->metadata_key.dec_ref();
     }
 
     sm_builtins_types.clear();
@@ -0,0 +1,286 @@
+/*
+Copyright 2022-2024 MetaOPT Team. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+================================================================================
+*/
+
+#include <cstdint>  // std::int64_t
+#include <cstring>  // std::memcpy
+#include <memory>   // std::unique_ptr, std::make_unique
+#include <sstream>  // std::ostringstream
+#include <string>   // std::string
+#include <utility>  // std::move
+#include <vector>   // std::vector
+
+#include "include/exceptions.h"
+#include "include/pymacros.h"
+#include "include/pytypes.h"
+#include "include/synchronization.h"
+#include "include/treespec.h"
+
+namespace optree {
+
+/*static*/ ssize_t PyTreeSpec::FindEntry(const Node& node, const py::handle& entry) {
+    if (node.node_entries) [[unlikely]] {
+        for (ssize_t i = 0; i < node.arity; ++i) {
+            if (TupleGetItemBorrowed(node.node_entries, i).equal(entry)) [[unlikely]] {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    switch (node.kind) {
+        case PyTreeKind::Leaf:
+        case PyTreeKind::None: {
+            return -1;
+        }
+
+        case PyTreeKind::Tuple:
+        case PyTreeKind::List:
+        case PyTreeKind::NamedTuple:
+        case PyTreeKind::Deque:
+        case PyTreeKind::StructSequence:
+        case PyTreeKind::Custom: {
+            if (PyLong_Check(entry.ptr()) == 0) [[unlikely]] {
+                return -1;
+            }
+            const auto index = thread_safe_cast<ssize_t>(entry);
+            return (index >= 0 && index < node.arity ? index : -1);
+        }
+
+        case PyTreeKind::Dict:
+        case PyTreeKind::OrderedDict:
+        case PyTreeKind::DefaultDict: {
+            const py::handle keys = (node.kind != PyTreeKind::DefaultDict
+                                         ? py::handle{node.node_data}
+                                         : TupleGetItemBorrowed(node.node_data, 1));
+            for (ssize_t i = 0; i < node.arity; ++i) {
+                if (FrozenListGetItemBorrowed(keys, i).equal(entry)) [[unlikely]] {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        default:
+            INTERNAL_ERROR();
+    }
+}
+
+ssize_t PyTreeSpec::LeafIndex(const py::tuple& path) const {
+    EXPECT_FALSE(m_traversal.empty(), "The tree node traversal is empty.");
+
+    // The subtree rooted at `pos` covers the leaves in [first_leaf, first_leaf + num_leaves).
+    ssize_t pos = GetNumNodes() - 1;
+    ssize_t first_leaf = 0;
+    const ssize_t depth = TupleGetSize(path);
+    for (ssize_t d = 0; d < depth; ++d) {
+        const Node& node = m_traversal.at(pos);
+        const ssize_t index = FindEntry(node, TupleGetItemBorrowed(path, d));
+        if (index < 0) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Path " << PyRepr(path) << " has no entry " << PyRepr(TupleGetItem(path, d))
+                << " at depth " << d << " in " << ToString() << ".";
+            throw py::value_error(oss.str());
+        }
+
+        ssize_t cur = pos - 1;
+        ssize_t num_leaves_after = 0;
+        for (ssize_t i = node.arity - 1; i > index; --i) {
+            const Node& child = m_traversal.at(cur);
+            num_leaves_after += child.num_leaves;
+            cur -= child.num_nodes;
+        }
+        first_leaf += node.num_leaves - num_leaves_after - m_traversal.at(cur).num_leaves;
+        pos = cur;
+    }
+
+    if (m_traversal.at(pos).kind != PyTreeKind::Leaf) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "Path " << PyRepr(path) << " does not lead to a leaf in " << ToString() << ".";
+        throw py::value_error(oss.str());
+    }
+    return first_leaf;
+}
+
+std::unique_ptr<PyTreeSpec> PyTreeSpec::WithAnnotations(const py::dict& columns) const {
+    const ssize_t num_leaves = GetNumLeaves();
+    auto out = std::make_unique<PyTreeSpec>(*this);
+
+    const scoped_critical_section cs{columns};
+    for (const auto& [key, value] : columns) {
+        auto name = thread_safe_cast<std::string>(key);
+        if (value.is_none()) [[unlikely]] {
+            out->m_annotations.erase(name);
+            continue;
+        }
+
+        AnnotationColumn column{};
+        ssize_t size = 0;
+        if (IsIntegerArray(py::reinterpret_borrow<py::object>(value))) [[unlikely]] {
+            const std::vector<ssize_t> integers =
+                ReadIntegerArray(py::reinterpret_borrow<py::object>(value), name.c_str());
+            size = py::ssize_t_cast(integers.size());
+            std::vector<std::int64_t> values(integers.cbegin(), integers.cend());
+            column.values = py::bytes(reinterpret_cast<const char*>(values.data()),
+                                      values.size() * sizeof(std::int64_t));
+            column.is_integer = true;
+        } else [[likely]] {
+            PyObject* const tuple = PySequence_Tuple(value.ptr());
+            if (tuple == nullptr) [[unlikely]] {
+                throw py::error_already_set();
+            }
+            column.values = py::reinterpret_steal<py::tuple>(tuple);
+            size = TupleGetSize(column.values);
+        }
+        if (size != num_leaves) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Expected annotation " << PyRepr(name) << " to have " << num_leaves
+                << " entries (one per leaf), got " << size << ".";
+            throw py::value_error(oss.str());
+        }
+        out->m_annotations.insert_or_assign(std::move(name), std::move(column));
+    }
+    return out;
+}
+
+py::dict PyTreeSpec::GetAnnotations() const {
+    py::dict annotations{};
+    for (const auto& [name, column] : m_annotations) {
+        if (column.is_integer) [[unlikely]] {
+            PyObject* const view = PyMemoryView_FromObject(column.values.ptr());
+            if (view == nullptr) [[unlikely]] {
+                throw py::error_already_set();
+            }
+            DictSetItem(annotations,
+                        py::str(name),
+                        py::getattr(py::reinterpret_steal<py::object>(view),
+                                    Py_Get_ID(cast))(py::str("q")));
+        } else [[likely]] {
+            DictSetItem(annotations, py::str(name), column.values);
+        }
+    }
+    return annotations;
+}
+
+py::object PyTreeSpec::GetAnnotation(const std::string& name, const py::object& leaf) const {
+    const auto it = m_annotations.find(name);
+    if (it == m_annotations.end()) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "PyTreeSpec has no annotation " << PyRepr(name) << ".";
+        throw py::key_error(oss.str());
+    }
+
+    ssize_t index = 0;
+    if (PyTuple_Check(leaf.ptr()) != 0) [[unlikely]] {
+        index = LeafIndex(py::reinterpret_borrow<py::tuple>(leaf));
+    } else [[likely]] {
+        const ssize_t num_leaves = GetNumLeaves();
+        index = thread_safe_cast<ssize_t>(leaf);
+        if (index < -num_leaves || index >= num_leaves) [[unlikely]] {
+            throw py::index_error("PyTreeSpec::GetAnnotation() index out of range.");
+        }
+        if (index < 0) [[unlikely]] {
+            index += num_leaves;
+        }
+    }
+
+    const AnnotationColumn& column = it->second;
+    if (column.is_integer) [[unlikely]] {
+        std::int64_t value = 0;
+        std::memcpy(&value,
+                    PyBytes_AS_STRING(column.values.ptr()) + index * sizeof(std::int64_t),
+                    sizeof(std::int64_t));
+        return py::int_(value);
+    }
+    return TupleGetItem(column.values, index);
+}
+
+void PyTreeSpec::SliceAnnotationsInto(PyTreeSpec& treespec,
+                                      const ssize_t& start,
+                                      const ssize_t& stop) const {
+    for (const auto& [name, column] : m_annotations) {
+        PyObject* values = nullptr;
+        if (column.is_integer) [[unlikely]] {
+            values = PyBytes_FromStringAndSize(
+                PyBytes_AS_STRING(column.values.ptr()) + start * sizeof(std::int64_t),
+                (stop - start) * py::ssize_t_cast(sizeof(std::int64_t)));
+        } else [[likely]] {
+            values = PyTuple_GetSlice(column.values.ptr(), start, stop);
+        }
+        if (values == nullptr) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        treespec.m_annotations.emplace(
+            name,
+            AnnotationColumn{
+                .values = py::reinterpret_steal<py::object>(values),
+                .is_integer = column.is_integer,
+            });
+    }
+}
+
+void PyTreeSpec::ComposeAnnotationsInto(PyTreeSpec& treespec, const PyTreeSpec& inner) const {
+    const ssize_t num_outer_leaves = GetNumLeaves();
+    const ssize_t num_inner_leaves = inner.GetNumLeaves();
+    const ssize_t num_leaves = num_outer_leaves * num_inner_leaves;
+
+    // The composed leaf `i * num_inner_leaves + j` is the leaf `j` of the copy of `inner` that
+    // replaces the outer leaf `i`.
+    const auto compose = [&num_leaves](const AnnotationColumn& column,
+                                       const auto& source_index) -> AnnotationColumn {
+        if (column.is_integer) [[unlikely]] {
+            const auto* const source = PyBytes_AS_STRING(column.values.ptr());
+            std::vector<std::int64_t> values(num_leaves);
+            for (ssize_t k = 0; k < num_leaves; ++k) {
+                std::memcpy(&values[k],
+                            source + source_index(k) * sizeof(std::int64_t),
+                            sizeof(std::int64_t));
+            }
+            return AnnotationColumn{
+                .values = py::bytes(reinterpret_cast<const char*>(values.data()),
+                                    values.size() * sizeof(std::int64_t)),
+                .is_integer = true,
+            };
+        }
+        const py::tuple values{num_leaves};
+        for (ssize_t k = 0; k < num_leaves; ++k) {
+            TupleSetItem(values, k, TupleGetItemBorrowed(column.values, source_index(k)));
+        }
+        return AnnotationColumn{.values = values, .is_integer = false};
+    };
+
+    for (const auto& [name, column] : m_annotations) {
+        treespec.m_annotations.emplace(
+            name,
+            compose(column, [&num_inner_leaves](const ssize_t& k) -> ssize_t {
+                return k / num_inner_leaves;
+            }));
+    }
+    for (const auto& [name, column] : inner.m_annotations) {
+        if (treespec.m_annotations.find(name) != treespec.m_annotations.end()) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "PyTreeSpecs have conflicting annotation " << PyRepr(name) << ".";
+            throw py::value_error(oss.str());
+        }
+        treespec.m_annotations.emplace(
+            name,
+            compose(column, [&num_inner_leaves](const ssize_t& k) -> ssize_t {
+                return k % num_inner_leaves;
+            }));
+    }
+}
+
+}  // namespace optree
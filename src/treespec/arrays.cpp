@@ -0,0 +1,437 @@
+/*
+Copyright 2022-2024 MetaOPT Team. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+================================================================================
+*/
+
+#include <cstddef>      // std::size_t
+#include <cstdint>      // std::uint8_t
+#include <cstring>      // std::memcpy
+#include <memory>       // std::unique_ptr, std::make_unique
+#include <optional>     // std::optional
+#include <sstream>      // std::ostringstream
+#include <string>       // std::string, std::to_string
+#include <type_traits>  // std::underlying_type_t, std::remove_cv_t, std::remove_reference_t
+#include <utility>      // std::move, std::pair
+#include <vector>       // std::vector
+
+#include "include/exceptions.h"
+#include "include/pytypes.h"
+#include "include/registry.h"
+#include "include/stdutils.h"
+#include "include/synchronization.h"
+#include "include/treespec.h"
+
+namespace optree {
+
+PyTreeTraversalArray::PyTreeTraversalArray(const py::object& treespec, const Field& field)
+    : m_treespec{treespec},
+      m_spec{&thread_safe_cast<const PyTreeSpec&>(treespec)},
+      m_field{field} {}
+
+py::buffer_info PyTreeTraversalArray::GetBuffer() const {
+    const auto& traversal = m_spec->m_traversal;
+    EXPECT_FALSE(traversal.empty(), "The tree node traversal is empty.");
+
+    // The buffer strides over the nodes. The traversal of a PyTreeSpec is never modified after
+    // construction, so the buffer remains valid while the PyTreeSpec is alive.
+    const PyTreeSpec::Node& root = traversal.front();
+    const auto make_buffer = [&traversal](const auto& field) -> py::buffer_info {
+        using T = std::remove_cv_t<std::remove_reference_t<decltype(field)>>;
+        return py::buffer_info{
+            // NOLINTNEXTLINE[cppcoreguidelines-pro-type-const-cast]
+            const_cast<T*>(&field),
+            static_cast<ssize_t>(sizeof(T)),
+            py::format_descriptor<T>::format(),
+            1,
+            {py::ssize_t_cast(traversal.size())},
+            {static_cast<ssize_t>(sizeof(PyTreeSpec::Node))},
+            /*readonly=*/true,
+        };
+    };
+
+    switch (m_field) {
+        case Field::Kind: {
+            static_assert(sizeof(PyTreeKind) == sizeof(std::underlying_type_t<PyTreeKind>));
+            return make_buffer(
+                *reinterpret_cast<const std::underlying_type_t<PyTreeKind>*>(&root.kind));
+        }
+        case Field::Arity: {
+            return make_buffer(root.arity);
+        }
+        case Field::NumLeaves: {
+            return make_buffer(root.num_leaves);
+        }
+        case Field::NumNodes: {
+            return make_buffer(root.num_nodes);
+        }
+        default:
+            INTERNAL_ERROR();
+    }
+}
+
+/*static*/ py::tuple PyTreeSpec::TraversalArrays(const py::object& treespec) {
+    const auto make_view = [&treespec](const PyTreeTraversalArray::Field& field) -> py::object {
+        const py::object array =
+            py::cast(std::make_unique<PyTreeTraversalArray>(treespec, field));
+        PyObject* const view = PyMemoryView_FromObject(array.ptr());
+        if (view == nullptr) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        return py::reinterpret_steal<py::object>(view);
+    };
+    return py::make_tuple(make_view(PyTreeTraversalArray::Field::Kind),
+                          make_view(PyTreeTraversalArray::Field::Arity),
+                          make_view(PyTreeTraversalArray::Field::NumLeaves),
+                          make_view(PyTreeTraversalArray::Field::NumNodes));
+}
+
+std::string NativeFormat(const std::string& format) {
+    if (!format.empty() && (format.front() == '@' || format.front() == '=')) [[unlikely]] {
+        return format.substr(1);
+    }
+    return format;
+}
+
+bool IsIntegerArray(const py::object& array) {
+    if (PyObject_CheckBuffer(array.ptr()) == 0) [[likely]] {
+        return false;
+    }
+    const py::buffer_info info = py::reinterpret_borrow<py::buffer>(array).request();
+    const std::string format = NativeFormat(info.format);
+    return info.ndim == 1 && format.size() == 1 &&
+           std::string{"bBhHiIlLqQnN"}.find(format.front()) != std::string::npos;
+}
+
+std::vector<ssize_t> ReadIntegerArray(const py::object& array, const char* const name) {
+    if (PyObject_CheckBuffer(array.ptr()) == 0) [[unlikely]] {
+        const py::list sequence{array};
+        const ssize_t size = ListGetSize(sequence);
+        auto values = reserved_vector<ssize_t>(size);
+        for (ssize_t i = 0; i < size; ++i) {
+            values.emplace_back(thread_safe_cast<ssize_t>(ListGetItem(sequence, i)));
+        }
+        return values;
+    }
+
+    const py::buffer_info info = py::reinterpret_borrow<py::buffer>(array).request();
+    if (info.ndim != 1) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "Expected a one-dimensional array for `" << name << "`, got an array with "
+            << info.ndim << " dimensions.";
+        throw py::value_error(oss.str());
+    }
+    const std::string format = NativeFormat(info.format);
+
+    const auto* const base = static_cast<const char*>(info.ptr);
+    const ssize_t size = info.shape[0];
+    const ssize_t stride = info.strides[0];
+    auto values = reserved_vector<ssize_t>(size);
+    const auto read = [&](const auto& zero) -> std::vector<ssize_t> {
+        using T = std::remove_cv_t<std::remove_reference_t<decltype(zero)>>;
+        if (info.itemsize != static_cast<ssize_t>(sizeof(T))) [[unlikely]] {
+            throw py::value_error(std::string("Mismatched item size for `") + name + "`.");
+        }
+        for (ssize_t i = 0; i < size; ++i) {
+            T value = zero;
+            std::memcpy(&value, base + i * stride, sizeof(T));
+            values.emplace_back(static_cast<ssize_t>(value));
+        }
+        return std::move(values);
+    };
+    if (format.size() == 1) [[likely]] {
+        switch (format.front()) {
+            case 'b':
+                return read(static_cast<signed char>(0));
+            case 'B':
+                return read(static_cast<unsigned char>(0));
+            case 'h':
+                return read(static_cast<short>(0));  // NOLINT[google-runtime-int]
+            case 'H':
+                return read(static_cast<unsigned short>(0));  // NOLINT[google-runtime-int]
+            case 'i':
+                return read(static_cast<int>(0));
+            case 'I':
+                return read(static_cast<unsigned int>(0));
+            case 'l':
+                return read(static_cast<long>(0));  // NOLINT[google-runtime-int]
+            case 'L':
+                return read(static_cast<unsigned long>(0));  // NOLINT[google-runtime-int]
+            case 'q':
+                return read(static_cast<long long>(0));  // NOLINT[google-runtime-int]
+            case 'Q':
+                return read(static_cast<unsigned long long>(0));  // NOLINT[google-runtime-int]
+            case 'n':
+                return read(static_cast<ssize_t>(0));
+            case 'N':
+                return read(static_cast<std::size_t>(0));
+            default:
+                break;
+        }
+    }
+    std::ostringstream oss{};
+    oss << "Expected an array of native integers for `" << name << "`, got format "
+        << PyRepr(info.format) << ".";
+    throw py::value_error(oss.str());
+}
+
+template <bool NoneIsLeaf>
+// NOLINTNEXTLINE[readability-function-cognitive-complexity]
+/*static*/ std::unique_ptr<PyTreeSpec> PyTreeSpec::FromArraysImpl(
+    const py::object& kinds,
+    const py::object& arities,
+    const std::optional<py::dict>& node_data,
+    const std::string& registry_namespace) {
+    const std::vector<ssize_t> kind_values = ReadIntegerArray(kinds, "kinds");
+    const std::vector<ssize_t> arity_values = ReadIntegerArray(arities, "arities");
+    const ssize_t num_nodes = py::ssize_t_cast(kind_values.size());
+    if (num_nodes != py::ssize_t_cast(arity_values.size())) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "Expected `kinds` and `arities` to have the same length, got " << num_nodes
+            << " and " << arity_values.size() << ".";
+        throw py::value_error(oss.str());
+    }
+    if (num_nodes == 0) [[unlikely]] {
+        throw py::value_error("Expected at least one node in the traversal.");
+    }
+
+    const auto fail = [](const ssize_t& index, const std::string& message) {
+        std::ostringstream oss{};
+        oss << "Invalid node at index " << index << " of the post-order traversal: " << message;
+        throw py::value_error(oss.str());
+    };
+
+    // Scatter the metadata table into a dense column indexed by node position.
+    std::vector<py::object> metadata(num_nodes);
+    if (node_data) [[likely]] {
+        const scoped_critical_section cs{*node_data};
+        for (const auto& [key, value] : *node_data) {
+            const auto index = thread_safe_cast<ssize_t>(key);
+            if (index < 0 || index >= num_nodes) [[unlikely]] {
+                std::ostringstream oss{};
+                oss << "Node index " << index << " in `node_data` is out of range for "
+                    << num_nodes << " nodes.";
+                throw py::value_error(oss.str());
+            }
+            metadata[index] = py::reinterpret_borrow<py::object>(value);
+        }
+    }
+
+    // Dict keys are given in the order of the children, which must match the order used by
+    // flattening in this namespace.
+    const bool dict_should_be_sorted = !IsDictInsertionOrdered(registry_namespace);
+    const auto make_keys = [&fail](const ssize_t& index,
+                                   const py::handle& object,
+                                   const ssize_t& arity,
+                                   const bool& should_be_sorted) -> py::list {
+        PyObject* const list = PySequence_List(object.ptr());
+        if (list == nullptr) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        auto keys = py::reinterpret_steal<py::list>(list);
+        if (ListGetSize(keys) != arity) [[unlikely]] {
+            fail(index, "the number of keys does not match the arity.");
+        }
+        const py::dict unique_keys{};
+        for (const py::handle& key : keys) {
+            DictSetItem(unique_keys, key, py::none());
+        }
+        if (DictGetSize(unique_keys) != arity) [[unlikely]] {
+            fail(index, "the keys must be unique.");
+        }
+        if (should_be_sorted) [[likely]] {
+            py::list sorted = py::getattr(keys, Py_Get_ID(copy))();
+            TotalOrderSort(sorted);
+            if (sorted.not_equal(keys)) [[unlikely]] {
+                fail(index, "the keys must be in sorted order.");
+            }
+        }
+        return keys;
+    };
+
+    auto out = std::make_unique<PyTreeSpec>();
+    out->m_traversal.reserve(num_nodes);
+    bool has_custom = false;
+
+    // The (num_leaves, num_nodes) pairs of the subtrees that have not been attached to a parent
+    // yet. A valid post-order traversal leaves exactly one pair (the root) at the end.
+    std::vector<std::pair<ssize_t, ssize_t>> pending{};
+    for (ssize_t index = 0; index < num_nodes; ++index) {
+        const ssize_t kind_value = kind_values[index];
+        const ssize_t arity = arity_values[index];
+        if (kind_value < static_cast<ssize_t>(PyTreeKind::Custom) ||
+            kind_value > static_cast<ssize_t>(PyTreeKind::StructSequence)) [[unlikely]] {
+            fail(index, "unknown node kind " + std::to_string(kind_value) + ".");
+        }
+        if (arity < 0 || arity > py::ssize_t_cast(pending.size())) [[unlikely]] {
+            fail(index,
+                 "the arity " + std::to_string(arity) + " is out of range for " +
+                     std::to_string(pending.size()) + " pending subtree(s).");
+        }
+
+        Node& node = out->m_traversal.emplace_back();
+        node.kind = static_cast<PyTreeKind>(kind_value);
+        node.arity = arity;
+        const py::object& data = metadata[index];
+
+        switch (node.kind) {
+            case PyTreeKind::Leaf:
+            case PyTreeKind::None: {
+                if (node.kind == PyTreeKind::None && NoneIsLeaf) [[unlikely]] {
+                    fail(index, "None nodes are not allowed with `none_is_leaf=True`.");
+                }
+                if (arity != 0) [[unlikely]] {
+                    fail(index, "leaf and None nodes must have arity 0.");
+                }
+                [[fallthrough]];
+            }
+            case PyTreeKind::Tuple:
+            case PyTreeKind::List: {
+                if (data) [[unlikely]] {
+                    fail(index, "this node kind does not take metadata.");
+                }
+                break;
+            }
+
+            case PyTreeKind::Dict:
+            case PyTreeKind::OrderedDict: {
+                py::list keys = make_keys(index,
+                                          data ? data : py::list{},
+                                          arity,
+                                          node.kind == PyTreeKind::Dict && dict_should_be_sorted);
+                if (node.kind == PyTreeKind::Dict) [[likely]] {
+                    node.original_keys = py::getattr(keys, Py_Get_ID(copy))();
+                }
+                node.node_data = std::move(keys);
+                break;
+            }
+
+            case PyTreeKind::DefaultDict: {
+                const auto pair = (data ? thread_safe_cast<py::tuple>(data) : py::tuple{});
+                if (TupleGetSize(pair) != 2) [[unlikely]] {
+                    fail(index, "expected `(default_factory, keys)` as the metadata.");
+                }
+                py::list keys =
+                    make_keys(index, TupleGetItem(pair, 1), arity, dict_should_be_sorted);
+                node.original_keys = py::getattr(keys, Py_Get_ID(copy))();
+                node.node_data = py::make_tuple(TupleGetItem(pair, 0), std::move(keys));
+                break;
+            }
+
+            case PyTreeKind::NamedTuple:
+            case PyTreeKind::StructSequence: {
+                const bool is_valid_type = data && (node.kind == PyTreeKind::NamedTuple
+                                                        ? IsNamedTupleClass(data)
+                                                        : IsStructSequenceClass(data));
+                if (!is_valid_type) [[unlikely]] {
+                    fail(index, "expected a namedtuple or PyStructSequence type as the metadata.");
+                }
+                const py::tuple fields = (node.kind == PyTreeKind::NamedTuple
+                                              ? NamedTupleGetFields(data)
+                                              : StructSequenceGetFields(data));
+                if (TupleGetSize(fields) != arity) [[unlikely]] {
+                    fail(index, "the number of fields does not match the arity.");
+                }
+                node.node_data = data;
+                break;
+            }
+
+            case PyTreeKind::Deque: {
+                if (data && !data.is_none() &&
+                    (!py::isinstance<py::int_>(data) || thread_safe_cast<ssize_t>(data) < 0))
+                    [[unlikely]] {
+                    fail(index, "expected `None` or a non-negative integer as the maxlen.");
+                }
+                node.node_data = (data ? data : py::none());
+                break;
+            }
+
+            case PyTreeKind::Custom: {
+                const auto spec = (data ? thread_safe_cast<py::tuple>(data) : py::tuple{});
+                const ssize_t num_items = TupleGetSize(spec);
+                if (num_items != 2 && num_items != 3) [[unlikely]] {
+                    fail(index, "expected `(type, metadata[, entries])` as the metadata.");
+                }
+                const py::object type = TupleGetItem(spec, 0);
+                node.custom = PyTreeTypeRegistry::Lookup<NoneIsLeaf>(type, registry_namespace);
+                if (node.custom == nullptr) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "unknown custom type " << PyRepr(type);
+                    if (!registry_namespace.empty()) [[likely]] {
+                        oss << " in namespace " << PyRepr(registry_namespace);
+                    } else [[unlikely]] {
+                        oss << " in the global namespace";
+                    }
+                    oss << ".";
+                    fail(index, oss.str());
+                }
+                node.node_data = TupleGetItem(spec, 1);
+                if (num_items == 3) [[likely]] {
+                    const py::object node_entries = TupleGetItem(spec, 2);
+                    if (!node_entries.is_none()) [[likely]] {
+                        node.node_entries = thread_safe_cast<py::tuple>(node_entries);
+                        if (TupleGetSize(node.node_entries) != arity) [[unlikely]] {
+                            fail(index, "the number of entries does not match the arity.");
+                        }
+                    }
+                }
+                has_custom = true;
+                break;
+            }
+
+            default:
+                INTERNAL_ERROR();
+        }
+
+        node.num_leaves = (node.kind == PyTreeKind::Leaf ? 1 : 0);
+        node.num_nodes = 1;
+        for (ssize_t i = 0; i < arity; ++i) {
+            node.num_leaves += pending.back().first;
+            node.num_nodes += pending.back().second;
+            pending.pop_back();
+        }
+        pending.emplace_back(node.num_leaves, node.num_nodes);
+    }
+
+    if (pending.size() != 1) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "Expected the post-order traversal to form a single tree, got " << pending.size()
+            << " disconnected subtrees.";
+        throw py::value_error(oss.str());
+    }
+
+    out->m_none_is_leaf = NoneIsLeaf;
+    // Like flattening, a namespace that preserves the dict insertion order is recorded.
+    if (has_custom ||
+        IsDictInsertionOrdered(registry_namespace, /*inherit_global_namespace=*/false))
+        [[unlikely]] {
+        out->m_namespace = registry_namespace;
+    }
+    return out;
+}
+
+/*static*/ std::unique_ptr<PyTreeSpec> PyTreeSpec::FromArrays(
+    const py::object& kinds,
+    const py::object& arities,
+    const std::optional<py::dict>& node_data,
+    const bool& none_is_leaf,
+    const std::string& registry_namespace) {
+    if (none_is_leaf) [[unlikely]] {
+        return FromArraysImpl<NONE_IS_LEAF>(kinds, arities, node_data, registry_namespace);
+    } else [[likely]] {
+        return FromArraysImpl<NONE_IS_NODE>(kinds, arities, node_data, registry_namespace);
+    }
+}
+
+}  // namespace optree
@@ -216,10 +216,10 @@ template <bool NoneIsLeaf>
         }
 
         case PyTreeKind::Custom: {
-            const py::tuple out = EVALUATE_WITH_LOCK_HELD2(
-                thread_safe_cast<py::tuple>(node.custom->flatten_func(handle)),
+            const py::tuple out = PyTreeTypeRegistry::FlattenCustom(
+                node.custom,
                 handle,
-                node.custom->flatten_func);
+                /*sort_keys=*/!IsDictInsertionOrdered(registry_namespace));
             const ssize_t num_out = TupleGetSize(out);
             if (num_out != 2 && num_out != 3) [[unlikely]] {
                 std::ostringstream oss{};
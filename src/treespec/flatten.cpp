@@ -15,6 +15,8 @@ limitations under the License.
 ================================================================================
 */
 
+#include <algorithm>  // std::copy
+#include <iterator>   // std::back_inserter
 #include <memory>     // std::unique_ptr, std::make_unique
 #include <optional>   // std::optional
 #include <sstream>    // std::ostringstream
@@ -33,7 +35,30 @@ limitations under the License.
 
 namespace optree {
 
-template <bool NoneIsLeaf, bool DictShouldBeSorted, typename Span>
+// Containers flattened with `assume_unshared=True` are traversed without critical sections. In
+// debug builds, check that their sizes do not change during the traversal to catch misuse.
+template <bool AssumeUnshared>
+inline void ExpectUnmutated([[maybe_unused]] const py::handle& container,
+                            [[maybe_unused]] const ssize_t& expected_size) {
+#ifdef Py_DEBUG
+    if constexpr (AssumeUnshared) {
+        const ssize_t size = PyObject_Size(container.ptr());
+        if (size != expected_size) [[unlikely]] {
+            if (size < 0) [[unlikely]] {
+                throw py::error_already_set();
+            }
+            std::ostringstream oss{};
+            oss << "The container of type " << PyRepr(py::type::handle_of(container))
+                << " was mutated during flattening with `assume_unshared=True` (size changed from "
+                << expected_size << " to " << size
+                << "). The pytree must not be shared with other threads.";
+            throw std::runtime_error(oss.str());
+        }
+    }
+#endif
+}
+
+template <bool NoneIsLeaf, bool DictShouldBeSorted, bool AssumeUnshared, typename Span>
 // NOLINTNEXTLINE[readability-function-cognitive-complexity]
 bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
                                  Span& leaves,
@@ -52,9 +77,8 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
     const ssize_t start_num_leaves = py::ssize_t_cast(leaves.size());
 
     if (leaf_predicate &&
-        EVALUATE_WITH_LOCK_HELD2(thread_safe_cast<bool>((*leaf_predicate)(handle)),
-                                 handle,
-                                 *leaf_predicate)) [[unlikely]] {
+        EVALUATE_WITH_LOCK_HELD(thread_safe_cast<bool>((*leaf_predicate)(handle)), handle))
+        [[unlikely]] {
         leaves.emplace_back(py::reinterpret_borrow<py::object>(handle));
     } else [[likely]] {
         node.kind =
@@ -63,14 +87,23 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
             // NOLINTNEXTLINE[misc-no-recursion]
             [this, &found_custom, &leaf_predicate, &registry_namespace, &leaves, &depth](
                 const py::handle& child) -> void {
-            found_custom |= FlattenIntoImpl<NoneIsLeaf, DictShouldBeSorted>(child,
-                                                                            leaves,
-                                                                            depth + 1,
-                                                                            leaf_predicate,
-                                                                            registry_namespace);
+            found_custom |=
+                FlattenIntoImpl<NoneIsLeaf, DictShouldBeSorted, AssumeUnshared>(child,
+                                                                                leaves,
+                                                                                depth + 1,
+                                                                                leaf_predicate,
+                                                                                registry_namespace);
         };
         switch (node.kind) {
             case PyTreeKind::Leaf: {
+                if (PyTreeProxy::Check(handle)) [[unlikely]] {
+                    return FlattenProxyInto<NoneIsLeaf, DictShouldBeSorted, AssumeUnshared>(
+                        maybe_thread_safe_cast<const PyTreeProxy&, !AssumeUnshared>(handle),
+                        leaves,
+                        depth,
+                        leaf_predicate,
+                        registry_namespace);
+                }
                 leaves.emplace_back(py::reinterpret_borrow<py::object>(handle));
                 break;
             }
@@ -93,9 +126,10 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
             }
 
             case PyTreeKind::List: {
-                const scoped_critical_section cs{handle};
+                const maybe_critical_section<!AssumeUnshared> cs{handle};
                 node.arity = ListGetSize(handle);
                 for (ssize_t i = 0; i < node.arity; ++i) {
+                    ExpectUnmutated<AssumeUnshared>(handle, node.arity);
                     recurse(ListGetItem(handle, i));
                 }
                 break;
@@ -106,7 +140,7 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
             case PyTreeKind::DefaultDict: {
                 py::list keys;
                 {
-                    const scoped_critical_section cs{handle};
+                    const maybe_critical_section<!AssumeUnshared> cs{handle};
                     const auto dict = py::reinterpret_borrow<py::dict>(handle);
                     node.arity = DictGetSize(dict);
                     keys = DictKeys(dict);
@@ -117,11 +151,12 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
                         }
                     }
                     for (const py::handle& key : keys) {
+                        ExpectUnmutated<AssumeUnshared>(handle, node.arity);
                         recurse(DictGetItem(dict, key));
                     }
                 }
                 if (node.kind == PyTreeKind::DefaultDict) [[unlikely]] {
-                    const scoped_critical_section cs{handle};
+                    const maybe_critical_section<!AssumeUnshared> cs{handle};
                     node.node_data = py::make_tuple(py::getattr(handle, Py_Get_ID(default_factory)),
                                                     std::move(keys));
                 } else [[likely]] {
@@ -142,10 +177,12 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
             }
 
             case PyTreeKind::Deque: {
-                const auto list = thread_safe_cast<py::list>(handle);
+                const auto list = maybe_thread_safe_cast<py::list, !AssumeUnshared>(handle);
                 node.arity = ListGetSize(list);
-                node.node_data =
-                    EVALUATE_WITH_LOCK_HELD(py::getattr(handle, Py_Get_ID(maxlen)), handle);
+                {
+                    const maybe_critical_section<!AssumeUnshared> cs{handle};
+                    node.node_data = py::getattr(handle, Py_Get_ID(maxlen));
+                }
                 for (ssize_t i = 0; i < node.arity; ++i) {
                     recurse(ListGetItem(list, i));
                 }
@@ -154,10 +191,36 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
 
             case PyTreeKind::Custom: {
                 found_custom = true;
-                const py::tuple out = EVALUATE_WITH_LOCK_HELD2(
-                    thread_safe_cast<py::tuple>(node.custom->flatten_func(handle)),
-                    handle,
-                    node.custom->flatten_func);
+                if (node.custom->protocol == PyTreeNodeProtocol::Sequence) [[unlikely]] {
+                    const py::object sequence = SequenceFast(handle);
+                    const maybe_critical_section<!AssumeUnshared> cs{sequence};
+                    node.arity = SequenceFastGetSize(sequence);
+                    node.node_data = py::none();
+                    for (ssize_t i = 0; i < node.arity; ++i) {
+                        recurse(SequenceFastGetItem(sequence, i));
+                    }
+                    break;
+                }
+                if (node.custom->protocol == PyTreeNodeProtocol::Mapping) [[unlikely]] {
+                    const py::dict items = MappingToDict(handle);
+                    py::list keys = DictKeys(items);
+                    if constexpr (DictShouldBeSorted) {
+                        TotalOrderSort(keys);
+                    }
+                    node.arity = ListGetSize(keys);
+                    for (const py::handle& key : keys) {
+                        recurse(DictGetItem(items, key));
+                    }
+                    node.node_entries = py::tuple{std::move(keys)};
+                    node.node_data = node.node_entries;
+                    break;
+                }
+                py::tuple out{};
+                {
+                    const maybe_critical_section<!AssumeUnshared> cs{handle};
+                    out = maybe_thread_safe_cast<py::tuple, !AssumeUnshared>(
+                        node.custom->flatten_func(handle));
+                }
                 const ssize_t num_out = TupleGetSize(out);
                 if (num_out != 2 && num_out != 3) [[unlikely]] {
                     std::ostringstream oss{};
@@ -168,8 +231,9 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
                 node.arity = 0;
                 node.node_data = TupleGetItem(out, 1);
                 {
-                    auto children = thread_safe_cast<py::iterable>(TupleGetItem(out, 0));
-                    const scoped_critical_section cs{children};
+                    auto children = maybe_thread_safe_cast<py::iterable, !AssumeUnshared>(
+                        TupleGetItem(out, 0));
+                    const maybe_critical_section<!AssumeUnshared> cs{children};
                     for (const py::handle& child : children) {
                         ++node.arity;
                         recurse(child);
@@ -178,7 +242,8 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
                 if (num_out == 3) [[likely]] {
                     const py::object node_entries = TupleGetItem(out, 2);
                     if (!node_entries.is_none()) [[likely]] {
-                        node.node_entries = thread_safe_cast<py::tuple>(node_entries);
+                        node.node_entries =
+                            maybe_thread_safe_cast<py::tuple, !AssumeUnshared>(node_entries);
                         const ssize_t num_entries = TupleGetSize(node.node_entries);
                         if (num_entries != node.arity) [[unlikely]] {
                             std::ostringstream oss{};
@@ -203,6 +268,91 @@ bool PyTreeSpec::FlattenIntoImpl(const py::handle& handle,
     return found_custom;
 }
 
+template <bool NoneIsLeaf, bool DictShouldBeSorted, bool AssumeUnshared, typename Span>
+bool PyTreeSpec::FlattenProxyInto(const PyTreeProxy& proxy,
+                                  Span& leaves,
+                                  const ssize_t& depth,
+                                  const std::optional<py::function>& leaf_predicate,
+                                  const std::string& registry_namespace) {
+    const PyTreeSpec& spec = *proxy.m_spec;
+    const Node& root = proxy.GetNode();
+    const ssize_t first = proxy.m_pos - root.num_nodes + 1;
+
+    // The stored nodes and leaves can be copied only if they are what flattening the real
+    // containers with the given options would produce. The stored leaves may be pytrees (or `None`
+    // with `none_is_leaf=False`), the types may be registered differently in the given namespace,
+    // and the dictionary keys may be in a different order.
+    bool copies_custom = false;
+    const auto can_copy = [&]() -> bool {
+        if (leaf_predicate || spec.m_none_is_leaf != NoneIsLeaf ||
+            (!spec.m_namespace.empty() && spec.m_namespace != registry_namespace)) [[unlikely]] {
+            return false;
+        }
+        RegistrationPtr custom{nullptr};
+        for (ssize_t i = 0; i < root.num_leaves; ++i) {
+            const py::handle leaf = TupleGetItem(proxy.m_leaves, proxy.m_leaf_start + i);
+            if (PyTreeTypeRegistry::GetKind<NoneIsLeaf>(leaf, custom, registry_namespace) !=
+                    PyTreeKind::Leaf ||
+                PyTreeProxy::Check(leaf)) [[unlikely]] {
+                return false;
+            }
+        }
+        for (ssize_t pos = first; pos <= proxy.m_pos; ++pos) {
+            const Node& node = spec.m_traversal[pos];
+            if (node.kind == PyTreeKind::Custom) [[unlikely]] {
+                if (node.custom->protocol == PyTreeNodeProtocol::Mapping ||
+                    PyTreeTypeRegistry::Lookup<NoneIsLeaf>(node.custom->type,
+                                                           registry_namespace) != node.custom)
+                    [[unlikely]] {
+                    // The insertion order of the keys is not recorded, or the spec was built with
+                    // another registration of the type.
+                    return false;
+                }
+                copies_custom = true;
+            }
+            if ((node.kind == PyTreeKind::NamedTuple || node.kind == PyTreeKind::StructSequence) &&
+                PyTreeTypeRegistry::Lookup<NoneIsLeaf>(node.node_data, registry_namespace))
+                [[unlikely]] {
+                // The type is registered as a custom node in the given namespace.
+                return false;
+            }
+            if ((node.kind == PyTreeKind::Dict || node.kind == PyTreeKind::DefaultDict) &&
+                node.arity > 1) [[unlikely]] {
+                if (!node.original_keys) [[unlikely]] {
+                    return false;
+                }
+                const auto keys = (node.kind != PyTreeKind::DefaultDict
+                                       ? py::reinterpret_borrow<py::list>(node.node_data)
+                                       : TupleGetItemAs<py::list>(node.node_data, 1));
+                py::list expected = py::getattr(node.original_keys, Py_Get_ID(copy))();
+                if constexpr (DictShouldBeSorted) {
+                    TotalOrderSort(expected);
+                }
+                if (keys.not_equal(expected)) [[unlikely]] {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    if (!can_copy()) [[unlikely]] {
+        // The subtrees may flatten differently with the given options. Flatten the real
+        // containers instead.
+        return FlattenIntoImpl<NoneIsLeaf, DictShouldBeSorted, AssumeUnshared>(
+            proxy.Materialize(), leaves, depth, leaf_predicate, registry_namespace);
+    }
+
+    // Copy the nodes and the leaves of the subtree without building the real containers.
+    std::copy(spec.m_traversal.cbegin() + first,
+              spec.m_traversal.cbegin() + (proxy.m_pos + 1),
+              std::back_inserter(m_traversal));
+    for (ssize_t i = 0; i < root.num_leaves; ++i) {
+        leaves.emplace_back(TupleGetItem(proxy.m_leaves, proxy.m_leaf_start + i));
+    }
+    return copies_custom;
+}
+
+template <bool AssumeUnshared>
 bool PyTreeSpec::FlattenInto(const py::handle& handle,
                              std::vector<py::object>& leaves,
                              const std::optional<py::function>& leaf_predicate,
@@ -211,46 +361,36 @@ bool PyTreeSpec::FlattenInto(const py::handle& handle,
     bool found_custom = false;
     bool is_dict_insertion_ordered = false;
     bool is_dict_insertion_ordered_in_current_namespace = false;
-    {
-#ifdef HAVE_READ_WRITE_LOCK
-        const scoped_read_lock_guard lock{sm_is_dict_insertion_ordered_mutex};
-#endif
-        is_dict_insertion_ordered = IsDictInsertionOrdered(registry_namespace);
-        is_dict_insertion_ordered_in_current_namespace =
-            IsDictInsertionOrdered(registry_namespace, /*inherit_global_namespace=*/false);
+    // Read both flags from the same snapshot with a single atomic load.
+    if (const PyTreeConfigSnapshot* const config = PyTreeConfigSnapshot::Current();
+        config != nullptr) [[unlikely]] {
+        is_dict_insertion_ordered = PyTreeConfigSnapshot::HasFlag(
+            config->Get(registry_namespace, /*inherit_global_namespace=*/true),
+            PyTreeConfigFlag::DictInsertionOrdered);
+        is_dict_insertion_ordered_in_current_namespace = PyTreeConfigSnapshot::HasFlag(
+            config->Get(registry_namespace, /*inherit_global_namespace=*/false),
+            PyTreeConfigFlag::DictInsertionOrdered);
     }
 
     if (none_is_leaf) [[unlikely]] {
         if (!is_dict_insertion_ordered) [[likely]] {
             found_custom =
-                FlattenIntoImpl<NONE_IS_LEAF, /*DictShouldBeSorted=*/true>(handle,
-                                                                           leaves,
-                                                                           0,
-                                                                           leaf_predicate,
-                                                                           registry_namespace);
+                FlattenIntoImpl<NONE_IS_LEAF, /*DictShouldBeSorted=*/true, AssumeUnshared>(
+                    handle, leaves, 0, leaf_predicate, registry_namespace);
         } else [[unlikely]] {
             found_custom =
-                FlattenIntoImpl<NONE_IS_LEAF, /*DictShouldBeSorted=*/false>(handle,
-                                                                            leaves,
-                                                                            0,
-                                                                            leaf_predicate,
-                                                                            registry_namespace);
+                FlattenIntoImpl<NONE_IS_LEAF, /*DictShouldBeSorted=*/false, AssumeUnshared>(
+                    handle, leaves, 0, leaf_predicate, registry_namespace);
         }
     } else [[likely]] {
         if (!is_dict_insertion_ordered) [[likely]] {
             found_custom =
-                FlattenIntoImpl<NONE_IS_NODE, /*DictShouldBeSorted=*/true>(handle,
-                                                                           leaves,
-                                                                           0,
-                                                                           leaf_predicate,
-                                                                           registry_namespace);
+                FlattenIntoImpl<NONE_IS_NODE, /*DictShouldBeSorted=*/true, AssumeUnshared>(
+                    handle, leaves, 0, leaf_predicate, registry_namespace);
         } else [[unlikely]] {
             found_custom =
-                FlattenIntoImpl<NONE_IS_NODE, /*DictShouldBeSorted=*/false>(handle,
-                                                                            leaves,
-                                                                            0,
-                                                                            leaf_predicate,
-                                                                            registry_namespace);
+                FlattenIntoImpl<NONE_IS_NODE, /*DictShouldBeSorted=*/false, AssumeUnshared>(
+                    handle, leaves, 0, leaf_predicate, registry_namespace);
         }
     }
     return found_custom || is_dict_insertion_ordered_in_current_namespace;
@@ -260,12 +400,18 @@ bool PyTreeSpec::FlattenInto(const py::handle& handle,
     const py::object& tree,
     const std::optional<py::function>& leaf_predicate,
     const bool& none_is_leaf,
-    const std::string& registry_namespace) {
+    const std::string& registry_namespace,
+    const bool& assume_unshared) {
     auto leaves = reserved_vector<py::object>(4);
     auto treespec = std::make_unique<PyTreeSpec>();
     treespec->m_none_is_leaf = none_is_leaf;
-    if (treespec->FlattenInto(tree, leaves, leaf_predicate, none_is_leaf, registry_namespace))
-        [[unlikely]] {
+    const bool found_custom =
+        (assume_unshared
+             ? treespec->FlattenInto</*AssumeUnshared=*/true>(
+                   tree, leaves, leaf_predicate, none_is_leaf, registry_namespace)
+             : treespec->FlattenInto</*AssumeUnshared=*/false>(
+                   tree, leaves, leaf_predicate, none_is_leaf, registry_namespace));
+    if (found_custom) [[unlikely]] {
         treespec->m_namespace = registry_namespace;
     }
     treespec->m_traversal.shrink_to_fit();
@@ -297,9 +443,8 @@ bool PyTreeSpec::FlattenIntoWithPathImpl(const py::handle& handle,
     const ssize_t start_num_leaves = py::ssize_t_cast(leaves.size());
 
     if (leaf_predicate &&
-        EVALUATE_WITH_LOCK_HELD2(thread_safe_cast<bool>((*leaf_predicate)(handle)),
-                                 handle,
-                                 *leaf_predicate)) [[unlikely]] {
+        EVALUATE_WITH_LOCK_HELD(thread_safe_cast<bool>((*leaf_predicate)(handle)), handle))
+        [[unlikely]] {
         py::tuple path{depth};
         for (ssize_t d = 0; d < depth; ++d) {
             TupleSetItem(path, d, stack[d]);
@@ -331,6 +476,17 @@ bool PyTreeSpec::FlattenIntoWithPathImpl(const py::handle& handle,
         };
         switch (node.kind) {
             case PyTreeKind::Leaf: {
+                if (PyTreeProxy::Check(handle)) [[unlikely]] {
+                    // Build the real containers of lazy views to generate the paths.
+                    return FlattenIntoWithPathImpl<NoneIsLeaf, DictShouldBeSorted>(
+                        thread_safe_cast<const PyTreeProxy&>(handle).Materialize(),
+                        leaves,
+                        paths,
+                        stack,
+                        depth,
+                        leaf_predicate,
+                        registry_namespace);
+                }
                 py::tuple path{depth};
                 for (ssize_t d = 0; d < depth; ++d) {
                     TupleSetItem(path, d, stack[d]);
@@ -415,10 +571,32 @@ bool PyTreeSpec::FlattenIntoWithPathImpl(const py::handle& handle,
 
             case PyTreeKind::Custom: {
                 found_custom = true;
-                const py::tuple out = EVALUATE_WITH_LOCK_HELD2(
-                    thread_safe_cast<py::tuple>(node.custom->flatten_func(handle)),
-                    handle,
-                    node.custom->flatten_func);
+                if (node.custom->protocol == PyTreeNodeProtocol::Sequence) [[unlikely]] {
+                    const py::object sequence = SequenceFast(handle);
+                    const scoped_critical_section cs{sequence};
+                    node.arity = SequenceFastGetSize(sequence);
+                    node.node_data = py::none();
+                    for (ssize_t i = 0; i < node.arity; ++i) {
+                        recurse(SequenceFastGetItem(sequence, i), py::int_(i));
+                    }
+                    break;
+                }
+                if (node.custom->protocol == PyTreeNodeProtocol::Mapping) [[unlikely]] {
+                    const py::dict items = MappingToDict(handle);
+                    py::list keys = DictKeys(items);
+                    if constexpr (DictShouldBeSorted) {
+                        TotalOrderSort(keys);
+                    }
+                    node.arity = ListGetSize(keys);
+                    for (const py::handle& key : keys) {
+                        recurse(DictGetItem(items, key), key);
+                    }
+                    node.node_entries = py::tuple{std::move(keys)};
+                    node.node_data = node.node_entries;
+                    break;
+                }
+                const py::tuple out = EVALUATE_WITH_LOCK_HELD(
+                    thread_safe_cast<py::tuple>(node.custom->flatten_func(handle)), handle);
                 const ssize_t num_out = TupleGetSize(out);
                 if (num_out != 2 && num_out != 3) [[unlikely]] {
                     std::ostringstream oss{};
@@ -486,13 +664,15 @@ bool PyTreeSpec::FlattenIntoWithPath(const py::handle& handle,
     bool found_custom = false;
     bool is_dict_insertion_ordered = false;
     bool is_dict_insertion_ordered_in_current_namespace = false;
-    {
-#ifdef HAVE_READ_WRITE_LOCK
-        const scoped_read_lock_guard lock{sm_is_dict_insertion_ordered_mutex};
-#endif
-        is_dict_insertion_ordered = IsDictInsertionOrdered(registry_namespace);
-        is_dict_insertion_ordered_in_current_namespace =
-            IsDictInsertionOrdered(registry_namespace, /*inherit_global_namespace=*/false);
+    // Read both flags from the same snapshot with a single atomic load.
+    if (const PyTreeConfigSnapshot* const config = PyTreeConfigSnapshot::Current();
+        config != nullptr) [[unlikely]] {
+        is_dict_insertion_ordered = PyTreeConfigSnapshot::HasFlag(
+            config->Get(registry_namespace, /*inherit_global_namespace=*/true),
+            PyTreeConfigFlag::DictInsertionOrdered);
+        is_dict_insertion_ordered_in_current_namespace = PyTreeConfigSnapshot::HasFlag(
+            config->Get(registry_namespace, /*inherit_global_namespace=*/false),
+            PyTreeConfigFlag::DictInsertionOrdered);
     }
 
     auto stack = reserved_vector<py::handle>(4);
@@ -561,8 +741,9 @@ PyTreeSpec::FlattenWithPath(const py::object& tree,
     return std::make_tuple(std::move(paths), std::move(leaves), std::move(treespec));
 }
 
+template <bool AssumeUnshared>
 // NOLINTNEXTLINE[readability-function-cognitive-complexity]
-py::list PyTreeSpec::FlattenUpTo(const py::object& full_tree) const {
+py::list PyTreeSpec::FlattenUpToImpl(const py::object& full_tree) const {
     const ssize_t num_leaves = GetNumLeaves();
 
     auto agenda = reserved_vector<py::object>(4);
@@ -579,10 +760,16 @@ py::list PyTreeSpec::FlattenUpTo(const py::object& full_tree) const {
             throw py::value_error(oss.str());
         }
         const Node& node = *it;
-        const py::object object = std::move(agenda.back());
+        py::object object = std::move(agenda.back());
         agenda.pop_back();
         ++it;
 
+        if (node.kind != PyTreeKind::Leaf && PyTreeProxy::Check(object)) [[unlikely]] {
+            // Build the real containers of lazy views to match them against the treespec.
+            object = maybe_thread_safe_cast<const PyTreeProxy&, !AssumeUnshared>(object)
+                         .Materialize();
+        }
+
         switch (node.kind) {
             case PyTreeKind::Leaf: {
                 EXPECT_GE(leaf, 0, "Leaf count mismatch.");
@@ -622,7 +809,7 @@ py::list PyTreeSpec::FlattenUpTo(const py::object& full_tree) const {
 
             case PyTreeKind::List: {
                 AssertExactList(object);
-                const scoped_critical_section cs{object};
+                const maybe_critical_section<!AssumeUnshared> cs{object};
                 const auto list = py::reinterpret_borrow<py::list>(object);
                 if (ListGetSize(list) != node.arity) [[unlikely]] {
                     std::ostringstream oss{};
@@ -640,7 +827,7 @@ py::list PyTreeSpec::FlattenUpTo(const py::object& full_tree) const {
             case PyTreeKind::OrderedDict:
             case PyTreeKind::DefaultDict: {
                 AssertExactStandardDict(object);
-                const scoped_critical_section2 cs{object, node.node_data};
+                const maybe_critical_section2<!AssumeUnshared> cs{object, node.node_data};
                 const auto dict = py::reinterpret_borrow<py::dict>(object);
                 const py::list expected_keys =
                     (node.kind != PyTreeKind::DefaultDict
@@ -699,7 +886,7 @@ py::list PyTreeSpec::FlattenUpTo(const py::object& full_tree) const {
 
             case PyTreeKind::Deque: {
                 AssertExactDeque(object);
-                const auto list = thread_safe_cast<py::list>(object);
+                const auto list = maybe_thread_safe_cast<py::list, !AssumeUnshared>(object);
                 if (ListGetSize(list) != node.arity) [[unlikely]] {
                     std::ostringstream oss{};
                     oss << "deque arity mismatch; expected: " << node.arity
@@ -751,10 +938,10 @@ py::list PyTreeSpec::FlattenUpTo(const py::object& full_tree) const {
                         << "; value: " << PyRepr(object) << ".";
                     throw py::value_error(oss.str());
                 }
-                const py::tuple out = EVALUATE_WITH_LOCK_HELD2(
-                    thread_safe_cast<py::tuple>(node.custom->flatten_func(object)),
+                const py::tuple out = PyTreeTypeRegistry::FlattenCustom(
+                    node.custom,
                     object,
-                    node.custom->flatten_func);
+                    /*sort_keys=*/!IsDictInsertionOrdered(m_namespace));
                 const ssize_t num_out = TupleGetSize(out);
                 if (num_out != 2 && num_out != 3) [[unlikely]] {
                     std::ostringstream oss{};
@@ -775,8 +962,9 @@ py::list PyTreeSpec::FlattenUpTo(const py::object& full_tree) const {
                 }
                 ssize_t arity = 0;
                 {
-                    auto children = thread_safe_cast<py::iterable>(TupleGetItem(out, 0));
-                    const scoped_critical_section cs{children};
+                    auto children = maybe_thread_safe_cast<py::iterable, !AssumeUnshared>(
+                        TupleGetItem(out, 0));
+                    const maybe_critical_section<!AssumeUnshared> cs{children};
                     for (const py::handle& child : children) {
                         ++arity;
                         agenda.emplace_back(py::reinterpret_borrow<py::object>(child));
@@ -804,14 +992,20 @@ py::list PyTreeSpec::FlattenUpTo(const py::object& full_tree) const {
     return leaves;
 }
 
+py::list PyTreeSpec::FlattenUpTo(const py::object& full_tree, const bool& assume_unshared) const {
+    if (assume_unshared) [[unlikely]] {
+        return FlattenUpToImpl</*AssumeUnshared=*/true>(full_tree);
+    }
+    return FlattenUpToImpl</*AssumeUnshared=*/false>(full_tree);
+}
+
 template <bool NoneIsLeaf>
 bool IsLeafImpl(const py::handle& handle,
                 const std::optional<py::function>& leaf_predicate,
                 const std::string& registry_namespace) {
     if (leaf_predicate &&
-        EVALUATE_WITH_LOCK_HELD2(thread_safe_cast<bool>((*leaf_predicate)(handle)),
-                                 handle,
-                                 *leaf_predicate)) [[unlikely]] {
+        EVALUATE_WITH_LOCK_HELD(thread_safe_cast<bool>((*leaf_predicate)(handle)), handle))
+        [[unlikely]] {
         return true;
     }
     PyTreeTypeRegistry::RegistrationPtr custom{nullptr};
@@ -837,9 +1031,8 @@ bool AllLeavesImpl(const py::iterable& iterable,
     PyTreeTypeRegistry::RegistrationPtr custom{nullptr};
     for (const py::handle& handle : iterable) {
         if (leaf_predicate &&
-            EVALUATE_WITH_LOCK_HELD2(thread_safe_cast<bool>((*leaf_predicate)(handle)),
-                                     handle,
-                                     *leaf_predicate)) [[unlikely]] {
+            EVALUATE_WITH_LOCK_HELD(thread_safe_cast<bool>((*leaf_predicate)(handle)), handle))
+            [[unlikely]] {
             continue;
         }
         if (PyTreeTypeRegistry::GetKind<NoneIsLeaf>(handle, custom, registry_namespace) !=
@@ -36,6 +36,9 @@ namespace optree {
         Py_VISIT(node.node_entries.ptr());
         Py_VISIT(node.original_keys.ptr());
     }
+    for (const auto& [name, column] : self.m_annotations) {
+        Py_VISIT(column.values.ptr());
+    }
     return 0;
 }
 
@@ -54,6 +57,96 @@ namespace optree {
         Py_VISIT(pair.first.ptr());
     }
     Py_VISIT(self.m_root.ptr());
+    for (const auto& node : self.m_pending) {
+        Py_VISIT(node.node_data.ptr());
+        Py_VISIT(node.node_entries.ptr());
+        Py_VISIT(node.original_keys.ptr());
+    }
+    if (self.m_treespec) [[unlikely]] {
+        for (const auto& node : self.m_treespec->m_traversal) {
+            Py_VISIT(node.node_data.ptr());
+            Py_VISIT(node.node_entries.ptr());
+            Py_VISIT(node.original_keys.ptr());
+        }
+    }
+    return 0;
+}
+
+// NOLINTNEXTLINE[readability-function-cognitive-complexity]
+/*static*/ int PyTreeZipIter::PyTpTraverse(PyObject* self_base, visitproc visit, void* arg) {
+#if PY_VERSION_HEX >= 0x03090000  // Python 3.9
+    Py_VISIT(Py_TYPE(self_base));
+#endif
+    auto* const instance = reinterpret_cast<py::detail::instance*>(self_base);
+    if (!instance->get_value_and_holder().holder_constructed()) [[unlikely]] {
+        // The holder is not constructed yet. Skip the traversal to avoid segfault.
+        return 0;
+    }
+    auto& self = thread_safe_cast<PyTreeZipIter&>(py::handle{self_base});
+    for (const auto& object : self.m_agenda) {
+        Py_VISIT(object.ptr());
+    }
+    Py_VISIT(self.m_root.ptr());
+    Py_VISIT(self.m_rests.ptr());
+    return 0;
+}
+
+// NOLINTNEXTLINE[readability-function-cognitive-complexity]
+/*static*/ int PyTreeProxy::PyTpTraverse(PyObject* self_base, visitproc visit, void* arg) {
+#if PY_VERSION_HEX >= 0x03090000  // Python 3.9
+    Py_VISIT(Py_TYPE(self_base));
+#endif
+    auto* const instance = reinterpret_cast<py::detail::instance*>(self_base);
+    if (!instance->get_value_and_holder().holder_constructed()) [[unlikely]] {
+        // The holder is not constructed yet. Skip the traversal to avoid segfault.
+        return 0;
+    }
+    auto& self = thread_safe_cast<PyTreeProxy&>(py::handle{self_base});
+    for (const auto& child : self.m_children) {
+        Py_VISIT(child.ptr());
+    }
+    Py_VISIT(self.m_key_index.ptr());
+    Py_VISIT(self.m_leaves.ptr());
+    Py_VISIT(self.m_treespec.ptr());
+    return 0;
+}
+
+// NOLINTNEXTLINE[readability-function-cognitive-complexity]
+/*static*/ int PyTreeSchema::PyTpTraverse(PyObject* self_base, visitproc visit, void* arg) {
+#if PY_VERSION_HEX >= 0x03090000  // Python 3.9
+    Py_VISIT(Py_TYPE(self_base));
+#endif
+    auto* const instance = reinterpret_cast<py::detail::instance*>(self_base);
+    if (!instance->get_value_and_holder().holder_constructed()) [[unlikely]] {
+        // The holder is not constructed yet. Skip the traversal to avoid segfault.
+        return 0;
+    }
+    auto& self = thread_safe_cast<PyTreeSchema&>(py::handle{self_base});
+    for (const auto& constraint : self.m_constraints) {
+        for (const auto& type : constraint.types) {
+            Py_VISIT(type.ptr());
+        }
+        Py_VISIT(constraint.original.ptr());
+    }
+    for (const auto& path : self.m_paths) {
+        Py_VISIT(path.ptr());
+    }
+    Py_VISIT(self.m_treespec.ptr());
+    return 0;
+}
+
+// NOLINTNEXTLINE[readability-function-cognitive-complexity]
+/*static*/ int PyTreeTraversalArray::PyTpTraverse(PyObject* self_base, visitproc visit, void* arg) {
+#if PY_VERSION_HEX >= 0x03090000  // Python 3.9
+    Py_VISIT(Py_TYPE(self_base));
+#endif
+    auto* const instance = reinterpret_cast<py::detail::instance*>(self_base);
+    if (!instance->get_value_and_holder().holder_constructed()) [[unlikely]] {
+        // The holder is not constructed yet. Skip the traversal to avoid segfault.
+        return 0;
+    }
+    auto& self = thread_safe_cast<PyTreeTraversalArray&>(py::handle{self_base});
+    Py_VISIT(self.m_treespec.ptr());
     return 0;
 }
 
@@ -17,7 +17,10 @@ limitations under the License.
 
 #include "include/hashing.h"
 
+#include <atomic>         // std::atomic, std::memory_order_relaxed
 #include <exception>      // std::rethrow_exception, std::current_exception
+#include <functional>     // std::hash
+#include <string_view>    // std::string_view
 #include <thread>         // std::this_thread::get_id
 #include <unordered_set>  // std::unordered_set
 
@@ -29,25 +32,176 @@ limitations under the License.
 
 namespace optree {
 
-ssize_t PyTreeSpec::HashValueImpl() const {
-    ssize_t seed = 0;
+// The maximum number of objects in the metadata intern table.
+constexpr ssize_t MAX_INTERN_TABLE_SIZE = 65536;
 
-    HashCombine(seed, GetNumLeaves());
-    HashCombine(seed, GetNumNodes());
-    HashCombine(seed, m_none_is_leaf);
-    HashCombine(seed, m_namespace);
+// The intern table is cleared when it is full, so it does not grow without bound. Each clearing
+// starts a new generation, and the intern IDs encode the generation in which they were assigned.
+// IDs from different generations are not comparable.
+//
+// Only objects whose equality does not call back into Python code are interned. Values of the
+// immutable builtin types (e.g., the `str` keys of dicts) are kept in the table until it is
+// cleared. Classes and functions compare by identity, so they are keyed by weak references and are
+// not kept alive by the table. Other objects (e.g., user-defined metadata) are not interned, and
+// the treespecs holding them are compared element-wise.
+static std::atomic<ssize_t> sm_intern_generation{0};
+static std::atomic<ssize_t> sm_intern_next_id{0};
+
+static const py::dict& GetInternTable() {
+    PYBIND11_CONSTINIT static py::gil_safe_call_once_and_store<py::dict> storage;
+    return storage.call_once_and_store_result([]() -> py::dict { return py::dict{}; })
+        .get_stored();
+}
+
+// The maximum nesting depth of the tuples interned by value.
+constexpr ssize_t MAX_INTERN_TUPLE_DEPTH = 8;
+
+// NOLINTNEXTLINE[misc-no-recursion]
+static bool IsImmutableValue(const py::handle& object, const ssize_t& depth = 0) {
+    PyObject* const ptr = object.ptr();
+    if (ptr == Py_None || PyBool_Check(ptr) || PyLong_CheckExact(ptr) || PyFloat_CheckExact(ptr) ||
+        PyUnicode_CheckExact(ptr) || PyBytes_CheckExact(ptr)) [[likely]] {
+        return true;
+    }
+    if (PyTuple_CheckExact(ptr) && depth < MAX_INTERN_TUPLE_DEPTH) [[unlikely]] {
+        for (const py::handle& item : py::reinterpret_borrow<py::tuple>(object)) {
+            if (!IsImmutableValue(item, depth + 1)) [[unlikely]] {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+ssize_t PyTreeSpec::InternMetadata(const py::handle& object, const ssize_t& generation) {
+    const py::dict& table = GetInternTable();
+
+    py::object key{};
+    if (IsImmutableValue(object)) [[likely]] {
+        key = py::reinterpret_borrow<py::object>(object);
+    } else if (PyType_CheckExact(object.ptr()) || PyFunction_Check(object.ptr())) [[likely]] {
+        // A dead weak reference only compares equal to itself, so its entry is never matched again
+        // (even if the address of the object is reused).
+        PyObject* const ref = PyWeakref_NewRef(object.ptr(), nullptr);
+        if (ref == nullptr) [[unlikely]] {
+            PyErr_Clear();
+            return -1;
+        }
+        key = py::reinterpret_steal<py::object>(ref);
+    } else [[unlikely]] {
+        return -1;
+    }
+
+    // The table may be cleared by another thread, so hold strong references to the IDs.
+    py::object id{};
+    int found = 0;
+#if PY_VERSION_HEX >= 0x030D00A1  // Python 3.13.0a1
+    PyObject* value = nullptr;
+    found = PyDict_GetItemRef(table.ptr(), key.ptr(), &value);
+    id = py::reinterpret_steal<py::object>(value);
+#else
+    id = py::reinterpret_borrow<py::object>(PyDict_GetItemWithError(table.ptr(), key.ptr()));
+    found = (id ? 1 : (PyErr_Occurred() != nullptr ? -1 : 0));
+#endif
+    if (found < 0) [[unlikely]] {
+        // Fall back to the element-wise comparison if the object cannot be interned (e.g., it is
+        // a tuple with an unhashable item).
+        PyErr_Clear();
+        return -1;
+    }
+    if (found == 0) [[unlikely]] {
+        if (sm_intern_generation.load(std::memory_order_acquire) != generation) [[unlikely]] {
+            return -1;
+        }
+        if (sm_intern_next_id.load(std::memory_order_relaxed) >= MAX_INTERN_TABLE_SIZE)
+            [[unlikely]] {
+            // Evict all entries and start a new generation. Only one thread clears the table.
+            ssize_t expected = generation;
+            if (sm_intern_generation.compare_exchange_strong(
+                    expected, generation + 1, std::memory_order_acq_rel)) [[likely]] {
+                sm_intern_next_id.store(0, std::memory_order_release);
+                PyDict_Clear(table.ptr());
+            }
+            return -1;
+        }
+        const ssize_t new_id = sm_intern_next_id.fetch_add(1, std::memory_order_relaxed);
+        if (new_id >= MAX_INTERN_TABLE_SIZE) [[unlikely]] {
+            return -1;
+        }
+        // Another thread may have inserted an equal object in the meantime.
+        const py::int_ candidate{generation * MAX_INTERN_TABLE_SIZE + new_id};
+#if PY_VERSION_HEX >= 0x030D00A1  // Python 3.13.0a1
+        if (PyDict_SetDefaultRef(table.ptr(), key.ptr(), candidate.ptr(), &value) < 0)
+            [[unlikely]] {
+            PyErr_Clear();
+            return -1;
+        }
+        id = py::reinterpret_steal<py::object>(value);
+#else
+        id = py::reinterpret_borrow<py::object>(
+            PyDict_SetDefault(table.ptr(), key.ptr(), candidate.ptr()));
+        if (!id) [[unlikely]] {
+            PyErr_Clear();
+            return -1;
+        }
+#endif
+    }
+    const ssize_t result = PyLong_AsSsize_t(id.ptr());
+    // The entry may have been inserted by a thread that was still in a previous generation.
+    if (result / MAX_INTERN_TABLE_SIZE != generation) [[unlikely]] {
+        return -1;
+    }
+    return result;
+}
+
+PyTreeSpec::Signature PyTreeSpec::MakeSignature() const {
+    Signature signature{};
+    signature.words.reserve(m_traversal.size() * 4);
+    signature.ids.reserve(m_traversal.size());
+    signature.interned = true;
+    signature.generation = sm_intern_generation.load(std::memory_order_acquire);
+
+    const auto hash = [&signature](const py::handle& object) -> void {
+        signature.words.emplace_back(EVALUATE_WITH_LOCK_HELD(py::hash(object), object));
+    };
+    const auto intern = [&signature](const py::handle& object) -> void {
+        if (!signature.interned) [[unlikely]] {
+            return;
+        }
+        const ssize_t id = InternMetadata(object, signature.generation);
+        if (id < 0) [[unlikely]] {
+            signature.interned = false;
+            signature.ids.clear();
+            return;
+        }
+        signature.ids.emplace_back(id);
+    };
 
     for (const Node& node : m_traversal) {
-        HashCombine(seed, node.kind);
-        HashCombine(seed, node.arity);
-        HashCombine(seed, node.num_leaves);
-        HashCombine(seed, node.num_nodes);
+        signature.words.emplace_back(static_cast<ssize_t>(node.kind));
+        signature.words.emplace_back(node.arity);
+        signature.words.emplace_back(node.num_leaves);
+        signature.words.emplace_back(node.num_nodes);
 
         switch (node.kind) {
             case PyTreeKind::Custom: {
-                // We don't hash node_data of custom node types since they may not hashable.
-                const auto& type = GetType(node);
-                HashCombine(seed, EVALUATE_WITH_LOCK_HELD(py::hash(type), type));
+                // We don't hash node_data of custom node types since they may not hashable, unless
+                // the registration provides a metadata key or declares the metadata hashable.
+                hash(node.custom->type);
+                const py::object& metadata_key = node.custom->metadata_key;
+                if (metadata_key && !metadata_key.is_none()) [[unlikely]] {
+                    const py::object metadata = node.node_data ? node.node_data : py::none();
+                    if (metadata_key.ptr() == Py_True) [[likely]] {
+                        hash(metadata);
+                    } else [[unlikely]] {
+                        hash(metadata_key(metadata));
+                    }
+                }
+                if (signature.interned) [[likely]] {
+                    signature.ids.emplace_back(reinterpret_cast<ssize_t>(node.custom.get()));
+                }
+                intern(node.node_data ? node.node_data : py::none());
                 break;
             }
 
@@ -58,10 +212,10 @@ ssize_t PyTreeSpec::HashValueImpl() const {
             case PyTreeKind::NamedTuple:
             case PyTreeKind::Deque:
             case PyTreeKind::StructSequence: {
-                HashCombine(
-                    seed,
-                    EVALUATE_WITH_LOCK_HELD(py::hash(node.node_data ? node.node_data : py::none()),
-                                            node.node_data));
+                if (node.node_data) [[unlikely]] {
+                    hash(node.node_data);
+                    intern(node.node_data);
+                }
                 break;
             }
 
@@ -72,9 +226,8 @@ ssize_t PyTreeSpec::HashValueImpl() const {
                 if (node.kind == PyTreeKind::DefaultDict) [[unlikely]] {
                     EXPECT_EQ(TupleGetSize(node.node_data), 2, "Number of metadata mismatch.");
                     const py::object default_factory = TupleGetItem(node.node_data, 0);
-                    HashCombine(
-                        seed,
-                        EVALUATE_WITH_LOCK_HELD(py::hash(default_factory), default_factory));
+                    hash(default_factory);
+                    intern(default_factory);
                 }
                 const auto keys = (node.kind != PyTreeKind::DefaultDict
                                        ? py::reinterpret_borrow<py::list>(node.node_data)
@@ -83,7 +236,8 @@ ssize_t PyTreeSpec::HashValueImpl() const {
                           node.arity,
                           "Number of keys and entries does not match.");
                 for (const py::handle& key : keys) {
-                    HashCombine(seed, EVALUATE_WITH_LOCK_HELD(py::hash(key), key));
+                    hash(key);
+                    intern(key);
                 }
                 break;
             }
@@ -92,6 +246,22 @@ ssize_t PyTreeSpec::HashValueImpl() const {
                 INTERNAL_ERROR();
         }
     }
+    return signature;
+}
+
+const PyTreeSpec::Signature& PyTreeSpec::GetSignature() const {
+    return m_signature.get([this]() -> Signature { return MakeSignature(); });
+}
+
+ssize_t PyTreeSpec::HashValueImpl() const {
+    const Signature& signature = GetSignature();
+
+    // Hash the packed words as a contiguous byte string.
+    auto seed = static_cast<ssize_t>(std::hash<std::string_view>{}(
+        std::string_view{reinterpret_cast<const char*>(signature.words.data()),
+                         signature.words.size() * sizeof(ssize_t)}));
+    HashCombine(seed, m_none_is_leaf);
+    HashCombine(seed, m_namespace);
     return seed;
 }
 
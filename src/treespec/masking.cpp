@@ -0,0 +1,262 @@
+/*
+Copyright 2022-2024 MetaOPT Team. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+================================================================================
+*/
+
+#include <algorithm>  // std::reverse
+#include <optional>   // std::optional
+#include <sstream>    // std::ostringstream
+#include <string>     // std::string
+#include <utility>    // std::pair, std::move
+#include <vector>     // std::vector
+
+#include "include/exceptions.h"
+#include "include/pytypes.h"
+#include "include/stdutils.h"
+#include "include/synchronization.h"
+#include "include/treespec.h"
+
+namespace optree {
+
+std::vector<py::object> PyTreeSpec::BroadcastPrefixLeaves(
+    const PyTreeSpec& prefix,
+    const std::vector<py::object>& prefix_leaves) const {
+    EXPECT_EQ(py::ssize_t_cast(prefix_leaves.size()),
+              prefix.GetNumLeaves(),
+              "Number of prefix leaves mismatch.");
+
+    // The number of leaves before each node in the post-order traversal, which is the index of the
+    // first leaf in the subtree rooted at the node after skipping its descendants.
+    const auto count_leaves_before =
+        [](const std::vector<Node>& traversal) -> std::vector<ssize_t> {
+        auto counts = reserved_vector<ssize_t>(traversal.size() + 1);
+        counts.emplace_back(0);
+        for (const Node& node : traversal) {
+            counts.emplace_back(counts.back() + (node.kind == PyTreeKind::Leaf ? 1 : 0));
+        }
+        return counts;
+    };
+    // The post-order indices of the children of the node at the given index.
+    const auto child_indices = [](const std::vector<Node>& traversal,
+                                  const ssize_t& index) -> std::vector<ssize_t> {
+        const Node& node = traversal.at(index);
+        auto indices = reserved_vector<ssize_t>(node.arity);
+        ssize_t cur = index - 1;
+        for (ssize_t i = 0; i < node.arity; ++i) {
+            EXPECT_GE(cur, 0, "PyTreeSpec traversal out of range.");
+            indices.emplace_back(cur);
+            cur -= traversal.at(cur).num_nodes;
+        }
+        std::reverse(indices.begin(), indices.end());
+        return indices;
+    };
+
+    const std::vector<ssize_t> leaves_before = count_leaves_before(m_traversal);
+    const std::vector<ssize_t> prefix_leaves_before = count_leaves_before(prefix.m_traversal);
+
+    std::vector<py::object> result(GetNumLeaves());
+    std::vector<std::pair<ssize_t, ssize_t>> agenda{
+        {prefix.GetNumNodes() - 1, GetNumNodes() - 1},
+    };
+    while (!agenda.empty()) {
+        const auto [a, b] = agenda.back();
+        agenda.pop_back();
+        const Node& prefix_node = prefix.m_traversal.at(a);
+        const Node& node = m_traversal.at(b);
+
+        if (prefix_node.kind == PyTreeKind::Leaf) [[unlikely]] {
+            const py::object& value = prefix_leaves[prefix_leaves_before[a]];
+            const ssize_t first = leaves_before[b - node.num_nodes + 1];
+            for (ssize_t i = first; i < first + node.num_leaves; ++i) {
+                result[i] = value;
+            }
+            continue;
+        }
+
+        EXPECT_EQ(prefix_node.arity, node.arity, "Node arity mismatch.");
+        const std::vector<ssize_t> prefix_children = child_indices(prefix.m_traversal, a);
+        std::vector<ssize_t> children = child_indices(m_traversal, b);
+
+        // Dictionaries with the same keys may be in different orders (e.g., `OrderedDict`).
+        if ((prefix_node.kind == PyTreeKind::Dict || prefix_node.kind == PyTreeKind::OrderedDict ||
+             prefix_node.kind == PyTreeKind::DefaultDict) &&
+            prefix_node.arity > 0) [[unlikely]] {
+            const scoped_critical_section2 cs(prefix_node.node_data, node.node_data);
+            const auto prefix_keys = (prefix_node.kind != PyTreeKind::DefaultDict
+                                          ? py::reinterpret_borrow<py::list>(prefix_node.node_data)
+                                          : TupleGetItemAs<py::list>(prefix_node.node_data, 1));
+            const auto keys = (node.kind != PyTreeKind::DefaultDict
+                                   ? py::reinterpret_borrow<py::list>(node.node_data)
+                                   : TupleGetItemAs<py::list>(node.node_data, 1));
+            if (prefix_keys.not_equal(keys)) [[unlikely]] {
+                const py::dict positions{};
+                for (ssize_t i = 0; i < node.arity; ++i) {
+                    DictSetItem(positions, ListGetItem(keys, i), py::int_(i));
+                }
+                auto reordered = reserved_vector<ssize_t>(node.arity);
+                for (ssize_t i = 0; i < node.arity; ++i) {
+                    reordered.emplace_back(
+                        children[thread_safe_cast<ssize_t>(
+                            DictGetItem(positions, ListGetItem(prefix_keys, i)))]);
+                }
+                children = std::move(reordered);
+            }
+        }
+
+        for (ssize_t i = 0; i < node.arity; ++i) {
+            agenda.emplace_back(prefix_children[i], children[i]);
+        }
+    }
+    return result;
+}
+
+py::tuple TreePartition(const py::object& tree,
+                        const py::object& predicate_or_mask_tree,
+                        const py::object& placeholder,
+                        const std::optional<py::function>& leaf_predicate,
+                        const bool& none_is_leaf,
+                        const std::string& registry_namespace) {
+    auto [leaves, treespec] =
+        PyTreeSpec::Flatten(tree, leaf_predicate, none_is_leaf, registry_namespace);
+    const ssize_t num_leaves = treespec->GetNumLeaves();
+
+    // A callable is a leaf of the mask tree, which is broadcast to all leaves.
+    std::vector<py::object> selectors{};
+    if (PyCallable_Check(predicate_or_mask_tree.ptr()) != 0) [[likely]] {
+        selectors.assign(num_leaves, predicate_or_mask_tree);
+    } else [[unlikely]] {
+        auto [mask_leaves, maskspec] = PyTreeSpec::Flatten(predicate_or_mask_tree,
+                                                           leaf_predicate,
+                                                           none_is_leaf,
+                                                           registry_namespace);
+        if (!maskspec->IsPrefix(*treespec)) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Expected the mask tree to be a prefix of the tree, got mask structure "
+                << maskspec->ToString() << " and tree structure " << treespec->ToString() << ".";
+            throw py::value_error(oss.str());
+        }
+        selectors = treespec->BroadcastPrefixLeaves(*maskspec, mask_leaves);
+    }
+
+    const py::tuple selected{num_leaves};
+    const py::tuple rejected{num_leaves};
+    for (ssize_t i = 0; i < num_leaves; ++i) {
+        const py::object& leaf = leaves[i];
+        const py::object& selector = selectors[i];
+        int truth = 0;
+        if (PyCallable_Check(selector.ptr()) != 0) [[likely]] {
+            truth = PyObject_IsTrue(selector(leaf).ptr());
+        } else [[unlikely]] {
+            truth = PyObject_IsTrue(selector.ptr());
+        }
+        if (truth < 0) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        TupleSetItem(selected, i, truth != 0 ? leaf : placeholder);
+        TupleSetItem(rejected, i, truth != 0 ? placeholder : leaf);
+    }
+    return py::make_tuple(treespec->Unflatten(selected), treespec->Unflatten(rejected));
+}
+
+py::object TreeCombine(const py::tuple& trees,
+                       const py::object& placeholder,
+                       const std::optional<py::function>& leaf_predicate,
+                       const bool& none_is_leaf,
+                       const std::string& registry_namespace) {
+    const ssize_t num_trees = TupleGetSize(trees);
+    if (num_trees == 0) [[unlikely]] {
+        throw py::value_error("Expected at least one pytree to combine.");
+    }
+
+    // The placeholder must occupy a leaf position, so `None` placeholders are treated as leaves.
+    const bool placeholder_is_leaf = none_is_leaf || placeholder.is_none();
+    auto [leaves, treespec] = PyTreeSpec::Flatten(
+        TupleGetItem(trees, 0), leaf_predicate, placeholder_is_leaf, registry_namespace);
+    for (ssize_t i = 1; i < num_trees; ++i) {
+        auto [other_leaves, other_treespec] = PyTreeSpec::Flatten(
+            TupleGetItem(trees, i), leaf_predicate, placeholder_is_leaf, registry_namespace);
+        if (*other_treespec != *treespec) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Expected every pytree to have the same structure, got "
+                << treespec->ToString() << " and " << other_treespec->ToString() << ".";
+            throw py::value_error(oss.str());
+        }
+        for (ssize_t j = 0; j < py::ssize_t_cast(leaves.size()); ++j) {
+            if (leaves[j].is(placeholder)) [[unlikely]] {
+                leaves[j] = std::move(other_leaves[j]);
+            }
+        }
+    }
+
+    const ssize_t num_leaves = py::ssize_t_cast(leaves.size());
+    const py::tuple combined{num_leaves};
+    for (ssize_t i = 0; i < num_leaves; ++i) {
+        TupleSetItem(combined, i, leaves[i]);
+    }
+    return treespec->Unflatten(combined);
+}
+
+// Convert a vector of leaves to a tuple for unflattening.
+static py::tuple LeavesToTuple(const std::vector<py::object>& leaves) {
+    const ssize_t num_leaves = py::ssize_t_cast(leaves.size());
+    const py::tuple tuple{num_leaves};
+    for (ssize_t i = 0; i < num_leaves; ++i) {
+        TupleSetItem(tuple, i, leaves[i]);
+    }
+    return tuple;
+}
+
+py::tuple TreeBroadcastCommon(const py::object& tree,
+                              const py::object& other_tree,
+                              const std::optional<py::function>& leaf_predicate,
+                              const bool& none_is_leaf,
+                              const std::string& registry_namespace) {
+    auto [leaves, treespec] =
+        PyTreeSpec::Flatten(tree, leaf_predicate, none_is_leaf, registry_namespace);
+    auto [other_leaves, other_treespec] =
+        PyTreeSpec::Flatten(other_tree, leaf_predicate, none_is_leaf, registry_namespace);
+
+    // Each tree keeps its own node types and key order, so the common suffix is taken from both
+    // sides. The leaves are broadcast during the same walks.
+    [[maybe_unused]] auto [common_treespec, common_leaves, unused_other_leaves] =
+        treespec->BroadcastToCommonSuffixLeaves(*other_treespec, leaves, other_leaves);
+    [[maybe_unused]] auto [other_common_treespec, other_common_leaves, unused_leaves] =
+        other_treespec->BroadcastToCommonSuffixLeaves(*treespec, other_leaves, leaves);
+    return py::make_tuple(common_treespec->Unflatten(LeavesToTuple(common_leaves)),
+                          other_common_treespec->Unflatten(LeavesToTuple(other_common_leaves)));
+}
+
+py::tuple BroadcastCommon(const py::object& tree,
+                          const py::object& other_tree,
+                          const std::optional<py::function>& leaf_predicate,
+                          const bool& none_is_leaf,
+                          const std::string& registry_namespace) {
+    auto [leaves, treespec] =
+        PyTreeSpec::Flatten(tree, leaf_predicate, none_is_leaf, registry_namespace);
+    auto [other_leaves, other_treespec] =
+        PyTreeSpec::Flatten(other_tree, leaf_predicate, none_is_leaf, registry_namespace);
+
+    auto [common_treespec, common_leaves, other_common_leaves] =
+        treespec->BroadcastToCommonSuffixLeaves(*other_treespec, leaves, other_leaves);
+    const py::list result{};
+    const py::list other_result{};
+    for (ssize_t i = 0; i < py::ssize_t_cast(common_leaves.size()); ++i) {
+        result.append(std::move(common_leaves[i]));
+        other_result.append(std::move(other_common_leaves[i]));
+    }
+    return py::make_tuple(result, other_result);
+}
+
+}  // namespace optree
@@ -16,6 +16,7 @@ limitations under the License.
 */
 
 #include <algorithm>      // std::copy, std::reverse
+#include <cstring>        // std::memcmp
 #include <unordered_map>  // std::unordered_map
 #include <vector>         // std::vector
 
@@ -23,7 +24,6 @@ limitations under the License.
 #include "include/pytypes.h"
 #include "include/registry.h"
 #include "include/stdutils.h"
-#include "include/synchronization.h"
 #include "include/treespec.h"
 
 namespace optree {
@@ -80,7 +80,6 @@ bool PyTreeSpec::IsPrefix(const PyTreeSpec &other, const bool &strict) const {
                     b->kind != PyTreeKind::DefaultDict) [[likely]] {
                     return false;
                 }
-                const scoped_critical_section2 cs(a->node_data, b->node_data);
                 const auto expected_keys = (a->kind != PyTreeKind::DefaultDict
                                                 ? py::reinterpret_borrow<py::list>(a->node_data)
                                                 : TupleGetItemAs<py::list>(a->node_data, 1));
@@ -144,9 +143,9 @@ bool PyTreeSpec::IsPrefix(const PyTreeSpec &other, const bool &strict) const {
             case PyTreeKind::NamedTuple:
             case PyTreeKind::StructSequence:
             case PyTreeKind::Custom: {
-                const scoped_critical_section2 cs(a->node_data, b->node_data);
-                if (a->kind != b->kind || (a->node_data && a->node_data.not_equal(b->node_data)))
-                    [[likely]] {
+                if (a->kind != b->kind ||
+                    (a->node_data && !a->node_data.is(b->node_data) &&
+                     a->node_data.not_equal(b->node_data))) [[likely]] {
                     return false;
                 }
                 break;
@@ -165,6 +164,12 @@ bool PyTreeSpec::IsPrefix(const PyTreeSpec &other, const bool &strict) const {
     return !strict || !all_leaves_match;
 }
 
+// Compare two packed word arrays with a length check and a single `memcmp`.
+static inline bool WordsEqual(const std::vector<ssize_t> &a, const std::vector<ssize_t> &b) {
+    return a.size() == b.size() &&
+           (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(ssize_t)) == 0);
+}
+
 bool PyTreeSpec::EqualTo(const PyTreeSpec &other) const {
     if (m_traversal.size() != other.m_traversal.size() || m_none_is_leaf != other.m_none_is_leaf)
         [[likely]] {
@@ -175,6 +180,18 @@ bool PyTreeSpec::EqualTo(const PyTreeSpec &other) const {
         return false;
     }
 
+    // Compare the canonical signatures first. Equal treespecs always have equal words. If all
+    // metadata are interned, the intern IDs decide the equality without calling back into Python.
+    const Signature &signature = GetSignature();
+    const Signature &other_signature = other.GetSignature();
+    if (!WordsEqual(signature.words, other_signature.words)) [[likely]] {
+        return false;
+    }
+    if (signature.interned && other_signature.interned &&
+        signature.generation == other_signature.generation) [[likely]] {
+        return WordsEqual(signature.ids, other_signature.ids);
+    }
+
     // NOLINTNEXTLINE[readability-qualified-auto]
     auto b = other.m_traversal.cbegin();
     // NOLINTNEXTLINE[readability-qualified-auto]
@@ -184,8 +201,9 @@ bool PyTreeSpec::EqualTo(const PyTreeSpec &other) const {
             a->custom != b->custom) [[likely]] {
             return false;
         }
-        const scoped_critical_section2 cs(a->node_data, b->node_data);
-        if (a->node_data && a->node_data.not_equal(b->node_data)) [[likely]] {
+        // Identical metadata is equal without calling `__eq__`.
+        if (a->node_data && !a->node_data.is(b->node_data) &&
+            a->node_data.not_equal(b->node_data)) [[likely]] {
             return false;
         }
         EXPECT_EQ(a->num_leaves, b->num_leaves);
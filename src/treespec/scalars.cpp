@@ -0,0 +1,162 @@
+/*
+Copyright 2022-2024 MetaOPT Team. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+================================================================================
+*/
+
+#include <cstdint>   // std::int64_t
+#include <cstring>   // std::memcpy
+#include <memory>    // std::unique_ptr
+#include <optional>  // std::optional
+#include <sstream>   // std::ostringstream
+#include <string>    // std::string
+#include <tuple>     // std::tuple, std::make_tuple
+#include <utility>   // std::move
+#include <vector>    // std::vector
+
+#include "include/exceptions.h"
+#include "include/pytypes.h"
+#include "include/treespec.h"
+
+namespace optree {
+
+std::tuple<py::bytearray, py::str, py::bytes, std::unique_ptr<PyTreeSpec>> TreeRavelScalars(
+    const py::object& tree,
+    const std::optional<py::function>& leaf_predicate,
+    const bool& none_is_leaf,
+    const std::string& registry_namespace) {
+    auto [leaves, treespec] =
+        PyTreeSpec::Flatten(tree, leaf_predicate, none_is_leaf, registry_namespace);
+    const ssize_t num_leaves = py::ssize_t_cast(leaves.size());
+
+    // Only exact types are accepted, so subclasses that may override `__float__` or `__index__`
+    // (e.g., `enum.IntEnum`) are never silently converted.
+    std::string kinds(num_leaves, '\0');
+    bool has_float = false;
+    for (ssize_t i = 0; i < num_leaves; ++i) {
+        PyObject* const leaf = leaves[i].ptr();
+        if (PyFloat_CheckExact(leaf)) [[likely]] {
+            kinds[i] = 'f';
+            has_float = true;
+        } else if (PyBool_Check(leaf)) {
+            kinds[i] = 'b';
+        } else if (PyLong_CheckExact(leaf)) [[likely]] {
+            kinds[i] = 'i';
+        } else [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Expected every leaf to be an exact `float`, `int`, or `bool`, got "
+                << PyRepr(leaves[i]) << " at leaf index " << i << ".";
+            throw py::type_error(oss.str());
+        }
+    }
+
+    static_assert(sizeof(double) == sizeof(std::int64_t));
+    py::bytearray data{nullptr, static_cast<size_t>(num_leaves) * sizeof(double)};
+    char* const buffer = PyByteArray_AS_STRING(data.ptr());
+    for (ssize_t i = 0; i < num_leaves; ++i) {
+        PyObject* const leaf = leaves[i].ptr();
+        if (has_float) [[likely]] {
+            const double value =
+                (kinds[i] == 'f' ? PyFloat_AS_DOUBLE(leaf) : PyLong_AsDouble(leaf));
+            if (value == -1.0 && PyErr_Occurred() != nullptr) [[unlikely]] {
+                throw py::error_already_set();
+            }
+            std::memcpy(buffer + i * sizeof(double), &value, sizeof(double));
+        } else {
+            const std::int64_t value = PyLong_AsLongLong(leaf);
+            if (value == -1 && PyErr_Occurred() != nullptr) [[unlikely]] {
+                throw py::error_already_set();
+            }
+            std::memcpy(buffer + i * sizeof(std::int64_t), &value, sizeof(std::int64_t));
+        }
+    }
+    return std::make_tuple(std::move(data),
+                           py::str{has_float ? "d" : "q"},
+                           py::bytes{kinds},
+                           std::move(treespec));
+}
+
+py::object TreeUnravelScalars(const PyTreeSpec& treespec,
+                              const py::object& flat,
+                              const py::bytes& kinds) {
+    const ssize_t num_leaves = treespec.GetNumLeaves();
+    const auto codes = static_cast<std::string>(kinds);
+    if (py::ssize_t_cast(codes.size()) != num_leaves) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "Expected " << num_leaves << " leaf type codes, got " << codes.size() << ".";
+        throw py::value_error(oss.str());
+    }
+
+    // Read the values as `double` or as integers, depending on the buffer format.
+    std::vector<double> reals{};
+    std::vector<ssize_t> integers{};
+    if (IsIntegerArray(flat)) {
+        integers = ReadIntegerArray(flat, "flat");
+    } else if (PyObject_CheckBuffer(flat.ptr()) != 0) [[likely]] {
+        const py::buffer_info info = py::reinterpret_borrow<py::buffer>(flat).request();
+        if (info.ndim != 1 || NativeFormat(info.format) != "d") [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Expected a one-dimensional `double` or integer array, got an array with "
+                << info.ndim << " dimensions and format " << PyRepr(info.format) << ".";
+            throw py::value_error(oss.str());
+        }
+        const auto* const base = static_cast<const char*>(info.ptr);
+        reals.reserve(info.shape[0]);
+        for (ssize_t i = 0; i < info.shape[0]; ++i) {
+            double value = 0.0;
+            std::memcpy(&value, base + i * info.strides[0], sizeof(double));
+            reals.emplace_back(value);
+        }
+    } else [[unlikely]] {
+        throw py::type_error("Expected an object supporting the buffer protocol, got " +
+                             PyRepr(flat) + ".");
+    }
+    const bool is_real = integers.empty() && !reals.empty();
+    const ssize_t size = py::ssize_t_cast(is_real ? reals.size() : integers.size());
+    if (size != num_leaves) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "The unravel function expected an array of shape (" << num_leaves
+            << ",), got shape (" << size << ",).";
+        throw py::value_error(oss.str());
+    }
+
+    const py::tuple leaves{num_leaves};
+    for (ssize_t i = 0; i < num_leaves; ++i) {
+        PyObject* leaf = nullptr;
+        switch (codes[i]) {
+            case 'f':
+                leaf = PyFloat_FromDouble(is_real ? reals[i] : static_cast<double>(integers[i]));
+                break;
+            case 'i':
+                leaf = (is_real ? PyLong_FromDouble(reals[i]) : PyLong_FromSsize_t(integers[i]));
+                break;
+            case 'b':
+                leaf = PyBool_FromLong(is_real ? reals[i] != 0.0 : integers[i] != 0);
+                break;
+            default: {
+                std::ostringstream oss{};
+                oss << "Invalid leaf type code " << PyRepr(codes.substr(i, 1))
+                    << " at leaf index " << i << ".";
+                throw py::value_error(oss.str());
+            }
+        }
+        if (leaf == nullptr) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        TupleSetItem(leaves, i, py::reinterpret_steal<py::object>(leaf));
+    }
+    return treespec.Unflatten(leaves);
+}
+
+}  // namespace optree
@@ -0,0 +1,241 @@
+/*
+Copyright 2022-2024 MetaOPT Team. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+================================================================================
+*/
+
+#include <optional>   // std::optional, std::nullopt
+#include <sstream>    // std::ostringstream
+#include <string>     // std::string
+#include <utility>    // std::move
+#include <vector>     // std::vector
+
+#include "include/exceptions.h"
+#include "include/pytypes.h"
+#include "include/stdutils.h"
+#include "include/synchronization.h"
+#include "include/treespec.h"
+
+namespace optree {
+
+PyTreeSchema::PyTreeSchema(const py::object& treespec, const py::iterable& constraints)
+    : m_treespec{treespec}, m_spec{&thread_safe_cast<const PyTreeSpec&>(treespec)} {
+    {
+        const scoped_critical_section cs{constraints};
+        for (const py::handle& constraint : constraints) {
+            m_constraints.emplace_back(
+                ParseConstraint(py::reinterpret_borrow<py::object>(constraint)));
+        }
+    }
+    if (py::ssize_t_cast(m_constraints.size()) != m_spec->GetNumLeaves()) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "Number of leaf constraints mismatch; expected: " << m_spec->GetNumLeaves()
+            << ", got: " << m_constraints.size() << ".";
+        throw py::value_error(oss.str());
+    }
+    m_paths = m_spec->Paths();
+}
+
+/*static*/ std::vector<py::object> PyTreeSchema::ParseTypes(const py::object& types) {
+    if (types.is_none()) [[likely]] {
+        return {};
+    }
+    if (PyType_Check(types.ptr())) [[likely]] {
+        return {types};
+    }
+    if (PyTuple_Check(types.ptr())) [[likely]] {
+        const ssize_t num_types = TupleGetSize(types);
+        auto result = reserved_vector<py::object>(num_types);
+        for (ssize_t i = 0; i < num_types; ++i) {
+            py::object type = TupleGetItem(types, i);
+            if (!PyType_Check(type.ptr())) [[unlikely]] {
+                throw py::type_error("Expected a tuple of types as the leaf type constraint, got " +
+                                     PyRepr(types) + ".");
+            }
+            result.emplace_back(std::move(type));
+        }
+        return result;
+    }
+    throw py::type_error("Expected a type or a tuple of types as the leaf type constraint, got " +
+                         PyRepr(types) + ".");
+}
+
+/*static*/ PyTreeSchema::LeafConstraint PyTreeSchema::ParseConstraint(
+    const py::object& constraint) {
+    LeafConstraint result{};
+    result.original = constraint;
+    if (!PyDict_Check(constraint.ptr())) [[likely]] {
+        result.types = ParseTypes(constraint);
+        return result;
+    }
+
+    const auto dict = py::reinterpret_borrow<py::dict>(constraint);
+    const scoped_critical_section cs{dict};
+    for (const auto& [key, value] : dict) {
+        const std::string name = (PyUnicode_Check(key.ptr()) ? PyStr(key) : std::string{});
+        if (name == "type") [[likely]] {
+            result.types = ParseTypes(py::reinterpret_borrow<py::object>(value));
+        } else if (name == "shape") [[likely]] {
+            if (value.is_none()) [[unlikely]] {
+                continue;
+            }
+            auto shape = std::vector<ssize_t>{};
+            for (const py::handle& dim : py::reinterpret_borrow<py::iterable>(value)) {
+                shape.emplace_back(dim.is_none() ? -1 : thread_safe_cast<ssize_t>(dim));
+            }
+            result.shape = std::move(shape);
+        } else if (name == "dtype") [[likely]] {
+            if (value.is_none()) [[unlikely]] {
+                continue;
+            }
+            // Accept both type strings and `numpy.dtype` objects.
+            result.typestr = (PyUnicode_Check(value.ptr())
+                                  ? PyStr(value)
+                                  : PyStr(py::getattr(value, Py_Get_ID(str))));
+        } else [[unlikely]] {
+            throw py::value_error(
+                "Expected keys 'type', 'shape', and 'dtype' in the leaf constraint, got " +
+                PyRepr(key) + ".");
+        }
+    }
+    return result;
+}
+
+/*static*/ std::string PyTreeSchema::CheckLeaf(const LeafConstraint& constraint,
+                                               const py::handle& leaf) {
+    if (!constraint.types.empty()) [[likely]] {
+        const PyObject* const type = reinterpret_cast<PyObject*>(Py_TYPE(leaf.ptr()));
+        bool matched = false;
+        for (const py::object& expected : constraint.types) {
+            if (expected.ptr() == type) [[likely]] {
+                matched = true;
+                break;
+            }
+        }
+        if (!matched) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Expected leaf of type ";
+            if (constraint.types.size() == 1) [[likely]] {
+                oss << PyRepr(constraint.types.front());
+            } else [[unlikely]] {
+                oss << "one of (";
+                for (size_t i = 0; i < constraint.types.size(); ++i) {
+                    oss << (i > 0 ? ", " : "") << PyRepr(constraint.types[i]);
+                }
+                oss << ")";
+            }
+            oss << ", got " << PyRepr(py::type::handle_of(leaf)) << ".";
+            return oss.str();
+        }
+    }
+
+    if (!constraint.shape && !constraint.typestr) [[likely]] {
+        return {};
+    }
+
+    py::object array_interface{};
+    {
+        PyObject* const ptr = PyObject_GetAttr(leaf.ptr(), Py_Get_ID(__array_interface__));
+        if (ptr == nullptr) [[unlikely]] {
+            if (PyErr_ExceptionMatches(PyExc_AttributeError) == 0) [[unlikely]] {
+                throw py::error_already_set();
+            }
+            PyErr_Clear();
+            return "Expected an array leaf with `__array_interface__`, got " +
+                   PyRepr(py::type::handle_of(leaf)) + ".";
+        }
+        array_interface = py::reinterpret_steal<py::object>(ptr);
+    }
+
+    if (constraint.shape) [[likely]] {
+        const py::object shape_object = array_interface[Py_Get_ID(shape)];
+        const auto shape = thread_safe_cast<py::tuple>(shape_object);
+        const auto& expected = *constraint.shape;
+        bool matched = TupleGetSize(shape) == py::ssize_t_cast(expected.size());
+        for (ssize_t i = 0; matched && i < TupleGetSize(shape); ++i) {
+            matched = expected[i] < 0 || thread_safe_cast<ssize_t>(TupleGetItem(shape, i)) ==
+                                             expected[i];
+        }
+        if (!matched) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Expected array of shape (";
+            for (size_t i = 0; i < expected.size(); ++i) {
+                oss << (i > 0 ? ", " : "");
+                if (expected[i] < 0) [[unlikely]] {
+                    oss << "None";
+                } else [[likely]] {
+                    oss << expected[i];
+                }
+            }
+            oss << (expected.size() == 1 ? ",)" : ")") << ", got " << PyRepr(shape) << ".";
+            return oss.str();
+        }
+    }
+
+    if (constraint.typestr) [[likely]] {
+        const py::object typestr_object = array_interface[Py_Get_ID(typestr)];
+        const std::string typestr = PyStr(typestr_object);
+        if (typestr != *constraint.typestr) [[unlikely]] {
+            return "Expected array of dtype '" + *constraint.typestr + "', got '" + typestr +
+                   "'.";
+        }
+    }
+    return {};
+}
+
+template <bool StopOnFirstViolation>
+py::list PyTreeSchema::ValidateImpl(const py::object& tree) const {
+    py::list violations{};
+    py::list leaves{};
+    try {
+        leaves = m_spec->FlattenUpTo(tree);
+    } catch (const py::value_error& ex) {
+        violations.append(py::make_tuple(py::tuple{}, py::str(ex.what())));
+        return violations;
+    }
+
+    const ssize_t num_leaves = ListGetSize(leaves);
+    for (ssize_t i = 0; i < num_leaves; ++i) {
+        const std::string message = CheckLeaf(m_constraints[i], ListGetItem(leaves, i));
+        if (!message.empty()) [[unlikely]] {
+            violations.append(py::make_tuple(m_paths[i], py::str(message)));
+            if constexpr (StopOnFirstViolation) {
+                break;
+            }
+        }
+    }
+    return violations;
+}
+
+py::list PyTreeSchema::Validate(const py::object& tree) const {
+    return ValidateImpl</*StopOnFirstViolation=*/false>(tree);
+}
+
+bool PyTreeSchema::IsValid(const py::object& tree) const {
+    return ListGetSize(ValidateImpl</*StopOnFirstViolation=*/true>(tree)) == 0;
+}
+
+py::list PyTreeSchema::GetConstraints() const {
+    py::list constraints{m_constraints.size()};
+    for (size_t i = 0; i < m_constraints.size(); ++i) {
+        ListSetItem(constraints, py::ssize_t_cast(i), m_constraints[i].original);
+    }
+    return constraints;
+}
+
+std::string PyTreeSchema::ToString() const {
+    return "PyTreeSchema(" + m_spec->ToString() + ", " + PyRepr(GetConstraints()) + ")";
+}
+
+}  // namespace optree
@@ -15,6 +15,7 @@ limitations under the License.
 ================================================================================
 */
 
+#include <cstdint>        // std::int64_t
 #include <exception>      // std::rethrow_exception, std::current_exception
 #include <memory>         // std::unique_ptr, std::make_unique
 #include <sstream>        // std::ostringstream
@@ -22,6 +23,7 @@ limitations under the License.
 #include <string>         // std::string
 #include <thread>         // std::this_thread::get_id
 #include <unordered_set>  // std::unordered_set
+#include <utility>        // std::move
 
 #include "include/exceptions.h"
 #include "include/hashing.h"
@@ -310,14 +312,27 @@ py::object PyTreeSpec::ToPickleable() const {
                                     py::int_(node.num_nodes),
                                     node.original_keys ? node.original_keys : py::none()));
     }
-    return py::make_tuple(node_states, py::bool_(m_none_is_leaf), py::str(m_namespace));
+    if (m_annotations.empty()) [[likely]] {
+        return py::make_tuple(node_states, py::bool_(m_none_is_leaf), py::str(m_namespace));
+    }
+    const py::tuple annotations{py::ssize_t_cast(m_annotations.size())};
+    i = 0;
+    for (const auto& [name, column] : m_annotations) {
+        TupleSetItem(annotations,
+                     i++,
+                     py::make_tuple(py::str(name), column.values, py::bool_(column.is_integer)));
+    }
+    return py::make_tuple(node_states,
+                          py::bool_(m_none_is_leaf),
+                          py::str(m_namespace),
+                          annotations);
 }
 
 // NOLINTBEGIN[cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers]
 // NOLINTNEXTLINE[readability-function-cognitive-complexity]
 /*static*/ std::unique_ptr<PyTreeSpec> PyTreeSpec::FromPickleable(const py::object& pickleable) {
     const auto state = thread_safe_cast<py::tuple>(pickleable);
-    if (state.size() != 3) [[unlikely]] {
+    if (state.size() != 3 && state.size() != 4) [[unlikely]] {
         throw std::runtime_error("Malformed pickled PyTreeSpec.");
     }
     bool none_is_leaf = false;
@@ -416,6 +431,30 @@ py::object PyTreeSpec::ToPickleable() const {
         node.num_nodes = thread_safe_cast<ssize_t>(t[6]);
     }
     out->m_traversal.shrink_to_fit();
+    if (state.size() == 4) [[unlikely]] {
+        const ssize_t num_leaves = out->GetNumLeaves();
+        for (const auto& item : thread_safe_cast<py::tuple>(state[3])) {
+            const auto t = thread_safe_cast<py::tuple>(item);
+            if (t.size() != 3) [[unlikely]] {
+                throw std::runtime_error("Malformed pickled PyTreeSpec.");
+            }
+            AnnotationColumn column{
+                .values = t[1],
+                .is_integer = thread_safe_cast<bool>(t[2]),
+            };
+            const bool is_valid =
+                (column.is_integer ? PyBytes_Check(column.values.ptr()) != 0 &&
+                                         PyBytes_GET_SIZE(column.values.ptr()) ==
+                                             num_leaves * py::ssize_t_cast(sizeof(std::int64_t))
+                                   : PyTuple_Check(column.values.ptr()) != 0 &&
+                                         TupleGetSize(column.values) == num_leaves);
+            if (!is_valid) [[unlikely]] {
+                throw std::runtime_error("Malformed pickled PyTreeSpec.");
+            }
+            out->m_annotations.insert_or_assign(thread_safe_cast<std::string>(t[0]),
+                                                std::move(column));
+        }
+    }
     return out;
 }
 // NOLINTEND[cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers]
@@ -0,0 +1,197 @@
+/*
+Copyright 2022-2024 MetaOPT Team. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+================================================================================
+*/
+
+#include <algorithm>  // std::copy
+#include <cmath>      // std::fabs
+#include <iterator>   // std::back_inserter
+#include <memory>     // std::unique_ptr, std::make_unique
+#include <sstream>    // std::ostringstream
+#include <string>     // std::string
+#include <utility>    // std::move, std::pair
+#include <vector>     // std::vector
+
+#include "include/exceptions.h"
+#include "include/pytypes.h"
+#include "include/stdutils.h"
+#include "include/treespec.h"
+
+namespace optree {
+
+py::list PyTreeSpec::Partition(const ssize_t& n, const py::object& balance) const {
+    if (n <= 0) [[unlikely]] {
+        std::ostringstream oss{};
+        oss << "Expected a positive number of shards, got " << n << ".";
+        throw py::value_error(oss.str());
+    }
+
+    const ssize_t num_nodes = GetNumNodes();
+    const ssize_t num_leaves = GetNumLeaves();
+
+    // The cost of each node by itself in the post-order traversal. The cost of a subtree is the
+    // sum over its contiguous range of nodes.
+    std::vector<double> costs(num_nodes, 0.0);
+    if (PyUnicode_Check(balance.ptr()) != 0) [[likely]] {
+        const auto mode = static_cast<std::string>(py::reinterpret_borrow<py::str>(balance));
+        if (mode == "leaves") [[likely]] {
+            for (ssize_t i = 0; i < num_nodes; ++i) {
+                costs[i] = (m_traversal[i].kind == PyTreeKind::Leaf ? 1.0 : 0.0);
+            }
+        } else if (mode == "nodes") {
+            costs.assign(num_nodes, 1.0);
+        } else [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Expected `balance` to be 'leaves', 'nodes', or a sequence of per-leaf weights, "
+                   "got "
+                << PyRepr(balance) << ".";
+            throw py::value_error(oss.str());
+        }
+    } else [[unlikely]] {
+        const auto weights = py::reinterpret_steal<py::tuple>(PySequence_Tuple(balance.ptr()));
+        if (!weights) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        if (TupleGetSize(weights) != num_leaves) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << "Expected `balance` to have " << num_leaves
+                << " weights (one per leaf), got " << TupleGetSize(weights) << ".";
+            throw py::value_error(oss.str());
+        }
+        ssize_t leaf = 0;
+        for (ssize_t i = 0; i < num_nodes; ++i) {
+            if (m_traversal[i].kind != PyTreeKind::Leaf) [[likely]] {
+                continue;
+            }
+            const double weight = PyFloat_AsDouble(TupleGetItem(weights, leaf).ptr());
+            if (weight == -1.0 && PyErr_Occurred() != nullptr) [[unlikely]] {
+                throw py::error_already_set();
+            }
+            if (!(weight >= 0.0)) [[unlikely]] {
+                std::ostringstream oss{};
+                oss << "Expected non-negative weights, got " << weight << " at leaf index "
+                    << leaf << ".";
+                throw py::value_error(oss.str());
+            }
+            costs[i] = weight;
+            ++leaf;
+        }
+    }
+
+    auto cost_before = reserved_vector<double>(num_nodes + 1);
+    auto leaves_before = reserved_vector<ssize_t>(num_nodes + 1);
+    cost_before.emplace_back(0.0);
+    leaves_before.emplace_back(0);
+    for (ssize_t i = 0; i < num_nodes; ++i) {
+        cost_before.emplace_back(cost_before.back() + costs[i]);
+        leaves_before.emplace_back(leaves_before.back() +
+                                   (m_traversal[i].kind == PyTreeKind::Leaf ? 1 : 0));
+    }
+    const auto first_node = [this](const ssize_t& pos) -> ssize_t {
+        return pos - m_traversal[pos].num_nodes + 1;
+    };
+    const double target = cost_before.back() / static_cast<double>(n);
+
+    // Descend into the subtrees heavier than the target cost. The remaining subtrees are the
+    // units of the shards, in the order of their leaves. Subtrees without leaves are dropped.
+    std::vector<std::pair<ssize_t, std::vector<ssize_t>>> units{};
+    std::vector<std::pair<ssize_t, std::vector<ssize_t>>> agenda{};
+    agenda.emplace_back(num_nodes - 1, std::vector<ssize_t>{});
+    while (!agenda.empty()) {
+        auto [pos, indices] = std::move(agenda.back());
+        agenda.pop_back();
+        const Node& node = m_traversal.at(pos);
+        if (node.num_leaves == 0) [[unlikely]] {
+            continue;
+        }
+        if (node.arity == 0 || cost_before[pos + 1] - cost_before[first_node(pos)] <= target)
+            [[likely]] {
+            units.emplace_back(pos, std::move(indices));
+            continue;
+        }
+        // The last child precedes the node in the post-order traversal. Push the children from
+        // the last to the first so that the first child is visited first.
+        ssize_t cur = pos - 1;
+        for (ssize_t i = node.arity - 1; i >= 0; --i) {
+            EXPECT_GE(cur, 0, "PyTreeSpec::Partition() walked off start of array.");
+            std::vector<ssize_t> child = indices;
+            child.emplace_back(i);
+            agenda.emplace_back(cur, std::move(child));
+            cur -= m_traversal.at(cur).num_nodes;
+        }
+    }
+
+    // Cut the units into shards at the unit boundaries closest to the ideal prefix costs.
+    const ssize_t num_units = py::ssize_t_cast(units.size());
+    auto unit_cost_before = reserved_vector<double>(num_units + 1);
+    unit_cost_before.emplace_back(0.0);
+    for (const auto& [pos, indices] : units) {
+        unit_cost_before.emplace_back(unit_cost_before.back() + cost_before[pos + 1] -
+                                      cost_before[first_node(pos)]);
+    }
+    // The costs of the split ancestors are not covered by any unit.
+    const double covered = unit_cost_before.back();
+    auto bounds = reserved_vector<ssize_t>(n + 1);
+    bounds.emplace_back(0);
+    ssize_t u = 0;
+    for (ssize_t k = 1; k < n; ++k) {
+        const double goal = covered * static_cast<double>(k) / static_cast<double>(n);
+        while (u < num_units &&
+               std::fabs(unit_cost_before[u + 1] - goal) < std::fabs(unit_cost_before[u] - goal)) {
+            ++u;
+        }
+        bounds.emplace_back(u);
+    }
+    bounds.emplace_back(num_units);
+
+    py::list shards{n};
+    ssize_t leaf_pos = 0;
+    for (ssize_t k = 0; k < n; ++k) {
+        const ssize_t start = leaf_pos;
+        const py::tuple roots{bounds[k + 1] - bounds[k]};
+        for (ssize_t i = bounds[k]; i < bounds[k + 1]; ++i) {
+            const auto& [pos, indices] = units[i];
+            const Node& node = m_traversal[pos];
+            EXPECT_EQ(leaves_before[first_node(pos)],
+                      leaf_pos,
+                      "PyTreeSpec::Partition() mismatched leaves.");
+
+            auto subtreespec = std::make_unique<PyTreeSpec>();
+            subtreespec->m_none_is_leaf = m_none_is_leaf;
+            subtreespec->m_namespace = m_namespace;
+            std::copy(m_traversal.cbegin() + first_node(pos),
+                      m_traversal.cbegin() + pos + 1,
+                      std::back_inserter(subtreespec->m_traversal));
+            subtreespec->m_traversal.shrink_to_fit();
+            if (!m_annotations.empty()) [[unlikely]] {
+                SliceAnnotationsInto(*subtreespec, leaf_pos, leaf_pos + node.num_leaves);
+            }
+
+            const py::tuple path{py::ssize_t_cast(indices.size())};
+            for (ssize_t d = 0; d < py::ssize_t_cast(indices.size()); ++d) {
+                TupleSetItem(path, d, py::int_(indices[d]));
+            }
+            TupleSetItem(roots,
+                         i - bounds[k],
+                         py::make_tuple(path, py::cast(std::move(subtreespec))));
+            leaf_pos += node.num_leaves;
+        }
+        ListSetItem(shards, k, py::make_tuple(py::int_(start), py::int_(leaf_pos), roots));
+    }
+    EXPECT_EQ(leaf_pos, num_leaves, "PyTreeSpec::Partition() mismatched leaves.");
+    return shards;
+}
+
+}  // namespace optree
@@ -15,9 +15,13 @@ limitations under the License.
 ================================================================================
 */
 
+#include <memory>     // std::unique_ptr, std::make_unique
 #include <optional>   // std::optional
 #include <sstream>    // std::ostringstream
 #include <stdexcept>  // std::runtime_error
+#include <string>     // std::string
+#include <utility>    // std::move
+#include <vector>     // std::vector
 
 #include "include/exceptions.h"
 #include "include/pytypes.h"
@@ -28,13 +32,55 @@ limitations under the License.
 
 namespace optree {
 
-template <bool NoneIsLeaf>
+PyTreeIter::PyTreeIter(const py::object& tree,
+                       const std::optional<py::function>& leaf_predicate,
+                       const bool& none_is_leaf,
+                       const std::string& registry_namespace,
+                       const bool& build_treespec)
+    : m_root{tree},
+      m_agenda{{{tree, 0}}},
+      m_leaf_predicate{leaf_predicate},
+      m_none_is_leaf{none_is_leaf},
+      m_namespace{registry_namespace},
+      m_is_dict_insertion_ordered{PyTreeSpec::IsDictInsertionOrdered(registry_namespace)},
+      m_treespec{build_treespec ? std::make_unique<PyTreeSpec>() : nullptr} {
+    if (m_treespec) [[unlikely]] {
+        m_treespec->m_none_is_leaf = none_is_leaf;
+        if (PyTreeSpec::IsDictInsertionOrdered(registry_namespace,
+                                               /*inherit_global_namespace=*/false)) [[unlikely]] {
+            m_treespec->m_namespace = registry_namespace;
+        }
+    }
+}
+
+template <bool NoneIsLeaf, bool BuildTreeSpec>
 // NOLINTNEXTLINE[readability-function-cognitive-complexity]
 py::object PyTreeIter::NextImpl() {
+    // Record a node whose children are pushed to the agenda. It is completed when the end marker
+    // pushed before its children is popped.
+    const auto push_pending = [this](PyTreeSpec::Node&& node, const ssize_t& depth) -> void {
+        node.num_nodes = py::ssize_t_cast(m_treespec->m_traversal.size());
+        node.num_leaves = m_num_leaves;
+        m_pending.emplace_back(std::move(node));
+        m_agenda.emplace_back(py::object{}, depth);
+    };
+
     while (!m_agenda.empty()) [[likely]] {
         auto [object, depth] = m_agenda.back();
         m_agenda.pop_back();
 
+        if constexpr (BuildTreeSpec) {
+            if (!object) [[unlikely]] {
+                PyTreeSpec::Node node = std::move(m_pending.back());
+                m_pending.pop_back();
+                node.num_nodes = py::ssize_t_cast(m_treespec->m_traversal.size()) -
+                                 node.num_nodes + 1;
+                node.num_leaves = m_num_leaves - node.num_leaves;
+                m_treespec->m_traversal.emplace_back(std::move(node));
+                continue;
+            }
+        }
+
         if (depth > MAX_RECURSION_DEPTH) [[unlikely]] {
             PyErr_SetString(PyExc_RecursionError,
                             "Maximum recursion depth exceeded during flattening the tree.");
@@ -42,24 +88,46 @@ py::object PyTreeIter::NextImpl() {
         }
 
         if (m_leaf_predicate &&
-            EVALUATE_WITH_LOCK_HELD2(thread_safe_cast<bool>((*m_leaf_predicate)(object)),
-                                     object,
-                                     *m_leaf_predicate)) [[unlikely]] {
+            EVALUATE_WITH_LOCK_HELD(thread_safe_cast<bool>((*m_leaf_predicate)(object)), object))
+            [[unlikely]] {
+            if constexpr (BuildTreeSpec) {
+                PyTreeSpec::Node leaf{};
+                leaf.num_leaves = 1;
+                leaf.num_nodes = 1;
+                m_treespec->m_traversal.emplace_back(std::move(leaf));
+                ++m_num_leaves;
+            }
             return object;
         }
 
-        PyTreeTypeRegistry::RegistrationPtr custom{nullptr};
-        const PyTreeKind kind =
-            PyTreeTypeRegistry::GetKind<NoneIsLeaf>(object, custom, m_namespace);
+        PyTreeSpec::Node node{};
+        node.kind = PyTreeTypeRegistry::GetKind<NoneIsLeaf>(object, node.custom, m_namespace);
 
         ++depth;
-        switch (kind) {
+        switch (node.kind) {
             case PyTreeKind::Leaf: {
+                if (PyTreeProxy::Check(object)) [[unlikely]] {
+                    // Build the real containers of lazy views and iterate over them.
+                    m_agenda.emplace_back(
+                        thread_safe_cast<const PyTreeProxy&>(object).Materialize(),
+                        depth - 1);
+                    break;
+                }
+                if constexpr (BuildTreeSpec) {
+                    node.num_leaves = 1;
+                    node.num_nodes = 1;
+                    m_treespec->m_traversal.emplace_back(std::move(node));
+                    ++m_num_leaves;
+                }
                 return object;
             }
 
             case PyTreeKind::None: {
                 if constexpr (!NoneIsLeaf) {
+                    if constexpr (BuildTreeSpec) {
+                        node.num_nodes = 1;
+                        m_treespec->m_traversal.emplace_back(std::move(node));
+                    }
                     break;
                 }
                 INTERNAL_ERROR(
@@ -69,6 +137,10 @@ py::object PyTreeIter::NextImpl() {
 
             case PyTreeKind::Tuple: {
                 const ssize_t arity = TupleGetSize(object);
+                if constexpr (BuildTreeSpec) {
+                    node.arity = arity;
+                    push_pending(std::move(node), depth);
+                }
                 for (ssize_t i = arity - 1; i >= 0; --i) {
                     m_agenda.emplace_back(TupleGetItem(object, i), depth);
                 }
@@ -78,6 +150,10 @@ py::object PyTreeIter::NextImpl() {
             case PyTreeKind::List: {
                 const scoped_critical_section cs{object};
                 const ssize_t arity = ListGetSize(object);
+                if constexpr (BuildTreeSpec) {
+                    node.arity = arity;
+                    push_pending(std::move(node), depth);
+                }
                 for (ssize_t i = arity - 1; i >= 0; --i) {
                     m_agenda.emplace_back(ListGetItem(object, i), depth);
                 }
@@ -90,9 +166,26 @@ py::object PyTreeIter::NextImpl() {
                 const scoped_critical_section cs{object};
                 const auto dict = py::reinterpret_borrow<py::dict>(object);
                 py::list keys = DictKeys(dict);
-                if (kind != PyTreeKind::OrderedDict && !m_is_dict_insertion_ordered) [[likely]] {
+                if constexpr (BuildTreeSpec) {
+                    node.arity = ListGetSize(keys);
+                    if (node.kind != PyTreeKind::OrderedDict) [[likely]] {
+                        node.original_keys = py::getattr(keys, Py_Get_ID(copy))();
+                    }
+                }
+                if (node.kind != PyTreeKind::OrderedDict && !m_is_dict_insertion_ordered)
+                    [[likely]] {
                     TotalOrderSort(keys);
                 }
+                if constexpr (BuildTreeSpec) {
+                    const py::list sorted_keys = py::getattr(keys, Py_Get_ID(copy))();
+                    if (node.kind == PyTreeKind::DefaultDict) [[unlikely]] {
+                        node.node_data = py::make_tuple(
+                            py::getattr(object, Py_Get_ID(default_factory)), sorted_keys);
+                    } else [[likely]] {
+                        node.node_data = sorted_keys;
+                    }
+                    push_pending(std::move(node), depth);
+                }
                 if (PyList_Reverse(keys.ptr()) < 0) [[unlikely]] {
                     throw py::error_already_set();
                 }
@@ -106,6 +199,11 @@ py::object PyTreeIter::NextImpl() {
             case PyTreeKind::StructSequence: {
                 const auto tuple = py::reinterpret_borrow<py::tuple>(object);
                 const ssize_t arity = TupleGetSize(tuple);
+                if constexpr (BuildTreeSpec) {
+                    node.arity = arity;
+                    node.node_data = py::type::of(tuple);
+                    push_pending(std::move(node), depth);
+                }
                 for (ssize_t i = arity - 1; i >= 0; --i) {
                     m_agenda.emplace_back(TupleGetItem(tuple, i), depth);
                 }
@@ -115,6 +213,14 @@ py::object PyTreeIter::NextImpl() {
             case PyTreeKind::Deque: {
                 const auto list = thread_safe_cast<py::list>(object);
                 const ssize_t arity = ListGetSize(list);
+                if constexpr (BuildTreeSpec) {
+                    node.arity = arity;
+                    {
+                        const scoped_critical_section cs{object};
+                        node.node_data = py::getattr(object, Py_Get_ID(maxlen));
+                    }
+                    push_pending(std::move(node), depth);
+                }
                 for (ssize_t i = arity - 1; i >= 0; --i) {
                     m_agenda.emplace_back(ListGetItem(list, i), depth);
                 }
@@ -122,34 +228,43 @@ py::object PyTreeIter::NextImpl() {
             }
 
             case PyTreeKind::Custom: {
-                const py::tuple out = EVALUATE_WITH_LOCK_HELD2(
-                    thread_safe_cast<py::tuple>(custom->flatten_func(object)),
+                const py::tuple out = PyTreeTypeRegistry::FlattenCustom(
+                    node.custom,
                     object,
-                    custom->flatten_func);
+                    /*sort_keys=*/!m_is_dict_insertion_ordered);
                 const ssize_t num_out = TupleGetSize(out);
                 if (num_out != 2 && num_out != 3) [[unlikely]] {
                     std::ostringstream oss{};
-                    oss << "PyTree custom flatten function for type " << PyRepr(custom->type)
+                    oss << "PyTree custom flatten function for type " << PyRepr(node.custom->type)
                         << " should return a 2- or 3-tuple, got " << num_out << ".";
                     throw std::runtime_error(oss.str());
                 }
                 auto children = thread_safe_cast<py::tuple>(TupleGetItem(out, 0));
                 const ssize_t arity = TupleGetSize(children);
+                node.arity = arity;
                 if (num_out == 3) [[likely]] {
                     const py::object node_entries = TupleGetItem(out, 2);
                     if (!node_entries.is_none()) [[likely]] {
-                        const ssize_t num_entries =
-                            TupleGetSize(thread_safe_cast<py::tuple>(node_entries));
+                        const auto entries = thread_safe_cast<py::tuple>(node_entries);
+                        const ssize_t num_entries = TupleGetSize(entries);
                         if (num_entries != arity) [[unlikely]] {
                             std::ostringstream oss{};
                             oss << "PyTree custom flatten function for type "
-                                << PyRepr(custom->type)
+                                << PyRepr(node.custom->type)
                                 << " returned inconsistent number of children (" << arity
                                 << ") and number of entries (" << num_entries << ").";
                             throw std::runtime_error(oss.str());
                         }
+                        if constexpr (BuildTreeSpec) {
+                            node.node_entries = entries;
+                        }
                     }
                 }
+                if constexpr (BuildTreeSpec) {
+                    node.node_data = TupleGetItem(out, 1);
+                    m_treespec->m_namespace = m_namespace;
+                    push_pending(std::move(node), depth);
+                }
                 for (ssize_t i = arity - 1; i >= 0; --i) {
                     m_agenda.emplace_back(TupleGetItem(children, i), depth);
                 }
@@ -161,10 +276,324 @@ py::object PyTreeIter::NextImpl() {
         }
     }
 
+    if constexpr (BuildTreeSpec) {
+        if (!m_exhausted) [[likely]] {
+            EXPECT_TRUE(m_pending.empty(), "PyTreeIter has pending nodes at the end.");
+            m_treespec->m_traversal.shrink_to_fit();
+        }
+    }
+    m_exhausted = true;
     throw py::stop_iteration();
 }
 
 py::object PyTreeIter::Next() {
+#ifdef Py_GIL_DISABLED
+    const scoped_lock_guard lock{m_mutex};
+#endif
+
+    if (m_none_is_leaf) [[unlikely]] {
+        return (m_treespec ? NextImpl<NONE_IS_LEAF, /*BuildTreeSpec=*/true>()
+                           : NextImpl<NONE_IS_LEAF, /*BuildTreeSpec=*/false>());
+    } else [[likely]] {
+        return (m_treespec ? NextImpl<NONE_IS_NODE, /*BuildTreeSpec=*/true>()
+                           : NextImpl<NONE_IS_NODE, /*BuildTreeSpec=*/false>());
+    }
+}
+
+std::unique_ptr<PyTreeSpec> PyTreeIter::GetTreeSpec() const {
+#ifdef Py_GIL_DISABLED
+    const scoped_lock_guard lock{m_mutex};
+#endif
+
+    if (!m_treespec) [[unlikely]] {
+        throw py::value_error(
+            "The treespec is only recorded by iterators created with `build_treespec=True`.");
+    }
+    if (!m_exhausted) [[unlikely]] {
+        throw py::value_error("The treespec is only available after the iterator is exhausted.");
+    }
+    return std::make_unique<PyTreeSpec>(*m_treespec);
+}
+
+PyTreeZipIter::PyTreeZipIter(const py::object& tree,
+                             const py::tuple& rests,
+                             const std::optional<py::function>& leaf_predicate,
+                             const bool& none_is_leaf,
+                             const std::string& registry_namespace)
+    : m_root{tree},
+      m_rests{rests},
+      m_num_trees{TupleGetSize(rests) + 1},
+      m_leaf_predicate{leaf_predicate},
+      m_none_is_leaf{none_is_leaf},
+      m_namespace{registry_namespace},
+      m_is_dict_insertion_ordered{PyTreeSpec::IsDictInsertionOrdered(registry_namespace)} {
+    m_agenda.reserve(4 * m_num_trees);
+    m_agenda.emplace_back(tree);
+    for (ssize_t t = 1; t < m_num_trees; ++t) {
+        m_agenda.emplace_back(TupleGetItem(rests, t - 1));
+    }
+    m_depths.emplace_back(0);
+}
+
+template <bool NoneIsLeaf>
+// NOLINTNEXTLINE[readability-function-cognitive-complexity]
+void PyTreeZipIter::PushChildren(const std::vector<py::object>& nodes,
+                                 const PyTreeKind& kind,
+                                 const RegistrationPtr& custom,
+                                 const ssize_t& depth) {
+    const py::object& object = nodes.front();
+    ssize_t arity = 0;
+    // The children of the t-th PyTree are stored at `children[t * arity + i]`.
+    std::vector<py::object> children{};
+    const auto check_arity = [&arity](const ssize_t& size,
+                                      const char* const name,
+                                      const py::handle& node) -> void {
+        if (size != arity) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << name << " arity mismatch; expected: " << arity << ", got: " << size << "; "
+                << name << ": " << PyRepr(node) << ".";
+            throw py::value_error(oss.str());
+        }
+    };
+    const auto check_type = [&object](const char* const name, const py::handle& node) -> void {
+        if (py::type::handle_of(node).not_equal(py::type::handle_of(object))) [[unlikely]] {
+            std::ostringstream oss{};
+            oss << name << " type mismatch; expected type: " << PyRepr(py::type::handle_of(object))
+                << ", got type: " << PyRepr(py::type::handle_of(node))
+                << "; tuple: " << PyRepr(node) << ".";
+            throw py::value_error(oss.str());
+        }
+    };
+
+    switch (kind) {
+        case PyTreeKind::None: {
+            for (ssize_t t = 1; t < m_num_trees; ++t) {
+                if (!nodes[t].is_none()) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "Expected None, got " << PyRepr(nodes[t]) << ".";
+                    throw py::value_error(oss.str());
+                }
+            }
+            return;
+        }
+
+        case PyTreeKind::Tuple:
+        case PyTreeKind::NamedTuple:
+        case PyTreeKind::StructSequence: {
+            const char* const name =
+                (kind == PyTreeKind::Tuple
+                     ? "tuple"
+                     : (kind == PyTreeKind::NamedTuple ? "namedtuple" : "PyStructSequence"));
+            arity = TupleGetSize(object);
+            children.reserve(m_num_trees * arity);
+            for (ssize_t t = 0; t < m_num_trees; ++t) {
+                const py::object& node = nodes[t];
+                if (t > 0) [[likely]] {
+                    if (kind == PyTreeKind::Tuple) [[likely]] {
+                        AssertExactTuple(node);
+                    } else if (kind == PyTreeKind::NamedTuple) {
+                        AssertExactNamedTuple(node);
+                        check_type(name, node);
+                    } else [[unlikely]] {
+                        AssertExactStructSequence(node);
+                        check_type(name, node);
+                    }
+                    check_arity(TupleGetSize(node), name, node);
+                }
+                for (ssize_t i = 0; i < arity; ++i) {
+                    children.emplace_back(TupleGetItem(node, i));
+                }
+            }
+            break;
+        }
+
+        case PyTreeKind::List:
+        case PyTreeKind::Deque: {
+            const char* const name = (kind == PyTreeKind::List ? "list" : "deque");
+            for (ssize_t t = 0; t < m_num_trees; ++t) {
+                const py::object& node = nodes[t];
+                if (t > 0) [[likely]] {
+                    if (kind == PyTreeKind::List) [[likely]] {
+                        AssertExactList(node);
+                    } else [[unlikely]] {
+                        AssertExactDeque(node);
+                    }
+                }
+                const auto list = (kind == PyTreeKind::List ? py::reinterpret_borrow<py::list>(node)
+                                                            : thread_safe_cast<py::list>(node));
+                const scoped_critical_section cs{list};
+                if (t == 0) [[unlikely]] {
+                    arity = ListGetSize(list);
+                    children.reserve(m_num_trees * arity);
+                } else [[likely]] {
+                    check_arity(ListGetSize(list), name, node);
+                }
+                for (ssize_t i = 0; i < arity; ++i) {
+                    children.emplace_back(ListGetItem(list, i));
+                }
+            }
+            break;
+        }
+
+        case PyTreeKind::Dict:
+        case PyTreeKind::OrderedDict:
+        case PyTreeKind::DefaultDict: {
+            py::list keys = DictKeys(py::reinterpret_borrow<py::dict>(object));
+            if (kind != PyTreeKind::OrderedDict && !m_is_dict_insertion_ordered) [[likely]] {
+                TotalOrderSort(keys);
+            }
+            arity = ListGetSize(keys);
+            children.reserve(m_num_trees * arity);
+            for (ssize_t t = 0; t < m_num_trees; ++t) {
+                const py::object& node = nodes[t];
+                if (t > 0) [[likely]] {
+                    AssertExactStandardDict(node);
+                }
+                const auto dict = py::reinterpret_borrow<py::dict>(node);
+                const scoped_critical_section cs{dict};
+                if (t > 0 && !DictKeysEqual(keys, dict)) [[unlikely]] {
+                    const auto [missing_keys, extra_keys] = DictKeysDifference(keys, dict);
+                    std::ostringstream oss{};
+                    oss << "dictionary key mismatch; expected key(s): " << PyRepr(keys)
+                        << ", got key(s): " << PyRepr(SortedDictKeys(dict));
+                    if (ListGetSize(missing_keys) != 0) [[likely]] {
+                        oss << ", missing key(s): " << PyRepr(missing_keys);
+                    }
+                    if (ListGetSize(extra_keys) != 0) [[likely]] {
+                        oss << ", extra key(s): " << PyRepr(extra_keys);
+                    }
+                    oss << "; dict: " << PyRepr(node) << ".";
+                    throw py::value_error(oss.str());
+                }
+                for (const py::handle& key : keys) {
+                    children.emplace_back(DictGetItem(dict, key));
+                }
+            }
+            break;
+        }
+
+        case PyTreeKind::Custom: {
+            py::object node_data{};
+            for (ssize_t t = 0; t < m_num_trees; ++t) {
+                const py::object& node = nodes[t];
+                if (t > 0) [[likely]] {
+                    const RegistrationPtr registration =
+                        PyTreeTypeRegistry::Lookup<NoneIsLeaf>(py::type::of(node), m_namespace);
+                    if (registration != custom) [[unlikely]] {
+                        std::ostringstream oss{};
+                        oss << "Custom node type mismatch; expected type: "
+                            << PyRepr(custom->type)
+                            << ", got type: " << PyRepr(py::type::handle_of(node))
+                            << "; value: " << PyRepr(node) << ".";
+                        throw py::value_error(oss.str());
+                    }
+                }
+                const py::tuple out = PyTreeTypeRegistry::FlattenCustom(
+                    custom,
+                    node,
+                    /*sort_keys=*/!m_is_dict_insertion_ordered);
+                const ssize_t num_out = TupleGetSize(out);
+                if (num_out != 2 && num_out != 3) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "PyTree custom flatten function for type " << PyRepr(custom->type)
+                        << " should return a 2- or 3-tuple, got " << num_out << ".";
+                    throw std::runtime_error(oss.str());
+                }
+                const auto node_children = thread_safe_cast<py::tuple>(TupleGetItem(out, 0));
+                if (t == 0) [[unlikely]] {
+                    arity = TupleGetSize(node_children);
+                    children.reserve(m_num_trees * arity);
+                    node_data = TupleGetItem(out, 1);
+                } else [[likely]] {
+                    const py::object other_node_data = TupleGetItem(out, 1);
+                    {
+                        const scoped_critical_section2 cs{node_data, other_node_data};
+                        if (node_data.not_equal(other_node_data)) [[unlikely]] {
+                            std::ostringstream oss{};
+                            oss << "Mismatch custom node data; expected: " << PyRepr(node_data)
+                                << ", got: " << PyRepr(other_node_data)
+                                << "; value: " << PyRepr(node) << ".";
+                            throw py::value_error(oss.str());
+                        }
+                    }
+                    check_arity(TupleGetSize(node_children), "Custom node", node);
+                }
+                for (ssize_t i = 0; i < arity; ++i) {
+                    children.emplace_back(TupleGetItem(node_children, i));
+                }
+            }
+            break;
+        }
+
+        default:
+            INTERNAL_ERROR();
+    }
+
+    for (ssize_t i = arity - 1; i >= 0; --i) {
+        for (ssize_t t = 0; t < m_num_trees; ++t) {
+            m_agenda.emplace_back(std::move(children[t * arity + i]));
+        }
+        m_depths.emplace_back(depth);
+    }
+}
+
+template <bool NoneIsLeaf>
+py::tuple PyTreeZipIter::NextImpl() {
+    std::vector<py::object> nodes(m_num_trees);
+    while (!m_depths.empty()) [[likely]] {
+        ssize_t depth = m_depths.back();
+        m_depths.pop_back();
+        for (ssize_t t = m_num_trees - 1; t >= 0; --t) {
+            nodes[t] = std::move(m_agenda.back());
+            m_agenda.pop_back();
+        }
+
+        if (depth > MAX_RECURSION_DEPTH) [[unlikely]] {
+            PyErr_SetString(PyExc_RecursionError,
+                            "Maximum recursion depth exceeded during flattening the tree.");
+            throw py::error_already_set();
+        }
+
+        // The leaf predicate is only applied to the first PyTree, which determines the structure.
+        const py::object& object = nodes.front();
+        bool is_leaf = (m_leaf_predicate &&
+                        EVALUATE_WITH_LOCK_HELD(
+                            thread_safe_cast<bool>((*m_leaf_predicate)(object)), object));
+        PyTreeTypeRegistry::RegistrationPtr custom{nullptr};
+        PyTreeKind kind = PyTreeKind::Leaf;
+        if (!is_leaf) [[likely]] {
+            kind = PyTreeTypeRegistry::GetKind<NoneIsLeaf>(object, custom, m_namespace);
+            if (kind == PyTreeKind::Leaf && PyTreeProxy::Check(object)) [[unlikely]] {
+                // Build the real containers of lazy views and iterate over them.
+                nodes.front() = thread_safe_cast<const PyTreeProxy&>(object).Materialize();
+                for (ssize_t t = 0; t < m_num_trees; ++t) {
+                    m_agenda.emplace_back(std::move(nodes[t]));
+                }
+                m_depths.emplace_back(depth);
+                continue;
+            }
+            is_leaf = (kind == PyTreeKind::Leaf);
+        }
+        if (is_leaf) [[unlikely]] {
+            const py::tuple leaves{m_num_trees};
+            for (ssize_t t = 0; t < m_num_trees; ++t) {
+                TupleSetItem(leaves, t, nodes[t]);
+            }
+            return leaves;
+        }
+
+        for (ssize_t t = 1; t < m_num_trees; ++t) {
+            if (PyTreeProxy::Check(nodes[t])) [[unlikely]] {
+                nodes[t] = thread_safe_cast<const PyTreeProxy&>(nodes[t]).Materialize();
+            }
+        }
+        PushChildren<NoneIsLeaf>(nodes, kind, custom, depth + 1);
+    }
+
+    throw py::stop_iteration();
+}
+
+py::tuple PyTreeZipIter::Next() {
 #ifdef Py_GIL_DISABLED
     const scoped_lock_guard lock{m_mutex};
 #endif
@@ -191,7 +620,7 @@ py::object PyTreeSpec::Walk(const py::function& f_node,
 
                 const auto leaf = py::reinterpret_borrow<py::object>(*it);
                 agenda.emplace_back(
-                    f_leaf ? EVALUATE_WITH_LOCK_HELD2((*f_leaf)(leaf), leaf, *f_leaf) : leaf);
+                    f_leaf ? EVALUATE_WITH_LOCK_HELD((*f_leaf)(leaf), leaf) : leaf);
                 ++it;
                 break;
             }
@@ -214,10 +643,9 @@ py::object PyTreeSpec::Walk(const py::function& f_node,
                     TupleSetItem(tuple, i, agenda.back());
                     agenda.pop_back();
                 }
-                agenda.emplace_back(EVALUATE_WITH_LOCK_HELD2(
+                agenda.emplace_back(EVALUATE_WITH_LOCK_HELD(
                     f_node(tuple, (node.node_data ? node.node_data : py::none())),
-                    node.node_data,
-                    f_node));
+                    node.node_data));
                 break;
             }
 
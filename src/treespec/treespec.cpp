@@ -18,10 +18,13 @@ limitations under the License.
 #include "include/treespec.h"
 
 #include <algorithm>  // std::copy, std::reverse
+#include <cstddef>    // std::size_t
+#include <cstdint>    // std::int64_t
 #include <iterator>   // std::back_inserter
 #include <memory>     // std::unique_ptr, std::make_unique
 #include <optional>   // std::optional
 #include <sstream>    // std::ostringstream
+#include <string>     // std::string
 #include <tuple>      // std::tuple
 #include <utility>    // std::move
 #include <vector>     // std::vector
@@ -35,6 +38,33 @@ limitations under the License.
 
 namespace optree {
 
+/*static*/ void PyTreeConfigSnapshot::SetFlag(const PyTreeConfigFlag& flag,
+                                             const bool& mode,
+                                             const std::string& registry_namespace) {
+    const scoped_lock_guard lock{sm_mutex};
+
+    const PyTreeConfigSnapshot* const current = Current();
+    FlagsMap flags = (current != nullptr ? current->GetFlagsMap() : FlagsMap{});
+    Flags& namespace_flags = flags[registry_namespace];
+    if (mode) [[likely]] {
+        namespace_flags |= Bit(flag);
+    } else [[unlikely]] {
+        namespace_flags &= ~Bit(flag);
+    }
+    if (namespace_flags == 0U) [[likely]] {
+        flags.erase(registry_namespace);
+    }
+
+    // Reuse the snapshot with the same contents. Toggling the flags back and forth (e.g., in a
+    // context manager) does not allocate new snapshots.
+    auto it = sm_snapshots.find(flags);
+    if (it == sm_snapshots.end()) [[unlikely]] {
+        auto snapshot = std::make_unique<const PyTreeConfigSnapshot>(flags);
+        it = sm_snapshots.emplace(std::move(flags), std::move(snapshot)).first;
+    }
+    sm_current.store(it->second.get(), std::memory_order_release);
+}
+
 // NOLINTNEXTLINE[readability-function-cognitive-complexity]
 /*static*/ py::object PyTreeSpec::MakeNode(const Node& node,
                                            // NOLINTNEXTLINE[cppcoreguidelines-avoid-c-arrays]
@@ -58,11 +88,9 @@ namespace optree {
                 TupleSetItem(tuple, i, children[i]);
             }
             if (node.kind == PyTreeKind::NamedTuple) [[unlikely]] {
-                const scoped_critical_section cs{node.node_data};
                 return node.node_data(*tuple);
             }
             if (node.kind == PyTreeKind::StructSequence) [[unlikely]] {
-                const scoped_critical_section cs{node.node_data};
                 return node.node_data(std::move(tuple));
             }
             return tuple;
@@ -85,30 +113,27 @@ namespace optree {
         case PyTreeKind::OrderedDict:
         case PyTreeKind::DefaultDict: {
             py::dict dict{};
-            const scoped_critical_section2 cs{node.node_data, node.original_keys};
             if (node.kind == PyTreeKind::DefaultDict) [[unlikely]] {
                 EXPECT_EQ(TupleGetSize(node.node_data), 2, "Number of metadata mismatch.");
             }
-            const auto keys = (node.kind != PyTreeKind::DefaultDict
-                                   ? py::reinterpret_borrow<py::list>(node.node_data)
-                                   : TupleGetItemAs<py::list>(node.node_data, 1));
+            const py::handle keys = (node.kind != PyTreeKind::DefaultDict
+                                         ? py::handle{node.node_data}
+                                         : TupleGetItemBorrowed(node.node_data, 1));
             if (node.original_keys) [[unlikely]] {
                 for (ssize_t i = 0; i < node.arity; ++i) {
-                    DictSetItem(dict, ListGetItem(node.original_keys, i), py::none());
+                    DictSetItem(dict, FrozenListGetItemBorrowed(node.original_keys, i), py::none());
                 }
             }
             for (ssize_t i = 0; i < node.arity; ++i) {
                 // NOLINTNEXTLINE[cppcoreguidelines-pro-bounds-pointer-arithmetic]
-                DictSetItem(dict, ListGetItem(keys, i), children[i]);
+                DictSetItem(dict, FrozenListGetItemBorrowed(keys, i), children[i]);
             }
             if (node.kind == PyTreeKind::OrderedDict) [[unlikely]] {
                 return PyOrderedDictTypeObject(std::move(dict));
             }
             if (node.kind == PyTreeKind::DefaultDict) [[unlikely]] {
-                const py::object default_factory = TupleGetItem(node.node_data, 0);
-                return EVALUATE_WITH_LOCK_HELD(
-                    PyDefaultDictTypeObject(default_factory, std::move(dict)),
-                    default_factory);
+                return PyDefaultDictTypeObject(TupleGetItemBorrowed(node.node_data, 0),
+                                               std::move(dict));
             }
             return dict;
         }
@@ -119,9 +144,7 @@ namespace optree {
                 // NOLINTNEXTLINE[cppcoreguidelines-pro-bounds-pointer-arithmetic]
                 TupleSetItem(tuple, i, children[i]);
             }
-            return EVALUATE_WITH_LOCK_HELD2(node.custom->unflatten_func(node.node_data, tuple),
-                                            node.node_data,
-                                            node.custom->unflatten_func);
+            return PyTreeTypeRegistry::UnflattenCustom(node.custom, node.node_data, tuple);
         }
 
         default:
@@ -185,223 +208,290 @@ namespace optree {
 }
 
 // NOLINTNEXTLINE[readability-function-cognitive-complexity]
-/*static*/ std::tuple<ssize_t, ssize_t, ssize_t, ssize_t> PyTreeSpec::BroadcastToCommonSuffixImpl(
+template <bool WithLeaves>
+/*static*/ ssize_t PyTreeSpec::BroadcastToCommonSuffixImpl(
     std::vector<Node>& nodes,
     const std::vector<Node>& traversal,
-    const ssize_t& pos,
     const std::vector<Node>& other_traversal,
-    const ssize_t& other_pos) {
-    const Node& root = traversal.at(pos);
-    const Node& other_root = other_traversal.at(other_pos);
-    EXPECT_GE(pos + 1,
-              root.num_nodes,
-              "PyTreeSpec::BroadcastToCommonSuffix() walked off start of array "
-              "for the current PyTreeSpec.");
-    EXPECT_GE(other_pos + 1,
-              other_root.num_nodes,
-              "PyTreeSpec::BroadcastToCommonSuffix() walked off start of array "
-              "for the other PyTreeSpec.");
-
-    ssize_t cur = pos - 1;
-    ssize_t other_cur = other_pos - 1;
-
-    if (root.kind == PyTreeKind::Leaf) [[likely]] {
-        std::copy(other_traversal.crend() - (other_pos + 1),
-                  other_traversal.crend() - (other_pos - other_root.num_nodes + 1),
-                  std::back_inserter(nodes));
-        other_cur -= other_root.num_nodes - 1;
-        return {pos - cur, other_pos - other_cur, other_root.num_nodes, other_root.num_leaves};
-    }
-    if (other_root.kind == PyTreeKind::Leaf) [[likely]] {
-        std::copy(traversal.crend() - (pos + 1),
-                  traversal.crend() - (pos - root.num_nodes + 1),
-                  std::back_inserter(nodes));
-        cur -= root.num_nodes - 1;
-        return {pos - cur, other_pos - other_cur, root.num_nodes, root.num_leaves};
-    }
-    if (root.kind == PyTreeKind::None) [[unlikely]] {
-        if (other_root.kind != PyTreeKind::None) [[unlikely]] {
-            std::ostringstream oss{};
-            oss << "PyTreeSpecs have incompatible node types; expected type: "
-                << NodeKindToString(root) << ", got: " << NodeKindToString(other_root) << ".";
-            throw py::value_error(oss.str());
-        }
-
-        nodes.emplace_back(root);
-        return {pos - cur, other_pos - other_cur, root.num_nodes, root.num_leaves};
-    }
-
-    Node node{
-        .kind = root.kind,
-        .arity = root.arity,
-        .node_data = root.node_data,
-        .custom = root.custom,
-        .num_leaves = 0,
-        .num_nodes = 1,
-        .original_keys = root.original_keys,
+    [[maybe_unused]] const std::vector<py::object>& leaves,
+    [[maybe_unused]] const std::vector<py::object>& other_leaves,
+    [[maybe_unused]] std::vector<py::object>& common_leaves,
+    [[maybe_unused]] std::vector<py::object>& other_common_leaves) {
+    // The number of leaves before each node in the post-order traversal, which is the index of the
+    // first leaf in the subtree ending at the node.
+    const auto count_leaves_before =
+        [](const std::vector<Node>& traversal) -> std::vector<ssize_t> {
+        auto counts = reserved_vector<ssize_t>(traversal.size() + 1);
+        counts.emplace_back(0);
+        for (const Node& node : traversal) {
+            counts.emplace_back(counts.back() + (node.kind == PyTreeKind::Leaf ? 1 : 0));
+        }
+        return counts;
     };
-    switch (root.kind) {
-        case PyTreeKind::Tuple:
-        case PyTreeKind::List:
-        case PyTreeKind::Deque: {
-            if (root.kind != other_root.kind) [[unlikely]] {
-                std::ostringstream oss{};
-                oss << "PyTreeSpecs have incompatible node types; expected type: "
-                    << NodeKindToString(root) << ", got: " << NodeKindToString(other_root) << ".";
-                throw py::value_error(oss.str());
-            }
-            if (root.arity != other_root.arity) [[unlikely]] {
-                std::ostringstream oss{};
-                oss << NodeKindToString(root) << " arity mismatch; expected: " << root.arity
-                    << ", got: " << other_root.arity << ".";
-                throw py::value_error(oss.str());
-            }
-            break;
+    // The post-order positions of the children of the node at the given position.
+    const auto child_positions = [](const std::vector<Node>& traversal,
+                                    const ssize_t& pos,
+                                    const char* const message) -> std::vector<ssize_t> {
+        const Node& node = traversal.at(pos);
+        auto positions = reserved_vector<ssize_t>(node.arity);
+        ssize_t cur = pos - 1;
+        for (ssize_t i = 0; i < node.arity; ++i) {
+            EXPECT_GE(cur, 0, message);
+            positions.emplace_back(cur);
+            cur -= traversal.at(cur).num_nodes;
         }
+        std::reverse(positions.begin(), positions.end());
+        return positions;
+    };
 
-        case PyTreeKind::Dict:
-        case PyTreeKind::OrderedDict:
-        case PyTreeKind::DefaultDict: {
-            if (other_root.kind != PyTreeKind::Dict && other_root.kind != PyTreeKind::OrderedDict &&
-                other_root.kind != PyTreeKind::DefaultDict) [[unlikely]] {
-                std::ostringstream oss{};
-                oss << "PyTreeSpecs have incompatible node types; expected type: "
-                    << NodeKindToString(root) << ", got: " << NodeKindToString(other_root) << ".";
-                throw py::value_error(oss.str());
-            }
-
-            const scoped_critical_section2 cs{root.node_data, other_root.node_data};
-            const auto expected_keys = (root.kind != PyTreeKind::DefaultDict
-                                            ? py::reinterpret_borrow<py::list>(root.node_data)
-                                            : TupleGetItemAs<py::list>(root.node_data, 1));
-            auto other_keys = (other_root.kind != PyTreeKind::DefaultDict
-                                   ? py::reinterpret_borrow<py::list>(other_root.node_data)
-                                   : TupleGetItemAs<py::list>(other_root.node_data, 1));
-            const py::dict dict{};
-            for (ssize_t i = 0; i < other_root.arity; ++i) {
-                DictSetItem(dict, ListGetItem(other_keys, i), py::int_(i));
-            }
-            if (!DictKeysEqual(expected_keys, dict)) [[unlikely]] {
-                TotalOrderSort(other_keys);
-                const auto [missing_keys, extra_keys] = DictKeysDifference(expected_keys, dict);
-                std::ostringstream key_difference_sstream{};
-                if (ListGetSize(missing_keys) != 0) [[likely]] {
-                    key_difference_sstream << ", missing key(s): " << PyRepr(missing_keys);
-                }
-                if (ListGetSize(extra_keys) != 0) [[likely]] {
-                    key_difference_sstream << ", extra key(s): " << PyRepr(extra_keys);
-                }
-                std::ostringstream oss{};
-                oss << "dictionary key mismatch; expected key(s): " << PyRepr(expected_keys)
-                    << ", got key(s): " + PyRepr(other_keys) << key_difference_sstream.str() << ".";
-                throw py::value_error(oss.str());
-            }
+    std::vector<ssize_t> leaves_before{};
+    std::vector<ssize_t> other_leaves_before{};
+    if constexpr (WithLeaves) {
+        leaves_before = count_leaves_before(traversal);
+        other_leaves_before = count_leaves_before(other_traversal);
+    }
 
-            const size_t start_num_nodes = nodes.size();
+    // The nodes are emitted in post-order. An interior node is pending until all its children are
+    // emitted, and its `num_nodes` and `num_leaves` fields hold the counts before its children.
+    ssize_t num_leaves = 0;
+    std::vector<Node> pending{};
+    // A pair of -1 in the agenda marks the end of the children of the innermost pending node.
+    std::vector<std::pair<ssize_t, ssize_t>> agenda{};
+    agenda.emplace_back(py::ssize_t_cast(traversal.size()) - 1,
+                        py::ssize_t_cast(other_traversal.size()) - 1);
+    while (!agenda.empty()) {
+        const auto [pos, other_pos] = agenda.back();
+        agenda.pop_back();
+
+        if (pos < 0) [[unlikely]] {
+            Node node = std::move(pending.back());
+            pending.pop_back();
+            node.num_nodes = py::ssize_t_cast(nodes.size()) - node.num_nodes + 1;
+            node.num_leaves = num_leaves - node.num_leaves;
             nodes.emplace_back(std::move(node));
-            auto other_curs = reserved_vector<ssize_t>(other_root.arity);
-            for (ssize_t i = 0; i < other_root.arity; ++i) {
-                other_curs.emplace_back(other_cur);
-                other_cur -= other_traversal.at(other_cur).num_nodes;
-            }
-            std::reverse(other_curs.begin(), other_curs.end());
-            const ssize_t last_other_cur = other_cur;
-            for (ssize_t i = root.arity - 1; i >= 0; --i) {
-                const py::object key = ListGetItem(expected_keys, i);
-                other_cur = other_curs[py::cast<ssize_t>(DictGetItem(dict, key))];
-                const auto [num_nodes, other_num_nodes, new_num_nodes, new_num_leaves] =
-                    // NOLINTNEXTLINE[misc-no-recursion]
-                    BroadcastToCommonSuffixImpl(nodes, traversal, cur, other_traversal, other_cur);
-                cur -= num_nodes;
-                nodes[start_num_nodes].num_nodes += new_num_nodes;
-                nodes[start_num_nodes].num_leaves += new_num_leaves;
-            }
-            return {pos - cur,
-                    other_pos - last_other_cur,
-                    nodes[start_num_nodes].num_nodes,
-                    nodes[start_num_nodes].num_leaves};
+            continue;
         }
 
-        case PyTreeKind::NamedTuple:
-        case PyTreeKind::StructSequence: {
-            if (root.kind != other_root.kind) [[unlikely]] {
-                std::ostringstream oss{};
-                oss << "PyTreeSpecs have incompatible node types; expected type: "
-                    << NodeKindToString(root) << ", got: " << NodeKindToString(other_root) << ".";
-                throw py::value_error(oss.str());
-            }
-            if (root.arity != other_root.arity) [[unlikely]] {
-                std::ostringstream oss{};
-                oss << (root.kind == PyTreeKind::NamedTuple ? "namedtuple" : "PyStructSequence")
-                    << " arity mismatch; expected: " << root.arity << ", got: " << other_root.arity
-                    << ".";
-                throw py::value_error(oss.str());
+        const Node& root = traversal.at(pos);
+        const Node& other_root = other_traversal.at(other_pos);
+        EXPECT_GE(pos + 1,
+                  root.num_nodes,
+                  "PyTreeSpec::BroadcastToCommonSuffix() walked off start of array "
+                  "for the current PyTreeSpec.");
+        EXPECT_GE(other_pos + 1,
+                  other_root.num_nodes,
+                  "PyTreeSpec::BroadcastToCommonSuffix() walked off start of array "
+                  "for the other PyTreeSpec.");
+
+        if (root.kind == PyTreeKind::Leaf) [[likely]] {
+            const ssize_t other_first = other_pos - other_root.num_nodes + 1;
+            std::copy(other_traversal.cbegin() + other_first,
+                      other_traversal.cbegin() + other_pos + 1,
+                      std::back_inserter(nodes));
+            if constexpr (WithLeaves) {
+                const py::object& leaf = leaves[leaves_before[pos]];
+                const ssize_t other_first_leaf = other_leaves_before[other_first];
+                for (ssize_t i = 0; i < other_root.num_leaves; ++i) {
+                    common_leaves.emplace_back(leaf);
+                    other_common_leaves.emplace_back(other_leaves[other_first_leaf + i]);
+                }
             }
-            if (root.node_data.not_equal(other_root.node_data)) [[unlikely]] {
-                std::ostringstream oss{};
-                oss << (root.kind == PyTreeKind::NamedTuple ? "namedtuple" : "PyStructSequence")
-                    << " type mismatch; expected type: " << NodeKindToString(root)
-                    << ", got type: " << NodeKindToString(other_root) << ".";
-                throw py::value_error(oss.str());
+            num_leaves += other_root.num_leaves;
+            continue;
+        }
+        if (other_root.kind == PyTreeKind::Leaf) [[likely]] {
+            const ssize_t first = pos - root.num_nodes + 1;
+            std::copy(traversal.cbegin() + first,
+                      traversal.cbegin() + pos + 1,
+                      std::back_inserter(nodes));
+            if constexpr (WithLeaves) {
+                const py::object& other_leaf = other_leaves[other_leaves_before[other_pos]];
+                const ssize_t first_leaf = leaves_before[first];
+                for (ssize_t i = 0; i < root.num_leaves; ++i) {
+                    common_leaves.emplace_back(leaves[first_leaf + i]);
+                    other_common_leaves.emplace_back(other_leaf);
+                }
             }
-            break;
+            num_leaves += root.num_leaves;
+            continue;
         }
-
-        case PyTreeKind::Custom: {
-            if (root.kind != other_root.kind) [[unlikely]] {
+        if (root.kind == PyTreeKind::None) [[unlikely]] {
+            if (other_root.kind != PyTreeKind::None) [[unlikely]] {
                 std::ostringstream oss{};
                 oss << "PyTreeSpecs have incompatible node types; expected type: "
                     << NodeKindToString(root) << ", got: " << NodeKindToString(other_root) << ".";
                 throw py::value_error(oss.str());
             }
-            if (!root.custom->type.is(other_root.custom->type)) [[unlikely]] {
-                std::ostringstream oss{};
-                oss << "Custom node type mismatch; expected type: " << NodeKindToString(root)
-                    << ", got type: " << NodeKindToString(other_root) << ".";
-                throw py::value_error(oss.str());
-            }
-            if (root.arity != other_root.arity) [[unlikely]] {
-                std::ostringstream oss{};
-                oss << "Custom type arity mismatch; expected: " << root.arity
-                    << ", got: " << other_root.arity << ".";
-                throw py::value_error(oss.str());
+
+            nodes.emplace_back(root);
+            continue;
+        }
+
+        Node node{
+            .kind = root.kind,
+            .arity = root.arity,
+            .node_data = root.node_data,
+            .custom = root.custom,
+            .num_leaves = num_leaves,
+            .num_nodes = py::ssize_t_cast(nodes.size()),
+            .original_keys = root.original_keys,
+        };
+        const std::vector<ssize_t> children = child_positions(
+            traversal,
+            pos,
+            "PyTreeSpec::BroadcastToCommonSuffix() walked off start of array "
+            "for the current PyTreeSpec.");
+        std::vector<ssize_t> other_children = child_positions(
+            other_traversal,
+            other_pos,
+            "PyTreeSpec::BroadcastToCommonSuffix() walked off start of array "
+            "for the other PyTreeSpec.");
+        switch (root.kind) {
+            case PyTreeKind::Tuple:
+            case PyTreeKind::List:
+            case PyTreeKind::Deque: {
+                if (root.kind != other_root.kind) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "PyTreeSpecs have incompatible node types; expected type: "
+                        << NodeKindToString(root) << ", got: " << NodeKindToString(other_root)
+                        << ".";
+                    throw py::value_error(oss.str());
+                }
+                if (root.arity != other_root.arity) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << NodeKindToString(root) << " arity mismatch; expected: " << root.arity
+                        << ", got: " << other_root.arity << ".";
+                    throw py::value_error(oss.str());
+                }
+                break;
             }
-            {
+
+            case PyTreeKind::Dict:
+            case PyTreeKind::OrderedDict:
+            case PyTreeKind::DefaultDict: {
+                if (other_root.kind != PyTreeKind::Dict &&
+                    other_root.kind != PyTreeKind::OrderedDict &&
+                    other_root.kind != PyTreeKind::DefaultDict) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "PyTreeSpecs have incompatible node types; expected type: "
+                        << NodeKindToString(root) << ", got: " << NodeKindToString(other_root)
+                        << ".";
+                    throw py::value_error(oss.str());
+                }
+
                 const scoped_critical_section2 cs{root.node_data, other_root.node_data};
+                const auto expected_keys = (root.kind != PyTreeKind::DefaultDict
+                                                ? py::reinterpret_borrow<py::list>(root.node_data)
+                                                : TupleGetItemAs<py::list>(root.node_data, 1));
+                auto other_keys = (other_root.kind != PyTreeKind::DefaultDict
+                                       ? py::reinterpret_borrow<py::list>(other_root.node_data)
+                                       : TupleGetItemAs<py::list>(other_root.node_data, 1));
+                const py::dict dict{};
+                for (ssize_t i = 0; i < other_root.arity; ++i) {
+                    DictSetItem(dict, ListGetItem(other_keys, i), py::int_(i));
+                }
+                if (!DictKeysEqual(expected_keys, dict)) [[unlikely]] {
+                    TotalOrderSort(other_keys);
+                    const auto [missing_keys, extra_keys] = DictKeysDifference(expected_keys, dict);
+                    std::ostringstream key_difference_sstream{};
+                    if (ListGetSize(missing_keys) != 0) [[likely]] {
+                        key_difference_sstream << ", missing key(s): " << PyRepr(missing_keys);
+                    }
+                    if (ListGetSize(extra_keys) != 0) [[likely]] {
+                        key_difference_sstream << ", extra key(s): " << PyRepr(extra_keys);
+                    }
+                    std::ostringstream oss{};
+                    oss << "dictionary key mismatch; expected key(s): " << PyRepr(expected_keys)
+                        << ", got key(s): " + PyRepr(other_keys) << key_difference_sstream.str()
+                        << ".";
+                    throw py::value_error(oss.str());
+                }
+
+                // Visit the children of the other node in the key order of this node.
+                auto reordered = reserved_vector<ssize_t>(root.arity);
+                for (ssize_t i = 0; i < root.arity; ++i) {
+                    const py::object key = ListGetItem(expected_keys, i);
+                    reordered.emplace_back(
+                        other_children[thread_safe_cast<ssize_t>(DictGetItem(dict, key))]);
+                }
+                other_children = std::move(reordered);
+                break;
+            }
+
+            case PyTreeKind::NamedTuple:
+            case PyTreeKind::StructSequence: {
+                if (root.kind != other_root.kind) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "PyTreeSpecs have incompatible node types; expected type: "
+                        << NodeKindToString(root) << ", got: " << NodeKindToString(other_root)
+                        << ".";
+                    throw py::value_error(oss.str());
+                }
+                if (root.arity != other_root.arity) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << (root.kind == PyTreeKind::NamedTuple ? "namedtuple" : "PyStructSequence")
+                        << " arity mismatch; expected: " << root.arity
+                        << ", got: " << other_root.arity << ".";
+                    throw py::value_error(oss.str());
+                }
                 if (root.node_data.not_equal(other_root.node_data)) [[unlikely]] {
                     std::ostringstream oss{};
-                    oss << "Mismatch custom node data; expected: " << PyRepr(root.node_data)
-                        << ", got: " << PyRepr(other_root.node_data) << ".";
+                    oss << (root.kind == PyTreeKind::NamedTuple ? "namedtuple" : "PyStructSequence")
+                        << " type mismatch; expected type: " << NodeKindToString(root)
+                        << ", got type: " << NodeKindToString(other_root) << ".";
                     throw py::value_error(oss.str());
                 }
+                break;
             }
-            break;
-        }
 
-        case PyTreeKind::Leaf:
-        case PyTreeKind::None:
-        default:
-            INTERNAL_ERROR();
-    }
+            case PyTreeKind::Custom: {
+                if (root.kind != other_root.kind) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "PyTreeSpecs have incompatible node types; expected type: "
+                        << NodeKindToString(root) << ", got: " << NodeKindToString(other_root)
+                        << ".";
+                    throw py::value_error(oss.str());
+                }
+                if (!root.custom->type.is(other_root.custom->type)) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "Custom node type mismatch; expected type: " << NodeKindToString(root)
+                        << ", got type: " << NodeKindToString(other_root) << ".";
+                    throw py::value_error(oss.str());
+                }
+                if (root.arity != other_root.arity) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "Custom type arity mismatch; expected: " << root.arity
+                        << ", got: " << other_root.arity << ".";
+                    throw py::value_error(oss.str());
+                }
+                {
+                    const scoped_critical_section2 cs{root.node_data, other_root.node_data};
+                    if (root.node_data.not_equal(other_root.node_data)) [[unlikely]] {
+                        std::ostringstream oss{};
+                        oss << "Mismatch custom node data; expected: " << PyRepr(root.node_data)
+                            << ", got: " << PyRepr(other_root.node_data) << ".";
+                        throw py::value_error(oss.str());
+                    }
+                }
+                break;
+            }
 
-    const size_t start_num_nodes = nodes.size();
-    nodes.emplace_back(std::move(node));
-    for (ssize_t i = root.arity - 1; i >= 0; --i) {
-        const auto [num_nodes, other_num_nodes, new_num_nodes, new_num_leaves] =
-            // NOLINTNEXTLINE[misc-no-recursion]
-            BroadcastToCommonSuffixImpl(nodes, traversal, cur, other_traversal, other_cur);
-        cur -= num_nodes;
-        other_cur -= other_num_nodes;
-        nodes[start_num_nodes].num_nodes += new_num_nodes;
-        nodes[start_num_nodes].num_leaves += new_num_leaves;
-    }
-    return {pos - cur,
-            other_pos - other_cur,
-            nodes[start_num_nodes].num_nodes,
-            nodes[start_num_nodes].num_leaves};
+            case PyTreeKind::Leaf:
+            case PyTreeKind::None:
+            default:
+                INTERNAL_ERROR();
+        }
+        pending.emplace_back(std::move(node));
+        agenda.emplace_back(-1, -1);
+        for (ssize_t i = root.arity - 1; i >= 0; --i) {
+            agenda.emplace_back(children[i], other_children[i]);
+        }
+    }
+    EXPECT_TRUE(pending.empty(), "PyTreeSpec::BroadcastToCommonSuffix() has pending nodes.");
+    return num_leaves;
 }
 
-std::unique_ptr<PyTreeSpec> PyTreeSpec::BroadcastToCommonSuffix(const PyTreeSpec& other) const {
+std::unique_ptr<PyTreeSpec> PyTreeSpec::MakeCommonSuffixTreeSpec(const PyTreeSpec& other) const {
     if (m_none_is_leaf != other.m_none_is_leaf) [[unlikely]] {
         throw py::value_error("PyTreeSpecs must have the same none_is_leaf value.");
     }
@@ -420,35 +510,57 @@ std::unique_ptr<PyTreeSpec> PyTreeSpec::BroadcastToCommonSuffix(const PyTreeSpec
     } else [[unlikely]] {
         treespec->m_namespace = other.m_namespace;
     }
+    return treespec;
+}
 
-    const ssize_t num_nodes = GetNumNodes();
-    const ssize_t other_num_nodes = other.GetNumNodes();
-
-    const auto [num_nodes_walked, other_num_nodes_walked, new_num_nodes, new_num_leaves] =
-        BroadcastToCommonSuffixImpl(treespec->m_traversal,
-                                    m_traversal,
-                                    num_nodes - 1,
-                                    other.m_traversal,
-                                    other_num_nodes - 1);
-    std::reverse(treespec->m_traversal.begin(), treespec->m_traversal.end());
-    EXPECT_EQ(num_nodes_walked,
-              num_nodes,
-              "`pos != 0` at end of PyTreeSpec::BroadcastToCommonSuffix() "
-              "for the current PyTreeSpec.");
-    EXPECT_EQ(other_num_nodes_walked,
-              other_num_nodes,
-              "`pos != 0` at end of PyTreeSpec::BroadcastToCommonSuffix() "
-              "for the other PyTreeSpec.");
-    EXPECT_EQ(new_num_nodes,
+std::unique_ptr<PyTreeSpec> PyTreeSpec::BroadcastToCommonSuffix(const PyTreeSpec& other) const {
+    auto treespec = MakeCommonSuffixTreeSpec(other);
+    std::vector<py::object> unused{};
+    const ssize_t num_leaves = BroadcastToCommonSuffixImpl</*WithLeaves=*/false>(
+        treespec->m_traversal, m_traversal, other.m_traversal, unused, unused, unused, unused);
+    EXPECT_EQ(py::ssize_t_cast(treespec->m_traversal.size()),
               treespec->GetNumNodes(),
               "PyTreeSpec::BroadcastToCommonSuffix() mismatched number of nodes.");
-    EXPECT_EQ(new_num_leaves,
+    EXPECT_EQ(num_leaves,
               treespec->GetNumLeaves(),
               "PyTreeSpec::BroadcastToCommonSuffix() mismatched number of leaves.");
     treespec->m_traversal.shrink_to_fit();
     return treespec;
 }
 
+std::tuple<std::unique_ptr<PyTreeSpec>, std::vector<py::object>, std::vector<py::object>>
+PyTreeSpec::BroadcastToCommonSuffixLeaves(const PyTreeSpec& other,
+                                          const std::vector<py::object>& leaves,
+                                          const std::vector<py::object>& other_leaves) const {
+    EXPECT_EQ(py::ssize_t_cast(leaves.size()), GetNumLeaves(), "Number of leaves mismatch.");
+    EXPECT_EQ(py::ssize_t_cast(other_leaves.size()),
+              other.GetNumLeaves(),
+              "Number of other leaves mismatch.");
+
+    auto treespec = MakeCommonSuffixTreeSpec(other);
+    std::vector<py::object> common_leaves{};
+    std::vector<py::object> other_common_leaves{};
+    const ssize_t num_leaves =
+        BroadcastToCommonSuffixImpl</*WithLeaves=*/true>(treespec->m_traversal,
+                                                         m_traversal,
+                                                         other.m_traversal,
+                                                         leaves,
+                                                         other_leaves,
+                                                         common_leaves,
+                                                         other_common_leaves);
+    EXPECT_EQ(py::ssize_t_cast(treespec->m_traversal.size()),
+              treespec->GetNumNodes(),
+              "PyTreeSpec::BroadcastToCommonSuffix() mismatched number of nodes.");
+    EXPECT_EQ(num_leaves,
+              treespec->GetNumLeaves(),
+              "PyTreeSpec::BroadcastToCommonSuffix() mismatched number of leaves.");
+    EXPECT_EQ(py::ssize_t_cast(common_leaves.size()),
+              num_leaves,
+              "PyTreeSpec::BroadcastToCommonSuffix() mismatched number of leaves.");
+    treespec->m_traversal.shrink_to_fit();
+    return {std::move(treespec), std::move(common_leaves), std::move(other_common_leaves)};
+}
+
 std::unique_ptr<PyTreeSpec> PyTreeSpec::Compose(const PyTreeSpec& inner_treespec) const {
     if (m_none_is_leaf != inner_treespec.m_none_is_leaf) [[unlikely]] {
         throw py::value_error("PyTreeSpecs must have the same none_is_leaf value.");
@@ -495,6 +607,9 @@ std::unique_ptr<PyTreeSpec> PyTreeSpec::Compose(const PyTreeSpec& inner_treespec
               (num_outer_nodes - num_outer_leaves) + (num_outer_leaves * num_inner_nodes),
               "Number of composed tree nodes mismatch.");
     treespec->m_traversal.shrink_to_fit();
+    if (!m_annotations.empty() || !inner_treespec.m_annotations.empty()) [[unlikely]] {
+        ComposeAnnotationsInto(*treespec, inner_treespec);
+    }
     return treespec;
 }
 
@@ -586,6 +701,368 @@ std::vector<py::tuple> PyTreeSpec::Paths() const {
     return paths;
 }
 
+// Helper that renders a path entry with `str()` or `repr()`.
+static std::string RenderPathEntry(const py::handle& entry, const bool& use_repr) {
+    if (!use_repr && PyUnicode_Check(entry.ptr())) [[likely]] {
+        Py_ssize_t size = 0;
+        const char* const data = PyUnicode_AsUTF8AndSize(entry.ptr(), &size);
+        if (data == nullptr) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        return std::string{data, static_cast<size_t>(size)};
+    }
+    return (use_repr ? PyRepr(entry) : static_cast<std::string>(py::str(entry)));
+}
+
+template <typename Span>
+ssize_t PyTreeSpec::PathStringsImpl(Span& strings,  // NOLINT[misc-no-recursion]
+                                    std::string& buffer,
+                                    const std::string& separator,
+                                    const bool& use_repr,
+                                    const ssize_t& pos,
+                                    const ssize_t& depth) const {
+    const Node& root = m_traversal.at(pos);
+    EXPECT_GE(pos + 1, root.num_nodes, "PyTreeSpec::PathStrings() walked off start of array.");
+
+    ssize_t cur = pos - 1;
+    // The children share the rendered prefix in the buffer, which is truncated after each child.
+    // NOLINTNEXTLINE[misc-no-recursion]
+    const auto recurse = [this, &strings, &buffer, &separator, &use_repr, &depth](
+                             const ssize_t& cur,
+                             const std::string& segment) -> ssize_t {
+        const size_t prefix_size = buffer.size();
+        if (depth > 0) [[likely]] {
+            buffer.append(separator);
+        }
+        buffer.append(segment);
+        const ssize_t num_nodes =
+            PathStringsImpl(strings, buffer, separator, use_repr, cur, depth + 1);
+        buffer.resize(prefix_size);
+        return num_nodes;
+    };
+    const auto render = [&use_repr](const py::handle& entry) -> std::string {
+        return RenderPathEntry(entry, use_repr);
+    };
+
+    if (root.node_entries) [[unlikely]] {
+        for (ssize_t i = root.arity - 1; i >= 0; --i) {
+            cur -= recurse(cur, render(TupleGetItem(root.node_entries, i)));
+        }
+    } else [[likely]] {
+        switch (root.kind) {
+            case PyTreeKind::Leaf: {
+                strings.emplace_back(buffer);
+                break;
+            }
+
+            case PyTreeKind::None:
+                break;
+
+            case PyTreeKind::Tuple:
+            case PyTreeKind::List:
+            case PyTreeKind::NamedTuple:
+            case PyTreeKind::Deque:
+            case PyTreeKind::StructSequence:
+            case PyTreeKind::Custom: {
+                for (ssize_t i = root.arity - 1; i >= 0; --i) {
+                    cur -= recurse(cur, std::to_string(i));
+                }
+                break;
+            }
+
+            case PyTreeKind::Dict:
+            case PyTreeKind::OrderedDict:
+            case PyTreeKind::DefaultDict: {
+                const scoped_critical_section cs{root.node_data};
+                const auto keys = (root.kind != PyTreeKind::DefaultDict
+                                       ? py::reinterpret_borrow<py::list>(root.node_data)
+                                       : TupleGetItemAs<py::list>(root.node_data, 1));
+                for (ssize_t i = root.arity - 1; i >= 0; --i) {
+                    cur -= recurse(cur, render(ListGetItem(keys, i)));
+                }
+                break;
+            }
+
+            default:
+                INTERNAL_ERROR();
+        }
+    }
+
+    return pos - cur;
+}
+
+py::tuple PyTreeSpec::PathStrings(const std::string& separator, const std::string& style) const {
+    if (style != "plain" && style != "repr") [[unlikely]] {
+        throw py::value_error("Expected `style` to be 'plain' or 'repr', got " + PyRepr(style) +
+                              ".");
+    }
+    const bool use_repr = (style == "repr");
+    const py::dict& cache = m_path_strings.get([]() -> py::dict { return py::dict{}; });
+    const py::tuple key = py::make_tuple(py::str(separator), py::bool_(use_repr));
+
+    {
+        const scoped_critical_section cs{cache};
+        const int contains = PyDict_Contains(cache.ptr(), key.ptr());
+        if (contains < 0) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        if (contains != 0) [[likely]] {
+            return DictGetItemAs<py::tuple>(cache, key);
+        }
+    }
+
+    const py::tuple result = [this, &separator, &use_repr]() -> py::tuple {
+        const ssize_t num_leaves = GetNumLeaves();
+        auto strings = reserved_vector<std::string>(num_leaves);
+        std::string buffer{};
+        const ssize_t num_nodes_walked =
+            PathStringsImpl(strings, buffer, separator, use_repr, GetNumNodes() - 1, 0);
+        EXPECT_EQ(num_nodes_walked,
+                  GetNumNodes(),
+                  "`pos != 0` at end of PyTreeSpec::PathStrings().");
+        EXPECT_EQ(py::ssize_t_cast(strings.size()),
+                  num_leaves,
+                  "PyTreeSpec::PathStrings() mismatched leaves.");
+        const py::tuple result{num_leaves};
+        for (ssize_t i = 0; i < num_leaves; ++i) {
+            // The traversal is walked backwards, so the strings are in reverse order.
+            TupleSetItem(result, i, py::str(strings[num_leaves - 1 - i]));
+        }
+        return result;
+    }();
+
+    const scoped_critical_section cs{cache};
+    if (PyDict_Size(cache.ptr()) >= MAX_PATH_STRINGS_CACHE_SIZE) [[unlikely]] {
+        PyDict_Clear(cache.ptr());
+    }
+    DictSetItem(cache, key, result);
+    return result;
+}
+
+// Helper that matches a single path entry against a glob segment with `*` and `?` wildcards.
+static bool GlobMatch(const std::string& glob, const std::string& text) {
+    size_t g = 0;
+    size_t t = 0;
+    size_t star = std::string::npos;
+    size_t mark = 0;
+    while (t < text.size()) {
+        if (g < glob.size() && (glob[g] == '?' || glob[g] == text[t])) [[likely]] {
+            ++g;
+            ++t;
+        } else if (g < glob.size() && glob[g] == '*') {
+            star = g++;
+            mark = t;
+        } else if (star != std::string::npos) {
+            g = star + 1;
+            t = ++mark;
+        } else [[unlikely]] {
+            return false;
+        }
+    }
+    while (g < glob.size() && glob[g] == '*') {
+        ++g;
+    }
+    return g == glob.size();
+}
+
+py::tuple PyTreeSpec::Select(const std::string& pattern) const {
+    const ssize_t num_leaves = GetNumLeaves();
+    const py::dict& selections = m_selections.get([]() -> py::dict { return py::dict{}; });
+    const py::str key{pattern};
+
+    py::object indices{};
+    {
+        const scoped_critical_section cs{selections};
+        const int contains = PyDict_Contains(selections.ptr(), key.ptr());
+        if (contains < 0) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        if (contains != 0) [[likely]] {
+            indices = DictGetItem(selections, key);
+        }
+    }
+
+    if (!indices) [[unlikely]] {
+        // Compile the pattern into segments. The matcher is a nondeterministic automaton whose
+        // state `j` means that the first `j` segments have matched the path so far.
+        std::vector<std::string> segments{};
+        if (!pattern.empty()) [[likely]] {
+            size_t start = 0;
+            while (true) {
+                const size_t end = pattern.find_first_of("./", start);
+                segments.emplace_back(pattern.substr(start, end - start));
+                if (segments.back().empty()) [[unlikely]] {
+                    std::ostringstream oss{};
+                    oss << "Expected a non-empty segment at position " << start
+                        << " of the pattern, got " << PyRepr(pattern) << ".";
+                    throw py::value_error(oss.str());
+                }
+                if (end == std::string::npos) [[likely]] {
+                    break;
+                }
+                start = end + 1;
+            }
+        }
+        const size_t num_segments = segments.size();
+        // The kind of each segment: 0 for a glob, 1 for `*`, and 2 for `**`.
+        std::vector<char> kinds(num_segments, 0);
+        for (size_t j = 0; j < num_segments; ++j) {
+            kinds[j] = (segments[j] == "*" ? 1 : (segments[j] == "**" ? 2 : 0));
+        }
+
+        // Follow the `**` segments, which may match an empty run of entries.
+        const auto close = [&kinds, &num_segments](std::vector<char>& states) -> bool {
+            bool alive = false;
+            for (size_t j = 0; j < num_segments; ++j) {
+                if (states[j] != 0) [[unlikely]] {
+                    alive = true;
+                    if (kinds[j] == 2) [[unlikely]] {
+                        states[j + 1] = 1;
+                    }
+                }
+            }
+            return alive || states[num_segments] != 0;
+        };
+        // Advance the automaton over one path entry. The entry is only rendered when a glob
+        // segment is active.
+        const auto step = [&segments, &num_segments, &kinds](const std::vector<char>& states,
+                                                              const auto& render,
+                                                              std::vector<char>& next) -> void {
+            next.assign(num_segments + 1, 0);
+            std::optional<std::string> entry{};
+            for (size_t j = 0; j < num_segments; ++j) {
+                if (states[j] == 0) [[likely]] {
+                    continue;
+                }
+                if (kinds[j] == 0) [[likely]] {
+                    if (!entry) [[likely]] {
+                        entry = render();
+                    }
+                    if (GlobMatch(segments[j], *entry)) {
+                        next[j + 1] = 1;
+                    }
+                } else if (kinds[j] == 2) {
+                    next[j] = 1;
+                } else [[likely]] {
+                    next[j + 1] = 1;
+                }
+            }
+        };
+
+        auto selected = reserved_vector<std::int64_t>(4);
+        ssize_t leaf = num_leaves;
+        // NOLINTNEXTLINE[misc-no-recursion]
+        const auto walk = [this, &close, &step, &selected, &leaf, &num_segments](
+                              const auto& self,
+                              const ssize_t& pos,
+                              std::vector<char>& states) -> ssize_t {
+            const Node& root = m_traversal.at(pos);
+            EXPECT_GE(pos + 1, root.num_nodes, "PyTreeSpec::Select() walked off start of array.");
+            // Prune the subtree if no path in it can match.
+            if (!close(states)) [[likely]] {
+                leaf -= root.num_leaves;
+                return root.num_nodes;
+            }
+
+            ssize_t cur = pos - 1;
+            std::vector<char> next{};
+            const auto recurse = [&self, &states, &step, &next, &cur](const auto& render) -> void {
+                step(states, render, next);
+                cur -= self(self, cur, next);
+            };
+
+            if (root.node_entries) [[unlikely]] {
+                for (ssize_t i = root.arity - 1; i >= 0; --i) {
+                    recurse([&root, &i]() -> std::string {
+                        return RenderPathEntry(TupleGetItem(root.node_entries, i), false);
+                    });
+                }
+            } else [[likely]] {
+                switch (root.kind) {
+                    case PyTreeKind::Leaf: {
+                        --leaf;
+                        if (states[num_segments] != 0) [[unlikely]] {
+                            selected.emplace_back(static_cast<std::int64_t>(leaf));
+                        }
+                        break;
+                    }
+
+                    case PyTreeKind::None:
+                        break;
+
+                    case PyTreeKind::Tuple:
+                    case PyTreeKind::List:
+                    case PyTreeKind::NamedTuple:
+                    case PyTreeKind::Deque:
+                    case PyTreeKind::StructSequence:
+                    case PyTreeKind::Custom: {
+                        for (ssize_t i = root.arity - 1; i >= 0; --i) {
+                            recurse([&i]() -> std::string { return std::to_string(i); });
+                        }
+                        break;
+                    }
+
+                    case PyTreeKind::Dict:
+                    case PyTreeKind::OrderedDict:
+                    case PyTreeKind::DefaultDict: {
+                        const scoped_critical_section cs{root.node_data};
+                        const auto keys = (root.kind != PyTreeKind::DefaultDict
+                                               ? py::reinterpret_borrow<py::list>(root.node_data)
+                                               : TupleGetItemAs<py::list>(root.node_data, 1));
+                        for (ssize_t i = root.arity - 1; i >= 0; --i) {
+                            recurse([&keys, &i]() -> std::string {
+                                return RenderPathEntry(ListGetItem(keys, i), false);
+                            });
+                        }
+                        break;
+                    }
+
+                    default:
+                        INTERNAL_ERROR();
+                }
+            }
+
+            return pos - cur;
+        };
+
+        std::vector<char> states(num_segments + 1, 0);
+        states[0] = 1;
+        const ssize_t num_nodes_walked = walk(walk, GetNumNodes() - 1, states);
+        EXPECT_EQ(num_nodes_walked, GetNumNodes(), "`pos != 0` at end of PyTreeSpec::Select().");
+        EXPECT_EQ(leaf, 0, "PyTreeSpec::Select() mismatched leaves.");
+        // The traversal is walked backwards, so the indices are in descending order.
+        std::reverse(selected.begin(), selected.end());
+
+        const py::bytes buffer{reinterpret_cast<const char*>(selected.data()),
+                               selected.size() * sizeof(std::int64_t)};
+        PyObject* const view = PyMemoryView_FromObject(buffer.ptr());
+        if (view == nullptr) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        indices = py::getattr(py::reinterpret_steal<py::object>(view),
+                              Py_Get_ID(cast))(py::str("q"));
+
+        const scoped_critical_section cs{selections};
+        if (PyDict_Size(selections.ptr()) >= MAX_SELECTION_CACHE_SIZE) [[unlikely]] {
+            PyDict_Clear(selections.ptr());
+        }
+        DictSetItem(selections, key, indices);
+    }
+
+    // `TupleSetItem` steals the reference without releasing the old item, so fill each slot once.
+    std::vector<bool> is_selected(static_cast<std::size_t>(num_leaves), false);
+    const py::buffer_info info = py::reinterpret_borrow<py::buffer>(indices).request();
+    const auto* const data = static_cast<const std::int64_t*>(info.ptr);
+    for (ssize_t i = 0; i < info.size; ++i) {
+        is_selected[static_cast<std::size_t>(data[i])] = true;
+    }
+    const py::tuple mask{num_leaves};
+    for (ssize_t i = 0; i < num_leaves; ++i) {
+        TupleSetItem(mask, i, py::bool_(is_selected[static_cast<std::size_t>(i)]));
+    }
+    return py::make_tuple(indices, Unflatten(mask));
+}
+
 template <typename Span, typename Stack>
 ssize_t PyTreeSpec::AccessorsImpl(Span& accessors,  // NOLINT[misc-no-recursion]
                                   Stack& stack,
@@ -609,9 +1086,8 @@ ssize_t PyTreeSpec::AccessorsImpl(Span& accessors,  // NOLINT[misc-no-recursion]
                              const ssize_t& cur,
                              const py::handle& entry,
                              const py::handle& path_entry_type) -> ssize_t {
-        stack.emplace_back(EVALUATE_WITH_LOCK_HELD2(path_entry_type(entry, node_type, node_kind),
-                                                    path_entry_type,
-                                                    node_type));
+        stack.emplace_back(
+            EVALUATE_WITH_LOCK_HELD(path_entry_type(entry, node_type, node_kind), node_type));
         const ssize_t num_nodes = AccessorsImpl(accessors, stack, cur, depth + 1);
         stack.pop_back();
         return num_nodes;
@@ -633,8 +1109,7 @@ ssize_t PyTreeSpec::AccessorsImpl(Span& accessors,  // NOLINT[misc-no-recursion]
                 for (ssize_t d = 0; d < depth; ++d) {
                     TupleSetItem(typed_path, d, stack[d]);
                 }
-                accessors.emplace_back(
-                    EVALUATE_WITH_LOCK_HELD(PyTreeAccessor(typed_path), PyTreeAccessor));
+                accessors.emplace_back(PyTreeAccessor(typed_path));
                 break;
             }
 
@@ -778,6 +1253,7 @@ std::vector<std::unique_ptr<PyTreeSpec>> PyTreeSpec::Children() const {
     auto children = reserved_vector<std::unique_ptr<PyTreeSpec>>(root.arity);
     children.resize(root.arity);
     ssize_t pos = py::ssize_t_cast(m_traversal.size()) - 1;
+    ssize_t leaf_pos = root.num_leaves;
     for (ssize_t i = root.arity - 1; i >= 0; --i) {
         children[i] = std::make_unique<PyTreeSpec>();
         children[i]->m_none_is_leaf = m_none_is_leaf;
@@ -788,7 +1264,11 @@ std::vector<std::unique_ptr<PyTreeSpec>> PyTreeSpec::Children() const {
                   m_traversal.cbegin() + pos,
                   std::back_inserter(children[i]->m_traversal));
         children[i]->m_traversal.shrink_to_fit();
+        if (!m_annotations.empty()) [[unlikely]] {
+            SliceAnnotationsInto(*children[i], leaf_pos - node.num_leaves, leaf_pos);
+        }
         pos -= node.num_nodes;
+        leaf_pos -= node.num_leaves;
     }
     EXPECT_EQ(pos, 0, "`pos != 0` at end of PyTreeSpec::Children().");
     return children;
@@ -805,10 +1285,12 @@ std::unique_ptr<PyTreeSpec> PyTreeSpec::Child(ssize_t index) const {
     }
 
     ssize_t pos = py::ssize_t_cast(m_traversal.size()) - 1;
+    ssize_t leaf_pos = root.num_leaves;
     for (ssize_t i = root.arity - 1; i > index; --i) {
         const Node& node = m_traversal.at(pos - 1);
         EXPECT_GE(pos, node.num_nodes, "PyTreeSpec::Child() walked off start of array.");
         pos -= node.num_nodes;
+        leaf_pos -= node.num_leaves;
     }
 
     auto child = std::make_unique<PyTreeSpec>();
@@ -820,6 +1302,9 @@ std::unique_ptr<PyTreeSpec> PyTreeSpec::Child(ssize_t index) const {
               m_traversal.cbegin() + pos,
               std::back_inserter(child->m_traversal));
     child->m_traversal.shrink_to_fit();
+    if (!m_annotations.empty()) [[unlikely]] {
+        SliceAnnotationsInto(*child, leaf_pos - node.num_leaves, leaf_pos);
+    }
     return child;
 }
 
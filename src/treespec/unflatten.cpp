@@ -15,10 +15,15 @@ limitations under the License.
 ================================================================================
 */
 
-#include <sstream>  // std::ostringstream
-#include <utility>  // std::move
+#include <algorithm>  // std::copy, std::min
+#include <iterator>   // std::back_inserter
+#include <memory>     // std::unique_ptr, std::make_unique
+#include <sstream>    // std::ostringstream
+#include <string>     // std::string
+#include <utility>    // std::move
 
 #include "include/exceptions.h"
+#include "include/pytypes.h"
 #include "include/registry.h"
 #include "include/stdutils.h"
 #include "include/synchronization.h"
@@ -27,11 +32,16 @@ limitations under the License.
 namespace optree {
 
 template <typename Span>
-py::object PyTreeSpec::UnflattenImpl(const Span& leaves) const {
+py::object PyTreeSpec::UnflattenImpl(const Span& leaves,
+                                     const ssize_t& first,
+                                     const ssize_t& last) const {
+    EXPECT_LT(first, last, "The node range to unflatten is empty.");
+    const ssize_t expected_num_leaves = m_traversal.at(last - 1).num_leaves;
     auto agenda = reserved_vector<py::object>(4);
     auto it = leaves.begin();
     ssize_t num_leaves = 0;
-    for (const Node& node : m_traversal) {
+    for (ssize_t i = first; i < last; ++i) {
+        const Node& node = m_traversal[i];
         EXPECT_GE(py::ssize_t_cast(agenda.size()),
                   node.arity,
                   "Too few elements for PyTreeSpec node.");
@@ -40,7 +50,7 @@ py::object PyTreeSpec::UnflattenImpl(const Span& leaves) const {
             case PyTreeKind::Leaf: {
                 if (it == leaves.end()) [[unlikely]] {
                     std::ostringstream oss{};
-                    oss << "Too few leaves for PyTreeSpec; expected: " << GetNumLeaves()
+                    oss << "Too few leaves for PyTreeSpec; expected: " << expected_num_leaves
                         << ", got: " << num_leaves << ".";
                     throw py::value_error(oss.str());
                 }
@@ -73,7 +83,7 @@ py::object PyTreeSpec::UnflattenImpl(const Span& leaves) const {
     }
     if (it != leaves.end()) [[unlikely]] {
         std::ostringstream oss{};
-        oss << "Too many leaves for PyTreeSpec; expected: " << GetNumLeaves() << ".";
+        oss << "Too many leaves for PyTreeSpec; expected: " << expected_num_leaves << ".";
         throw py::value_error(oss.str());
     }
     EXPECT_EQ(agenda.size(), 1, "PyTreeSpec traversal did not yield a singleton.");
@@ -81,8 +91,319 @@ py::object PyTreeSpec::UnflattenImpl(const Span& leaves) const {
 }
 
 py::object PyTreeSpec::Unflatten(const py::iterable& leaves) const {
+    EXPECT_FALSE(m_traversal.empty(), "The tree node traversal is empty.");
     const scoped_critical_section cs{leaves};
-    return UnflattenImpl(leaves);
+    return UnflattenImpl(leaves, 0, py::ssize_t_cast(m_traversal.size()));
+}
+
+/*static*/ py::object PyTreeSpec::UnflattenLazy(const py::object& treespec,
+                                                const py::iterable& leaves) {
+    const auto& self = thread_safe_cast<const PyTreeSpec&>(treespec);
+    EXPECT_FALSE(self.m_traversal.empty(), "The tree node traversal is empty.");
+    const auto tuple = EVALUATE_WITH_LOCK_HELD(py::tuple{leaves}, leaves);
+    const ssize_t num_leaves = TupleGetSize(tuple);
+    if (num_leaves != self.GetNumLeaves()) [[unlikely]] {
+        std::ostringstream oss{};
+        if (num_leaves < self.GetNumLeaves()) [[likely]] {
+            oss << "Too few leaves for PyTreeSpec; expected: " << self.GetNumLeaves()
+                << ", got: " << num_leaves << ".";
+        } else [[unlikely]] {
+            oss << "Too many leaves for PyTreeSpec; expected: " << self.GetNumLeaves() << ".";
+        }
+        throw py::value_error(oss.str());
+    }
+    return PyTreeProxy::MakeView(treespec,
+                                 tuple,
+                                 py::ssize_t_cast(self.m_traversal.size()) - 1,
+                                 /*leaf_start=*/0);
+}
+
+PyTreeProxy::PyTreeProxy(const py::object& treespec,
+                         const py::tuple& leaves,
+                         const ssize_t& pos,
+                         const ssize_t& leaf_start)
+    : m_treespec{treespec},
+      m_spec{&thread_safe_cast<const PyTreeSpec&>(treespec)},
+      m_leaves{leaves},
+      m_pos{pos},
+      m_leaf_start{leaf_start} {
+    const PyTreeSpec::Node& root = GetNode();
+    m_child_positions.resize(root.arity);
+    m_children.resize(root.arity);
+    ssize_t child_pos = pos - 1;
+    ssize_t child_leaf_start = leaf_start + root.num_leaves;
+    for (ssize_t i = root.arity - 1; i >= 0; --i) {
+        EXPECT_GE(child_pos, 0, "PyTreeProxy walked off start of array.");
+        const PyTreeSpec::Node& child = m_spec->m_traversal[child_pos];
+        child_leaf_start -= child.num_leaves;
+        m_child_positions[i] = {child_pos, child_leaf_start};
+        child_pos -= child.num_nodes;
+    }
+    EXPECT_EQ(child_pos, pos - root.num_nodes, "PyTreeProxy walked off the subtree.");
+    EXPECT_EQ(child_leaf_start, leaf_start, "PyTreeProxy walked off the leaves.");
+}
+
+/*static*/ py::object PyTreeProxy::MakeView(const py::object& treespec,
+                                            const py::tuple& leaves,
+                                            const ssize_t& pos,
+                                            const ssize_t& leaf_start) {
+    const auto& spec = thread_safe_cast<const PyTreeSpec&>(treespec);
+    const PyTreeSpec::Node& node = spec.m_traversal.at(pos);
+    switch (node.kind) {
+        case PyTreeKind::Leaf:
+            return TupleGetItem(leaves, leaf_start);
+
+        case PyTreeKind::None:
+            return py::none();
+
+        case PyTreeKind::Tuple:
+        case PyTreeKind::List:
+        case PyTreeKind::Dict:
+        case PyTreeKind::NamedTuple:
+        case PyTreeKind::OrderedDict:
+        case PyTreeKind::DefaultDict:
+        case PyTreeKind::Deque:
+        case PyTreeKind::StructSequence:
+            return py::cast(std::make_unique<PyTreeProxy>(treespec, leaves, pos, leaf_start));
+
+        case PyTreeKind::Custom: {
+            // The protocols of custom types are unknown, materialize them on access.
+            const auto subleaves = py::reinterpret_steal<py::tuple>(
+                PyTuple_GetSlice(leaves.ptr(), leaf_start, leaf_start + node.num_leaves));
+            if (!subleaves) [[unlikely]] {
+                throw py::error_already_set();
+            }
+            return spec.UnflattenImpl(subleaves, pos - node.num_nodes + 1, pos + 1);
+        }
+
+        default:
+            INTERNAL_ERROR();
+    }
+}
+
+const PyTreeSpec::Node& PyTreeProxy::GetNode() const { return m_spec->m_traversal[m_pos]; }
+
+bool PyTreeProxy::IsMapping() const {
+    const PyTreeKind kind = GetNode().kind;
+    return kind == PyTreeKind::Dict || kind == PyTreeKind::OrderedDict ||
+           kind == PyTreeKind::DefaultDict;
+}
+
+ssize_t PyTreeProxy::GetLength() const { return GetNode().arity; }
+
+py::object PyTreeProxy::GetChild(const ssize_t& index) {
+    {
+#ifdef Py_GIL_DISABLED
+        const scoped_lock_guard lock{m_mutex};
+#endif
+        if (m_children[index]) [[likely]] {
+            return m_children[index];
+        }
+    }
+
+    const auto& [pos, leaf_start] = m_child_positions[index];
+    py::object child = MakeView(m_treespec, m_leaves, pos, leaf_start);
+    {
+#ifdef Py_GIL_DISABLED
+        const scoped_lock_guard lock{m_mutex};
+#endif
+        // Another thread may have built the child in the meantime.
+        if (!m_children[index]) [[likely]] {
+            m_children[index] = std::move(child);
+        }
+        return m_children[index];
+    }
+}
+
+py::list PyTreeProxy::GetSortedKeys() const {
+    const PyTreeSpec::Node& node = GetNode();
+    if (node.kind == PyTreeKind::DefaultDict) [[unlikely]] {
+        return TupleGetItemAs<py::list>(node.node_data, 1);
+    }
+    return py::reinterpret_borrow<py::list>(node.node_data);
+}
+
+ssize_t PyTreeProxy::FindKey(const py::object& key) {
+    py::object key_index{};
+    {
+#ifdef Py_GIL_DISABLED
+        const scoped_lock_guard lock{m_mutex};
+#endif
+        key_index = m_key_index;
+    }
+    if (!key_index) [[unlikely]] {
+        const py::list keys = GetSortedKeys();
+        py::dict index{};
+        {
+            const scoped_critical_section cs{keys};
+            const ssize_t num_keys = ListGetSize(keys);
+            for (ssize_t i = 0; i < num_keys; ++i) {
+                index[ListGetItem(keys, i)] = py::int_(i);
+            }
+        }
+        {
+#ifdef Py_GIL_DISABLED
+            const scoped_lock_guard lock{m_mutex};
+#endif
+            if (!m_key_index) [[likely]] {
+                m_key_index = std::move(index);
+            }
+            key_index = m_key_index;
+        }
+    }
+
+    // The key index is never mutated after publication, so the borrowed reference remains valid.
+    PyObject* const found = PyDict_GetItemWithError(key_index.ptr(), key.ptr());
+    if (found == nullptr) [[unlikely]] {
+        if (PyErr_Occurred() != nullptr) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        return -1;
+    }
+    return PyLong_AsSsize_t(found);
+}
+
+py::object PyTreeProxy::GetItem(const py::object& key) {
+    if (IsMapping()) [[unlikely]] {
+        const ssize_t index = FindKey(key);
+        if (index < 0) [[unlikely]] {
+            PyErr_SetObject(PyExc_KeyError, key.ptr());
+            throw py::error_already_set();
+        }
+        return GetChild(index);
+    }
+
+    if (PySlice_Check(key.ptr())) [[unlikely]] {
+        return Materialize()[key];
+    }
+    ssize_t index = PyNumber_AsSsize_t(key.ptr(), PyExc_IndexError);
+    if (index == -1 && PyErr_Occurred() != nullptr) [[unlikely]] {
+        throw py::error_already_set();
+    }
+    const ssize_t arity = GetLength();
+    if (index < -arity || index >= arity) [[unlikely]] {
+        throw py::index_error("PyTreeProxy index out of range.");
+    }
+    if (index < 0) [[unlikely]] {
+        index += arity;
+    }
+    return GetChild(index);
+}
+
+py::object PyTreeProxy::GetAttr(const std::string& name) {
+    const PyTreeSpec::Node& node = GetNode();
+    if (node.kind == PyTreeKind::NamedTuple || node.kind == PyTreeKind::StructSequence)
+        [[likely]] {
+        const py::tuple fields = (node.kind == PyTreeKind::NamedTuple
+                                      ? NamedTupleGetFields(node.node_data)
+                                      : StructSequenceGetFields(node.node_data));
+        const ssize_t num_fields = std::min(TupleGetSize(fields), node.arity);
+        for (ssize_t i = 0; i < num_fields; ++i) {
+            if (PyStr(TupleGetItem(fields, i)) == name) [[unlikely]] {
+                return GetChild(i);
+            }
+        }
+    }
+    throw py::attribute_error("'PyTreeProxy' object has no attribute '" + name + "'.");
+}
+
+bool PyTreeProxy::Contains(const py::object& value) {
+    if (IsMapping()) [[unlikely]] {
+        return FindKey(value) >= 0;
+    }
+    const ssize_t arity = GetLength();
+    for (ssize_t i = 0; i < arity; ++i) {
+        const int result = PyObject_RichCompareBool(GetChild(i).ptr(), value.ptr(), Py_EQ);
+        if (result == -1) [[unlikely]] {
+            throw py::error_already_set();
+        }
+        if (result == 1) [[unlikely]] {
+            return true;
+        }
+    }
+    return false;
+}
+
+py::iterator PyTreeProxy::Iter() {
+    if (IsMapping()) [[unlikely]] {
+        return py::iter(Keys());
+    }
+    const ssize_t arity = GetLength();
+    py::list children{arity};
+    for (ssize_t i = 0; i < arity; ++i) {
+        ListSetItem(children, i, GetChild(i));
+    }
+    return py::iter(children);
+}
+
+py::list PyTreeProxy::Keys() const {
+    if (!IsMapping()) [[unlikely]] {
+        throw py::type_error("PyTreeProxy of a " + PyTreeSpec::NodeKindToString(GetNode()) +
+                             " node is not a mapping.");
+    }
+    const PyTreeSpec::Node& node = GetNode();
+    const py::list keys = (node.original_keys ? py::reinterpret_borrow<py::list>(node.original_keys)
+                                              : GetSortedKeys());
+    return EVALUATE_WITH_LOCK_HELD(py::list{keys}, keys);
+}
+
+py::list PyTreeProxy::Values() {
+    const py::list keys = Keys();
+    const ssize_t num_keys = ListGetSize(keys);
+    py::list values{num_keys};
+    for (ssize_t i = 0; i < num_keys; ++i) {
+        ListSetItem(values, i, GetChild(FindKey(ListGetItem(keys, i))));
+    }
+    return values;
+}
+
+py::list PyTreeProxy::Items() {
+    const py::list keys = Keys();
+    const ssize_t num_keys = ListGetSize(keys);
+    py::list items{num_keys};
+    for (ssize_t i = 0; i < num_keys; ++i) {
+        const py::object key = ListGetItem(keys, i);
+        ListSetItem(items, i, py::make_tuple(key, GetChild(FindKey(key))));
+    }
+    return items;
+}
+
+py::object PyTreeProxy::Get(const py::object& key, const py::object& default_value) {
+    if (!IsMapping()) [[unlikely]] {
+        throw py::type_error("PyTreeProxy of a " + PyTreeSpec::NodeKindToString(GetNode()) +
+                             " node is not a mapping.");
+    }
+    const ssize_t index = FindKey(key);
+    if (index < 0) [[unlikely]] {
+        return default_value;
+    }
+    return GetChild(index);
+}
+
+py::object PyTreeProxy::Materialize() const {
+    const PyTreeSpec::Node& node = GetNode();
+    const auto subleaves = py::reinterpret_steal<py::tuple>(
+        PyTuple_GetSlice(m_leaves.ptr(), m_leaf_start, m_leaf_start + node.num_leaves));
+    if (!subleaves) [[unlikely]] {
+        throw py::error_already_set();
+    }
+    return m_spec->UnflattenImpl(subleaves, m_pos - node.num_nodes + 1, m_pos + 1);
+}
+
+std::unique_ptr<PyTreeSpec> PyTreeProxy::GetTreeSpec() const {
+    const PyTreeSpec::Node& node = GetNode();
+    auto treespec = std::make_unique<PyTreeSpec>();
+    treespec->m_none_is_leaf = m_spec->m_none_is_leaf;
+    treespec->m_namespace = m_spec->m_namespace;
+    std::copy(m_spec->m_traversal.cbegin() + (m_pos - node.num_nodes + 1),
+              m_spec->m_traversal.cbegin() + (m_pos + 1),
+              std::back_inserter(treespec->m_traversal));
+    treespec->m_traversal.shrink_to_fit();
+    return treespec;
+}
+
+std::string PyTreeProxy::ToString() const {
+    return "PyTreeProxy(" + GetTreeSpec()->ToString() + ")";
 }
 
 }  // namespace optree
@@ -38,6 +38,7 @@ skipif_pypy = pytest.mark.skipif(
 )
 
 Py_GIL_DISABLED = sysconfig.get_config_var('Py_GIL_DISABLED') is not None
+Py_DEBUG = hasattr(sys, 'gettotalrefcount')
 NUM_GC_REPEAT = 10 if Py_GIL_DISABLED else 5
 
 
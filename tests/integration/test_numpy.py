@@ -143,3 +143,147 @@ def test_tree_ravel_single_dtype(tree):
         unravel_func(np.concatenate([flat, np.zeros((1,))]))
 
     unravel_func(flat.astype(np.complex128))
+
+
+@parametrize(tree=list(TREES + LEAVES))
+def test_tree_ravel_views(tree):
+    random.seed(0)
+    dtypes = [np.float32, np.float64, np.int32]
+
+    def replace_leaf(_):
+        shape = random.choice([(), (random.randint(1, 5),), (2, random.randint(1, 5))])
+        return np.random.uniform(low=-5.0, high=5.0, size=shape).astype(random.choice(dtypes))
+
+    tree = optree.tree_map(replace_leaf, tree)
+    storages, views = optree.integration.numpy.tree_ravel_views(tree)
+
+    leaves, treespec = optree.tree_flatten(tree)
+    view_leaves, view_treespec = optree.tree_flatten(views)
+    assert view_treespec == treespec
+    assert set(storages) == {np.asarray(leaf).dtype for leaf in leaves}
+    for dtype, storage in storages.items():
+        assert storage.dtype == dtype
+        assert storage.ndim == 1
+        assert storage.size == sum(np.size(leaf) for leaf in leaves if leaf.dtype == dtype)
+    for leaf, view in zip(leaves, view_leaves):
+        assert view.dtype == leaf.dtype
+        assert view.shape == np.shape(leaf)
+        assert np.array_equal(view, leaf)
+        assert np.shares_memory(view, storages[view.dtype])
+
+    for storage in storages.values():
+        storage += 1
+    for leaf, view in zip(leaves, view_leaves):
+        assert np.array_equal(view, leaf + 1)
+
+
+@parametrize(tree=list(TREES + LEAVES))
+def test_tree_foreach(tree):
+    random.seed(0)
+
+    def replace_leaf(_):
+        shape = random.choice([(), (random.randint(1, 5),), (2, random.randint(1, 5))])
+        dtype = random.choice([np.float32, np.float64])
+        return np.random.uniform(low=-5.0, high=5.0, size=shape).astype(dtype)
+
+    x = optree.tree_map(replace_leaf, tree)
+    y = optree.tree_map(lambda a: np.random.uniform(size=np.shape(a)).astype(a.dtype), x)
+    integration = optree.integration.numpy
+
+    def assert_tree_allclose(actual, expected):
+        actual_leaves, actual_treespec = optree.tree_flatten(actual)
+        expected_leaves, expected_treespec = optree.tree_flatten(expected)
+        assert actual_treespec == expected_treespec
+        for a, e in zip(actual_leaves, expected_leaves):
+            assert np.shape(a) == np.shape(e)
+            assert np.allclose(a, e)
+
+    assert_tree_allclose(
+        integration.tree_foreach_add(x, y, alpha=0.5),
+        optree.tree_map(lambda a, b: a + 0.5 * b, x, y),
+    )
+    assert_tree_allclose(integration.tree_foreach_add(x, y), optree.tree_map(np.add, x, y))
+    assert_tree_allclose(
+        integration.tree_foreach_axpy(-2.0, x, y),
+        optree.tree_map(lambda a, b: -2.0 * a + b, x, y),
+    )
+    assert_tree_allclose(
+        integration.tree_foreach_scale(x, 3.0),
+        optree.tree_map(lambda a: 3.0 * a, x),
+    )
+    assert_tree_allclose(
+        integration.tree_foreach_lerp(x, y, 0.25),
+        optree.tree_map(lambda a, b: a + 0.25 * (b - a), x, y),
+    )
+
+    leaves = optree.tree_leaves(x)
+    flat = np.concatenate([np.ravel(leaf).astype(np.float64) for leaf in leaves] or [np.zeros(0)])
+    for order in (0, 1, 2, np.inf):
+        expected_norm = np.linalg.norm(flat, ord=order)
+        assert np.isclose(integration.tree_foreach_norm(x, ord=order), expected_norm)
+
+    expected = optree.tree_map(lambda a, b: a + 0.5 * (b - a), x, y)
+    x = optree.tree_map(np.asarray, x)
+    result = integration.tree_foreach_lerp(x, y, 0.5, inplace=True)
+    assert result is x
+    assert_tree_allclose(x, expected)
+
+
+def test_tree_foreach_norm_zero_size_leaves():
+    tree = {'a': np.zeros(0), 'b': np.array([3.0, -4.0]), 'c': np.zeros((2, 0), dtype=np.float32)}
+    assert optree.integration.numpy.tree_foreach_norm(tree, ord=np.inf) == 4.0
+    assert optree.integration.numpy.tree_foreach_norm(tree, ord=0) == 2.0
+    assert optree.integration.numpy.tree_foreach_norm(tree, ord=2) == 5.0
+    assert optree.integration.numpy.tree_foreach_norm({'a': np.zeros(0)}, ord=np.inf) == 0.0
+
+
+@parametrize(tree=list(TREES + LEAVES))
+def test_tree_ravel_scalars(tree):
+    random.seed(0)
+
+    def replace_leaf(_):
+        return random.choice(
+            [random.uniform(-5.0, 5.0), random.randint(-5, 5), random.random() > 0.5],
+        )
+
+    tree = optree.tree_map(replace_leaf, tree)
+    leaves, treespec = optree.tree_flatten(tree)
+    flat, unravel_func = optree.integration.numpy.tree_ravel_scalars(tree)
+    assert flat.ndim == 1
+    assert flat.size == len(leaves)
+    if any(type(leaf) is float for leaf in leaves):
+        assert flat.dtype == np.float64
+    else:
+        assert flat.dtype == np.int64
+    cast = float if flat.dtype == np.float64 else int
+    assert flat.tolist() == [cast(leaf) for leaf in leaves]
+
+    restored = unravel_func(flat)
+    restored_leaves, restored_treespec = optree.tree_flatten(restored)
+    assert restored_treespec == treespec
+    assert restored_leaves == leaves
+    assert [type(leaf) for leaf in restored_leaves] == [type(leaf) for leaf in leaves]
+
+    updated_leaves = optree.tree_leaves(unravel_func(flat * 2))
+    for leaf, updated in zip(leaves, updated_leaves):
+        assert type(updated) is type(leaf)
+        if type(leaf) is not bool:
+            assert updated == leaf * 2
+        else:
+            assert updated == bool(leaf)
+
+
+def test_tree_ravel_scalars_int_only():
+    tree = {'a': 1, 'b': (True, -(2**40)), 'c': None}
+    flat, unravel_func = optree.integration.numpy.tree_ravel_scalars(tree)
+    assert flat.dtype == np.int64
+    assert flat.tolist() == [1, 1, -(2**40)]
+    assert unravel_func(flat) == tree
+    assert unravel_func(np.array([2.7, 0.0, 3.0])) == {'a': 2, 'b': (False, 3), 'c': None}
+
+    with pytest.raises(ValueError, match=r'expected an array of shape \(3,\), got shape \(2,\)'):
+        unravel_func(np.array([1, 2]))
+    with pytest.raises(TypeError, match=r'Expected every leaf to be an exact `float`, `int`'):
+        optree.integration.numpy.tree_ravel_scalars([1.0, np.float64(2.0)])
+    with pytest.raises(OverflowError):
+        optree.integration.numpy.tree_ravel_scalars([1, 2**64])
@@ -171,3 +171,106 @@ def test_tree_ravel_non_tensor():
         optree.integration.torch.tree_ravel((torch.tensor(1), 2))
 
     optree.integration.torch.tree_ravel((torch.tensor(1), torch.tensor(2)))
+
+
+@parametrize(tree=list(TREES + LEAVES))
+def test_tree_ravel_views(tree):
+    random.seed(0)
+    dtypes = [torch.float32, torch.float64, torch.int32]
+
+    def replace_leaf(_):
+        shape = random.choice([(), (random.randint(1, 5),), (2, random.randint(1, 5))])
+        return torch.randint(-5, 5, shape).to(random.choice(dtypes))
+
+    tree = optree.tree_map(replace_leaf, tree)
+    storages, views = optree.integration.torch.tree_ravel_views(tree)
+
+    leaves, treespec = optree.tree_flatten(tree)
+    view_leaves, view_treespec = optree.tree_flatten(views)
+    assert view_treespec == treespec
+    assert set(storages) == {leaf.dtype for leaf in leaves}
+    for dtype, storage in storages.items():
+        assert storage.dtype == dtype
+        assert storage.ndim == 1
+        assert storage.numel() == sum(leaf.numel() for leaf in leaves if leaf.dtype == dtype)
+    for leaf, view in zip(leaves, view_leaves):
+        assert view.dtype == leaf.dtype
+        assert view.shape == leaf.shape
+        assert torch.equal(view, leaf)
+        storage = storages[view.dtype]
+        assert view.untyped_storage().data_ptr() == storage.untyped_storage().data_ptr()
+
+    for storage in storages.values():
+        storage.add_(1)
+    for leaf, view in zip(leaves, view_leaves):
+        assert torch.equal(view, leaf + 1)
+
+
+def test_tree_ravel_views_requires_grad():
+    weight = torch.ones((2, 3), requires_grad=True)
+    bias = torch.zeros((3,))
+    storages, views = optree.integration.torch.tree_ravel_views({'weight': weight, 'bias': bias})
+    storage = storages[torch.float32]
+    assert storage.requires_grad
+    assert storage.is_leaf
+
+    (views['weight'].sum() * 2 + views['bias'].sum()).backward()
+    assert torch.equal(storage.grad, torch.tensor([1.0, 1.0, 1.0] + [2.0] * 6))
+
+    with pytest.raises(ValueError, match=r'All leaves must be tensors\.'):
+        optree.integration.torch.tree_ravel_views((torch.tensor(1), 2))
+
+
+@parametrize(tree=list(TREES + LEAVES))
+def test_tree_foreach(tree):
+    random.seed(0)
+
+    def replace_leaf(_):
+        shape = random.choice([(), (random.randint(1, 5),), (2, random.randint(1, 5))])
+        return torch.rand(shape, dtype=random.choice([torch.float32, torch.float64]))
+
+    x = optree.tree_map(replace_leaf, tree)
+    y = optree.tree_map(torch.rand_like, x)
+    integration = optree.integration.torch
+
+    def assert_tree_allclose(actual, expected):
+        actual_leaves, actual_treespec = optree.tree_flatten(actual)
+        expected_leaves, expected_treespec = optree.tree_flatten(expected)
+        assert actual_treespec == expected_treespec
+        for a, e in zip(actual_leaves, expected_leaves):
+            assert a.dtype == e.dtype
+            assert a.shape == e.shape
+            assert torch.allclose(a, e)
+
+    assert_tree_allclose(
+        integration.tree_foreach_add(x, y, alpha=0.5),
+        optree.tree_map(lambda a, b: a + 0.5 * b, x, y),
+    )
+    assert_tree_allclose(
+        integration.tree_foreach_axpy(-2.0, x, y),
+        optree.tree_map(lambda a, b: -2.0 * a + b, x, y),
+    )
+    assert_tree_allclose(
+        integration.tree_foreach_scale(x, 3.0),
+        optree.tree_map(lambda a: 3.0 * a, x),
+    )
+    assert_tree_allclose(
+        integration.tree_foreach_lerp(x, y, 0.25),
+        optree.tree_map(lambda a, b: a + 0.25 * (b - a), x, y),
+    )
+
+    leaves = optree.tree_leaves(x)
+    flat = torch.cat([leaf.reshape(-1).double() for leaf in leaves] or [torch.zeros(0)])
+    for order in (0, 1, 2, torch.inf):
+        assert torch.isclose(
+            integration.tree_foreach_norm(x, ord=order).double(),
+            torch.linalg.vector_norm(flat, order),
+        )
+
+    expected = optree.tree_map(lambda a, b: a + 0.5 * (b - a), x, y)
+    result = integration.tree_foreach_lerp(x, y, 0.5, inplace=True)
+    assert result is x
+    assert_tree_allclose(x, expected)
+
+    with pytest.raises(ValueError, match=r'All leaves must be tensors\.'):
+        integration.tree_foreach_scale((torch.tensor(1.0), 2.0), 2.0)
@@ -0,0 +1,244 @@
+# Copyright 2022-2024 MetaOPT Team. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+
+# pylint: disable=missing-function-docstring,invalid-name
+
+import array
+import os
+from collections import OrderedDict
+
+import pytest
+
+import optree
+from helpers import parametrize
+
+
+def make_tree():
+    return {
+        'params': OrderedDict(
+            w=array.array('d', [float(i) for i in range(1000)]),
+            b=array.array('f', [0.5, 1.5]),
+        ),
+        'buffer': bytearray(b'optree' * 50),
+        'empty': array.array('i'),
+        'meta': (7, 'run', b'raw', None),
+    }
+
+
+@parametrize(
+    chunk_size=[1, 7, 64, optree.checkpoint.DEFAULT_CHUNK_SIZE],
+    max_workers=[None, 1, 4],
+)
+def test_checkpoint_save_load(tmp_path, chunk_size, max_workers):
+    tree = make_tree()
+    treespec = optree.checkpoint.save(
+        tmp_path,
+        tree,
+        chunk_size=chunk_size,
+        max_workers=max_workers,
+    )
+    assert treespec == optree.tree_structure(tree)
+
+    manifest = optree.checkpoint.load_manifest(tmp_path)
+    assert manifest['treespec'] == treespec
+    records = manifest['records']
+    assert len(records) == treespec.num_leaves
+    assert [record['kind'] for record in records] == [
+        'buffer',
+        'buffer',
+        'pickle',
+        'pickle',
+        'pickle',
+        'buffer',
+        'buffer',
+    ]
+    assert all(record['offset'] % optree.checkpoint.ALIGNMENT == 0 for record in records)
+
+    restored = optree.checkpoint.load(tmp_path, chunk_size=chunk_size, max_workers=max_workers)
+    assert optree.tree_structure(restored) == treespec
+    assert restored['params']['w'].tolist() == tree['params']['w'].tolist()
+    assert restored['params']['b'].tolist() == tree['params']['b'].tolist()
+    assert restored['params']['w'].format == 'd'
+    assert bytes(restored['buffer']) == bytes(tree['buffer'])
+    assert bytes(restored['empty']) == b''
+    assert restored['meta'] == tree['meta']
+
+
+def test_checkpoint_load_inplace(tmp_path):
+    tree = make_tree()
+    optree.checkpoint.save(tmp_path, tree, chunk_size=16, max_workers=4)
+
+    target = optree.tree_map(
+        lambda x: type(x)(x.typecode, [0] * len(x)) if isinstance(x, array.array) else x,
+        make_tree(),
+    )
+    target['buffer'] = bytearray(len(tree['buffer']))
+    restored = optree.checkpoint.load(tmp_path, target, chunk_size=16, max_workers=4)
+    assert restored['params']['w'] is target['params']['w']
+    assert restored['buffer'] is target['buffer']
+    assert target['params']['w'] == tree['params']['w']
+    assert target['params']['b'] == tree['params']['b']
+    assert target['buffer'] == tree['buffer']
+
+    # Leaves with mismatched sizes are allocated rather than overwritten.
+    target['params']['w'] = array.array('d', [0.0])
+    restored = optree.checkpoint.load(tmp_path, target)
+    assert restored['params']['w'] is not target['params']['w']
+    assert restored['params']['w'].tolist() == tree['params']['w'].tolist()
+    assert target['params']['w'].tolist() == [0.0]
+
+    # Leaves with the same size but a different format are not reinterpreted.
+    target['params']['w'] = array.array('q', [0] * len(tree['params']['w']))
+    restored = optree.checkpoint.load(tmp_path, target)
+    assert restored['params']['w'] is not target['params']['w']
+    assert restored['params']['w'].format == 'd'
+    assert restored['params']['w'].tolist() == tree['params']['w'].tolist()
+    assert target['params']['w'].tolist() == [0] * len(tree['params']['w'])
+
+    with pytest.raises(ValueError, match=r'Expected the target to have the saved structure'):
+        optree.checkpoint.load(tmp_path, {'params': target['params']})
+
+
+def test_checkpoint_overwrite(tmp_path):
+    optree.checkpoint.save(tmp_path, make_tree())
+    optree.checkpoint.save(tmp_path, [bytearray(b'abc'), 1])
+    restored = optree.checkpoint.load(tmp_path)
+    assert bytes(restored[0]) == b'abc'
+    assert restored[1] == 1
+
+
+def test_checkpoint_overwrite_interrupted(tmp_path, monkeypatch):
+    optree.checkpoint.save(tmp_path, [bytearray(b'abc'), 1])
+
+    def interrupted(*args):
+        raise OSError('interrupted')
+
+    monkeypatch.setattr(optree.checkpoint, '_pwrite', interrupted)
+    with pytest.raises(OSError, match=r'interrupted'):
+        optree.checkpoint.save(tmp_path, [bytearray(b'xyz' * 1000), 2])
+    monkeypatch.undo()
+
+    restored = optree.checkpoint.load(tmp_path)
+    assert bytes(restored[0]) == b'abc'
+    assert restored[1] == 1
+
+
+def test_checkpoint_invalid_chunk_size(tmp_path):
+    with pytest.raises(ValueError, match=r'Expected `chunk_size` to be a positive integer'):
+        optree.checkpoint.save(tmp_path, [1], chunk_size=0)
+    with pytest.raises(ValueError, match=r'Expected `chunk_size` to be a positive integer'):
+        optree.checkpoint.load(tmp_path, chunk_size=-1)
+
+
+def test_checkpoint_incremental(tmp_path):
+    tree = make_tree()
+    optree.checkpoint.save(tmp_path / '1', tree)
+    manifest = optree.checkpoint.load_manifest(tmp_path / '1')
+    assert manifest['parent'] is None
+    assert [record['path'] for record in manifest['records']] == optree.tree_paths(tree)
+    assert all(record['file'] == 'data.bin' for record in manifest['records'])
+
+    # Structural edits are tolerated because leaves are matched by path.
+    tree['params']['w'][0] = -1.0
+    tree['params'].move_to_end('w', last=False)
+    tree['extra'] = array.array('q', [1, 2, 3])
+    del tree['empty']
+    optree.checkpoint.save(tmp_path / '2', tree, base=tmp_path / '1', chunk_size=64)
+    manifest = optree.checkpoint.load_manifest(tmp_path / '2')
+    assert manifest['parent'] == os.path.join('..', '1')
+    files = {record['path']: record['file'] for record in manifest['records']}
+    assert files[('params', 'w')] == 'data.bin'
+    assert files[('extra',)] == 'data.bin'
+    assert files[('params', 'b')].endswith('data.bin') and files[('params', 'b')] != 'data.bin'
+    assert files[('buffer',)] == files[('params', 'b')]
+
+    # Records that are unchanged point at the checkpoint that wrote them, not at the parent.
+    tree['buffer'][0] = ord('O')
+    optree.checkpoint.save(tmp_path / '3', tree, base=tmp_path / '2')
+    manifest = optree.checkpoint.load_manifest(tmp_path / '3')
+    files = {record['path']: record['file'] for record in manifest['records']}
+    assert files[('buffer',)] == 'data.bin'
+    assert files[('params', 'w')] == files[('extra',)]
+    assert files[('params', 'b')] != files[('params', 'w')]
+
+    def check(restored):
+        assert optree.tree_structure(restored) == optree.tree_structure(tree)
+        assert restored['params']['w'].tolist() == tree['params']['w'].tolist()
+        assert restored['params']['b'].tolist() == tree['params']['b'].tolist()
+        assert restored['extra'].tolist() == [1, 2, 3]
+        assert bytes(restored['buffer']) == bytes(tree['buffer'])
+        assert restored['meta'] == tree['meta']
+
+    check(optree.checkpoint.load(tmp_path / '3', max_workers=4))
+
+    manifest = optree.checkpoint.compact(tmp_path / '3', chunk_size=100, max_workers=4)
+    assert manifest['parent'] is None
+    assert all(record['file'] == 'data.bin' for record in manifest['records'])
+    assert optree.checkpoint.load_manifest(tmp_path / '3') == manifest
+    for name in ('1', '2'):
+        for file in (tmp_path / name).iterdir():
+            file.unlink()
+        (tmp_path / name).rmdir()
+    check(optree.checkpoint.load(tmp_path / '3'))
+
+    with pytest.raises(ValueError, match=r'Expected `base` to be a different checkpoint directory'):
+        optree.checkpoint.save(tmp_path / '3', tree, base=tmp_path / '3')
+
+
+def test_checkpoint_incremental_alternating(tmp_path):
+    tree = make_tree()
+    optree.checkpoint.save(tmp_path / 'a', tree)
+    optree.checkpoint.save(tmp_path / 'b', tree, base=tmp_path / 'a')
+
+    # Every record of `b` borrows from `a`, which is overwritten with `b` as its base.
+    tree['meta'] = (8, 'run', b'raw', None)
+    optree.checkpoint.save(tmp_path / 'a', tree, base=tmp_path / 'b')
+    manifest = optree.checkpoint.load_manifest(tmp_path / 'a')
+    assert all(record['file'] == 'data.bin' for record in manifest['records'])
+
+    restored = optree.checkpoint.load(tmp_path / 'a')
+    assert restored['params']['w'].tolist() == tree['params']['w'].tolist()
+    assert restored['params']['b'].tolist() == tree['params']['b'].tolist()
+    assert bytes(restored['buffer']) == bytes(tree['buffer'])
+    assert restored['meta'] == tree['meta']
+
+
+def test_checkpoint_load_inplace_numpy(tmp_path):
+    numpy = pytest.importorskip('numpy')
+
+    tree = {
+        'x': numpy.arange(6, dtype=numpy.float64).reshape(2, 3),
+        't': numpy.arange(4).astype('datetime64[s]'),
+    }
+    optree.checkpoint.save(tmp_path, tree)
+
+    target = {'x': numpy.zeros((2, 3)), 't': numpy.zeros(4, dtype='datetime64[s]')}
+    restored = optree.checkpoint.load(tmp_path, target)
+    assert restored['x'] is target['x']
+    assert restored['t'] is target['t']
+    assert numpy.array_equal(target['x'], tree['x'])
+    assert numpy.array_equal(target['t'], tree['t'])
+
+    # Arrays with the same size but a different dtype or shape are not reinterpreted.
+    target = {'x': numpy.zeros((2, 3), dtype=numpy.int64), 't': numpy.zeros(4, dtype=numpy.int64)}
+    restored = optree.checkpoint.load(tmp_path, target)
+    assert restored['x'] is not target['x']
+    assert restored['x'].dtype == numpy.float64
+    assert numpy.array_equal(restored['x'], tree['x'])
+    assert not target['x'].any()
+    target = {'x': numpy.zeros((3, 2)), 't': numpy.zeros(4, dtype='datetime64[s]')}
+    restored = optree.checkpoint.load(tmp_path, target)
+    assert restored['x'] is not target['x']
+    assert restored['x'].shape == (2, 3)
@@ -25,6 +25,7 @@ from concurrent.futures import ThreadPoolExecutor, as_completed
 import pytest
 
 import optree
+import optree._C
 from helpers import GLOBAL_NAMESPACE, PYPY, TREES, Py_GIL_DISABLED, gc_collect, parametrize
 
 
@@ -335,3 +336,72 @@ def test_tree_iter_thread_safe(
     for seq in results:
         assert sorted(seq) == seq
     assert sorted(itertools.chain.from_iterable(results)) == list(range(num_leaves))
+
+
+def test_dict_insertion_ordered_toggle_thread_safe():
+    tree = {'b': 2, 'a': 1, 'c': {'e': 5, 'd': 4}}
+    sorted_leaves = [1, 2, 4, 5]
+    insertion_ordered_leaves = [2, 1, 5, 4]
+    counter = itertools.count()
+
+    def test_fn():
+        results = []
+        for _ in range(64):
+            optree._C.set_dict_insertion_ordered(next(counter) % 2 == 0, 'toggle')
+            results.append(
+                (optree.tree_leaves(tree), optree.tree_leaves(tree, namespace='toggle')),
+            )
+        return results
+
+    try:
+        for results in concurrent_run(test_fn):
+            for global_leaves, toggled_leaves in results:
+                assert global_leaves == sorted_leaves
+                assert toggled_leaves in (sorted_leaves, insertion_ordered_leaves)
+    finally:
+        optree._C.set_dict_insertion_ordered(False, 'toggle')
+
+    assert not optree._C.is_dict_insertion_ordered('toggle')
+    assert optree.tree_leaves(tree, namespace='toggle') == sorted_leaves
+
+
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+)
+def test_tree_flatten_shared_leaf_predicate_thread_safe(tree, none_is_leaf):
+    def is_leaf(x):
+        return isinstance(x, int)
+
+    def test_fn():
+        return (
+            optree.tree_flatten(tree, is_leaf=is_leaf, none_is_leaf=none_is_leaf),
+            optree.tree_leaves(tree, is_leaf=is_leaf, none_is_leaf=none_is_leaf),
+            optree.tree_is_leaf(tree, is_leaf=is_leaf, none_is_leaf=none_is_leaf),
+            list(optree.tree_iter(tree, is_leaf=is_leaf, none_is_leaf=none_is_leaf)),
+        )
+
+    expected = test_fn()
+    for result in concurrent_run(test_fn):
+        assert result == expected
+
+
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_treespec_unflatten_and_compare_shared_thread_safe(tree, none_is_leaf, namespace):
+    leaves, treespec = optree.tree_flatten(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+    other_treespec = optree.tree_structure(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+
+    def test_fn():
+        return (
+            treespec.unflatten(leaves),
+            treespec == other_treespec,
+            treespec.is_prefix(other_treespec),
+            treespec.is_prefix(other_treespec, strict=True),
+        )
+
+    for result in concurrent_run(test_fn):
+        assert result == (tree, True, True, False)
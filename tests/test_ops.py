@@ -15,6 +15,7 @@
 
 # pylint: disable=missing-function-docstring,invalid-name,wrong-import-order
 
+import concurrent.futures
 import copy
 import functools
 import itertools
@@ -43,6 +44,7 @@ from helpers import (
     is_list,
     is_none,
     is_tuple,
+    Py_DEBUG,
     never,
     parametrize,
 )
@@ -170,6 +172,15 @@ def test_flatten_dict_order():
     assert list(optree.tree_iter({'a': 1, 2: 2})) == [2, 1]
     assert list(optree.tree_iter({'a': 1, 2: 2, 3.0: 3})) == [3, 2, 1]
     assert list(optree.tree_iter({2: 2, 3.0: 3})) == [2, 3]
+    assert optree.tree_leaves({'b': 1, 3: 2, b'c': 3, 1: 4, 'a': 5, 2.5: 6}) == [3, 6, 4, 2, 5, 1]
+    assert optree.tree_leaves({True: 1, 'a': 2, 0: 3}) == [1, 3, 2]
+
+    class NonSortable:
+        pass
+
+    x, y = NonSortable(), NonSortable()
+    assert optree.tree_leaves({y: 1, 'b': 2, x: 3, 'a': 4}) == [1, 2, 3, 4]
+    assert optree.tree_leaves({y: 1, x: 2}) == [1, 2]
 
     sorted_treespec = optree.tree_structure({'a': 1, 'b': 2, 'c': {'e': 3, 'f': None, 'g': 4}})
 
@@ -229,6 +240,144 @@ def test_tree_iter(
         with pytest.raises(StopIteration):
             next(it)
 
+        leaves, treespec = optree.tree_flatten(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+        it = optree.tree_iter(
+            tree,
+            none_is_leaf=none_is_leaf,
+            namespace=namespace,
+            build_treespec=True,
+        )
+        assert list(it) == leaves
+        assert it.treespec == treespec
+        assert it.treespec.namespace == treespec.namespace
+        assert repr(it.treespec) == repr(treespec)
+        assert it.treespec.paths() == treespec.paths()
+
+
+def test_tree_iter_build_treespec():
+    tree = {'b': (2, [3, 4]), 'a': 1, 'c': None, 'd': OrderedDict(y=5, x=6)}
+    it = optree.tree_iter(tree, build_treespec=True)
+    with pytest.raises(ValueError, match=r'only available after the iterator is exhausted'):
+        _ = it.treespec
+    assert next(it) == 1
+    assert list(it) == [2, 3, 4, 5, 6]
+    treespec = it.treespec
+    assert treespec == optree.tree_structure(tree)
+    assert it.treespec is not treespec
+    assert optree.tree_unflatten(treespec, [1, 2, 3, 4, 5, 6]) == tree
+    assert list(optree.tree_unflatten(treespec, range(6))) == ['b', 'a', 'c', 'd']
+    with pytest.raises(StopIteration):
+        next(it)
+    assert it.treespec == treespec
+
+    it = optree.tree_iter([1, (2, 3)], is_leaf=lambda x: isinstance(x, tuple), build_treespec=True)
+    assert list(it) == [1, (2, 3)]
+    assert it.treespec == optree.tree_structure([1, 2])
+    it = optree.tree_iter(None, build_treespec=True)
+    assert list(it) == []
+    assert it.treespec == optree.tree_structure(None)
+
+    it = optree.tree_iter(tree)
+    assert list(it) == [1, 2, 3, 4, 5, 6]
+    with pytest.raises(ValueError, match=r'created with `build_treespec=True`'):
+        _ = it.treespec
+
+
+@parametrize(
+    tree=list(TREES + LEAVES),
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+    dict_should_be_sorted=[False, True],
+    dict_session_namespace=['', 'undefined', 'namespace'],
+)
+def test_tree_iter_zip(
+    tree,
+    none_is_leaf,
+    namespace,
+    dict_should_be_sorted,
+    dict_session_namespace,
+):
+    with optree.dict_insertion_ordered(
+        not dict_should_be_sorted,
+        namespace=dict_session_namespace or GLOBAL_NAMESPACE,
+    ):
+        leaves, treespec = optree.tree_flatten(
+            tree,
+            none_is_leaf=none_is_leaf,
+            namespace=namespace,
+        )
+        it = optree.tree_iter_zip(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+        assert iter(it) is it
+        assert list(it) == [(leaf,) for leaf in leaves]
+        with pytest.raises(StopIteration):
+            next(it)
+
+        other = treespec.unflatten(range(len(leaves)))
+        nested = treespec.unflatten([(i, [i]) for i in range(len(leaves))])
+        it = optree.tree_iter_zip(
+            tree,
+            other,
+            nested,
+            none_is_leaf=none_is_leaf,
+            namespace=namespace,
+        )
+        assert list(it) == list(
+            zip(leaves, treespec.flatten_up_to(other), treespec.flatten_up_to(nested)),
+        )
+
+
+def test_tree_iter_zip_mismatch():
+    assert list(optree.tree_iter_zip({'a': 1, 'b': 2}, OrderedDict(b=3, a=4))) == [(1, 4), (2, 3)]
+    assert list(optree.tree_iter_zip(1, {'a': 1})) == [(1, {'a': 1})]
+    it = optree.tree_iter_zip([1, (2, 3)], [4, 5], is_leaf=lambda x: isinstance(x, tuple))
+    assert list(it) == [(1, 4), ((2, 3), 5)]
+
+    with pytest.raises(ValueError, match=re.escape('list arity mismatch; expected: 2, got: 3')):
+        list(optree.tree_iter_zip([1, 2], [1, 2, 3]))
+    with pytest.raises(ValueError, match=re.escape('Expected an instance of tuple, got [1, 2].')):
+        list(optree.tree_iter_zip((1, 2), [1, 2]))
+    with pytest.raises(ValueError, match=re.escape("missing key(s): ['b']")):
+        list(optree.tree_iter_zip({'a': 1, 'b': 2}, {'a': 1}))
+    with pytest.raises(ValueError, match=re.escape('Expected None, got 1.')):
+        list(optree.tree_iter_zip([None], [1]))
+
+    # The error is raised lazily when the mismatched node is reached.
+    it = optree.tree_iter_zip([1, [2]], [3, (4,)])
+    assert next(it) == (1, 3)
+    with pytest.raises(ValueError, match=re.escape('Expected an instance of list, got (4,).')):
+        next(it)
+
+
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_tree_iter_shard(tree, none_is_leaf, namespace):
+    leaves, treespec = optree.tree_flatten(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+    for n in (1, 2, 5):
+        shards = treespec.partition(n)
+        shard_leaves = []
+        for shard in shards:
+            start, stop, _ = shard
+            it = optree.tree_iter_shard(tree, treespec, shard)
+            assert list(it) == leaves[start:stop]
+            shard_leaves.extend(optree.tree_iter_shard(tree, treespec, shard))
+        assert shard_leaves == leaves
+
+
+def test_tree_iter_shard_threads():
+    tree = {'layers': [{'w': [i, i + 1], 'b': i} for i in range(0, 40, 2)], 'step': 0}
+    leaves, treespec = optree.tree_flatten(tree)
+    shards = treespec.partition(4)
+    with concurrent.futures.ThreadPoolExecutor(max_workers=4) as executor:
+        results = list(
+            executor.map(lambda shard: list(optree.tree_iter_shard(tree, treespec, shard)), shards),
+        )
+    assert [sum(map(len, results[:i])) for i in range(4)] == [start for start, _, _ in shards]
+    assert [leaf for result in results for leaf in result] == leaves
+    assert max(map(len, results)) - min(map(len, results)) <= 3
+
 
 def test_walk():
     tree = {'b': 2, 'a': 1, 'c': {'f': None, 'e': 3, 'g': 4}}
@@ -333,6 +482,54 @@ def test_flatten_up_to_none_is_leaf():
     assert subtrees == [accessor(tree) for accessor in optree.treespec_accessors(treespec)]
 
 
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_tree_flatten_assume_unshared(tree, none_is_leaf, namespace):
+    expected_leaves, expected_treespec = optree.tree_flatten(
+        tree,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    leaves, treespec = optree.tree_flatten(
+        tree,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+        assume_unshared=True,
+    )
+    assert leaves == expected_leaves
+    assert treespec == expected_treespec
+    assert (
+        optree.tree_leaves(tree, none_is_leaf=none_is_leaf, namespace=namespace, assume_unshared=True)
+        == expected_leaves
+    )
+    assert (
+        optree.tree_structure(
+            tree,
+            none_is_leaf=none_is_leaf,
+            namespace=namespace,
+            assume_unshared=True,
+        )
+        == expected_treespec
+    )
+    assert treespec.flatten_up_to(tree, assume_unshared=True) == treespec.flatten_up_to(tree)
+
+
+@pytest.mark.skipif(not Py_DEBUG, reason='mutation checks are only enabled in debug builds')
+def test_tree_flatten_assume_unshared_detects_mutation():
+    tree = [1, [2, 3], 4]
+
+    def is_leaf(x):
+        if x == 2:
+            tree.append(5)
+        return False
+
+    with pytest.raises(RuntimeError, match=r'was mutated during flattening'):
+        optree.tree_flatten(tree, is_leaf=is_leaf, assume_unshared=True)
+
+
 @parametrize(
     leaves_fn=[
         optree.tree_leaves,
@@ -2662,6 +2859,109 @@ def test_tree_replace_nones():
     assert optree.tree_replace_nones(sentinel, None) == sentinel
 
 
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_tree_partition_combine(tree, none_is_leaf, namespace):
+    sentinel = object()
+    counter = itertools.count()
+    leaves, treespec = optree.tree_flatten(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+    selected, rejected = optree.tree_partition(
+        tree,
+        lambda _: next(counter) % 2 == 0,
+        placeholder=sentinel,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    selected_leaves, selected_treespec = optree.tree_flatten(
+        selected,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    rejected_leaves, rejected_treespec = optree.tree_flatten(
+        rejected,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    assert selected_treespec == treespec
+    assert rejected_treespec == treespec
+    for i, (leaf, a, b) in enumerate(zip(leaves, selected_leaves, rejected_leaves)):
+        if i % 2 == 0:
+            assert a is leaf
+            assert b is sentinel
+        else:
+            assert a is sentinel
+            assert b is leaf
+
+    combined = optree.tree_combine(
+        selected,
+        rejected,
+        placeholder=sentinel,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    combined_leaves, combined_treespec = optree.tree_flatten(
+        combined,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    assert combined_treespec == treespec
+    assert all(a is b for a, b in zip(combined_leaves, leaves))
+
+    mask = treespec.unflatten([True] * treespec.num_leaves)
+    selected, rejected = optree.tree_partition(
+        tree,
+        mask,
+        placeholder=sentinel,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    )
+    assert optree.tree_leaves(selected, none_is_leaf=none_is_leaf, namespace=namespace) == leaves
+    assert optree.tree_leaves(
+        rejected,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    ) == [sentinel] * treespec.num_leaves
+
+
+def test_tree_partition_mask_tree():
+    tree = {'a': 1, 'b': 2.0, 'c': (3, 4.0)}
+    assert optree.tree_partition(tree, lambda x: isinstance(x, int)) == (
+        {'a': 1, 'b': None, 'c': (3, None)},
+        {'a': None, 'b': 2.0, 'c': (None, 4.0)},
+    )
+    assert optree.tree_partition(tree, {'a': True, 'b': False, 'c': True}) == (
+        {'a': 1, 'b': None, 'c': (3, 4.0)},
+        {'a': None, 'b': 2.0, 'c': (None, None)},
+    )
+    assert optree.tree_partition(tree, {'a': 0, 'b': 1, 'c': lambda x: x > 3}, placeholder=0) == (
+        {'a': 0, 'b': 2.0, 'c': (0, 4.0)},
+        {'a': 1, 'b': 0, 'c': (3, 0)},
+    )
+    assert optree.tree_partition(tree, True) == (tree, {'a': None, 'b': None, 'c': (None, None)})
+
+    ordered = OrderedDict([('c', (3, 4.0)), ('b', 2.0), ('a', 1)])
+    assert optree.tree_partition(ordered, {'a': True, 'b': False, 'c': (False, True)}) == (
+        OrderedDict([('c', (None, 4.0)), ('b', None), ('a', 1)]),
+        OrderedDict([('c', (3, None)), ('b', 2.0), ('a', None)]),
+    )
+
+    with pytest.raises(ValueError, match=r'Expected the mask tree to be a prefix of the tree'):
+        optree.tree_partition(tree, {'a': True, 'b': False})
+    with pytest.raises(ValueError, match=r'Expected the mask tree to be a prefix of the tree'):
+        optree.tree_partition(tree, {'a': True, 'b': False, 'c': [True, False]})
+
+    selected, rejected = optree.tree_partition({'a': 1, 'b': (2, None)}, lambda x: x > 1)
+    assert selected == {'a': None, 'b': (2, None)}
+    assert rejected == {'a': 1, 'b': (None, None)}
+    assert optree.tree_combine(selected, rejected) == {'a': 1, 'b': (2, None)}
+    assert optree.tree_combine([1, 0, 0], [0, 2, 0], [0, 5, 3], placeholder=0) == [1, 2, 3]
+    with pytest.raises(ValueError, match=r'Expected every pytree to have the same structure'):
+        optree.tree_combine([1, None], [None, 2, 3])
+
+
 @parametrize(
     tree=TREES,
     none_is_leaf=[False, True],
@@ -3036,6 +3336,41 @@ def test_broadcast_common():
     )
 
 
+@parametrize(
+    tree=list(TREES + LEAVES),
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_broadcast_common_with_leaf(tree, none_is_leaf, namespace):
+    leaves = optree.tree_leaves(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+    zeros = optree.tree_map(lambda _: 0, tree, none_is_leaf=none_is_leaf, namespace=namespace)
+
+    assert optree.tree_broadcast_common(
+        tree,
+        0,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    ) == (tree, zeros)
+    assert optree.tree_broadcast_common(
+        0,
+        tree,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    ) == (zeros, tree)
+    assert optree.broadcast_common(
+        tree,
+        0,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    ) == (leaves, [0] * len(leaves))
+    assert optree.broadcast_common(
+        tree,
+        tree,
+        none_is_leaf=none_is_leaf,
+        namespace=namespace,
+    ) == (leaves, leaves)
+
+
 def test_tree_reduce():
     assert optree.tree_reduce(operator.add, {'x': 1, 'y': (2, 3)}) == 6
     assert optree.tree_reduce(operator.add, {'x': 1, 'y': (2, None), 'z': 3}) == 6
@@ -495,6 +495,147 @@ def test_pytree_node_registry_get():
     assert handler is not None
 
 
+def test_register_pytree_node_with_declarative_kind():
+    class MyList(UserList):
+        pass
+
+    class MyDict(UserDict):
+        pass
+
+    optree.register_pytree_node(MyList, kind='sequence', namespace='foo')
+    optree.register_pytree_node_class(MyDict, kind='mapping', namespace='foo')
+
+    tree = MyDict({'b': MyList([2, 3]), 'a': 1, 'c': None})
+    leaves, treespec = optree.tree_flatten(tree, namespace='foo')
+    assert leaves == [1, 2, 3]
+    assert (
+        str(treespec)
+        == "PyTreeSpec(CustomTreeNode(MyDict[('a', 'b', 'c')], [*, CustomTreeNode(MyList[None], [*, *]), None]), namespace='foo')"
+    )
+    assert optree.tree_leaves(tree) == [tree]
+    assert optree.tree_paths(tree, namespace='foo') == [('a',), ('b', 0), ('b', 1)]
+    assert treespec.entries() == ['a', 'b', 'c']
+
+    restored = optree.tree_unflatten(treespec, [4, 5, 6])
+    assert type(restored) is MyDict
+    assert type(restored['b']) is MyList
+    assert restored == MyDict({'a': 4, 'b': MyList([5, 6]), 'c': None})
+    assert optree.tree_map(lambda x: x + 1, tree, namespace='foo') == MyDict(
+        {'a': 2, 'b': MyList([3, 4]), 'c': None},
+    )
+    assert optree.tree_structure(restored, namespace='foo') == treespec
+    assert treespec.flatten_up_to(tree) == [1, 2, 3]
+
+    children, metadata, entries, unflatten_func = optree.tree_flatten_one_level(
+        tree,
+        namespace='foo',
+    )
+    assert list(children) == [1, MyList([2, 3]), None]
+    assert tuple(metadata) == ('a', 'b', 'c')
+    assert tuple(entries) == ('a', 'b', 'c')
+    assert unflatten_func(metadata, children) == tree
+
+    with optree.dict_insertion_ordered(True, namespace='foo'):
+        leaves, treespec = optree.tree_flatten(tree, namespace='foo')
+        assert leaves == [2, 3, 1]
+        assert treespec.entries() == ['b', 'a', 'c']
+        children, metadata, entries, unflatten_func = optree.tree_flatten_one_level(
+            tree,
+            namespace='foo',
+        )
+        assert list(children) == [MyList([2, 3]), 1, None]
+        assert tuple(metadata) == ('b', 'a', 'c')
+        assert tuple(entries) == ('b', 'a', 'c')
+        assert list(unflatten_func(metadata, children)) == ['b', 'a', 'c']
+        handler = optree.register_pytree_node.get(MyDict, namespace='foo')
+        assert handler is optree.register_pytree_node.get(MyDict, namespace='foo')
+    assert handler.flatten_func is not (
+        optree.register_pytree_node.get(MyDict, namespace='foo').flatten_func
+    )
+
+    handler = optree.register_pytree_node.get(MyList, namespace='foo')
+    assert handler is not None
+    assert handler.kind == 'sequence'
+
+    with pytest.raises(ValueError, match=r"Expected `kind` to be one of 'sequence' and 'mapping'"):
+        optree.register_pytree_node(MyList, kind='set', namespace='bar')
+    with pytest.raises(ValueError, match=r'Cannot specify `flatten_func` or `unflatten_func`'):
+        optree.register_pytree_node(
+            MyList,
+            lambda x: (x.data, None),
+            lambda _, c: MyList(c),
+            kind='sequence',
+            namespace='bar',
+        )
+    with pytest.raises(TypeError, match=r'Must specify `flatten_func` and `unflatten_func`'):
+        optree.register_pytree_node(MyList, namespace='bar')
+
+    optree.unregister_pytree_node(MyList, namespace='foo')
+    optree.unregister_pytree_node(MyDict, namespace='foo')
+
+
+def test_register_pytree_node_with_metadata_key():
+    class Box:
+        def __init__(self, metadata, value):
+            self.metadata = metadata
+            self.value = value
+
+    def flatten(box):
+        return (box.value,), box.metadata
+
+    def unflatten(metadata, children):
+        return Box(metadata, *children)
+
+    optree.register_pytree_node(Box, flatten, unflatten, namespace='unhashed')
+    optree.register_pytree_node(Box, flatten, unflatten, metadata_key=True, namespace='hashed')
+    optree.register_pytree_node(
+        Box,
+        flatten,
+        unflatten,
+        metadata_key=lambda metadata: tuple(sorted(metadata.items())),
+        namespace='keyed',
+    )
+    assert optree.register_pytree_node.get(Box, namespace='unhashed').metadata_key is None
+    assert optree.register_pytree_node.get(Box, namespace='hashed').metadata_key is True
+    with pytest.raises(TypeError, match=r'Expected the metadata key to be None, a boolean'):
+        optree.register_pytree_node(Box, flatten, unflatten, metadata_key=1, namespace='invalid')
+
+    treespecs = [optree.tree_structure(Box(i, 0), namespace='unhashed') for i in range(16)]
+    assert len({hash(treespec) for treespec in treespecs}) == 1
+    assert len(set(treespecs)) == 16
+
+    treespecs = [optree.tree_structure(Box(i, 0), namespace='hashed') for i in range(16)]
+    assert len({hash(treespec) for treespec in treespecs}) == 16
+    assert len(set(treespecs)) == 16
+    treespec = optree.tree_structure(Box(1, 2), namespace='hashed')
+    assert treespec == treespecs[1]
+    assert hash(treespec) == hash(treespecs[1])
+    with pytest.raises(TypeError, match=r'unhashable type'):
+        hash(optree.tree_structure(Box({'size': 1}, 0), namespace='hashed'))
+
+    treespecs = [optree.tree_structure(Box({'size': i}, 0), namespace='keyed') for i in range(16)]
+    assert len({hash(treespec) for treespec in treespecs}) == 16
+    assert len(set(treespecs)) == 16
+    treespec = optree.tree_structure(Box({'size': 1}, 2), namespace='keyed')
+    assert treespec == treespecs[1]
+    assert hash(treespec) == hash(treespecs[1])
+
+    # Identical metadata is equal without calling `__eq__`.
+    class Metadata:
+        def __eq__(self, other):
+            raise RuntimeError('Should not be called.')
+
+    box = Box(Metadata(), 0)
+    assert optree.tree_structure(box, namespace='unhashed') == optree.tree_structure(
+        box,
+        namespace='unhashed',
+    )
+
+    optree.unregister_pytree_node(Box, namespace='unhashed')
+    optree.unregister_pytree_node(Box, namespace='hashed')
+    optree.unregister_pytree_node(Box, namespace='keyed')
+
+
 def test_pytree_node_registry_with_init_subclass():
     @optree.register_pytree_node_class(namespace='mydict')
     class MyDict(UserDict):
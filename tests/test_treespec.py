@@ -15,7 +15,9 @@
 
 # pylint: disable=missing-function-docstring,invalid-name,wrong-import-order
 
+import array
 import contextlib
+import copy
 import itertools
 import pickle
 import re
@@ -66,6 +68,104 @@ def test_treespec_equal_hash():
             assert hash(treespec1_none_is_leaf) != hash(treespec2)
 
 
+def test_treespec_equal_hash_metadata():
+    treespec1 = optree.tree_structure({1: 0, 'a': 1})
+    treespec2 = optree.tree_structure({1.0: 0, 'a': 1})
+    treespec3 = optree.tree_structure({True: 0, 'a': 1})
+    treespec4 = optree.tree_structure({2: 0, 'a': 1})
+    assert treespec1 == treespec2 == treespec3
+    assert hash(treespec1) == hash(treespec2) == hash(treespec3)
+    assert treespec1 != treespec4
+    assert hash(treespec1) != hash(treespec4)
+
+    class Foo:
+        def __init__(self, x, y, metadata):
+            self.x = x
+            self.y = y
+            self.metadata = metadata
+
+    optree.register_pytree_node(
+        Foo,
+        lambda foo: ((foo.x, foo.y), foo.metadata),
+        lambda metadata, children: Foo(children[0], children[1], metadata),
+        namespace='foo',
+    )
+
+    for metadata, other_metadata in (
+        (('a', 1), ('a', 2)),
+        (['a', 1], ['a', 2]),
+        ({'a': [1]}, {'a': [2]}),
+    ):
+        treespec1 = optree.tree_structure(Foo(0, 1, metadata), namespace='foo')
+        treespec2 = optree.tree_structure(Foo(2, 3, copy.deepcopy(metadata)), namespace='foo')
+        treespec3 = optree.tree_structure(Foo(0, 1, other_metadata), namespace='foo')
+        assert treespec1 == treespec2
+        assert hash(treespec1) == hash(treespec2)
+        assert treespec1 != treespec3
+        assert treespec2 != treespec3
+
+    optree.unregister_pytree_node(Foo, namespace='foo')
+
+
+def test_treespec_equal_hash_intern_table_eviction():
+    treespec1 = optree.tree_structure({'key': 0, 'value': 1})
+    hash(treespec1)
+
+    # Fill the bounded metadata intern table with distinct keys, so it is cleared.
+    for i in range(70000):
+        hash(optree.tree_structure({f'key{i}': 0}))
+
+    treespec2 = optree.tree_structure({'key': 0, 'value': 1})
+    treespec3 = optree.tree_structure({'key': 0, 'other': 1})
+    assert treespec1 == treespec2
+    assert hash(treespec1) == hash(treespec2)
+    assert treespec1 != treespec3
+    assert treespec2 != treespec3
+
+
+def test_treespec_hash_does_not_intern_user_metadata():
+    class Metadata:
+        def __init__(self, value):
+            self.value = value
+
+        def __hash__(self):
+            return hash(self.value)
+
+        def __eq__(self, other):
+            if comparing_disabled:
+                raise RuntimeError('metadata compared while hashing')
+            return isinstance(other, Metadata) and self.value == other.value
+
+    class Foo:
+        def __init__(self, x, metadata):
+            self.x = x
+            self.metadata = metadata
+
+    optree.register_pytree_node(
+        Foo,
+        lambda foo: ((foo.x,), foo.metadata),
+        lambda metadata, children: Foo(children[0], metadata),
+        metadata_key=True,
+        namespace='foo',
+    )
+
+    comparing_disabled = True
+    metadata = Metadata(1)
+    treespec1 = optree.tree_structure(Foo(0, metadata), namespace='foo')
+    treespec2 = optree.tree_structure(Foo(0, Metadata(1)), namespace='foo')
+    assert hash(treespec1) == hash(treespec2)
+    comparing_disabled = False
+    assert treespec1 == treespec2
+
+    # The intern table does not keep the metadata alive.
+    ref = weakref.ref(metadata)
+    del metadata, treespec1
+    gc_collect()
+    assert ref() is None
+
+    optree.unregister_pytree_node(Foo, namespace='foo')
+
+
 @parametrize(
     tree=TREES,
     none_is_leaf=[False, True],
@@ -901,6 +1001,154 @@ def test_treespec_child(
         ]
 
 
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+)
+def test_treespec_unflatten_lazy(tree, none_is_leaf):
+    leaves, treespec = optree.tree_flatten(tree, none_is_leaf=none_is_leaf)
+    lazy = treespec.unflatten_lazy(leaves)
+    expected = treespec.unflatten(leaves)
+    if not isinstance(lazy, optree._C.PyTreeProxy):
+        assert optree.tree_flatten(lazy, none_is_leaf=none_is_leaf) == (leaves, treespec)
+        return
+
+    assert lazy.treespec == treespec
+    assert len(lazy) == len(expected)
+    assert type(lazy.materialize()) is type(expected)
+    assert optree.tree_flatten(lazy.materialize(), none_is_leaf=none_is_leaf) == (
+        leaves,
+        treespec,
+    )
+
+    flat, spec = optree.tree_flatten(lazy, none_is_leaf=none_is_leaf)
+    assert flat == leaves
+    assert spec == treespec
+    assert list(optree.tree_iter(lazy, none_is_leaf=none_is_leaf)) == leaves
+    assert optree.tree_flatten_with_path(lazy, none_is_leaf=none_is_leaf) == (
+        optree.tree_flatten_with_path(expected, none_is_leaf=none_is_leaf)
+    )
+
+
+def test_treespec_unflatten_lazy_access():
+    tree = {'b': [1, (2, 3)], 'a': {'x': 4, 'y': None}, 'c': 5}
+    leaves, treespec = optree.tree_flatten(tree)
+    lazy = treespec.unflatten_lazy(leaves)
+    assert isinstance(lazy, optree._C.PyTreeProxy)
+    assert len(lazy) == 3
+    assert list(lazy) == ['b', 'a', 'c']
+    assert lazy.keys() == ['b', 'a', 'c']
+    assert 'a' in lazy
+    assert 'd' not in lazy
+    assert lazy['c'] == 5
+    assert lazy.get('d', 6) == 6
+    with pytest.raises(KeyError):
+        lazy['d']
+
+    child = lazy['b']
+    assert isinstance(child, optree._C.PyTreeProxy)
+    assert lazy['b'] is child
+    assert child.treespec == optree.tree_structure([1, (2, 3)])
+    assert child[0] == 1
+    assert child[-1].materialize() == (2, 3)
+    assert child[:1] == [1]
+    assert 1 in child
+    with pytest.raises(IndexError, match=re.escape('PyTreeProxy index out of range.')):
+        child[2]
+    with pytest.raises(TypeError, match='is not a mapping'):
+        child.keys()
+    assert lazy['a']['y'] is None
+    assert lazy['a'].items() == [('x', 4), ('y', None)]
+    assert lazy.materialize() == tree
+    assert list(lazy.materialize()) == ['b', 'a', 'c']
+
+    point = helpers.CustomNamedTupleSubclass(1, 2)
+    lazy = optree.tree_structure(point).unflatten_lazy([3, 4])
+    assert lazy.foo == 3
+    assert lazy.bar == 4
+    with pytest.raises(AttributeError):
+        lazy.baz
+
+    leaves, treespec = optree.tree_flatten({'a': [1, 2], 'b': 3})
+    lazy = treespec.unflatten_lazy(leaves)
+    assert optree.tree_map(lambda x, y: x + y, lazy, {'a': [10, 20], 'b': 30}) == {
+        'a': [11, 22],
+        'b': 33,
+    }
+    assert optree.tree_map(lambda x, y: x + y, {'a': [10, 20], 'b': 30}, lazy) == {
+        'a': [11, 22],
+        'b': 33,
+    }
+    assert optree.tree_leaves({'x': lazy['a'], 'y': lazy}) == [1, 2, 1, 2, 3]
+
+    with pytest.raises(ValueError, match=re.escape('Too few leaves for PyTreeSpec')):
+        treespec.unflatten_lazy([1, 2])
+    with pytest.raises(ValueError, match=re.escape('Too many leaves for PyTreeSpec')):
+        treespec.unflatten_lazy([1, 2, 3, 4])
+
+
+def test_treespec_unflatten_lazy_flatten_matches_materialize():
+    # A stored leaf that is a pytree is expanded.
+    lazy = optree.tree_structure([0, 0]).unflatten_lazy([[1, 2], 3])
+    assert optree.tree_flatten(lazy) == optree.tree_flatten(lazy.materialize())
+    assert optree.tree_leaves(lazy) == [1, 2, 3]
+
+    # A stored `None` leaf is a `None` node with `none_is_leaf=False`.
+    lazy = optree.tree_structure([0, 0]).unflatten_lazy([None, 1])
+    assert optree.tree_flatten(lazy) == optree.tree_flatten(lazy.materialize())
+    assert optree.tree_leaves(lazy) == [1]
+
+    # The keys follow the dictionary order mode used for flattening, not the one used for building.
+    tree = {'b': 1, 'a': [2, 3], 'c': 4}
+    leaves, treespec = optree.tree_flatten(tree)
+    lazy = treespec.unflatten_lazy(leaves)
+    with optree.dict_insertion_ordered(True, namespace=GLOBAL_NAMESPACE):
+        assert optree.tree_flatten(lazy) == optree.tree_flatten(lazy.materialize())
+        assert optree.tree_leaves(lazy) == [1, 2, 3, 4]
+        leaves, treespec = optree.tree_flatten(tree)
+    lazy = treespec.unflatten_lazy(leaves)
+    assert optree.tree_flatten(lazy) == optree.tree_flatten(lazy.materialize())
+    assert optree.tree_leaves(lazy) == [2, 3, 1, 4]
+
+    # The types follow the registrations of the namespace used for flattening.
+    class Pair:
+        def __init__(self, first, second):
+            self.first = first
+            self.second = second
+
+        def __eq__(self, other):
+            return (
+                type(other) is Pair and self.first == other.first and self.second == other.second
+            )
+
+        def __hash__(self):
+            return hash((self.first, self.second))
+
+    optree.register_pytree_node(
+        Pair,
+        lambda p: ((p.first, p.second), None),
+        lambda _, children: Pair(*children),
+        namespace=GLOBAL_NAMESPACE,
+    )
+    optree.register_pytree_node(
+        Pair,
+        lambda p: ((p.first,), p.second),
+        lambda second, children: Pair(*children, second),
+        namespace='pair',
+    )
+    lazy = optree.tree_structure([Pair(0, 0), 0]).unflatten_lazy([1, 2, 3])
+    leaves, treespec = optree.tree_flatten(lazy, namespace='pair')
+    assert (leaves, treespec) == optree.tree_flatten(lazy.materialize(), namespace='pair')
+    assert leaves == [1, 3]
+    assert treespec.namespace == 'pair'
+    leaves, treespec = optree.tree_flatten(lazy)
+    assert (leaves, treespec) == optree.tree_flatten(lazy.materialize())
+    assert leaves == [1, 2, 3]
+    assert treespec.namespace == ''
+    optree.unregister_pytree_node(Pair, namespace='pair')
+    optree.unregister_pytree_node(Pair, namespace=GLOBAL_NAMESPACE)
+
+
 @parametrize(
     tree=TREES,
     none_is_leaf=[False, True],
@@ -956,6 +1204,437 @@ def test_treespec_num_leaves(
         assert treespec.num_leaves == len(treespec.accessors())
 
 
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_treespec_traversal_arrays(tree, none_is_leaf, namespace):
+    treespec = optree.tree_structure(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+
+    def postorder(spec):
+        for child in spec.children():
+            yield from postorder(child)
+        yield spec
+
+    expected = [
+        (spec.kind, spec.num_children, spec.num_leaves, spec.num_nodes)
+        for spec in postorder(treespec)
+    ]
+    arrays = treespec.traversal_arrays()
+    assert len(arrays) == 4
+    for array in arrays:
+        assert isinstance(array, memoryview)
+        assert array.readonly
+        assert array.ndim == 1
+        assert len(array) == treespec.num_nodes
+        with pytest.raises(TypeError):
+            array[0] = 0
+
+    kinds, arities, num_leaves, num_nodes = arrays
+    assert list(zip(map(optree.PyTreeKind, kinds), arities, num_leaves, num_nodes)) == expected
+    assert kinds.format == 'B'
+    assert num_nodes[-1] == treespec.num_nodes
+    assert num_leaves[-1] == treespec.num_leaves
+    assert sum(kind == int(optree.PyTreeKind.LEAF) for kind in kinds) == treespec.num_leaves
+
+    # The buffers keep the treespec alive.
+    del treespec
+    gc_collect()
+    assert list(zip(map(optree.PyTreeKind, kinds), arities, num_leaves, num_nodes)) == expected
+
+
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_treespec_from_arrays(tree, none_is_leaf, namespace):
+    treespec = optree.tree_structure(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+    node_states, _, treespec_namespace = treespec.__getstate__()
+    node_data = {}
+    for index, (kind, _, data, entries, custom_type, *_) in enumerate(node_states):
+        if kind == int(optree.PyTreeKind.CUSTOM):
+            node_data[index] = (custom_type, data, entries)
+        elif data is not None:
+            node_data[index] = data
+
+    kinds, arities, num_leaves, num_nodes = treespec.traversal_arrays()
+    for args in (
+        (kinds, arities),
+        (list(kinds), list(arities)),
+        (array.array('q', kinds), array.array('i', arities)),
+    ):
+        rebuilt = optree.treespec_from_arrays(
+            *args,
+            node_data,
+            none_is_leaf=none_is_leaf,
+            namespace=treespec_namespace or namespace,
+        )
+        assert rebuilt == treespec
+        assert hash(rebuilt) == hash(treespec)
+        assert str(rebuilt) == str(treespec)
+        assert rebuilt.namespace == treespec.namespace
+        assert [list(a) for a in rebuilt.traversal_arrays()] == [
+            list(kinds),
+            list(arities),
+            list(num_leaves),
+            list(num_nodes),
+        ]
+
+
+def test_treespec_from_arrays_invalid():
+    kind_leaf = int(optree.PyTreeKind.LEAF)
+    kind_none = int(optree.PyTreeKind.NONE)
+    kind_tuple = int(optree.PyTreeKind.TUPLE)
+    kind_dict = int(optree.PyTreeKind.DICT)
+    kind_namedtuple = int(optree.PyTreeKind.NAMEDTUPLE)
+    kind_deque = int(optree.PyTreeKind.DEQUE)
+
+    with pytest.raises(ValueError, match=r'Expected at least one node in the traversal\.'):
+        optree.treespec_from_arrays([], [])
+    with pytest.raises(ValueError, match=r'Expected `kinds` and `arities` to have the same length'):
+        optree.treespec_from_arrays([kind_leaf, kind_leaf], [0])
+    with pytest.raises(ValueError, match=r'form a single tree, got 2 disconnected subtrees\.'):
+        optree.treespec_from_arrays([kind_leaf, kind_leaf], [0, 0])
+    with pytest.raises(ValueError, match=r'index 0 .*: unknown node kind 42\.'):
+        optree.treespec_from_arrays([42], [0])
+    with pytest.raises(ValueError, match=r'index 1 .*: the arity 2 is out of range'):
+        optree.treespec_from_arrays([kind_leaf, kind_tuple], [0, 2])
+    with pytest.raises(ValueError, match=r'index 0 .*: leaf and None nodes must have arity 0\.'):
+        optree.treespec_from_arrays([kind_leaf, kind_tuple], [1, 1])
+    with pytest.raises(ValueError, match=r'None nodes are not allowed with `none_is_leaf=True`'):
+        optree.treespec_from_arrays([kind_none], [0], none_is_leaf=True)
+    with pytest.raises(ValueError, match=r'this node kind does not take metadata\.'):
+        optree.treespec_from_arrays([kind_leaf, kind_tuple], [0, 1], {1: 'metadata'})
+    with pytest.raises(ValueError, match=r'the number of keys does not match the arity\.'):
+        optree.treespec_from_arrays([kind_leaf, kind_dict], [0, 1], {1: ['a', 'b']})
+    with pytest.raises(ValueError, match=r'the keys must be in sorted order\.'):
+        optree.treespec_from_arrays([kind_leaf, kind_leaf, kind_dict], [0, 0, 2], {2: ['b', 'a']})
+    with pytest.raises(ValueError, match=r'the keys must be unique\.'):
+        optree.treespec_from_arrays([kind_leaf, kind_leaf, kind_dict], [0, 0, 2], {2: ['a', 'a']})
+    with pytest.raises(ValueError, match=r'or a non-negative integer as the maxlen\.'):
+        optree.treespec_from_arrays([kind_leaf, kind_deque], [0, 1], {1: -1})
+    with pytest.raises(ValueError, match=r'or a non-negative integer as the maxlen\.'):
+        optree.treespec_from_arrays([kind_leaf, kind_deque], [0, 1], {1: 'maxlen'})
+    with pytest.raises(ValueError, match=r'expected a namedtuple or PyStructSequence type'):
+        optree.treespec_from_arrays([kind_leaf, kind_namedtuple], [0, 1], {1: tuple})
+    with pytest.raises(ValueError, match=r'Node index 5 in `node_data` is out of range'):
+        optree.treespec_from_arrays([kind_leaf], [0], {5: None})
+    with pytest.raises(ValueError, match=r'Expected a one-dimensional array for `kinds`'):
+        optree.treespec_from_arrays(memoryview(bytes([kind_leaf])).cast('B', (1, 1)), [0])
+    with pytest.raises(ValueError, match=r'Expected an array of native integers for `arities`'):
+        optree.treespec_from_arrays([kind_leaf], array.array('d', [0.0]))
+    with pytest.raises(ValueError, match=r'unknown custom type .* in the global namespace\.'):
+        optree.treespec_from_arrays(
+            [int(optree.PyTreeKind.CUSTOM)],
+            [0],
+            {0: (object, None)},
+        )
+
+    with optree.dict_insertion_ordered(True, namespace='from-arrays'):
+        treespec = optree.treespec_from_arrays(
+            [kind_leaf, kind_leaf, kind_dict],
+            [0, 0, 2],
+            {2: ['b', 'a']},
+            namespace='from-arrays',
+        )
+    assert treespec.namespace == 'from-arrays'
+    assert optree.tree_unflatten(treespec, [1, 2]) == {'b': 1, 'a': 2}
+    assert list(optree.tree_unflatten(treespec, [1, 2])) == ['b', 'a']
+
+
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_treespec_path_strings(tree, none_is_leaf, namespace):
+    treespec = optree.tree_structure(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+    paths = treespec.paths()
+
+    path_strings = treespec.path_strings()
+    assert isinstance(path_strings, tuple)
+    assert path_strings == tuple('.'.join(map(str, path)) for path in paths)
+    assert treespec.path_strings() is path_strings
+    assert treespec.path_strings('.', style='plain') is path_strings
+
+    assert treespec.path_strings('/') == tuple('/'.join(map(str, path)) for path in paths)
+    assert treespec.path_strings(style='repr') == tuple(
+        '.'.join(map(repr, path)) for path in paths
+    )
+    assert treespec.path_strings() is path_strings
+
+
+def test_treespec_path_strings_caching():
+    tree = {'layers': [{'attn': {'w': 1, 'b': 2}}] * 2, 'step': 0, 'count': 3}
+    treespec = optree.tree_structure(tree)
+    assert treespec.path_strings('/') == (
+        'count',
+        'layers/0/attn/b',
+        'layers/0/attn/w',
+        'layers/1/attn/b',
+        'layers/1/attn/w',
+        'step',
+    )
+    # The renderings are cached per `(separator, style)` pair.
+    assert treespec.path_strings('/') is treespec.path_strings('/')
+    assert treespec.path_strings() == (
+        'count',
+        'layers.0.attn.b',
+        'layers.0.attn.w',
+        'layers.1.attn.b',
+        'layers.1.attn.w',
+        'step',
+    )
+    assert treespec.path_strings(style='repr')[:2] == ("'count'", "'layers'.0.'attn'.'b'")
+    slash = treespec.path_strings('/')
+    dot = treespec.path_strings()
+    dot_repr = treespec.path_strings(style='repr')
+    assert treespec.path_strings('/') is slash
+    assert treespec.path_strings('.', style='plain') is dot
+    assert treespec.path_strings(style='repr') is dot_repr
+    assert treespec.path_strings('/', style='repr') is not slash
+    # Copies of the treespec start with an empty cache.
+    assert copy.copy(treespec).path_strings() == treespec.path_strings()
+    assert optree.tree_structure(1).path_strings() == ('',)
+    assert optree.tree_structure(None).path_strings() == ()
+
+    with pytest.raises(ValueError, match=r"Expected `style` to be 'plain' or 'repr'"):
+        treespec.path_strings(style='json')
+
+
+def _select_reference(pattern, path):
+    segments = re.split(r'[./]', pattern) if pattern else []
+    entries = tuple(map(str, path))
+
+    def match(i, j):
+        if i == len(segments):
+            return j == len(entries)
+        if segments[i] == '**':
+            return any(match(i + 1, k) for k in range(j, len(entries) + 1))
+        if j == len(entries):
+            return False
+        glob = re.escape(segments[i]).replace(r'\*', '.*').replace(r'\?', '.')
+        return re.fullmatch(glob, entries[j], flags=re.DOTALL) is not None and match(i + 1, j + 1)
+
+    return match(0, 0)
+
+
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_treespec_select(tree, none_is_leaf, namespace):
+    treespec = optree.tree_structure(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+    paths = treespec.paths()
+    for pattern in ('', '*', '**', '*.*', '**.0', '0/**', '**/*/**', '?', 'a*.**', '**.?*'):
+        indices, mask = treespec.select(pattern)
+        assert isinstance(indices, memoryview)
+        assert indices.readonly
+        expected = [i for i, path in enumerate(paths) if _select_reference(pattern, path)]
+        assert indices.tolist() == expected
+        assert optree.tree_structure(
+            mask,
+            none_is_leaf=none_is_leaf,
+            namespace=namespace,
+        ) == treespec
+        assert optree.tree_leaves(mask, none_is_leaf=none_is_leaf, namespace=namespace) == [
+            i in expected for i in range(treespec.num_leaves)
+        ]
+
+
+def test_treespec_select_patterns():
+    tree = {
+        'encoder': [{'weight': 1, 'bias': 2}, {'weight': 3, 'bias': 4}],
+        'decoder': {'norm': {'scale': 5}, 'bias': 6},
+    }
+    treespec = optree.tree_structure(tree)
+    assert treespec.path_strings() == (
+        'decoder.bias',
+        'decoder.norm.scale',
+        'encoder.0.bias',
+        'encoder.0.weight',
+        'encoder.1.bias',
+        'encoder.1.weight',
+    )
+
+    indices, mask = treespec.select('encoder.*.bias')
+    assert indices.tolist() == [2, 4]
+    assert mask == {
+        'encoder': [{'weight': False, 'bias': True}, {'weight': False, 'bias': True}],
+        'decoder': {'norm': {'scale': False}, 'bias': False},
+    }
+    assert treespec.select('**/norm/*')[0].tolist() == [1]
+    assert treespec.select('**.bias')[0].tolist() == [0, 2, 4]
+    assert treespec.select('*.bias')[0].tolist() == [0]
+    assert treespec.select('enc*/1/w?ight')[0].tolist() == [5]
+    assert treespec.select('**')[0].tolist() == list(range(6))
+    assert treespec.select('decoder.**')[0].tolist() == [0, 1]
+    assert treespec.select('decoder')[0].tolist() == []
+    assert treespec.select('')[0].tolist() == []
+    assert optree.tree_structure(1).select('')[0].tolist() == [0]
+    assert optree.tree_structure(1).select('**')[0].tolist() == [0]
+
+    # The indices are cached per pattern, and the mask tree is built on each call.
+    indices, mask = treespec.select('**.bias')
+    other_indices, other_mask = treespec.select('**.bias')
+    assert other_indices is indices
+    assert other_mask == mask
+    assert other_mask is not mask
+    assert copy.copy(treespec).select('**.bias')[0] is not indices
+    assert copy.copy(treespec).select('**.bias')[0].tolist() == indices.tolist()
+
+    for pattern in ('encoder..bias', '.bias', 'encoder/'):
+        with pytest.raises(ValueError, match=r'Expected a non-empty segment'):
+            treespec.select(pattern)
+
+
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_treespec_partition(tree, none_is_leaf, namespace):
+    treespec = optree.tree_structure(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+    paths = treespec.paths()
+    num_leaves = treespec.num_leaves
+    for n in (1, 2, 3, 8):
+        for balance in ('leaves', 'nodes', [float(i % 3) for i in range(num_leaves)]):
+            shards = treespec.partition(n, balance=balance)
+            assert len(shards) == n
+            stop = 0
+            for start, stop_, roots in shards:
+                assert start == stop
+                offset = start
+                for indices, subtreespec in roots:
+                    assert isinstance(indices, tuple)
+                    assert subtreespec.num_leaves > 0
+                    assert subtreespec.none_is_leaf == none_is_leaf
+                    assert subtreespec.namespace == treespec.namespace
+                    child = treespec
+                    for index in indices:
+                        child = child.child(index)
+                    assert subtreespec == child
+                    assert [
+                        path[len(indices) :]
+                        for path in paths[offset : offset + subtreespec.num_leaves]
+                    ] == subtreespec.paths()
+                    offset += subtreespec.num_leaves
+                assert offset == stop_
+                stop = stop_
+            assert stop == num_leaves
+
+    assert treespec.partition(1)[0][:2] == (0, num_leaves)
+
+
+def test_treespec_partition_balance():
+    tree = {'a': [1, 2, 3], 'b': (4, 5), 'c': 6}
+    treespec = optree.tree_structure(tree)
+    shards = treespec.partition(2)
+    assert [shard[:2] for shard in shards] == [(0, 3), (3, 6)]
+    assert [[indices for indices, _ in roots] for _, _, roots in shards] == [[(0,)], [(1,), (2,)]]
+    assert shards[0][2][0][1] == optree.tree_structure([1, 2, 3])
+
+    # The heavy subtrees are split into their children.
+    shards = treespec.partition(3)
+    assert [shard[:2] for shard in shards] == [(0, 2), (2, 3), (3, 6)]
+    assert [[indices for indices, _ in roots] for _, _, roots in shards] == [
+        [(0, 0), (0, 1)],
+        [(0, 2)],
+        [(1,), (2,)],
+    ]
+    assert [shard[:2] for shard in treespec.partition(2, balance=[10, 0, 0, 0, 0, 1])] == [
+        (0, 1),
+        (1, 6),
+    ]
+    assert [shard[:2] for shard in treespec.partition(4, balance='nodes')][-1] == (4, 6)
+    assert [shard[:2] for shard in optree.tree_structure(1).partition(2)] == [(0, 0), (0, 1)]
+    assert optree.tree_structure(None).partition(2) == [(0, 0, ()), (0, 0, ())]
+
+    with pytest.raises(ValueError, match=r'Expected a positive number of shards, got 0\.'):
+        treespec.partition(0)
+    with pytest.raises(ValueError, match=r"Expected `balance` to be 'leaves', 'nodes'"):
+        treespec.partition(2, balance='bytes')
+    with pytest.raises(ValueError, match=r'Expected `balance` to have 6 weights'):
+        treespec.partition(2, balance=[1.0])
+    with pytest.raises(ValueError, match=r'Expected non-negative weights'):
+        treespec.partition(2, balance=[1, 1, -1, 1, 1, 1])
+
+
+@parametrize(
+    tree=TREES,
+    none_is_leaf=[False, True],
+    namespace=['', 'undefined', 'namespace'],
+)
+def test_treespec_annotations(tree, none_is_leaf, namespace):
+    treespec = optree.tree_structure(tree, none_is_leaf=none_is_leaf, namespace=namespace)
+    num_leaves = treespec.num_leaves
+    assert treespec.annotations() == {}
+
+    names = [f'leaf{i}' for i in range(num_leaves)]
+    annotated = treespec.with_annotations(
+        {'name': names, 'rank': array.array('h', range(num_leaves))},
+    )
+    assert annotated == treespec
+    assert hash(annotated) == hash(treespec)
+    assert treespec.annotations() == {}
+    annotations = annotated.annotations()
+    assert annotations['name'] == tuple(names)
+    assert isinstance(annotations['rank'], memoryview)
+    assert annotations['rank'].readonly
+    assert annotations['rank'].tolist() == list(range(num_leaves))
+
+    for i, path in enumerate(treespec.paths()):
+        assert treespec.leaf_index(path) == i
+        assert annotated.annotation('name', i) == names[i]
+        assert annotated.annotation('rank', i) == i
+        assert annotated.annotation('name', path) == names[i]
+
+    offset = 0
+    for child in annotated.children():
+        assert child.annotations()['name'] == tuple(names[offset : offset + child.num_leaves])
+        assert child.annotations()['rank'].tolist() == list(
+            range(offset, offset + child.num_leaves),
+        )
+        offset += child.num_leaves
+    assert offset == num_leaves
+    for i, child in enumerate(annotated.children()):
+        assert annotated.child(i).annotations()['name'] == child.annotations()['name']
+
+    assert annotated.with_annotations({'name': None}).annotations().keys() == {'rank'}
+
+
+def test_treespec_annotations_compose():
+    outer = optree.tree_structure({'a': 1, 'b': (2, 3)}).with_annotations({'lr': [0.1, 0.2, 0.3]})
+    inner = optree.tree_structure([1, 2]).with_annotations({'frozen': array.array('b', [1, 0])})
+    composed = outer.compose(inner)
+    assert composed.num_leaves == 6
+    assert composed.annotations()['lr'] == (0.1, 0.1, 0.2, 0.2, 0.3, 0.3)
+    assert composed.annotations()['frozen'].tolist() == [1, 0, 1, 0, 1, 0]
+    assert composed.annotation('lr', ('b', 1, 0)) == 0.3
+    assert composed.annotation('frozen', ('b', 1, 0)) == 1
+
+    restored = pickle.loads(pickle.dumps(composed))
+    assert restored == composed
+    assert restored.annotations()['lr'] == composed.annotations()['lr']
+    assert restored.annotations()['frozen'].tolist() == [1, 0, 1, 0, 1, 0]
+
+    with pytest.raises(ValueError, match=r"conflicting annotation 'lr'"):
+        outer.compose(outer)
+    with pytest.raises(ValueError, match=r"Expected annotation 'lr' to have 3 entries"):
+        outer.with_annotations({'lr': [0.1]})
+    with pytest.raises(KeyError, match=r"no annotation 'missing'"):
+        outer.annotation('missing', 0)
+    with pytest.raises(IndexError, match=r'index out of range'):
+        outer.annotation('lr', 3)
+    with pytest.raises(ValueError, match=r"has no entry 'c' at depth 0"):
+        outer.leaf_index(('c',))
+    with pytest.raises(ValueError, match=r'does not lead to a leaf'):
+        outer.leaf_index(('b',))
+
+
 @parametrize(
     tree=TREES,
     none_is_leaf=[False, True],
@@ -1501,3 +2180,58 @@ def test_treespec_constructor_none_treespec_inputs():
             optree.treespec_tuple((optree.treespec_leaf(), optree.treespec_leaf())),
         ],
     ) == optree.tree_structure([0, (1, 2)])
+
+
+def test_treespec_schema():
+    class Array:
+        def __init__(self, shape, typestr):
+            self.__array_interface__ = {'shape': shape, 'typestr': typestr, 'version': 3}
+
+    treespec = optree.tree_structure({'a': 0, 'b': (0, 0), 'c': [0, None]})
+    schema = optree.PyTreeSchema(
+        treespec,
+        [
+            int,
+            (int, float),
+            {'shape': (None, 3), 'dtype': '<f4'},
+            {'type': Array, 'shape': (2,)},
+        ],
+    )
+    assert schema.treespec == treespec
+    assert len(schema.constraints) == 4
+    assert repr(schema).startswith('PyTreeSchema(PyTreeSpec(')
+
+    tree = {'a': 1, 'b': (2.0, Array((5, 3), '<f4')), 'c': [Array((2,), '<i8'), None]}
+    assert schema.validate(tree) == []
+    assert schema.is_valid(tree)
+
+    tree = {'a': True, 'b': ('2', Array((5, 4), '<f8')), 'c': [object(), None]}
+    violations = schema.validate(tree)
+    assert not schema.is_valid(tree)
+    assert [path for path, _ in violations] == [('a',), ('b', 0), ('b', 1), ('c', 0)]
+    assert violations[0][1] == "Expected leaf of type <class 'int'>, got <class 'bool'>."
+    assert violations[1][1] == (
+        "Expected leaf of type one of (<class 'int'>, <class 'float'>), got <class 'str'>."
+    )
+    assert violations[2][1] == 'Expected array of shape (None, 3), got (5, 4).'
+    assert violations[3][1].startswith('Expected leaf of type ')
+
+    tree = {'a': 1, 'b': (2, Array((1, 3), '<f8')), 'c': [Array((2,), '<i8'), None]}
+    assert schema.validate(tree) == [(('b', 1), "Expected array of dtype '<f4', got '<f8'.")]
+
+    tree = {'a': 1, 'b': (2, 3), 'c': [Array((2,), '<i8'), None]}
+    assert schema.validate(tree) == [
+        (('b', 1), "Expected an array leaf with `__array_interface__`, got <class 'int'>."),
+    ]
+
+    violations = schema.validate({'a': 1, 'b': (2,)})
+    assert len(violations) == 1
+    assert violations[0][0] == ()
+    assert not schema.is_valid([1, 2, 3])
+
+    with pytest.raises(ValueError, match=re.escape('Number of leaf constraints mismatch')):
+        optree.PyTreeSchema(treespec, [int])
+    with pytest.raises(TypeError, match='Expected a type or a tuple of types'):
+        optree.PyTreeSchema(treespec, [1, None, None, None])
+    with pytest.raises(ValueError, match="Expected keys 'type', 'shape', and 'dtype'"):
+        optree.PyTreeSchema(treespec, [{'ndim': 2}, None, None, None])